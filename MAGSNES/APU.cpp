@@ -1,5 +1,7 @@
 #include "APU.h"
 
+#include <cstring>
+
 #define byte	MAGSNES::byte
 
 //Bits 0 and 1 of an address, where (address >= 0x4000 && address < 0x4010), identify the register affected
@@ -44,7 +46,10 @@
 
 #define APU_FRAME_COUNTER	0x4017
 
-#define APU_CLOCK_RATE		7457			//1.789773 Mhz / 7457 = ~240Hz; If we clock the APU every 7457 CPU cycles, it will operate at roughly the desired 240Hz
+//What a step of the frame sequence clocks
+#define FRAME_QUARTER			0x01			//Envelopes and the triangle's linear counter; ~240Hz
+#define FRAME_HALF				0x02			//Length counters and sweeps; ~120Hz
+#define FRAME_IRQ					0x04
 
 
 __FILESCOPE__{
@@ -54,6 +59,40 @@ __FILESCOPE__{
 		12, 16, 24, 18, 48, 20, 96, 22, 
 		192, 24, 72, 26, 16, 28, 32, 30
 	};
+
+	//Noise timer periods in CPU cycles (NTSC), indexed by the low 4 bits of $400E
+	const MAGSNES::word noisePeriodLookupTable[16] = {
+		4, 8, 16, 32, 64, 96, 128, 160,
+		202, 254, 380, 508, 762, 1016, 2034, 4068
+	};
+
+	//DMC timer periods in CPU cycles (NTSC), indexed by the low 4 bits of $4010
+	const MAGSNES::word dmcPeriodLookupTable[16] = {
+		428, 380, 340, 320, 286, 254, 226, 214,
+		190, 160, 142, 128, 106, 84, 72, 54
+	};
+
+	//The frame sequence in 4 step and 5 step mode: the CPU cycle each step lands on (counting from the start of the sequence), what it
+	//clocks, and how long the whole sequence is (NTSC)
+	const byte frameStepCount[2] = { 4, 5 };
+	const MAGSNES::word frameStepCycles[2][5] = {
+		{ 7457, 14913, 22371, 29829, 0 },
+		{ 7457, 14913, 22371, 29829, 37281 }
+	};
+	const byte frameStepActions[2][5] = {
+		{ FRAME_QUARTER, FRAME_QUARTER | FRAME_HALF, FRAME_QUARTER, FRAME_QUARTER | FRAME_HALF | FRAME_IRQ, 0 },
+		{ FRAME_QUARTER, FRAME_QUARTER | FRAME_HALF, FRAME_QUARTER, 0, FRAME_QUARTER | FRAME_HALF }
+	};
+	const MAGSNES::word frameSequenceCycles[2] = { 29830, 37282 };
+
+	//Noise and DMC are averaged over this many CPU cycles for each output sample, which makes them APU_SAMPLE_FREQUENCY
+	const MAGSNES::dword CYCLES_PER_OUTPUT_SAMPLE = MAGSNES::SyncPacer::CPU_CYCLES_PER_SECOND / MAGSNES::Core::AudioRegs::APU_SAMPLE_FREQUENCY;
+
+	//The CPU loses 1 to 4 cycles to each DMC fetch, depending on what it was doing; this always takes the common case
+	const byte DMC_FETCH_CYCLES = 4;
+
+	//The mixer formula gives levels about 3 times those of the squares and triangle as AudioManager mixes them
+	const float NOISE_DMC_GAIN = 1.0f / 3.0f;
 }
 
 using namespace MAGSNES;
@@ -67,8 +106,9 @@ APU::APU(CPU *pCPU, Bus *pBus)
 	regs = new APUREGISTERS;
 	regs->interruptInhibitFlag = false;
 	regs->useFiveStepFrameSequencerMode = false;
-	regs->masterCounter = 0;
-	regs->frameCounter = 0;
+	regs->isFrameIRQPending = false;
+	regs->frameStep = 0;
+	regs->cyclesToFrameStep = frameStepCycles[0][0];
 
 	square0Regs = new CHANNELREGISTERS;
 	square0Regs->disableEnvelopeDecay = false;
@@ -111,6 +151,36 @@ APU::APU(CPU *pCPU, Bus *pBus)
 	triangleRegs->lengthCounter = 0;
 	triangleRegs->linearCounter = 0;
 	sysCore.audioRegs.triangleAmp = 0.005; //Triangle wave seems to always be louder than squares, so it must have reduced gain
+
+	noiseRegs = new NOISEREGISTERS;
+	std::memset(noiseRegs, 0, sizeof(NOISEREGISTERS));
+	noiseRegs->shiftRegister = 0x0001; //The LFSR is loaded with 1 at power up; it would never leave 0
+	noiseRegs->period = noisePeriodLookupTable[0];
+	noiseRegs->timer = noiseRegs->period;
+
+	dmcRegs = new DMCREGISTERS;
+	std::memset(dmcRegs, 0, sizeof(DMCREGISTERS));
+	dmcRegs->isSilent = true;
+	dmcRegs->bitsRemaining = 8;
+	dmcRegs->period = dmcPeriodLookupTable[0];
+	dmcRegs->timer = dmcRegs->period;
+	dmcRegs->sampleAddress = 0xC000;
+	dmcRegs->sampleLength = 1;
+
+	outputSum = 0;
+	cyclesToOutputSample = CYCLES_PER_OUTPUT_SAMPLE;
+	outputBlock = nullptr;
+	outputBlockCount = 0;
+
+	//tnd_out from the NES mixer, without the triangle's term since that is synthesized on the audio thread
+	for (int noise = 0; noise < 16; noise++) {
+		for (int dmc = 0; dmc < 128; dmc++) {
+			const float sum = (noise / 12241.0f) + (dmc / 22638.0f);
+			noiseDmcMixTable[noise][dmc] = (sum == 0) ? 0.0f : ((159.79f / ((1.0f / sum) + 100.0f)) * NOISE_DMC_GAIN);
+		}
+	}
+
+	update_status();
 }
 
 //No cleanup needed
@@ -119,13 +189,16 @@ APU::~APU() {
 	delete square0Regs;
 	delete square1Regs;
 	delete triangleRegs;
+	delete noiseRegs;
+	delete dmcRegs;
 }
 
 void APU::tick(const byte CPU_CYCLES) {
 
 	//Check for R/W to memory-mapped I/O registers
 	if (refBus.readBus == APUSTATUS) { //APU only has one read register
-
+		//The CPU has already read the flag; reading it acknowledges the frame interrupt (but not the DMC's)
+		regs->isFrameIRQPending = false;
 	}
 
 	if ((refBus.writeBus & 0xFF00) == 0x4000) { //Don't care if write isn't to 0x40XX
@@ -140,10 +213,19 @@ void APU::tick(const byte CPU_CYCLES) {
 			case TRIANGLE_WRITE:
 				check_channel_triangle(refMM[refBus.writeBus], refBus.writeBus);
 				break;
+			case NOISE_WRITE:
+				check_channel_noise(refMM[refBus.writeBus], refBus.writeBus);
+				break;
 			}
 
 		} else { //It's to a DMC or ctrl reg
 			switch (refBus.writeBus) {
+			case DMC_REG_0:
+			case DMC_REG_1:
+			case DMC_REG_2:
+			case DMC_REG_3:
+				check_channel_dmc(refMM[refBus.writeBus], refBus.writeBus);
+				break;
 			case APUCTRL:
 				check_apu_ctrl(refMM[APUCTRL]);
 				break;
@@ -154,58 +236,70 @@ void APU::tick(const byte CPU_CYCLES) {
 		}
 	}
 
-	for (int i = 0; i < CPU_CYCLES; i++) {
-		regs->masterCounter++;
-		if (regs->masterCounter == APU_CLOCK_RATE) {
-			regs->masterCounter = 0;
-
+	dword cyclesLeft = CPU_CYCLES;
+	while (cyclesLeft != 0) {
+		//Run up to whichever comes first: the noise or DMC timer running out, the frame sequencer's next step, the end of the current
+		//output sample, or the end of these cycles. Every counter is at least 1 here, so this always makes progress.
+		dword run = cyclesLeft;
+		run = (noiseRegs->timer < run) ? noiseRegs->timer : run;
+		run = (dmcRegs->timer < run) ? dmcRegs->timer : run;
+		run = (regs->cyclesToFrameStep < run) ? regs->cyclesToFrameStep : run;
+		run = (cyclesToOutputSample < run) ? cyclesToOutputSample : run;
+
+		//Output can only change at an event, so it holds for the whole run
+		outputSum += get_noise_dmc_output() * run;
+
+		cyclesLeft -= run;
+		noiseRegs->timer -= run;
+		dmcRegs->timer -= run;
+		regs->cyclesToFrameStep -= run;
+		cyclesToOutputSample -= run;
+
+		if (noiseRegs->timer == 0) {
+			clock_noise();
+		}
+		if (dmcRegs->timer == 0) {
+			clock_dmc();
+		}
+		if (regs->cyclesToFrameStep == 0) {
 			clock_frame_counter();
 		}
-	}
-}
-
-FORCEINLINE void APU::clock_frame_counter() {
-
-	if (regs->useFiveStepFrameSequencerMode) { //5-step mode
-		if (regs->frameCounter == 5) {
-			regs->frameCounter = 0;
+		if (cyclesToOutputSample == 0) {
+			emit_output_sample();
 		}
+	}
 
-		if (regs->frameCounter == 4) {
-
-			//Do nothing; effectively lower frame counter frequency to ~192Hz
-
-		} else {
-			if (!(regs->frameCounter & 0x01)) { //Clock length & sweep on 0 and 2
-				clock_length_and_sweep_counter();
-			}
-
-			clock_envelope_and_triangle_counter(); //These get clocked on 0, 1, 2, 3
+	update_status();
 
-			//We HAVE to check if we turn on/off the triangle here, because it depends on both its counters being above 0
-			if ((triangleRegs->lengthCounter != 0) && (triangleRegs->linearCounter != 0)) {
-				sysCore.audioRegs.triangleImplicitOff = false;
-			} else {
-				sysCore.audioRegs.triangleImplicitOff = true;
-			}
+	//The IRQ line stays asserted until both flags are acknowledged, so keep posting it; the CPU takes it once flag I is clear
+	if (regs->isFrameIRQPending || dmcRegs->isIRQPending) {
+		refCPU.post_interrupt(CPU::INTERRUPT_IRQ);
+	}
+}
 
-		}
+FORCEINLINE void APU::clock_frame_counter() {
+	const byte mode = regs->useFiveStepFrameSequencerMode ? 1 : 0;
+	const word stepCycle = frameStepCycles[mode][regs->frameStep];
 
-	} else { //4-step mode
-		if (regs->frameCounter == 4) {
-			regs->frameCounter = 0;
-		}
+	clock_frame_step(frameStepActions[mode][regs->frameStep]);
 
-		//Fire CPU IRQ on last step of sequence
-		if (regs->frameCounter == 3 && !(regs->interruptInhibitFlag)) {
-			refCPU.post_interrupt(CPU::INTERRUPT_IRQ);
-		}
+	//On to the next step, or back to the first at the end of the sequence
+	regs->frameStep++;
+	if (regs->frameStep == frameStepCount[mode]) {
+		regs->frameStep = 0;
+		regs->cyclesToFrameStep = (frameSequenceCycles[mode] - stepCycle) + frameStepCycles[mode][0];
+	} else {
+		regs->cyclesToFrameStep = frameStepCycles[mode][regs->frameStep] - stepCycle;
+	}
+}
 
-		if (regs->frameCounter & 0x01) { //Clock length & sweep on 1 and 3
-			clock_length_and_sweep_counter();
-		}
+void APU::clock_frame_step(const byte actions) {
+	if (actions & FRAME_HALF) {
+		clock_length_and_sweep_counter();
+	}
 
-		clock_envelope_and_triangle_counter(); //Always clock these
+	if (actions & FRAME_QUARTER) {
+		clock_envelope_and_triangle_counter();
 
 		//We HAVE to check if we turn on/off the triangle here, because it depends on both its counters being above 0
 		if ((triangleRegs->lengthCounter != 0) && (triangleRegs->linearCounter != 0)) {
@@ -215,7 +309,10 @@ FORCEINLINE void APU::clock_frame_counter() {
 		}
 	}
 
-	regs->frameCounter++;
+	//Fire CPU IRQ on last step of 4-step sequence
+	if ((actions & FRAME_IRQ) && !(regs->interruptInhibitFlag)) {
+		regs->isFrameIRQPending = true;
+	}
 }
 
 FORCEINLINE void APU::clock_envelope_and_triangle_counter() {
@@ -291,6 +388,24 @@ FORCEINLINE void APU::clock_envelope_and_triangle_counter() {
 
 	//Otherwise leave the linear counter at zero
 
+	//Noise envelope: restarts at 15 after a length write, then decays by 1 every (volume + 1) clocks
+	if (noiseRegs->shouldRestartEnvelope) {
+		noiseRegs->shouldRestartEnvelope = false;
+		noiseRegs->envelopeDecay = 15;
+		noiseRegs->envelopeDivider = noiseRegs->volume;
+
+	} else if (noiseRegs->envelopeDivider == 0) {
+		noiseRegs->envelopeDivider = noiseRegs->volume;
+
+		if (noiseRegs->envelopeDecay != 0) {
+			noiseRegs->envelopeDecay--;
+		} else if (noiseRegs->shouldLoopEnvelope) {
+			noiseRegs->envelopeDecay = 15;
+		}
+
+	} else {
+		noiseRegs->envelopeDivider--;
+	}
 }
 
 FORCEINLINE void APU::clock_length_and_sweep_counter() {
@@ -307,14 +422,14 @@ FORCEINLINE void APU::clock_length_and_sweep_counter() {
 				if (square0Regs->shouldSweepDownward) {
 					sysCore.audioRegs.square0Period -= ((word)sysCore.audioRegs.square0Period >> square0Regs->sweepShiftAmt);
 					//Implicit silence at >12.4KHz
-					if (sysCore.audioRegs.square0Period < ((sysCore.audioRegs.SAMPLE_FREQUENCY)/12400)) {
+					if (sysCore.audioRegs.square0Period < ((Core::AudioRegs::APU_SAMPLE_FREQUENCY)/12400)) {
 						sysCore.audioRegs.square0ImplicitOff = true;
 						square0Regs->sweepEnabled = false;
 					}
 				} else {
 					sysCore.audioRegs.square0Period += ((word)sysCore.audioRegs.square0Period >> square0Regs->sweepShiftAmt);
 					//Implicit silence at ~<50Hz
-					if (sysCore.audioRegs.square0Period > ((sysCore.audioRegs.SAMPLE_FREQUENCY) / 50)) {
+					if (sysCore.audioRegs.square0Period > ((Core::AudioRegs::APU_SAMPLE_FREQUENCY) / 50)) {
 						sysCore.audioRegs.square0ImplicitOff = true;
 						square0Regs->sweepEnabled = false;
 					}
@@ -337,14 +452,14 @@ FORCEINLINE void APU::clock_length_and_sweep_counter() {
 				if (square1Regs->shouldSweepDownward) {
 					sysCore.audioRegs.square1Period -= (((word)sysCore.audioRegs.square1Period >> square1Regs->sweepShiftAmt) - 1); //Square1 goes down a hair faster
 					//Implicit silence at >12.4KHz
-					if (sysCore.audioRegs.square1Period < ((sysCore.audioRegs.SAMPLE_FREQUENCY) / 12400)) {
+					if (sysCore.audioRegs.square1Period < ((Core::AudioRegs::APU_SAMPLE_FREQUENCY) / 12400)) {
 						sysCore.audioRegs.square1ImplicitOff = true;
 						square1Regs->sweepEnabled = false;
 					}
 				} else {
 					sysCore.audioRegs.square1Period += ((word)sysCore.audioRegs.square1Period >> square1Regs->sweepShiftAmt);
 					//Implicit silence at ~<50Hz
-					if (sysCore.audioRegs.square1Period >((sysCore.audioRegs.SAMPLE_FREQUENCY) / 50)) {
+					if (sysCore.audioRegs.square1Period >((Core::AudioRegs::APU_SAMPLE_FREQUENCY) / 50)) {
 						sysCore.audioRegs.square1ImplicitOff = true;
 						square1Regs->sweepEnabled = false;
 					}
@@ -364,7 +479,6 @@ FORCEINLINE void APU::clock_length_and_sweep_counter() {
 
 	if (square0Regs->lengthCounter == 0) {
 		sysCore.audioRegs.square0ImplicitOff = true;
-		refMM[APUCTRL] &= 0xFE; //Turn off status flag for channel
 	}
 
 
@@ -374,20 +488,137 @@ FORCEINLINE void APU::clock_length_and_sweep_counter() {
 
 	if (square1Regs->lengthCounter == 0) {
 		sysCore.audioRegs.square1ImplicitOff = true;
-		refMM[APUCTRL] &= 0xFD; //Turn off status flag for channel
 	}
 
 	if ((triangleRegs->lengthCounter != 0) && !(triangleRegs->shouldLoopEnvelope)) {
 		triangleRegs->lengthCounter--;
 	}
 
-	if (triangleRegs->lengthCounter == 0) {
-		refMM[APUCTRL] &= 0xFB; //Turn off status flag for channel
+	if ((noiseRegs->lengthCounter != 0) && !(noiseRegs->shouldLoopEnvelope)) {
+		noiseRegs->lengthCounter--;
 	}
 }
 
+FORCEINLINE void APU::clock_noise() {
+	//Feedback is bit 0 XOR bit 6 in short mode (a 93 step sequence, which sounds metallic), otherwise bit 0 XOR bit 1
+	const word shiftRegister = noiseRegs->shiftRegister;
+	const word feedback = (shiftRegister ^ (shiftRegister >> (noiseRegs->useShortMode ? 6 : 1))) & 0x01;
+
+	noiseRegs->shiftRegister = (shiftRegister >> 1) | (feedback << 14);
+	noiseRegs->timer = noiseRegs->period;
+}
+
+FORCEINLINE void APU::clock_dmc() {
+	//Bit 0 of the shift register says whether the level goes up or down; it stays put rather than leaving 0-127
+	if (!(dmcRegs->isSilent)) {
+		if (dmcRegs->shiftRegister & 0x01) {
+			if (dmcRegs->outputLevel <= 125) {
+				dmcRegs->outputLevel += 2;
+			}
+		} else if (dmcRegs->outputLevel >= 2) {
+			dmcRegs->outputLevel -= 2;
+		}
+	}
+
+	dmcRegs->shiftRegister >>= 1;
+	dmcRegs->bitsRemaining--;
+
+	//End of a byte: start on the one in the sample buffer, or go silent for the next 8 bits if there isn't one
+	if (dmcRegs->bitsRemaining == 0) {
+		dmcRegs->bitsRemaining = 8;
+
+		if (dmcRegs->isBufferFull) {
+			dmcRegs->isSilent = false;
+			dmcRegs->shiftRegister = dmcRegs->sampleBuffer;
+			dmcRegs->isBufferFull = false;
+			fetch_dmc_sample();
+		} else {
+			dmcRegs->isSilent = true;
+		}
+	}
+
+	dmcRegs->timer = dmcRegs->period;
+}
+
+void APU::fetch_dmc_sample() {
+	if (dmcRegs->isBufferFull || (dmcRegs->bytesRemaining == 0)) {
+		return;
+	}
+
+	//The DMC takes the bus from the CPU for the read
+	dmcRegs->sampleBuffer = refMM[dmcRegs->currentAddress];
+	dmcRegs->isBufferFull = true;
+	refCPU.steal_cycles(DMC_FETCH_CYCLES);
+
+	//Wraps around to $8000 past the end of memory
+	dmcRegs->currentAddress = (dmcRegs->currentAddress == 0xFFFF) ? 0x8000 : (dmcRegs->currentAddress + 1);
+	dmcRegs->bytesRemaining--;
+
+	if (dmcRegs->bytesRemaining == 0) {
+		if (dmcRegs->shouldLoop) {
+			restart_dmc_sample();
+		} else if (dmcRegs->isIRQEnabled) {
+			dmcRegs->isIRQPending = true;
+		}
+	}
+}
+
+FORCEINLINE void APU::restart_dmc_sample() {
+	dmcRegs->currentAddress = dmcRegs->sampleAddress;
+	dmcRegs->bytesRemaining = dmcRegs->sampleLength;
+}
+
+FORCEINLINE const float APU::get_noise_dmc_output() const {
+	//Noise is silenced while bit 0 of the LFSR is set, and once its length counter runs out (which is also how disabling it silences it)
+	const byte noise = ((noiseRegs->lengthCounter == 0) || (noiseRegs->shiftRegister & 0x01))
+		? 0
+		: (noiseRegs->useConstantVolume ? noiseRegs->volume : noiseRegs->envelopeDecay);
+
+	return noiseDmcMixTable[noise][dmcRegs->outputLevel];
+}
+
+void APU::emit_output_sample() {
+	cyclesToOutputSample = CYCLES_PER_OUTPUT_SAMPLE;
+
+	if (outputBlock == nullptr) {
+		outputBlock = sysCore.apuSampleQueue->begin_push();
+
+		//The audio thread isn't taking them (i.e. there's no audio device); drop the sample
+		if (outputBlock == nullptr) {
+			outputSum = 0;
+			return;
+		}
+	}
+
+	outputBlock->samples[outputBlockCount++] = outputSum / CYCLES_PER_OUTPUT_SAMPLE;
+	outputSum = 0;
+
+	if (outputBlockCount == Core::APUSampleBlock::SAMPLE_COUNT) {
+		sysCore.apuSampleQueue->end_push();
+		outputBlock = nullptr;
+		outputBlockCount = 0;
+	}
+}
+
+FORCEINLINE void APU::update_status() {
+	byte status = 0;
+
+	//Bits 0-4: whether each channel's length counter (or for the DMC, its sample) has anything left
+	status |= (square0Regs->lengthCounter != 0) ? 0x01 : 0;
+	status |= (square1Regs->lengthCounter != 0) ? 0x02 : 0;
+	status |= (triangleRegs->lengthCounter != 0) ? 0x04 : 0;
+	status |= (noiseRegs->lengthCounter != 0) ? 0x08 : 0;
+	status |= (dmcRegs->bytesRemaining != 0) ? 0x10 : 0;
+
+	//Bits 6 and 7: pending frame and DMC interrupts
+	status |= regs->isFrameIRQPending ? 0x40 : 0;
+	status |= dmcRegs->isIRQPending ? 0x80 : 0;
+
+	refMM[APUSTATUS] = status;
+}
+
 FORCEINLINE void APU::check_apu_ctrl(const byte val) {
-	refMM[APUCTRL] &= 0x7F; //reset IRQ flag for apuctrl reads
+	dmcRegs->isIRQPending = false; //Any write acknowledges the DMC interrupt
 
 	//*****BUG*****: when channels are silenced by an apuctrl write, they can only be re-enabled with another apuctrl write.
 	//In this implementation, a write to any register or any event that touches the implicit silence flag for a channel 
@@ -403,7 +634,6 @@ FORCEINLINE void APU::check_apu_ctrl(const byte val) {
 	} else {
 		sysCore.audioRegs.square0ImplicitOff = true;
 		square0Regs->lengthCounter = 0;
-		refMM[APUCTRL] &= 0xFE; //Turn off status flag
 	}
 
 	if (val & 0x02) {
@@ -411,7 +641,6 @@ FORCEINLINE void APU::check_apu_ctrl(const byte val) {
 	} else {
 		sysCore.audioRegs.square1ImplicitOff = true;
 		square1Regs->lengthCounter = 0;
-		refMM[APUCTRL] &= 0xFD;
 	}
 
 	if (val & 0x04) {
@@ -419,7 +648,24 @@ FORCEINLINE void APU::check_apu_ctrl(const byte val) {
 	} else {
 		sysCore.audioRegs.triangleImplicitOff = true;
 		triangleRegs->lengthCounter = 0;
-		refMM[APUCTRL] &= 0xFB;
+	}
+
+	//A disabled noise channel ignores length counter loads until it is enabled again
+	if (val & 0x08) {
+		noiseRegs->isEnabled = true;
+	} else {
+		noiseRegs->isEnabled = false;
+		noiseRegs->lengthCounter = 0;
+	}
+
+	//Enabling the DMC only starts the sample over once the last one has finished; disabling it lets the byte already fetched play out
+	if (val & 0x10) {
+		if (dmcRegs->bytesRemaining == 0) {
+			restart_dmc_sample();
+			fetch_dmc_sample();
+		}
+	} else {
+		dmcRegs->bytesRemaining = 0;
 	}
 }
 
@@ -427,8 +673,18 @@ FORCEINLINE void APU::check_apu_frame_counter(const byte val) {
 	regs->interruptInhibitFlag = (val & 0x40) ? true : false;
 	regs->useFiveStepFrameSequencerMode = (val & 0x80) ? true : false;
 
-	//********* UNSURE: Some sources say to clock the frame counter an ADDITIONAL time on a $4017 write?
-	regs->frameCounter = 0; //Reset frame counter; Note that the frame counter may still be clocked this cycle
+	//Setting the inhibit flag also acknowledges a pending frame interrupt
+	if (regs->interruptInhibitFlag) {
+		regs->isFrameIRQPending = false;
+	}
+
+	//The sequence starts over (3 or 4 cycles after the write on the NES); in 5 step mode the write also clocks everything at once
+	regs->frameStep = 0;
+	regs->cyclesToFrameStep = frameStepCycles[regs->useFiveStepFrameSequencerMode ? 1 : 0][0];
+
+	if (regs->useFiveStepFrameSequencerMode) {
+		clock_frame_step(FRAME_QUARTER | FRAME_HALF);
+	}
 }
 
 FORCEINLINE void APU::check_channel_square(const byte val, const word REG_ADDRESS, const byte CHANNEL_ID) {
@@ -526,12 +782,6 @@ FORCEINLINE void APU::check_channel_square(const byte val, const word REG_ADDRES
 		currentChannelRegs->envelopeCounter = 0x0F; //Make sure to reset the envelope counter here; on the actual APU the phase of the square is reset too.
 		
 		currentChannelRegs->lengthCounter = lengthCounterLookupTable[(((val & 0xF8) >> 3) & 0x1F)]; //5 bit index into the 32 entry lookup table (we mask to lo 5 bits at the end to avoid overflowing the buffer)
-		
-		if (CHANNEL_ID == SQUARE_0_WRITE) {
-			refMM[APUCTRL] |= 0x01; //Inform the status register that this channel's length counter is >0
-		} else {
-			refMM[APUCTRL] |= 0x02;
-		}
 
 		break;
 	}
@@ -583,10 +833,57 @@ void APU::check_channel_triangle(const byte val, const word REG_ADDRESS) {
 
 		triangleRegs->lengthCounter = lengthCounterLookupTable[(((val & 0xF8) >> 3) & 0x1F)]; //5 bit index into the 32 entry lookup table (we mask to lo 5 bits at the end to avoid overflowing the buffer)
 
+		break;
+	}
+}
+
+void APU::check_channel_noise(const byte val, const word REG_ADDRESS) {
+	switch (REG_ADDRESS & 0x03) {
+	case REG_0_WRITE: //Length counter halt/envelope loop, constant volume, volume/envelope period
+		noiseRegs->shouldLoopEnvelope = (val & 0x20) ? true : false;
+		noiseRegs->useConstantVolume = (val & 0x10) ? true : false;
+		noiseRegs->volume = val & 0x0F;
+		break;
+
+	case REG_2_WRITE: //Mode and period; the new period is picked up the next time the timer reloads
+		noiseRegs->useShortMode = (val & 0x80) ? true : false;
+		noiseRegs->period = noisePeriodLookupTable[val & 0x0F];
+		break;
+
+	case REG_3_WRITE: //Length counter load, which also restarts the envelope
+		if (noiseRegs->isEnabled) {
+			noiseRegs->lengthCounter = lengthCounterLookupTable[(((val & 0xF8) >> 3) & 0x1F)];
+		}
+
+		noiseRegs->shouldRestartEnvelope = true;
+		break;
+	}
+}
+
+void APU::check_channel_dmc(const byte val, const word REG_ADDRESS) {
+	switch (REG_ADDRESS) {
+	case DMC_REG_0: //IRQ enable, loop, period
+		dmcRegs->isIRQEnabled = (val & 0x80) ? true : false;
+		dmcRegs->shouldLoop = (val & 0x40) ? true : false;
+		dmcRegs->period = dmcPeriodLookupTable[val & 0x0F];
+
+		//Clearing IRQ enable acknowledges the interrupt
+		if (!(dmcRegs->isIRQEnabled)) {
+			dmcRegs->isIRQPending = false;
+		}
+
+		break;
 
-		refMM[APUCTRL] |= 0x40;
+	case DMC_REG_1: //Direct load of the output level, which games use to play PCM a byte at a time
+		dmcRegs->outputLevel = val & 0x7F;
+		break;
 
+	case DMC_REG_2: //Sample address, in 64 byte steps from $C000
+		dmcRegs->sampleAddress = 0xC000 | (val << 6);
+		break;
 
+	case DMC_REG_3: //Sample length, in 16 byte steps, plus 1
+		dmcRegs->sampleLength = (val << 4) + 1;
 		break;
 	}
 }
\ No newline at end of file
@@ -11,15 +11,17 @@ public:
 	APU(CPU *pCPU, Bus *pBus);
 	~APU();
 
+	//Runs the frame sequencer, noise and DMC for CPU_CYCLES, one event (a timer running out, a sequencer step, the end of an output sample)
+	//at a time, so cost goes with how much happens rather than how many cycles pass
 	void tick(const MAGSNES::byte CPU_CYCLES);
 
 private:
 
 	//Registers shared by all channels
 	struct APUREGISTERS {
-		bool interruptInhibitFlag, useFiveStepFrameSequencerMode;
-		dword masterCounter;
-		MAGSNES::byte frameCounter;
+		bool interruptInhibitFlag, useFiveStepFrameSequencerMode, isFrameIRQPending;
+		dword cyclesToFrameStep;		//CPU cycles until the frame sequencer's next step
+		MAGSNES::byte frameStep;		//Index of that step in the sequence
 	} *regs;
 
 	//Registers which each channel has its own instance of.
@@ -31,19 +33,61 @@ private:
 		word programmableTimer;
 	} *square0Regs, *square1Regs, *triangleRegs;
 
+	//A 15 bit LFSR, shifted each time its timer runs out, and an envelope. Output is the volume while bit 0 is clear and the length counter isn't 0.
+	struct NOISEREGISTERS {
+		bool isEnabled, shouldLoopEnvelope, useConstantVolume, shouldRestartEnvelope, useShortMode; //'shouldLoopEnvelope' also halts the length counter
+		MAGSNES::byte volume, envelopeDivider, envelopeDecay, lengthCounter;
+		word shiftRegister, period;
+		dword timer;
+	} *noiseRegs;
+
+	//1 bit delta modulation: each timer clock moves the 7 bit output level up or down by 2 for the next bit of the sample byte. Sample bytes
+	//are fetched from CPU memory one at a time, stealing cycles from the CPU for each.
+	struct DMCREGISTERS {
+		bool isIRQEnabled, isIRQPending, shouldLoop, isSilent, isBufferFull;
+		MAGSNES::byte outputLevel, shiftRegister, bitsRemaining, sampleBuffer;
+		word period, sampleAddress, sampleLength, currentAddress, bytesRemaining;
+		dword timer;
+	} *dmcRegs;
+
+	//Noise and DMC output summed over the current output sample, which is CYCLES_PER_OUTPUT_SAMPLE long, and the block it goes into
+	float outputSum;
+	dword cyclesToOutputSample;
+	Core::APUSampleBlock *outputBlock;
+	dword outputBlockCount;
+
+	//Noise and DMC mixed for every pair of output values (noise 0-15, DMC 0-127); they don't add linearly on the NES
+	float noiseDmcMixTable[16][128];
+
 	Bus &refBus;
 	Core &sysCore;
 	CPU &refCPU;
 	MAGSNES::byte(&refMM)[MM_SIZE];
 
 	void clock_frame_counter();
+	void clock_frame_step(const MAGSNES::byte actions);
 	void clock_envelope_and_triangle_counter();
 	void clock_length_and_sweep_counter();
+	void clock_noise();
+	void clock_dmc();
+
+	//Fills the DMC's sample buffer from CPU memory if it is empty and the sample has bytes left
+	void fetch_dmc_sample();
+	void restart_dmc_sample();
+
+	//Noise and DMC mixed, as they are right now
+	const float get_noise_dmc_output() const;
+	void emit_output_sample();
+
+	//Brings $4015 up to date, so a CPU read sees the current channel and interrupt status
+	void update_status();
 
 	void check_apu_ctrl(const MAGSNES::byte val);
 	void check_apu_frame_counter(const MAGSNES::byte val);
 	void check_channel_square(const MAGSNES::byte val, const word REG_ADDRESS, const MAGSNES::byte CHANNEL_ID);
 	void check_channel_triangle(const MAGSNES::byte val, const word REG_ADDRESS);
+	void check_channel_noise(const MAGSNES::byte val, const word REG_ADDRESS);
+	void check_channel_dmc(const MAGSNES::byte val, const word REG_ADDRESS);
 
 };
 
@@ -26,13 +26,17 @@ __FILESCOPE__{
 	};
 
 	const float filterCoefficientLP = 0.815686f, filterCoefficientHP90 = 0.996039f, filterCoefficientHP14 = 0.999835f;
+
+	//Most noise/DMC blocks let queue up before the oldest are dropped: ~46ms. Under audio sync the exec thread only keeps about a frame
+	//(3 blocks) ahead, but under the other policies nothing stops it getting further ahead of the device, or running with no device at all.
+	const MAGSNES::dword MAX_NOISE_DMC_BACKLOG = 8;
 }
 
 using namespace MAGSNES;
 
 AudioManager::AudioManager()
 	: sysCore(Core::get_sys_core()), pwfx(NULL), pEnumerator(NULL), pDevice(NULL),
-		pAudioClient(NULL), pRenderClient(NULL), oscTimer(0) {}
+		pAudioClient(NULL), pRenderClient(NULL), oscTimer(0), noiseDmcOffset(0), lastNoiseDmcSample(0) {}
 
 AudioManager::~AudioManager() {
 
@@ -118,6 +122,9 @@ void AudioManager::begin_audio() {
 		return;
 	}
 
+	//Every wake-up asks the resampler for at most a whole buffer
+	resampler.set_rates(Core::AudioRegs::APU_SAMPLE_FREQUENCY, pwfx->nSamplesPerSec, bufferFrameCount);
+
 	// Set up our render client
 	hr = pAudioClient->GetService(
 		IID_IAudioRenderClient,
@@ -182,6 +189,9 @@ void AudioManager::main_audio_loop() {
 
 		numFramesAvailable = bufferFrameCount - numFramesPadding;
 
+		//How much audio the device still had queued when we woke up
+		sysCore.telemetry->record(Telemetry::METRIC_AUDIO_QUEUED, (dword)(((qword)numFramesPadding * MICROSECONDS_PER_SECOND) / pwfx->nSamplesPerSec));
+
 		// Grab all the available space in the shared buffer.
 		hr = pRenderClient->GetBuffer(numFramesAvailable, &pData);
 
@@ -196,33 +206,52 @@ void AudioManager::main_audio_loop() {
 		dword limit = numFramesAvailable * 2;
 		pf = (float *)pData;
 
+		//Under audio sync the exec thread paces itself by this clock, and the rate is nudged slightly to keep it steadily ahead
+		const float rateRatio = sysCore.syncPacer->advance_audio_clock(numFramesAvailable, pwfx->nSamplesPerSec);
+
+		//The channels are synthesized at APU_SAMPLE_FREQUENCY straight into the resampler's history: as many samples as it needs to make
+		//numFramesAvailable device frames at rateRatio. The history was sized for a whole buffer, so there should always be room.
+		dword apuSampleCount = resampler.get_input_needed(numFramesAvailable, rateRatio);
+		float * const apuSamples = resampler.begin_push(apuSampleCount);
+
+		//If there isn't, the block is dropped: nothing is synthesized, and pull pads whatever the history can't cover with silence
+		if (apuSamples == nullptr) {
+			sysCore.syncPacer->count_audio_underrun();
+			apuSampleCount = 0;
+		}
+
+		//Periods (in APU samples) are read once per wake-up, so a write from the exec thread can't change them partway through
+		const float square0Period = sysCore.audioRegs.square0Period,
+								square1Period = sysCore.audioRegs.square1Period,
+								trianglePeriod = sysCore.audioRegs.trianglePeriod;
+
 		float thresholdSquare0, thresholdSquare1;
 
 		switch (sysCore.audioRegs.square0DutyCycle) {
 		case DutyCycle::DUTY_CYCLE_HALF:
-			thresholdSquare0 = sysCore.audioRegs.square0Period / 2.0;
+			thresholdSquare0 = square0Period / 2.0;
 			break;
 		case DutyCycle::DUTY_CYCLE_QUARTER:
-			thresholdSquare0 = sysCore.audioRegs.square0Period / 4.0;
+			thresholdSquare0 = square0Period / 4.0;
 			break;
 		case DutyCycle::DUTY_CYCLE_EIGHTH:
-			thresholdSquare0 = sysCore.audioRegs.square0Period / 8.0;
+			thresholdSquare0 = square0Period / 8.0;
 			break;
 		}
 
 		switch (sysCore.audioRegs.square1DutyCycle) {
 		case DutyCycle::DUTY_CYCLE_HALF:
-			thresholdSquare1 = sysCore.audioRegs.square1Period / 2.0;
+			thresholdSquare1 = square1Period / 2.0;
 			break;
 		case DutyCycle::DUTY_CYCLE_QUARTER:
-			thresholdSquare1 = sysCore.audioRegs.square1Period / 4.0;
+			thresholdSquare1 = square1Period / 4.0;
 			break;
 		case DutyCycle::DUTY_CYCLE_EIGHTH:
-			thresholdSquare1 = sysCore.audioRegs.square1Period / 8.0;
+			thresholdSquare1 = square1Period / 8.0;
 			break;
 		}
 
-		for (dword i = 0; i < limit; i += 2) {
+		for (dword i = 0; i < apuSampleCount; i++) {
 			//This was a HUGE pain, as there is no direct way to tell (that I can find) if the buffer wants values
 			//in the range -1.0 and +1.0: from an amazing MSDN user at https://msdn.microsoft.com/en-us/library/windows/desktop/dd316756(v=vs.85).aspx
 			/*
@@ -266,7 +295,7 @@ void AudioManager::main_audio_loop() {
 			if (sysCore.audioRegs.square0ImplicitOff) {
 				square0Result = 0;
 			} else {
-				square0Result = (std::fmod((float)oscTimer, sysCore.audioRegs.square0Period) < thresholdSquare0)
+				square0Result = (std::fmod((float)oscTimer, square0Period) < thresholdSquare0)
 					? sysCore.audioRegs.square0negativeAmp
 					: sysCore.audioRegs.square0positiveAmp;
 			}
@@ -274,7 +303,7 @@ void AudioManager::main_audio_loop() {
 			if (sysCore.audioRegs.square1ImplicitOff) {
 				square1Result = 0;
 			} else {
-				square1Result = (std::fmod((float)oscTimer, sysCore.audioRegs.square1Period) < thresholdSquare1)
+				square1Result = (std::fmod((float)oscTimer, square1Period) < thresholdSquare1)
 					? sysCore.audioRegs.square1negativeAmp
 					: sysCore.audioRegs.square1positiveAmp;
 			}
@@ -297,7 +326,7 @@ void AudioManager::main_audio_loop() {
 					waitForTriangleAlignment = false;
 				}*/
 
-				triangleResult = (std::fmod(oscTimer, sysCore.audioRegs.trianglePeriod) < sysCore.audioRegs.trianglePeriod / 2.0f)
+				triangleResult = (std::fmod(oscTimer, trianglePeriod) < trianglePeriod / 2.0f)
 					? -0.05f
 					: 0.05f;
 
@@ -309,7 +338,7 @@ void AudioManager::main_audio_loop() {
 
 			////Right channel
 			//*(pf + i + 1) = (square1Result + triangleResult) / 2.0f;
-			*(pf + i + 1) = *(pf + i) = (square0Result + square1Result + triangleResult) / 3.0f;
+			apuSamples[i] = (square0Result + square1Result + triangleResult) / 3.0f;
 
 			oscTimer++;
 
@@ -317,6 +346,15 @@ void AudioManager::main_audio_loop() {
 			lastTriangleResult = triangleResult;
 		}
 
+		mix_noise_and_dmc(apuSamples, apuSampleCount);
+		resampler.end_push(apuSampleCount);
+
+		//Resample into the left channel, then copy it to the right
+		resampler.pull(pf, numFramesAvailable, 2, rateRatio);
+		for (dword i = 0; i < limit; i += 2) {
+			*(pf + i + 1) = *(pf + i);
+		}
+
 		/*************FILTER**************/
 		/*for (dword i = 2; i < limit; i++) {
 			*(pf + i) = (*(pf + i) - *(pf + i - 2)) * filterCoefficientLP;
@@ -364,6 +402,10 @@ void AudioManager::main_audio_loop() {
 
 		/*********************************/
 
+		if (sysCore.captureSink->is_capturing()) {
+			sysCore.captureSink->submit_audio((float *)pData, numFramesAvailable);
+		}
+
 		hr = pRenderClient->ReleaseBuffer(numFramesAvailable, 0);
 
 		if (FAILED(hr)) {
@@ -373,6 +415,33 @@ void AudioManager::main_audio_loop() {
 	}
 }
 
+void AudioManager::mix_noise_and_dmc(float * const dst, const dword count) {
+	SPSCQueue<Core::APUSampleBlock, 64> &queue = *(sysCore.apuSampleQueue);
+
+	while (queue.size() > MAX_NOISE_DMC_BACKLOG) {
+		queue.pop();
+		noiseDmcOffset = 0;
+	}
+
+	for (dword i = 0; i < count; i++) {
+		const Core::APUSampleBlock * const block = queue.front();
+
+		//The exec thread is behind (or stopped); hold the last level rather than dropping to 0, which would click
+		if (block == nullptr) {
+			dst[i] += lastNoiseDmcSample;
+			continue;
+		}
+
+		lastNoiseDmcSample = block->samples[noiseDmcOffset++];
+		dst[i] += lastNoiseDmcSample;
+
+		if (noiseDmcOffset == Core::APUSampleBlock::SAMPLE_COUNT) {
+			queue.pop();
+			noiseDmcOffset = 0;
+		}
+	}
+}
+
 void AudioManager::end_audio() {
 	HRESULT hr;
 
@@ -388,6 +457,8 @@ void AudioManager::end_audio() {
 
 void AudioManager::safe_stop_audio(const char * const msg) {
 	if (msg != nullptr) {
+		//Nothing will move the audio clock now
+		sysCore.syncPacer->stop_audio_clock();
 		sysCore.alert_error(msg);
 	}
 
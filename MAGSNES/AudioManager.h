@@ -5,6 +5,7 @@
 #include <mmdeviceapi.h>
 
 #include "Core.h"
+#include "AudioResampler.h"
 
 namespace MAGSNES {
 
@@ -32,7 +33,18 @@ private:
 
 	void safe_stop_audio(const char * const msg);
 
+	//Counts samples at APU_SAMPLE_FREQUENCY
 	dword oscTimer;
+
+	//From APU_SAMPLE_FREQUENCY to the device's rate
+	AudioResampler resampler;
+
+	//How far into the noise/DMC block at the front of Core::apuSampleQueue the audio thread has got, and the last sample it took
+	dword noiseDmcOffset;
+	float lastNoiseDmcSample;
+
+	//Adds count samples of the noise and DMC output the exec thread has queued to dst
+	void mix_noise_and_dmc(float * const dst, const dword count);
 };
 
 } /* namespace MAGSNES */
@@ -0,0 +1,233 @@
+#include "AudioResampler.h"
+
+#include <cmath>
+#include <cstring>
+
+__FILESCOPE__{
+	//Taps handled per iteration by each vector kernel
+	const int SSE2_TAPS = 4,
+						AVX_TAPS = 8;
+
+	const double PI = 3.14159265358979323846;
+
+	//The passband ends at 0.40 of the lower of the two rates and the stopband starts at its Nyquist frequency (0.50); the cutoff is
+	//halfway between. Kaiser beta for ~75dB of attenuation over a transition band that wide with TAP_COUNT taps.
+	const double CUTOFF = 0.45;
+	const double KAISER_BETA = 7.3;
+
+	//Zeroth order modified Bessel function of the first kind, for the Kaiser window
+	double bessel_i0(const double x) {
+		double sum = 1.0, term = 1.0;
+
+		for (int k = 1; k < 32; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+
+			if (term < (sum * 1e-12)) {
+				break;
+			}
+		}
+
+		return sum;
+	}
+
+	FORCEINLINE float horizontal_sum_sse2(const __m128 v) {
+		const __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+	}
+}
+
+using namespace MAGSNES;
+
+AudioResampler::AudioResampler()
+	: resampleKernel(nullptr), forceScalar(false), nominalStep(1.0), historyCount(0), position(0) {
+
+	select_kernel();
+}
+
+//No cleanup needed
+AudioResampler::~AudioResampler() {}
+
+void AudioResampler::select_kernel() {
+	//The 8 wide kernel only needs AVX (no FMA or integer AVX2), so it runs on every CPU with YMM registers
+	if (!forceScalar && SIMD::has_avx()) {
+		resampleKernel = &AudioResampler::resample_avx;
+	} else if (!forceScalar && SIMD::has_sse2()) {
+		resampleKernel = &AudioResampler::resample_sse2;
+	} else {
+		resampleKernel = &AudioResampler::resample_scalar;
+	}
+}
+
+void AudioResampler::set_rates(const dword inputRate, const dword outputRate, const dword maxOutputCount) {
+	nominalStep = (double)inputRate / outputRate;
+
+	//When going to a lower rate, everything above the output's Nyquist frequency has to go as well
+	const double cutoff = CUTOFF * ((outputRate < inputRate) ? ((double)outputRate / inputRate) : 1.0);
+	const double halfWidth = TAP_COUNT / 2.0, windowScale = 1.0 / bessel_i0(KAISER_BETA);
+
+	coefficients.assign((PHASE_COUNT + 1) * TAP_COUNT, 0.0f);
+
+	for (int phase = 0; phase <= PHASE_COUNT; phase++) {
+		float * const row = coefficients.data() + (phase * TAP_COUNT);
+		double sum = 0;
+
+		for (int k = 0; k < TAP_COUNT; k++) {
+			//Distance from tap k to the output sample, which falls phase / PHASE_COUNT of a sample past tap get_delay()
+			const double t = (k - get_delay()) - ((double)phase / PHASE_COUNT);
+			const double x = 2.0 * cutoff * t;
+			const double sinc = (std::fabs(x) < 1e-9) ? 1.0 : (std::sin(PI * x) / (PI * x));
+
+			//The window is centred on the output sample too, so every phase is the same filter, only shifted
+			const double w = t / halfWidth;
+			const double window = (std::fabs(w) >= 1.0) ? 0.0 : (bessel_i0(KAISER_BETA * std::sqrt(1.0 - (w * w))) * windowScale);
+
+			const double h = 2.0 * cutoff * sinc * window;
+			row[k] = (float)h;
+			sum += h;
+		}
+
+		//Unity gain at DC for every phase, so a constant level doesn't pick up a ripple at the phase rate
+		for (int k = 0; k < TAP_COUNT; k++) {
+			row[k] = (float)(row[k] / sum);
+		}
+	}
+
+	//Room for a full pull at the largest ratio sync asks for (1.005), plus the filter's width and the fraction left over from the last pull
+	history.assign((dword)(maxOutputCount * nominalStep * 1.01) + (TAP_COUNT * 2) + 2, 0.0f);
+
+	//Start out with the filter's delay in silence, so the first output sample falls on the first pushed sample
+	historyCount = get_delay();
+	position = 0;
+
+	select_kernel();
+}
+
+const dword AudioResampler::get_input_needed(const dword outputCount, const float ratio) const {
+	//One step of slack, since pull adds the steps up one at a time and could land a hair further along than the product
+	const double lastPosition = position + ((double)outputCount * nominalStep * ratio);
+	const dword required = (dword)lastPosition + TAP_COUNT;
+
+	return (required > historyCount) ? (required - historyCount) : 0;
+}
+
+float * AudioResampler::begin_push(const dword count) {
+	if ((historyCount + count) > history.size()) {
+		return nullptr;
+	}
+
+	return history.data() + historyCount;
+}
+
+void AudioResampler::end_push(const dword count) {
+	historyCount += count;
+}
+
+void AudioResampler::pull(float * const dst, const dword outputCount, const int dstStride, const float ratio) {
+	const double step = nominalStep * ratio;
+
+	//Only produce what the history can cover; anything past that is silence, and shows up as a gap rather than garbage
+	//i.e. the samples whose first tap is before historyCount - TAP_COUNT + 1
+	const double end = (double)historyCount - TAP_COUNT + 1;
+	dword available = (end > position) ? (dword)std::ceil((end - position) / step) : 0;
+	available = (available < outputCount) ? available : outputCount;
+
+	(this->*resampleKernel)(dst, available, dstStride, step);
+
+	for (dword i = available; i < outputCount; i++) {
+		dst[i * dstStride] = 0.0f;
+	}
+
+	//Drop the input that is behind the next output sample's first tap
+	const dword consumed = (dword)position;
+	if (consumed > 0) {
+		std::memmove(history.data(), history.data() + consumed, (historyCount - consumed) * sizeof(float));
+		historyCount -= consumed;
+		position -= consumed;
+	}
+}
+
+void AudioResampler::resample_scalar(float *dst, const dword outputCount, const int dstStride, const double step) {
+	const float * const input = history.data(), * const table = coefficients.data();
+
+	for (dword i = 0; i < outputCount; i++) {
+		const dword index = (dword)position;
+		const double phasePosition = (position - index) * PHASE_COUNT;
+		const int phase = (int)phasePosition;
+		const float frac = (float)(phasePosition - phase);
+
+		const float * const x = input + index, * const h0 = table + (phase * TAP_COUNT), * const h1 = h0 + TAP_COUNT;
+		float sum0 = 0, sum1 = 0;
+
+		for (int k = 0; k < TAP_COUNT; k++) {
+			sum0 += x[k] * h0[k];
+			sum1 += x[k] * h1[k];
+		}
+
+		*dst = sum0 + ((sum1 - sum0) * frac);
+		dst += dstStride;
+		position += step;
+	}
+}
+
+void AudioResampler::resample_sse2(float *dst, const dword outputCount, const int dstStride, const double step) {
+	const float * const input = history.data(), * const table = coefficients.data();
+
+	for (dword i = 0; i < outputCount; i++) {
+		const dword index = (dword)position;
+		const double phasePosition = (position - index) * PHASE_COUNT;
+		const int phase = (int)phasePosition;
+		const float frac = (float)(phasePosition - phase);
+
+		const float * const x = input + index, * const h0 = table + (phase * TAP_COUNT), * const h1 = h0 + TAP_COUNT;
+		__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+
+		for (int k = 0; k < TAP_COUNT; k += SSE2_TAPS) {
+			const __m128 samples = _mm_loadu_ps(x + k);
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(samples, _mm_loadu_ps(h0 + k)));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(samples, _mm_loadu_ps(h1 + k)));
+		}
+
+		//Interpolating the two dot products is the same as interpolating the two phases' coefficients first
+		const __m128 blended = _mm_add_ps(sum0, _mm_mul_ps(_mm_sub_ps(sum1, sum0), _mm_set1_ps(frac)));
+
+		*dst = horizontal_sum_sse2(blended);
+		dst += dstStride;
+		position += step;
+	}
+}
+
+void AudioResampler::resample_avx(float *dst, const dword outputCount, const int dstStride, const double step) {
+	const float * const input = history.data(), * const table = coefficients.data();
+
+	for (dword i = 0; i < outputCount; i++) {
+		const dword index = (dword)position;
+		const double phasePosition = (position - index) * PHASE_COUNT;
+		const int phase = (int)phasePosition;
+		const float frac = (float)(phasePosition - phase);
+
+		const float * const x = input + index, * const h0 = table + (phase * TAP_COUNT), * const h1 = h0 + TAP_COUNT;
+		__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+
+		for (int k = 0; k < TAP_COUNT; k += AVX_TAPS) {
+			const __m256 samples = _mm256_loadu_ps(x + k);
+			sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(samples, _mm256_loadu_ps(h0 + k)));
+			sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(samples, _mm256_loadu_ps(h1 + k)));
+		}
+
+		const __m256 blended = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_sub_ps(sum1, sum0), _mm256_set1_ps(frac)));
+
+		//Reduced with VEX encoded instructions only; the lanes are swapped, then the pairs, then the neighbours
+		__m256 total = _mm256_add_ps(blended, _mm256_permute2f128_ps(blended, blended, 0x01));
+		total = _mm256_add_ps(total, _mm256_permute_ps(total, _MM_SHUFFLE(1, 0, 3, 2)));
+		total = _mm256_add_ps(total, _mm256_permute_ps(total, _MM_SHUFFLE(2, 3, 0, 1)));
+		*dst = _mm_cvtss_f32(_mm256_castps256_ps128(total));
+
+		//Without /arch:AVX the position and phase math is legacy SSE, which stalls (or picks up false dependencies) while the upper
+		//halves of the YMM registers are dirty
+		_mm256_zeroupper();
+
+		dst += dstStride;
+		position += step;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "SIMD.h"
+
+namespace MAGSNES {
+
+//Converts mono samples from the fixed rate the channels are synthesized at to whatever rate a sink (i.e. the audio device) runs at,
+//with a polyphase windowed-sinc FIR. Each output sample is the dot product of TAP_COUNT input samples with the filter phase nearest
+//its position, interpolated with the next phase. The step between output samples can change on every pull, which is how the audio
+//thread nudges its rate for sync.
+//Samples are written straight into the history with begin_push/end_push, then pull turns as many as it needs into output.
+class AudioResampler {
+	DECLARE_DEBUGGER_ACCESS
+
+public:
+	//Taps per phase, a whole number of AVX iterations; with the Kaiser window this gives ~75dB of stopband attenuation
+	static const int TAP_COUNT = 48;
+	static const int PHASE_COUNT = 256;
+
+	AudioResampler();
+	~AudioResampler();
+
+	//Designs the filter for inputRate -> outputRate, and clears the history. maxOutputCount is the most samples pull will be asked for at
+	//once, which sizes the history. Also picks the fastest kernel the CPU supports.
+	void set_rates(const dword inputRate, const dword outputRate, const dword maxOutputCount);
+
+	//How many more input samples have to be pushed before pull can produce outputCount samples at ratio times the nominal step
+	const dword get_input_needed(const dword outputCount, const float ratio) const;
+
+	//Room for count more input samples at the end of the history, or nullptr if there isn't that much room. Write them and call end_push.
+	float * begin_push(const dword count);
+	void end_push(const dword count);
+
+	//Writes outputCount samples, each dstStride floats apart (i.e. 2 to fill one channel of interleaved stereo). ratio > 1 steps through
+	//the input faster, so the same input makes less output. Input that is no longer needed is dropped from the history.
+	void pull(float * const dst, const dword outputCount, const int dstStride, const float ratio);
+
+	//Output is delayed by this many input samples (the filter's group delay)
+	__CLASSMETHOD__ const int get_delay() { return (TAP_COUNT / 2) - 1; }
+
+private:
+	typedef void (AudioResampler::*ResampleKernel)(float *dst, const dword outputCount, const int dstStride, const double step);
+
+	ResampleKernel resampleKernel;
+
+	//Lets the Debugger compare the vectorized kernels against the scalar one
+	bool forceScalar;
+
+	//Input samples per output sample, at a ratio of 1
+	double nominalStep;
+
+	//(PHASE_COUNT + 1) rows of TAP_COUNT coefficients; the extra row is phase 0 shifted by a whole sample, for interpolating past the last phase
+	std::vector<float> coefficients;
+
+	//Unconsumed input. position is where the next output sample falls, in samples from history[0].
+	std::vector<float> history;
+	dword historyCount;
+	double position;
+
+	//Picks the fastest kernel the CPU supports
+	void select_kernel();
+
+	//Each kernel writes outputCount samples starting at position, leaving position just past the last one
+	void resample_scalar(float *dst, const dword outputCount, const int dstStride, const double step);
+	void resample_sse2(float *dst, const dword outputCount, const int dstStride, const double step);
+	void resample_avx(float *dst, const dword outputCount, const int dstStride, const double step);
+};
+
+} /* namespace MAGSNES */
@@ -3,6 +3,9 @@
 __FILESCOPE__{
 	MAGSNES::GLManager *pSharedGLM = nullptr;
 	MAGSNES::AudioManager *pSharedALM = nullptr;
+
+	//At ~1.789 MHz, we have 1789 NES CPU cycles per millisecond; the exec thread checks its pacing after each slice this long
+	const MAGSNES::dword EXEC_SLICE_CYCLES = MAGSNES::SyncPacer::CPU_CYCLES_PER_SECOND / 1000;
 }
 
 using namespace MAGSNES;
@@ -36,14 +39,17 @@ int BIOS::start_execution(HANDLE contextArg) {
 
 	sysCore.isExecRunning = true;
 
-	LARGE_INTEGER start, end, elapsed;
+	LARGE_INTEGER start, end, emulated;
 	QueryPerformanceCounter(&start);
-	dword cyclesTaken;
+	dword cyclesTaken, waited;
 
 	context.pSys = new System(&glm);
 	context.pSys->loadROM(context.sysCore.fileSelection);
 
 	MAIN_EXEC_LOOP:
+	//Emulated time starts out lined up with whichever clock we follow
+	context.sysCore.syncPacer->begin(context.sysCore.cpuRegs.syncPolicy);
+
 	while (context.sysCore.shouldEmulate) {
 		if (context.sysCore.shouldHalt) {
 			continue;
@@ -52,23 +58,22 @@ int BIOS::start_execution(HANDLE contextArg) {
 		QueryPerformanceCounter(&start);
 		cyclesTaken = 0;
 
-		while (cyclesTaken < 1789) { //At ~1.789 MHz, we have 1789 NES CPU cycles per millisecond
+		while (cyclesTaken < EXEC_SLICE_CYCLES) {
 			cyclesTaken += context.pSys->step();
 		}
 
-		//Wait until 1 millisecond has passed.
-		while (true) {
+		QueryPerformanceCounter(&end);
+		context.sysCore.get_elapsed_microseconds(start, end, emulated);
 
-			QueryPerformanceCounter(&end);
-			context.sysCore.get_elapsed_microseconds(start, end, elapsed);
-			if (elapsed.QuadPart > 1000) { //CHANGING THIS NUMBER IS THE EASIEST WAY TO ALTER THE EMULATION SPEED
-				break;
-			}
-			
-		}
+		//Wait for as long as the sync policy's clock says we're ahead
+		waited = context.sysCore.syncPacer->pace(cyclesTaken);
+
+		context.sysCore.telemetry->add_exec_slice((dword)emulated.QuadPart, waited);
 		
 	}
 
+	context.sysCore.syncPacer->end();
+
 	//The gotos are used to make sure we don't kill the thread until the user wants to quit the program (std::thread seems to have trouble exiting and restarting...)
 	while (context.sysCore.shouldRun) {
 		if (context.sysCore.shouldEmulate) {
@@ -107,9 +112,28 @@ int BIOS::start_video(HANDLE contextArg) {
 			continue;
 		}
 
-		if (context.sysCore.shouldDrawFrame) {
+		//Following vsync, SwapBuffers waits for each refresh and the exec thread emulates a frame per refresh, so present every time
+		if (context.sysCore.syncPacer->get_policy() == SyncPacer::Policy::VSYNC) {
+			glm.set_vsync(true);
+
+			if (!glm.take_frame()) {
+				glm.count_repeated_frame();
+			}
+			glm.update_screen();
+
+			//Without swap control the driver won't wait for us, so approximate a 60Hz refresh
+			if (!glm.is_vsync_enabled()) {
+				Sleep(FRAME_INTERVAL);
+			}
+
+			context.sysCore.syncPacer->signal_vblank();
+			continue;
+		}
+
+		glm.set_vsync(false);
+
+		if (glm.take_frame()) {
 			glm.update_screen();
-			context.sysCore.shouldDrawFrame = false;
 
 			QueryPerformanceCounter(&end);
 			context.sysCore.get_elapsed_microseconds(start, end, elapsed);
@@ -120,6 +144,15 @@ int BIOS::start_video(HANDLE contextArg) {
 				Sleep(FRAME_INTERVAL - (elapsed.QuadPart / 1000));
 			}
 			QueryPerformanceCounter(&start);
+		} else {
+			QueryPerformanceCounter(&end);
+			context.sysCore.get_elapsed_microseconds(start, end, elapsed);
+
+			//A whole interval went by without a new frame, so the last one stays on screen for another
+			if (elapsed.QuadPart > (FRAME_INTERVAL * 1000)) {
+				glm.count_repeated_frame();
+				QueryPerformanceCounter(&start);
+			}
 		}
 	}
 
@@ -1,4 +1,8 @@
 #include "CPU.h"
+#include "Recompiler.h"
+#include "CPUTrace.h"
+
+#include <cstring>
 
 __FILESCOPE__{
 	//Interrupt vectors and magic numbers
@@ -8,6 +12,23 @@ const int VECTOR_IRQ = 0xFFFE;
 
 const int STACK_OFFSET = 0x100;
 const int DMA_LIMIT = 256;
+
+//codePages when there is no recompiler, so write_byte never has to check for one
+const MAGSNES::byte NO_CODE_PAGES[0x100] = {};
+
+#ifdef CPU_TRACE
+const char * const CPU_TRACE_PATH = "MAGSNES_trace.bin";
+
+//In the order of the CPU's MN_ values
+const char * const MNEMONIC_NAMES[MAGSNES::CPU::MN_TOTAL] = {
+	"ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC",
+	"CLD", "CLI", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP",
+	"JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI",
+	"RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA",
+	"ALR", "ANC", "ARR", "AXS", "DCP", "ISC", "LAX", "RLA", "RRA", "SAX", "SLO", "SRE",
+	"???"
+};
+#endif
 }
 
 using namespace MAGSNES; //Windows.h includes a typedef in one of its headers for 'byte', so we need to scope it within this file
@@ -17,39 +38,103 @@ CPU::CPU(Bus *refBus)
 		refMM(this->refBus.mainMemory),
 		refReadBus(this->refBus.readBus),
 		refWriteBus(this->refBus.writeBus),
-		sysCore(Core::get_sys_core()) {
+		sysCore(Core::get_sys_core()),
+		recompiler(nullptr),
+		trace(nullptr),
+		codePages(NO_CODE_PAGES),
+		clockCallback(nullptr),
+		clockContext(nullptr) {
+
+#ifdef CPU_DECODE_CACHE
+	decodeCache = new DecodedOp[MM_SIZE - 0x8000];
+	std::memset(&decodeStats, 0, sizeof(DecodeStats));
+#endif
+#ifdef CPU_IDLE_SKIP
+	std::memset(&idleStats, 0, sizeof(IdleStats));
+#endif
 
 	total_reset();
+
+#ifdef CPU_TRACE
+	if (sysCore.cpuRegs.traceInstructions) {
+		trace = new CPUTrace();
+		describe_opcodes(*trace);
+	}
+#endif
+
+#ifdef CPU_RECOMPILER
+	//Blocks are run as a whole, so they can't stop at each access, and the instructions in them aren't traced
+	if (sysCore.cpuRegs.useRecompiler && !sysCore.cpuRegs.cycleAccurate && (trace == nullptr)) {
+		recompiler = new Recompiler(*this, sysCore.cpuRegs.checkRecompiler);
+		codePages = recompiler->get_code_pages();
+	}
+#endif
+}
+
+CPU::~CPU() {
+	char statsMsg[256];
+
+#ifdef CPU_IDLE_SKIP
+	sprintf_s(statsMsg, "Idle loops: %llu passes skipped (%llu cycles)", idleStats.passesSkipped, idleStats.cyclesSkipped);
+	sysCore.logmsg(statsMsg);
+#endif
+
+#ifdef CPU_DECODE_CACHE
+	const qword decodeLookups = decodeStats.hits + decodeStats.misses;
+	sprintf_s(statsMsg, "Decode cache: %llu hits, %llu misses (%.2f%% hit rate), %llu bank invalidations",
+		decodeStats.hits, decodeStats.misses, decodeLookups ? (100.0 * decodeStats.hits) / decodeLookups : 0.0, decodeStats.invalidations);
+	sysCore.logmsg(statsMsg);
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+	sprintf_s(statsMsg, "Fused instructions: %llu pairs run, %llu PPUSTATUS polling passes skipped", decodeStats.fusedRuns, decodeStats.spinPassesSkipped);
+	sysCore.logmsg(statsMsg);
+#endif
+
+	delete[] decodeCache;
+#endif
+
+#ifdef CPU_RECOMPILER
+	if (recompiler != nullptr) { delete recompiler; }
+#endif
+
+#ifdef CPU_TRACE
+	if (trace != nullptr) { delete trace; }
+#endif
 }
 
 void CPU::total_reset() {
 	regA = 0;
 	regX = 0;
 	regY = 0;
-	regP = 0x20; //Flag T must always be on, although regP isn't used in this implementation
+	regP = FLAG_TRASH; //Flag T must always be on; regP only holds the flags with CPU_PACKED_FLAGS
 	regSP = 0xFF;
 	regPC = 0;
 	regInterrupt = INTERRUPT_NONE;
 	regExtraCycles = 0;
 	regPageCross = 0;
+	instructionStart = 0;
+	clockedCycles = 0;
+	stolenCycles = 0;
+	readCycle = 0;
+	writeCycle = 0;
+#ifdef CPU_IDLE_SKIP
+	idleLoop.isTracking = false;
+	idleLoop.rejectedHead = idleLoop.rejectedPC = 0;
+#endif
 	DMACounter = 0;
 	DMAAddress = 0;
 	refBus.reset();
+#ifdef CPU_DECODE_CACHE
+	clear_decode_cache();
+#endif
 
-	//Store the flags separately for efficiency
-	flagN = false;
-	flagV = false;
-	flagTrash = true; //Bit 5 in 6502 P register. Not used, but should always be on.
-	flagB = false;
-	flagD = false;
-	flagI = false;
-	flagZ = false;
-	flagC = false;
+	//Every flag starts clear except flagTrash
+	pToFlags(FLAG_TRASH);
 }
 
 void CPU::post_interrupt(const MAGSNES::byte INTERRUPT_TYPE) {
-	//Ignore IRQ if flag I is set
-	if ((INTERRUPT_TYPE == INTERRUPT_IRQ) && flagI) {
+	//Ignore IRQ if flag I is set, or if an NMI, DMA or reset is already waiting; whatever raised it keeps posting it until it's acknowledged
+	if ((INTERRUPT_TYPE == INTERRUPT_IRQ) && (get_I() || (regInterrupt != INTERRUPT_NONE))) {
 		return;
 	}
 
@@ -60,26 +145,715 @@ void CPU::initialize_PC() {
 	regPC = refMM[VECTOR_RESET] | (refMM[VECTOR_RESET + 1] << 8);
 }
 
+void CPU::map_prg_bank(const word startAddr, const dword length, const dword prgChunk) {
+#ifdef CPU_DECODE_CACHE
+	for (dword offset = 0; offset < length; offset += DECODE_SLOT_SIZE) {
+		const dword slot = ((startAddr + offset) >> 13) & 3;
+		const dword chunk = prgChunk + (offset / DECODE_SLOT_SIZE);
+
+		if (decodedChunks[slot] != chunk) {
+			decodedChunks[slot] = chunk;
+			std::memset(&decodeCache[slot * DECODE_SLOT_SIZE], 0, DECODE_SLOT_SIZE * sizeof(DecodedOp));
+			decodeStats.invalidations++;
+		}
+	}
+#endif
+
+#ifdef CPU_RECOMPILER
+	if (recompiler != nullptr) {
+		recompiler->map_prg(startAddr, length, prgChunk);
+	}
+#endif
+}
+
+void CPU::invalidate_code_page(const MAGSNES::byte page) {
+#ifdef CPU_RECOMPILER
+	recompiler->invalidate_page(page);
+#endif
+}
+
 //Interrupt and cycle handling takes place here
 MAGSNES::byte CPU::execute_next() {
+	//Nothing runs while the bus is taken; the rest of the system still gets the cycles
+	if (stolenCycles) {
+		const MAGSNES::byte cycles = stolenCycles;
+		stolenCycles = 0;
+		return cycles;
+	}
+
+#ifdef CPU_TRACE
+	if (trace != nullptr) {
+		return execute_traced();
+	}
+#endif
+
 	MAGSNES::byte extraCycles = 0;
 	if (regInterrupt) { //anything but zero means an interrupt
 		extraCycles = handle_interrupt();
+#ifdef CPU_IDLE_SKIP
+		//The handler can change anything an idle loop is waiting on
+		idleLoop.isTracking = false;
+#endif
 		//Block CPU from executing on DMA
 		if (regInterrupt == INTERRUPT_DMA) {
 			return extraCycles;
 		}
 	}
+
+	//Only the interpreter sees each access as it happens, so nothing is decoded, fused, skipped or recompiled in cycle stepped mode
+	if (clockCallback != nullptr) {
+		instructionStart = extraCycles;
+		return execute(refMM[regPC]) + extraCycles;
+	}
+
+#ifdef CPU_IDLE_SKIP
+	const word pc = regPC;
+	const MAGSNES::byte cycles = execute_at_PC() + extraCycles;
+	return cycles + track_idle_loop(pc, cycles);
+#else
+	return execute_at_PC() + extraCycles;
+#endif
+}
+
+FORCEINLINE MAGSNES::byte CPU::execute_at_PC() {
+#ifdef CPU_RECOMPILER
+	//Run a whole block natively if one can start here
+	MAGSNES::byte blockCycles;
+	if ((recompiler != nullptr) && recompiler->run(blockCycles)) {
+		return blockCycles;
+	}
+#endif
+
+#ifdef CPU_DECODE_CACHE
+	//PRG ROM only changes on a bank switch, so its instructions are decoded once
+	if (regPC & 0x8000) {
+		return execute_decoded();
+	}
+#endif
+
 	//Execute the opcode at PC (note that PC will have likely been changed if an interrupt
 	//took place)
 	MAGSNES::byte opcode = refMM[regPC];
-	return execute(opcode) + extraCycles;
+	return execute(opcode);
+}
+
+#ifdef CPU_TRACE
+//Nothing is fused, skipped or run as a block, so every instruction is recorded on its own. PRG ROM still runs from the decode cache
+//(without fusion) outside of cycle stepped mode, which keeps tracing cheap.
+MAGSNES::byte CPU::execute_traced() {
+	if (sysCore.shouldDumpTrace) {
+		sysCore.shouldDumpTrace = false;
+		trace->write_snapshot(CPU_TRACE_PATH);
+	}
+
+	MAGSNES::byte extraCycles = 0;
+	if (regInterrupt) {
+		extraCycles = handle_interrupt();
+		trace->add_cycles(extraCycles);
+
+		if (regInterrupt == INTERRUPT_DMA) {
+			return extraCycles;
+		}
+	}
+
+	trace->record(regPC, refMM[regPC], refMM[(word)(regPC + 1)], refMM[(word)(regPC + 2)], regA, regX, regY, flagsToP(), regSP,
+		*pPPUSCANLINE, *pPPUPIXEL);
+
+	instructionStart = extraCycles;
+#ifdef CPU_DECODE_CACHE
+	const DecodedOp * const op = ((clockCallback == nullptr) && (regPC & 0x8000)) ? get_decoded(regPC) : nullptr;
+	const MAGSNES::byte cycles = (op != nullptr) ? run_decoded(*op) : execute(refMM[regPC]);
+#else
+	const MAGSNES::byte cycles = execute(refMM[regPC]);
+#endif
+
+	trace->add_cycles(cycles);
+	return cycles + extraCycles;
+}
+
+void CPU::describe_opcodes(CPUTrace &target) {
+	for (int opcode = 0; opcode < 0x100; opcode++) {
+		const OpInfo &opinfo = opcodeVector[opcode];
+		CPUTrace::OperandFormat format;
+
+		switch (opinfo.addrMode) {
+		case ACCUMULATOR:
+			format = CPUTrace::OPERAND_ACCUMULATOR;
+			break;
+		case IMMEDIATE:
+			format = CPUTrace::OPERAND_IMMEDIATE;
+			break;
+		case ZERO_PAGE:
+			format = CPUTrace::OPERAND_ZERO_PAGE;
+			break;
+		case ZERO_PAGE_X:
+			format = CPUTrace::OPERAND_ZERO_PAGE_X;
+			break;
+		case ZERO_PAGE_Y:
+			format = CPUTrace::OPERAND_ZERO_PAGE_Y;
+			break;
+		case ABSOLUTE:
+			format = CPUTrace::OPERAND_ABSOLUTE;
+			break;
+		case ABSOLUTE_X:
+			format = CPUTrace::OPERAND_ABSOLUTE_X;
+			break;
+		case ABSOLUTE_Y:
+			format = CPUTrace::OPERAND_ABSOLUTE_Y;
+			break;
+		case RELATIVE:
+			format = CPUTrace::OPERAND_RELATIVE;
+			break;
+		case INDIRECT_X:
+			format = CPUTrace::OPERAND_INDIRECT_X;
+			break;
+		case INDIRECT_Y:
+			format = CPUTrace::OPERAND_INDIRECT_Y;
+			break;
+		case ABSOLUTE_INDIRECT:
+			format = CPUTrace::OPERAND_INDIRECT;
+			break;
+		default: //ADDR_MODE_NONE, IMPLIED
+			format = CPUTrace::OPERAND_NONE;
+			break;
+		}
+
+		//$EA is the only official NOP, and $EB is an unofficial copy of SBC #imm
+		const bool isUnofficial = (opinfo.mnemonic >= MN_ALR) || ((opinfo.mnemonic == MN_NOP) && (opcode != 0xEA)) || (opcode == 0xEB);
+
+		target.set_opcode_info((MAGSNES::byte)opcode, MNEMONIC_NAMES[opinfo.mnemonic], format, isUnofficial);
+	}
+}
+#endif
+
+//In cycle stepped mode, everything before an I/O access is run first, so a read sees e.g. a vblank flag set just before it. Then
+//the access's own cycle is run, which is where the PPU, APU, controller and mapper see it.
+MAGSNES::byte CPU::read_byte_stepped(const word addr) {
+	clock_to(readCycle - 1);
+	const MAGSNES::byte val = bus_read(addr);
+	clock_to(readCycle);
+	return val;
+}
+
+void CPU::write_byte_stepped(const word addr, const MAGSNES::byte val) {
+	clock_to(writeCycle - 1);
+	bus_write(addr, val);
+	clock_to(writeCycle);
+}
+
+void CPU::clock_to(const MAGSNES::byte cycle) {
+	const MAGSNES::byte stepCycle = instructionStart + cycle;
+
+	if (stepCycle > clockedCycles) {
+		clockCallback(clockContext, stepCycle - clockedCycles);
+		clockedCycles = stepCycle;
+	}
+}
+
+//Reads and writes take place on the instruction's last cycle. Read-modify-writes read two cycles before that, then write back
+//the unchanged value and the result on the last two. The dummy accesses themselves aren't made.
+void CPU::set_access_cycles(const OpInfo &opinfo, const MAGSNES::byte pageCrossCycle) {
+	const MAGSNES::byte lastCycle = opinfo.cycles + pageCrossCycle;
+
+	readCycle = (opinfo.access == ACCESS_RMW) ? (lastCycle - 2) : lastCycle;
+	writeCycle = lastCycle;
+}
+
+//Mirrors PPU::emulateCRT: a scanline is 342 ticks, and the tick that moves from pixel 341 of scanline 240 to 241 sets vblank
+const dword CPU::get_ppu_ticks_to_vblank() const {
+	const dword TICKS_PER_SCANLINE = 342, SCANLINES_PER_FRAME = 262, VBLANK_SCANLINE = 241;
+	const dword scanline = *pPPUSCANLINE, pixel = *pPPUPIXEL;
+	const dword scanlinesToGo = (scanline < VBLANK_SCANLINE) ? (VBLANK_SCANLINE - scanline) : (SCANLINES_PER_FRAME - scanline + VBLANK_SCANLINE);
+
+	return (TICKS_PER_SCANLINE - pixel) + ((scanlinesToGo - 1) * TICKS_PER_SCANLINE);
+}
+
+#ifdef CPU_IDLE_SKIP
+//A loop is idle once two arrivals at its head, with only the loop's own instructions run in between, find the CPU in the same state.
+//The loop never writes memory or reads I/O (see is_idle_loop_body), so every pass from then on is identical, until an interrupt.
+//Those passes are skipped by returning their cycles without running them, stopping short of vblank so an NMI is taken at exactly
+//the same instruction as it would be otherwise. IRQs are only ignored while flag I is set; otherwise nothing is skipped.
+MAGSNES::byte CPU::track_idle_loop(const word pc, const MAGSNES::byte cycles) {
+	if (idleLoop.isTracking) {
+		if ((pc < idleLoop.head) || (pc > idleLoop.end)) {
+			idleLoop.isTracking = false;
+		} else {
+			idleLoop.passCycles += cycles;
+		}
+	}
+
+	//Only a jump back to (or onto) the instructions just run can end a pass
+	if ((regPC > pc) || ((pc - regPC) >= IDLE_MAX_LOOP_BYTES)) {
+		return 0;
+	}
+
+	const MAGSNES::byte p = flagsToP();
+
+	if (idleLoop.isTracking && (idleLoop.head == regPC) && (idleLoop.passCycles != 0) && get_I() &&
+		(idleLoop.a == regA) && (idleLoop.x == regX) && (idleLoop.y == regY) && (idleLoop.sp == regSP) && (idleLoop.p == p)) {
+
+		const dword passCycles = idleLoop.passCycles, ticksToVblank = get_ppu_ticks_to_vblank();
+		dword skipped = 0;
+
+		while (((cycles + skipped + passCycles) <= MAX_SKIP_CYCLES) && (((cycles + skipped + passCycles) * 3) < ticksToVblank)) {
+			skipped += passCycles;
+			idleStats.passesSkipped++;
+		}
+
+		idleStats.cyclesSkipped += skipped;
+		idleLoop.passCycles = 0;
+		return skipped;
+	}
+
+	if (!idleLoop.isTracking || (idleLoop.head != regPC)) {
+		//Busy loops (DEX/BNE and the like) jump back all the time, so the last one turned down isn't looked at again
+		word end;
+		if (((idleLoop.rejectedHead == regPC) && (idleLoop.rejectedPC == pc)) || !is_idle_loop_body(regPC, pc, end)) {
+			idleLoop.isTracking = false;
+			idleLoop.rejectedHead = regPC;
+			idleLoop.rejectedPC = pc;
+			return 0;
+		}
+
+		idleLoop.isTracking = true;
+		idleLoop.head = regPC;
+		idleLoop.end = end;
+	}
+
+	idleLoop.a = regA;
+	idleLoop.x = regX;
+	idleLoop.y = regY;
+	idleLoop.sp = regSP;
+	idleLoop.p = p;
+	idleLoop.passCycles = 0;
+	return 0;
+}
+
+//The loop starting at head is idle if it leaves memory alone and has no bus side effects: no stores, read-modify-writes or stack
+//use, and reads only from fixed addresses outside $2000-$401F. It runs through the step that started at pc, so it ends with the
+//first jump back to head at or after pc; that jump's address is returned in end. Jumps to anywhere else must land on an instruction
+//of the loop or leave it (which stops tracking).
+const bool CPU::is_idle_loop_body(const word head, const word pc, word &end) {
+	//Bit n is set if an instruction starts at head + n
+	dword starts = 0;
+	word addr = head;
+
+	while (true) {
+		//The jump back can be at most IDLE_MAX_LOOP_BYTES past head, and is 3 bytes at most
+		if ((addr - head) > IDLE_MAX_LOOP_BYTES) {
+			return false;
+		}
+
+		const OpInfo &opinfo = opcodeVector[refMM[addr]];
+		const MAGSNES::byte mnemonic = opinfo.mnemonic;
+
+		if ((opinfo.addrMode == ADDR_MODE_NONE) || (opinfo.access == ACCESS_WRITE) ||
+			(mnemonic == MN_PHA) || (mnemonic == MN_PHP) || (mnemonic == MN_PLA) || (mnemonic == MN_PLP) ||
+			(mnemonic == MN_JSR) || (mnemonic == MN_RTS) || (mnemonic == MN_RTI) || (mnemonic == MN_BRK)) {
+			return false;
+		}
+
+		const word operandWord = refMM[addr + 1] | (refMM[addr + 2] << 8);
+		const MAGSNES::byte length = get_instruction_length(opinfo.addrMode);
+		starts |= 1 << (addr - head);
+
+		switch (opinfo.addrMode) {
+		case ACCUMULATOR:
+		case IMPLIED:
+		case IMMEDIATE:
+		case RELATIVE:
+			break;
+
+		case ZERO_PAGE:
+		case ZERO_PAGE_X:
+		case ZERO_PAGE_Y:
+		case ABSOLUTE:
+		case ABSOLUTE_X:
+		case ABSOLUTE_Y:
+			//INC/DEC and the shifts write back to memory
+			if (opinfo.access == ACCESS_RMW) {
+				return false;
+			}
+
+			//JMP doesn't read its operand
+			if ((opinfo.addrMode == ABSOLUTE) && (mnemonic != MN_JMP)) {
+				const word readAddr = coerce_address(operandWord);
+				if ((readAddr >= 0x2000) && (readAddr < 0x4020)) {
+					return false;
+				}
+			} else if ((opinfo.addrMode == ABSOLUTE_X) || (opinfo.addrMode == ABSOLUTE_Y)) {
+				//Any index could be added, so the whole range must be clear of I/O
+				if ((operandWord < 0x4020) && ((operandWord + 0xFF) >= 0x2000)) {
+					return false;
+				}
+			}
+			break;
+
+		default: //Indirect modes
+			return false;
+		}
+
+		const bool isJump = (opinfo.addrMode == RELATIVE) || (mnemonic == MN_JMP);
+		const word target = (opinfo.addrMode == RELATIVE) ? (word)(addr + 2 + (signed char)refMM[addr + 1]) : operandWord;
+
+		if (isJump && (target == head) && (addr >= pc)) {
+			end = addr;
+			break;
+		}
+
+		addr += length;
+	}
+
+	//Every jump inside the loop must land on the start of one of its instructions
+	for (addr = head; addr <= end; addr += get_instruction_length(opcodeVector[refMM[addr]].addrMode)) {
+		const OpInfo &opinfo = opcodeVector[refMM[addr]];
+		word target;
+
+		if (opinfo.addrMode == RELATIVE) {
+			target = addr + 2 + (signed char)refMM[addr + 1];
+		} else if (opinfo.mnemonic == MN_JMP) {
+			target = refMM[addr + 1] | (refMM[addr + 2] << 8);
+		} else {
+			continue;
+		}
+
+		if ((target >= head) && (target <= end) && !(starts & (1 << (target - head)))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+#ifdef CPU_DECODE_CACHE
+MAGSNES::byte CPU::execute_decoded() {
+	DecodedOp * const op = get_decoded(regPC);
+
+	//Illegal opcodes aren't cached; execute() reports them. Nor are instructions that straddle two slots; execute() runs those too.
+	if (op == nullptr) {
+		return execute(refMM[regPC]);
+	}
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+	switch (op->fusion) {
+	case FUSE_NONE:
+		break;
+
+	case FUSE_DEX_BNE:
+	case FUSE_DEY_BNE: {
+		//DEX/DEY ignore the operand, so the first instruction can still run alone
+		if (!can_defer_interrupts(2)) {
+			break;
+		}
+
+		MAGSNES::byte &reg = (op->fusion == FUSE_DEX_BNE) ? regX : regY;
+		reg--;
+		set_NZ(reg);
+		decodeStats.fusedRuns++;
+
+		//operand holds the branch target
+		if (reg) {
+			regPC = op->operand;
+			return op->takenCycles;
+		}
+
+		regPC += 3;
+		return 4;
+	}
+
+	case FUSE_STATUS_SPIN:
+		return run_status_spin(*op);
+
+	default:
+		return run_fused_pair(*op);
+	}
+#endif
+
+	return run_decoded(*op);
+}
+
+CPU::DecodedOp * CPU::get_decoded(const word pc) {
+	DecodedOp &op = decodeCache[pc & 0x7FFF];
+
+	if (op.instr != nullptr) {
+		decodeStats.hits++;
+		return &op;
+	}
+
+	const MAGSNES::byte opcode = refMM[pc];
+	const OpInfo &opinfo = opcodeVector[opcode];
+	decodeStats.misses++;
+
+	if (opinfo.addrMode == ADDR_MODE_NONE) {
+		return nullptr;
+	}
+
+	//Switching only the next slot (or wrapping past $FFFF) would leave the cached operand stale, since map_prg_bank only clears the
+	//slot being mapped. This only happens at the last 2 bytes of a slot, so those are simply decoded every time.
+	if ((((dword)pc + get_instruction_length(opinfo.addrMode) - 1) & 0xE000) != (pc & 0xE000)) {
+		return nullptr;
+	}
+
+	const word operandLo = refMM[pc + 1];
+	const word operandWord = operandLo | (refMM[pc + 2] << 8);
+
+	switch (opinfo.addrMode) {
+	case IMMEDIATE:
+	case RELATIVE:
+		op.operand = pc + 1;
+		break;
+
+	case ZERO_PAGE:
+	case ZERO_PAGE_X:
+	case ZERO_PAGE_Y:
+	case INDIRECT_X:
+	case INDIRECT_Y:
+		op.operand = operandLo;
+		break;
+
+	case ABSOLUTE:
+		op.operand = coerce_address(operandWord);
+		break;
+
+	case ABSOLUTE_X:
+	case ABSOLUTE_Y:
+	case ABSOLUTE_INDIRECT:
+		op.operand = operandWord;
+		break;
+
+	default: //ACCUMULATOR, IMPLIED
+		op.operand = 0;
+		break;
+	}
+
+	op.addrMode = opinfo.addrMode;
+	op.length = get_instruction_length(opinfo.addrMode);
+	op.pageCrossCycle = opinfo.pageCrossCycle;
+	op.instr = opinfo.instr;
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+	fuse(pc, op);
+#endif
+
+	return &op;
+}
+
+MAGSNES::byte CPU::run_decoded(const DecodedOp &op) {
+	//Same operands as execute() works out, from the decoded bytes
+	word operand = op.operand;
+	MAGSNES::byte extraCycles = 0;
+
+	switch (op.addrMode) {
+	case ACCUMULATOR:
+		operand = regA;
+		break;
+
+	case ZERO_PAGE_X:
+		operand = (operand + regX) & 0xFF;
+		break;
+
+	case ZERO_PAGE_Y:
+		operand = (operand + regY) & 0xFF;
+		break;
+
+	case ABSOLUTE_X:
+	case ABSOLUTE_Y: {
+		const word memAddr = operand + ((op.addrMode == ABSOLUTE_X) ? regX : regY);
+		if ((operand & 0xFF00) != (memAddr & 0xFF00)) {
+			extraCycles = op.pageCrossCycle;
+		}
+		operand = coerce_address(memAddr);
+		break;
+	}
+
+	case INDIRECT_X: {
+		const word indirectAddr = (operand + regX) & 0xFF;
+		operand = coerce_address(refMM[indirectAddr] | (refMM[(indirectAddr + 1) & 0xFF] << 8));
+		break;
+	}
+
+	case INDIRECT_Y: {
+		const word baseAddr = refMM[operand] | (refMM[(operand + 1) & 0xFF] << 8);
+		const word memAddr = baseAddr + regY;
+		if ((baseAddr & 0xFF00) != (memAddr & 0xFF00)) {
+			extraCycles = op.pageCrossCycle;
+		}
+		operand = coerce_address(memAddr);
+		break;
+	}
+
+	case ABSOLUTE_INDIRECT: {
+		//Hi byte of the pointer wraps around the page
+		const word pointerHi = (operand & 0xFF00) | ((operand + 1) & 0xFF);
+		operand = coerce_address(refMM[operand] | (refMM[pointerHi] << 8));
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	regPC += op.length;
+	return op.instr(operand, *this) + extraCycles;
+}
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+//System::step runs the peripherals after the step, and the PPU handles readBus/writeBus on the first dot of it. Running two
+//instructions in one step therefore moves the second one's access up to the first one's cycles * 3 dots earlier, and defers an
+//interrupt raised during the first one until after the second. So the second instruction may only access RAM, while the first
+//may read I/O (it still reaches the PPU on the first dot) but never write I/O or PRG ROM, since a DMA or bank switch must happen
+//before the next instruction runs. Interrupts are left to run_fused_pair, which runs the first instruction alone when one could
+//be raised during it. The second instruction must be in the same 8KB slot, so a bank switch can't separate the two.
+//Cycle stepped mode (cpuRegs.cycleAccurate) never runs from the decode cache, so nothing is fused there.
+void CPU::fuse(const word pc, DecodedOp &op) {
+	op.fusion = FUSE_NONE;
+
+	const word next = pc + op.length;
+	if ((next & 0xE000) != (pc & 0xE000)) {
+		return;
+	}
+
+	const MAGSNES::byte first = opcodeVector[refMM[pc]].mnemonic;
+	const OpInfo &second = opcodeVector[refMM[next]];
+	if ((second.addrMode == ADDR_MODE_NONE) || (((next + get_instruction_length(second.addrMode) - 1) & 0xE000) != (pc & 0xE000))) {
+		return;
+	}
+
+	//Decrement and loop; no bus access at all
+	if (((first == MN_DEX) || (first == MN_DEY)) && (second.mnemonic == MN_BNE)) {
+		const word afterBranch = next + 2;
+		const word target = afterBranch + (signed char)refMM[next + 1];
+
+		op.fusion = (first == MN_DEX) ? FUSE_DEX_BNE : FUSE_DEY_BNE;
+		op.operand = target;
+		op.takenCycles = ((afterBranch & 0xFF00) != (target & 0xFF00)) ? 6 : 5;
+		return;
+	}
+
+	//Polling PPUSTATUS until vblank: LDA/BIT $2002, then BPL back to it. Branches don't touch the bus.
+	if (((first == MN_LDA) || (first == MN_BIT)) && (op.addrMode == ABSOLUTE) && (op.operand == 0x2002) && (second.mnemonic == MN_BPL)) {
+		if ((word)(next + 2 + (signed char)refMM[next + 1]) == pc) {
+			op.fusion = FUSE_STATUS_SPIN;
+			return;
+		}
+	}
+
+	//Compare and branch on equality
+	if (((first == MN_CMP) || (first == MN_CPX) || (first == MN_CPY)) && ((second.mnemonic == MN_BEQ) || (second.mnemonic == MN_BNE))) {
+		op.fusion = FUSE_PAIR;
+		return;
+	}
+
+	//Copy a byte into RAM; LDA only reads, so it may load from anywhere
+	if ((first == MN_LDA) && (second.mnemonic == MN_STA) && only_accesses_RAM(next)) {
+		op.fusion = FUSE_PAIR;
+		return;
+	}
+
+	//Bump a zero page counter and load from RAM
+	if ((first == MN_INC) && (op.addrMode == ZERO_PAGE) && (second.mnemonic == MN_LDA) && only_accesses_RAM(next)) {
+		op.fusion = FUSE_PAIR;
+		return;
+	}
+}
+
+const bool CPU::only_accesses_RAM(const word pc) {
+	const word address = refMM[(word)(pc + 1)] | (refMM[(word)(pc + 2)] << 8);
+
+	switch (opcodeVector[refMM[pc]].addrMode) {
+	case IMMEDIATE:
+	case ZERO_PAGE:
+	case ZERO_PAGE_X:
+	case ZERO_PAGE_Y:
+		return true;
+
+	case ABSOLUTE:
+		return address < 0x2000;
+
+	//Has to stay in RAM whatever the index is
+	case ABSOLUTE_X:
+	case ABSOLUTE_Y:
+		return (address + 0xFF) < 0x2000;
+
+	default: //Indirect addresses are only known when the instruction runs
+		return false;
+	}
+}
+
+//IRQs aren't taken while flag I is set, and since the first instruction of a pair can't write PPUCTRL, an NMI only comes with vblank
+FORCEINLINE const bool CPU::can_defer_interrupts(const MAGSNES::byte cycles) const {
+	return get_I() && ((dword)(cycles * 3) < get_ppu_ticks_to_vblank());
+}
+
+MAGSNES::byte CPU::run_fused_pair(const DecodedOp &op) {
+	const MAGSNES::byte cycles = run_decoded(op);
+
+	//An interrupt raised during the first instruction is taken before the second, so that one waits for the next step
+	if (!can_defer_interrupts(cycles)) {
+		return cycles;
+	}
+
+	decodeStats.fusedRuns++;
+
+	//Checked to be legal when the pair was fused
+	return cycles + run_decoded(*get_decoded(regPC));
+}
+
+MAGSNES::byte CPU::run_status_spin(const DecodedOp &op) {
+	const word loopPC = regPC;
+	MAGSNES::byte cycles = run_fused_pair(op);
+
+	//Vblank was already set, so the loop ends as usual (or the BPL was left for the next step)
+	if (regPC != loopPC) {
+		return cycles;
+	}
+
+	//Later reads return the same value until vblank is set, and one more pass through the loop changes nothing but the time,
+	//so every pass that would end before then is run right here. Reading PPUSTATUS again only clears what the first read did.
+	const dword ticksToVblank = get_ppu_ticks_to_vblank();
+	const MAGSNES::byte cyclesPerPass = cycles;
+	dword passes = 1;
+
+	while (((cycles + cyclesPerPass) <= MAX_SKIP_CYCLES) && (((cycles + cyclesPerPass) * 3) < ticksToVblank)) {
+		cycles += cyclesPerPass;
+		passes++;
+	}
+
+	decodeStats.spinPassesSkipped += passes - 1;
+	return cycles;
+}
+
+#endif
+
+void CPU::clear_decode_cache() {
+	std::memset(decodeCache, 0, (MM_SIZE - 0x8000) * sizeof(DecodedOp));
+
+	for (int slot = 0; slot < 4; slot++) {
+		decodedChunks[slot] = DECODE_NO_CHUNK;
+	}
+}
+#endif
+
+const MAGSNES::byte CPU::get_instruction_length(const MAGSNES::byte addrMode) {
+	switch (addrMode) {
+	case ACCUMULATOR:
+	case IMPLIED:
+		return 1;
+	case ABSOLUTE:
+	case ABSOLUTE_X:
+	case ABSOLUTE_Y:
+	case ABSOLUTE_INDIRECT:
+		return 3;
+	default:
+		return 2;
+	}
 }
 
 //Decodes an opcode into an ALU operation, addressing mode, and cycle group, then executes it.
 //Returns the # of cycles taken.
 MAGSNES::byte CPU::execute(const MAGSNES::byte opcode) {
-	OpInfo	opinfo = opcodeVector[opcode];
+	const OpInfo &opinfo = opcodeVector[opcode];
 	byte		addrMode = opinfo.addrMode, extraCycles = 0;
 	word		operand;
 
@@ -117,17 +891,17 @@ MAGSNES::byte CPU::execute(const MAGSNES::byte opcode) {
 
 	case ABSOLUTE_X:
 		operand = absoluteIndexedXOperand();
-		/*if (regExtraCycles && pageCrossOpcodes[opcode]) {
-		extraCycles = regExtraCycles;
-		}*/
+		if (regPageCross) {
+			extraCycles = opinfo.pageCrossCycle;
+		}
 		operand = coerce_address(operand);
 		break;
 
 	case ABSOLUTE_Y:
 		operand = absoluteIndexedYOperand();
-		/*if (regExtraCycles && pageCrossOpcodes[opcode]) {
-		extraCycles = regExtraCycles;
-		}*/
+		if (regPageCross) {
+			extraCycles = opinfo.pageCrossCycle;
+		}
 		operand = coerce_address(operand);
 		break;
 
@@ -138,9 +912,9 @@ MAGSNES::byte CPU::execute(const MAGSNES::byte opcode) {
 
 	case INDIRECT_Y:
 		operand = indirectIndexedYOperand();
-		/*if (regExtraCycles && pageCrossOpcodes[opcode]) {
-		extraCycles = regExtraCycles;
-		}*/
+		if (regPageCross) {
+			extraCycles = opinfo.pageCrossCycle;
+		}
 		operand = coerce_address(operand);
 		break;
 
@@ -159,7 +933,12 @@ MAGSNES::byte CPU::execute(const MAGSNES::byte opcode) {
 	}
 
 	OpCallback tmpProc = opinfo.instr;
-	MAGSNES::byte cyclesTaken = tmpProc(operand, addrMode, *this);
+
+	if (clockCallback != nullptr) {
+		set_access_cycles(opinfo, extraCycles);
+	}
+
+	MAGSNES::byte cyclesTaken = tmpProc(operand, *this);
 	return cyclesTaken + extraCycles;
 }
 
@@ -170,7 +949,7 @@ const MAGSNES::byte CPU::handle_interrupt() {
 		push_byte(regPC); //regPC will be coerced to a byte here
 		push_byte(flagsToP());
 
-		flagI = true;
+		set_I(true);
 		regPC = refMM[VECTOR_NMI] | (refMM[VECTOR_NMI + 1] << 8);
 
 	} else if (regInterrupt == INTERRUPT_DMA) {
@@ -183,7 +962,7 @@ const MAGSNES::byte CPU::handle_interrupt() {
 		push_byte(regPC); //regPC will be coerced to a MAGSNES::byte here
 		push_byte(flagsToP() | 0x10); //Set flagB in the version of the flags we push (as per CPU manual)
 
-		flagI = true;
+		set_I(true);
 		regPC = refMM[VECTOR_IRQ] | (refMM[VECTOR_IRQ + 1] << 8);
 
 	} else { //reset
@@ -229,107 +1008,267 @@ FORCEINLINE MAGSNES::byte CPU::pop_byte() {
 	return refMM[regSP + STACK_OFFSET];
 }
 
-//Each opcode serves as an index into this array. Illegal opcodes
-//point to ERR as their callback, which will raise an exception.
-const CPU::OpInfo CPU::opcodeVector[0x100] = {
-
-	/* 0x00 */{ BRK, IMPLIED },					{ ORA, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x04 */{ ERR, 0 },								{ ORA, ZERO_PAGE },						{ ASL, ZERO_PAGE },					{ ERR, 0 },
-	/* 0x08 */{ PHP, IMPLIED },					{ ORA, IMMEDIATE },						{ ASL, ACCUMULATOR },				{ ERR, 0 },
-	/* 0x0C */{ ERR, 0 },								{ ORA, ABSOLUTE },						{ ASL, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0x10 */{ BPL, RELATIVE },				{ ORA, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x14 */{ ERR, 0 },								{ ORA, ZERO_PAGE_X },					{ ASL, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0x18 */{ CLC, IMPLIED },					{ ORA, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x1C */{ ERR, 0 },								{ ORA, ABSOLUTE_X },					{ ASL, ABSOLUTE_X },				{ ERR, 0 },
-
-	/* 0x20 */{ JSR, ABSOLUTE },				{ AND, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x24 */{ BIT, ZERO_PAGE },				{ AND, ZERO_PAGE },						{ ROL, ZERO_PAGE },					{ ERR, 0 },
-	/* 0x28 */{ PLP, IMPLIED },					{ AND, IMMEDIATE },						{ ROL, ACCUMULATOR },				{ ERR, 0 },
-	/* 0x2C */{ BIT, ABSOLUTE },				{ AND, ABSOLUTE },						{ ROL, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0x30 */{ BMI, RELATIVE },				{ AND, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x34 */{ ERR, 0 },								{ AND, ZERO_PAGE_X },					{ ROL, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0x38 */{ SEC, IMPLIED },         { AND, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x3C */{ ERR, 0 },								{ AND, ABSOLUTE_X },					{ ROL, ABSOLUTE_X },				{ ERR, 0 },
-
-	/* 0x40 */{ RTI, IMPLIED },					{ EOR, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x44 */{ ERR, 0 },								{ EOR, ZERO_PAGE },						{ LSR, ZERO_PAGE },					{ ERR, 0 },
-	/* 0x48 */{ PHA, IMPLIED },					{ EOR, IMMEDIATE },						{ LSR, ACCUMULATOR },				{ ERR, 0 },
-	/* 0x4C */{ JMP, ABSOLUTE },				{ EOR, ABSOLUTE },						{ LSR, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0x50 */{ BVC, RELATIVE },				{ EOR, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x54 */{ ERR, 0 },								{ EOR, ZERO_PAGE_X },					{ LSR, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0x58 */{ CLI, IMPLIED },					{ EOR, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x5C */{ ERR, 0 },								{ EOR, ABSOLUTE_X },					{ LSR, ABSOLUTE_X },				{ ERR, 0 },
-
-	/* 0x60 */{ RTS, IMPLIED },					{ ADC, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x64 */{ ERR, 0 },								{ ADC, ZERO_PAGE },						{ ROR, ZERO_PAGE },					{ ERR, 0 },
-	/* 0x68 */{ PLA, IMPLIED },					{ ADC, IMMEDIATE },						{ ROR, ACCUMULATOR },				{ ERR, 0 },
-	/* 0x6C */{ JMP, ABSOLUTE_INDIRECT },{ ADC, ABSOLUTE },						{ ROR, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0x70 */{ BVS, RELATIVE },				{ ADC, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x74 */{ ERR, 0 },								{ ADC, ZERO_PAGE_X },					{ ROR, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0x78 */{ SEI, IMPLIED },					{ ADC, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x7C */{ ERR, 0 },								{ ADC, ABSOLUTE_X },					{ ROR, ABSOLUTE_X },				{ ERR, 0 },
-
-	/* 0x80 */{ ERR, 0 },								{ STA, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x84 */{ STY, ZERO_PAGE },				{ STA, ZERO_PAGE },						{ STX, ZERO_PAGE },					{ ERR, 0 },
-	/* 0x88 */{ DEY, IMPLIED },					{ ERR, 0 },										{ TXA, IMPLIED },						{ ERR, 0 },
-	/* 0x8C */{ STY, ABSOLUTE },				{ STA, ABSOLUTE },						{ STX, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0x90 */{ BCC, RELATIVE },				{ STA, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0x94 */{ STY, ZERO_PAGE_X },			{ STA, ZERO_PAGE_X },					{ STX, ZERO_PAGE_Y },				{ ERR, 0 },
-	/* 0x98 */{ TYA, IMPLIED },					{ STA, ABSOLUTE_Y },					{ TXS, IMPLIED },						{ ERR, 0 },
-	/* 0x9C */{ ERR, 0 },								{ STA, ABSOLUTE_X },					{ ERR, 0 },									{ ERR, 0 },
-
-	/* 0xA0 */{ LDY, IMMEDIATE },				{ LDA, INDIRECT_X },					{ LDX, IMMEDIATE },					{ ERR, 0 },
-	/* 0xA4 */{ LDY, ZERO_PAGE },				{ LDA, ZERO_PAGE },						{ LDX, ZERO_PAGE },					{ ERR, 0 },
-	/* 0xA8 */{ TAY, IMPLIED },					{ LDA, IMMEDIATE },						{ TAX, IMPLIED },						{ ERR, 0 },
-	/* 0xAC */{ LDY, ABSOLUTE },				{ LDA, ABSOLUTE },						{ LDX, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0xB0 */{ BCS, RELATIVE },				{ LDA, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xB4 */{ LDY, ZERO_PAGE_X },			{ LDA, ZERO_PAGE_X },					{ LDX, ZERO_PAGE_Y },				{ ERR, 0 },
-	/* 0xB8 */{ CLV, IMPLIED },					{ LDA, ABSOLUTE_Y },					{ TSX, IMPLIED },						{ ERR, 0 },
-	/* 0xBC */{ LDY, ABSOLUTE_X },			{ LDA, ABSOLUTE_X },					{ LDX, ABSOLUTE_Y },				{ ERR, 0 },
-
-	/* 0xC0 */{ CPY, IMMEDIATE },				{ CMP, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xC4 */{ CPY, ZERO_PAGE },				{ CMP, ZERO_PAGE },						{ DEC, ZERO_PAGE },					{ ERR, 0 },
-	/* 0xC8 */{ INY, IMPLIED },					{ CMP, IMMEDIATE },						{ DEX, IMPLIED },						{ ERR, 0 },
-	/* 0xCC */{ CPY, ABSOLUTE },				{ CMP, ABSOLUTE },						{ DEC, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0xD0 */{ BNE, RELATIVE },				{ CMP, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xD4 */{ ERR, 0 },								{ CMP, ZERO_PAGE_X },					{ DEC, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0xD8 */{ CLD, IMPLIED },					{ CMP, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xDC */{ ERR, 0 },								{ CMP, ABSOLUTE_X },					{ DEC, ABSOLUTE_X },				{ ERR, 0 },
-
-	/* 0xE0 */{ CPX, IMMEDIATE },				{ SBC, INDIRECT_X },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xE4 */{ CPX, ZERO_PAGE },				{ SBC, ZERO_PAGE },						{ INC, ZERO_PAGE },					{ ERR, 0 },
-	/* 0xE8 */{ INX, IMPLIED },					{ SBC, IMMEDIATE },						{ NOP, IMPLIED },						{ ERR, 0 },
-	/* 0xEC */{ CPX, ABSOLUTE },				{ SBC, ABSOLUTE },						{ INC, ABSOLUTE },					{ ERR, 0 },
-
-	/* 0xF0 */{ BEQ, RELATIVE },				{ SBC, INDIRECT_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xF4 */{ ERR, 0 },								{ SBC, ZERO_PAGE_X },					{ INC, ZERO_PAGE_X },				{ ERR, 0 },
-	/* 0xF8 */{ SED, IMPLIED },					{ SBC, ABSOLUTE_Y },					{ ERR, 0 },									{ ERR, 0 },
-	/* 0xFC */{ ERR, 0 },								{ SBC, ABSOLUTE_X },					{ INC, ABSOLUTE_X },				{ ERR, 0 },
-
+#ifdef CPU_PACKED_FLAGS
+//FLAG_Z for 0, FLAG_N for 0x80 to 0xFF
+const MAGSNES::byte CPU::NZ_TABLE[0x100] = {
+	/* 0x00 */ 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x10 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x20 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x30 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x40 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x50 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x60 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x70 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x80 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0x90 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xA0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xB0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xC0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xD0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xE0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	/* 0xF0 */ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
 };
+#endif
 
-/*
-These are the functions which encapsulate instruction logic. Each instruction returns the
-number of cycles taken, based on the given addressing mode. Each of these functions
-can be pointed to by an OpCallback pointer.
+__FILESCOPE__{
+	//*****Opcode table generation*****
+	//An opcode's bits are aaabbbcc. cc picks one of four groups, and within a group bbb mostly picks the addressing mode and aaa
+	//the instruction. Group 11 is all unofficial; most of it does the group 10 and group 01 instructions with the same aaa one
+	//after the other (SLO is ASL then ORA, DCP is DEC then CMP, and so on), in group 01's addressing modes.
+	//These have to stay single expressions for MSVC 2015's constexpr.
+
+	constexpr MAGSNES::byte op_aaa(const MAGSNES::byte opcode) { return opcode >> 5; }
+	constexpr MAGSNES::byte op_bbb(const MAGSNES::byte opcode) { return (opcode >> 2) & 0x07; }
+	constexpr MAGSNES::byte op_cc(const MAGSNES::byte opcode) { return opcode & 0x03; }
+
+	//Addressing modes by bbb; groups 01 and 11 share theirs
+	constexpr MAGSNES::byte GROUP_00_MODES[8] = {
+		CPU::IMMEDIATE, CPU::ZERO_PAGE, CPU::IMPLIED, CPU::ABSOLUTE, CPU::RELATIVE, CPU::ZERO_PAGE_X, CPU::IMPLIED, CPU::ABSOLUTE_X
+	};
+	constexpr MAGSNES::byte GROUP_01_MODES[8] = {
+		CPU::INDIRECT_X, CPU::ZERO_PAGE, CPU::IMMEDIATE, CPU::ABSOLUTE, CPU::INDIRECT_Y, CPU::ZERO_PAGE_X, CPU::ABSOLUTE_Y, CPU::ABSOLUTE_X
+	};
+	constexpr MAGSNES::byte GROUP_10_MODES[8] = {
+		CPU::IMMEDIATE, CPU::ZERO_PAGE, CPU::ACCUMULATOR, CPU::ABSOLUTE, CPU::IMPLIED, CPU::ZERO_PAGE_X, CPU::IMPLIED, CPU::ABSOLUTE_X
+	};
+
+	//Group 00 is too irregular for anything but a full table, by bbb then aaa. $9C is SHY, which isn't emulated.
+	constexpr MAGSNES::byte GROUP_00_MNEMONICS[8][8] = {
+		{ CPU::MN_BRK, CPU::MN_JSR, CPU::MN_RTI, CPU::MN_RTS, CPU::MN_NOP, CPU::MN_LDY, CPU::MN_CPY, CPU::MN_CPX },
+		{ CPU::MN_NOP, CPU::MN_BIT, CPU::MN_NOP, CPU::MN_NOP, CPU::MN_STY, CPU::MN_LDY, CPU::MN_CPY, CPU::MN_CPX },
+		{ CPU::MN_PHP, CPU::MN_PLP, CPU::MN_PHA, CPU::MN_PLA, CPU::MN_DEY, CPU::MN_TAY, CPU::MN_INY, CPU::MN_INX },
+		{ CPU::MN_NOP, CPU::MN_BIT, CPU::MN_JMP, CPU::MN_JMP, CPU::MN_STY, CPU::MN_LDY, CPU::MN_CPY, CPU::MN_CPX },
+		{ CPU::MN_BPL, CPU::MN_BMI, CPU::MN_BVC, CPU::MN_BVS, CPU::MN_BCC, CPU::MN_BCS, CPU::MN_BNE, CPU::MN_BEQ },
+		{ CPU::MN_NOP, CPU::MN_NOP, CPU::MN_NOP, CPU::MN_NOP, CPU::MN_STY, CPU::MN_LDY, CPU::MN_NOP, CPU::MN_NOP },
+		{ CPU::MN_CLC, CPU::MN_SEC, CPU::MN_CLI, CPU::MN_SEI, CPU::MN_TYA, CPU::MN_CLV, CPU::MN_CLD, CPU::MN_SED },
+		{ CPU::MN_NOP, CPU::MN_NOP, CPU::MN_NOP, CPU::MN_NOP, CPU::MN_ERR, CPU::MN_LDY, CPU::MN_NOP, CPU::MN_NOP }
+	};
+
+	//The rest by aaa
+	constexpr MAGSNES::byte GROUP_01_MNEMONICS[8] = {
+		CPU::MN_ORA, CPU::MN_AND, CPU::MN_EOR, CPU::MN_ADC, CPU::MN_STA, CPU::MN_LDA, CPU::MN_CMP, CPU::MN_SBC
+	};
+	constexpr MAGSNES::byte GROUP_10_MNEMONICS[8] = {
+		CPU::MN_ASL, CPU::MN_ROL, CPU::MN_LSR, CPU::MN_ROR, CPU::MN_STX, CPU::MN_LDX, CPU::MN_DEC, CPU::MN_INC
+	};
+	//bbb = 010, where group 10 works on registers
+	constexpr MAGSNES::byte GROUP_10_REGISTER_MNEMONICS[8] = {
+		CPU::MN_ASL, CPU::MN_ROL, CPU::MN_LSR, CPU::MN_ROR, CPU::MN_TXA, CPU::MN_TAX, CPU::MN_DEX, CPU::MN_NOP
+	};
+	constexpr MAGSNES::byte GROUP_11_MNEMONICS[8] = {
+		CPU::MN_SLO, CPU::MN_RLA, CPU::MN_SRE, CPU::MN_RRA, CPU::MN_SAX, CPU::MN_LAX, CPU::MN_DCP, CPU::MN_ISC
+	};
+	//bbb = 010, which doesn't follow the pattern. $8B is XAA, which isn't emulated; $AB is LAX, taken as the stable
+	//A = X = operand.
+	constexpr MAGSNES::byte GROUP_11_IMMEDIATE_MNEMONICS[8] = {
+		CPU::MN_ANC, CPU::MN_ANC, CPU::MN_ALR, CPU::MN_ARR, CPU::MN_ERR, CPU::MN_LAX, CPU::MN_AXS, CPU::MN_SBC
+	};
+
+	//Cycles by access type, then addressing mode. Stores and read-modify-writes always spend the page cross cycle.
+	constexpr MAGSNES::byte ACCESS_CYCLES[4][CPU::ADDR_MODE_TOTAL] = {
+		/* ACCESS_NONE */	{ 0, 2, 0, 0, 0, 0, 0, 0, 0, 2, 2, 0, 0, 0 },
+		/* ACCESS_READ */	{ 0, 0, 2, 3, 4, 4, 4, 4, 4, 0, 0, 6, 5, 0 },
+		/* ACCESS_WRITE */	{ 0, 0, 0, 3, 4, 4, 4, 5, 5, 0, 0, 6, 6, 0 },
+		/* ACCESS_RMW */	{ 0, 0, 0, 5, 6, 6, 6, 7, 7, 0, 0, 8, 8, 0 }
+	};
+
+	constexpr MAGSNES::byte decode_group_10(const MAGSNES::byte opcode) {
+		return (op_bbb(opcode) == 0) ? ((op_aaa(opcode) == 5) ? CPU::MN_LDX : (op_aaa(opcode) >= 4) ? CPU::MN_NOP : CPU::MN_ERR) :
+			(op_bbb(opcode) == 2) ? GROUP_10_REGISTER_MNEMONICS[op_aaa(opcode)] :
+			(op_bbb(opcode) == 4) ? CPU::MN_ERR :
+			(op_bbb(opcode) == 6) ? ((op_aaa(opcode) == 4) ? CPU::MN_TXS : (op_aaa(opcode) == 5) ? CPU::MN_TSX : CPU::MN_NOP) :
+			(opcode == 0x9E) ? CPU::MN_ERR :
+			GROUP_10_MNEMONICS[op_aaa(opcode)];
+	}
 
-Note that these functions set refBus's readBus and writeBus appropriately.
-*/
+	constexpr MAGSNES::byte decode_group_11(const MAGSNES::byte opcode) {
+		return (op_bbb(opcode) == 2) ? GROUP_11_IMMEDIATE_MNEMONICS[op_aaa(opcode)] :
+			((opcode == 0x93) || (opcode == 0x9B) || (opcode == 0x9F) || (opcode == 0xBB)) ? CPU::MN_ERR :
+			GROUP_11_MNEMONICS[op_aaa(opcode)];
+	}
 
-//Add memory and regA with carry
-MAGSNES::byte CPU::ADC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	word operand = context.read_byte(address);
+	//MN_ERR for KIL, and for the unofficial opcodes whose results depend on the chip (XAA, AHX, TAS, SHX, SHY, LAS)
+	constexpr MAGSNES::byte decode_mnemonic(const MAGSNES::byte opcode) {
+		return (op_cc(opcode) == 0) ? GROUP_00_MNEMONICS[op_bbb(opcode)][op_aaa(opcode)] :
+			(op_cc(opcode) == 1) ? ((opcode == 0x89) ? CPU::MN_NOP : GROUP_01_MNEMONICS[op_aaa(opcode)]) :
+			(op_cc(opcode) == 2) ? decode_group_10(opcode) :
+			decode_group_11(opcode);
+	}
+
+	constexpr MAGSNES::byte group_addr_mode(const MAGSNES::byte opcode) {
+		return (op_cc(opcode) == 0) ? GROUP_00_MODES[op_bbb(opcode)] :
+			(op_cc(opcode) == 2) ? GROUP_10_MODES[op_bbb(opcode)] :
+			GROUP_01_MODES[op_bbb(opcode)];
+	}
+
+	//STX, LDX, SAX and LAX index with regY where the rest of their groups use regX
+	constexpr bool uses_Y_index(const MAGSNES::byte opcode) {
+		return (op_cc(opcode) >= 2) && ((op_aaa(opcode) == 4) || (op_aaa(opcode) == 5));
+	}
+
+	constexpr MAGSNES::byte decode_addr_mode(const MAGSNES::byte opcode) {
+		return (decode_mnemonic(opcode) == CPU::MN_ERR) ? CPU::ADDR_MODE_NONE :
+			//BRK, RTI, RTS, JSR and JMP (indirect) don't follow the group 00 modes
+			((opcode == 0x00) || (opcode == 0x40) || (opcode == 0x60)) ? CPU::IMPLIED :
+			(opcode == 0x20) ? CPU::ABSOLUTE :
+			(opcode == 0x6C) ? CPU::ABSOLUTE_INDIRECT :
+			//TXA, TAX, DEX and NOP don't touch regA
+			((op_cc(opcode) == 2) && (op_bbb(opcode) == 2) && (op_aaa(opcode) >= 4)) ? CPU::IMPLIED :
+			(uses_Y_index(opcode) && (group_addr_mode(opcode) == CPU::ZERO_PAGE_X)) ? CPU::ZERO_PAGE_Y :
+			(uses_Y_index(opcode) && (group_addr_mode(opcode) == CPU::ABSOLUTE_X)) ? CPU::ABSOLUTE_Y :
+			group_addr_mode(opcode);
+	}
 
-	word result = operand + context.regA + context.flagC;
+	constexpr bool is_RMW_mnemonic(const MAGSNES::byte mnemonic) {
+		return (mnemonic == CPU::MN_ASL) || (mnemonic == CPU::MN_LSR) || (mnemonic == CPU::MN_ROL) || (mnemonic == CPU::MN_ROR) ||
+			(mnemonic == CPU::MN_INC) || (mnemonic == CPU::MN_DEC) || (mnemonic == CPU::MN_SLO) || (mnemonic == CPU::MN_RLA) ||
+			(mnemonic == CPU::MN_SRE) || (mnemonic == CPU::MN_RRA) || (mnemonic == CPU::MN_DCP) || (mnemonic == CPU::MN_ISC);
+	}
 
-	context.flagC = (result > 0xFF) ? true : false;
+	constexpr MAGSNES::byte decode_access(const MAGSNES::byte opcode) {
+		return ((decode_addr_mode(opcode) == CPU::ADDR_MODE_NONE) || (decode_addr_mode(opcode) == CPU::ACCUMULATOR) ||
+			(decode_addr_mode(opcode) == CPU::IMPLIED) || (decode_addr_mode(opcode) == CPU::RELATIVE) ||
+			(decode_mnemonic(opcode) == CPU::MN_JMP) || (decode_mnemonic(opcode) == CPU::MN_JSR)) ? CPU::ACCESS_NONE :
+			((decode_mnemonic(opcode) == CPU::MN_STA) || (decode_mnemonic(opcode) == CPU::MN_STX) ||
+			(decode_mnemonic(opcode) == CPU::MN_STY) || (decode_mnemonic(opcode) == CPU::MN_SAX)) ? CPU::ACCESS_WRITE :
+			is_RMW_mnemonic(decode_mnemonic(opcode)) ? CPU::ACCESS_RMW :
+			CPU::ACCESS_READ;
+	}
+
+	//Branches are the not taken count
+	constexpr MAGSNES::byte decode_cycles(const MAGSNES::byte opcode) {
+		return (decode_mnemonic(opcode) == CPU::MN_ERR) ? 0 :
+			(decode_mnemonic(opcode) == CPU::MN_BRK) ? 7 :
+			((decode_mnemonic(opcode) == CPU::MN_JSR) || (decode_mnemonic(opcode) == CPU::MN_RTI) ||
+			(decode_mnemonic(opcode) == CPU::MN_RTS)) ? 6 :
+			(decode_mnemonic(opcode) == CPU::MN_JMP) ? ((decode_addr_mode(opcode) == CPU::ABSOLUTE) ? 3 : 5) :
+			((decode_mnemonic(opcode) == CPU::MN_PHA) || (decode_mnemonic(opcode) == CPU::MN_PHP)) ? 3 :
+			((decode_mnemonic(opcode) == CPU::MN_PLA) || (decode_mnemonic(opcode) == CPU::MN_PLP)) ? 4 :
+			ACCESS_CYCLES[decode_access(opcode)][decode_addr_mode(opcode)];
+	}
+
+	constexpr MAGSNES::byte decode_page_cross_cycle(const MAGSNES::byte opcode) {
+		return ((decode_access(opcode) == CPU::ACCESS_READ) && ((decode_addr_mode(opcode) == CPU::ABSOLUTE_X) ||
+			(decode_addr_mode(opcode) == CPU::ABSOLUTE_Y) || (decode_addr_mode(opcode) == CPU::INDIRECT_Y))) ? 1 : 0;
+	}
+}
+
+//Each opcode gets its own instance, with its instruction, addressing mode and cycles all constants
+template <MAGSNES::byte OPCODE>
+MAGSNES::byte CPU::run_opcode(word address, CPU &context) {
+	constexpr MAGSNES::byte MODE = decode_addr_mode(OPCODE);
+	constexpr MAGSNES::byte CYCLES = decode_cycles(OPCODE);
+
+	switch (decode_mnemonic(OPCODE)) {
+	case MN_ADC: return CYCLES + ADC(address, context);
+	case MN_AND: return CYCLES + AND(address, context);
+	case MN_ASL: return CYCLES + ASL<MODE>(address, context);
+	case MN_BCC: return CYCLES + BCC(address, context);
+	case MN_BCS: return CYCLES + BCS(address, context);
+	case MN_BEQ: return CYCLES + BEQ(address, context);
+	case MN_BIT: return CYCLES + BIT(address, context);
+	case MN_BMI: return CYCLES + BMI(address, context);
+	case MN_BNE: return CYCLES + BNE(address, context);
+	case MN_BPL: return CYCLES + BPL(address, context);
+	case MN_BRK: return CYCLES + BRK(address, context);
+	case MN_BVC: return CYCLES + BVC(address, context);
+	case MN_BVS: return CYCLES + BVS(address, context);
+	case MN_CLC: return CYCLES + CLC(address, context);
+	case MN_CLD: return CYCLES + CLD(address, context);
+	case MN_CLI: return CYCLES + CLI(address, context);
+	case MN_CLV: return CYCLES + CLV(address, context);
+	case MN_CMP: return CYCLES + CMP(address, context);
+	case MN_CPX: return CYCLES + CPX(address, context);
+	case MN_CPY: return CYCLES + CPY(address, context);
+	case MN_DEC: return CYCLES + DEC(address, context);
+	case MN_DEX: return CYCLES + DEX(address, context);
+	case MN_DEY: return CYCLES + DEY(address, context);
+	case MN_EOR: return CYCLES + EOR(address, context);
+	case MN_INC: return CYCLES + INC(address, context);
+	case MN_INX: return CYCLES + INX(address, context);
+	case MN_INY: return CYCLES + INY(address, context);
+	case MN_JMP: return CYCLES + JMP(address, context);
+	case MN_JSR: return CYCLES + JSR(address, context);
+	case MN_LDA: return CYCLES + LDA(address, context);
+	case MN_LDX: return CYCLES + LDX(address, context);
+	case MN_LDY: return CYCLES + LDY(address, context);
+	case MN_LSR: return CYCLES + LSR<MODE>(address, context);
+	case MN_NOP: return CYCLES + NOP<MODE>(address, context);
+	case MN_ORA: return CYCLES + ORA(address, context);
+	case MN_PHA: return CYCLES + PHA(address, context);
+	case MN_PHP: return CYCLES + PHP(address, context);
+	case MN_PLA: return CYCLES + PLA(address, context);
+	case MN_PLP: return CYCLES + PLP(address, context);
+	case MN_ROL: return CYCLES + ROL<MODE>(address, context);
+	case MN_ROR: return CYCLES + ROR<MODE>(address, context);
+	case MN_RTI: return CYCLES + RTI(address, context);
+	case MN_RTS: return CYCLES + RTS(address, context);
+	case MN_SBC: return CYCLES + SBC(address, context);
+	case MN_SEC: return CYCLES + SEC(address, context);
+	case MN_SED: return CYCLES + SED(address, context);
+	case MN_SEI: return CYCLES + SEI(address, context);
+	case MN_STA: return CYCLES + STA(address, context);
+	case MN_STX: return CYCLES + STX(address, context);
+	case MN_STY: return CYCLES + STY(address, context);
+	case MN_TAX: return CYCLES + TAX(address, context);
+	case MN_TAY: return CYCLES + TAY(address, context);
+	case MN_TSX: return CYCLES + TSX(address, context);
+	case MN_TXA: return CYCLES + TXA(address, context);
+	case MN_TXS: return CYCLES + TXS(address, context);
+	case MN_TYA: return CYCLES + TYA(address, context);
+	case MN_ALR: return CYCLES + ALR(address, context);
+	case MN_ANC: return CYCLES + ANC(address, context);
+	case MN_ARR: return CYCLES + ARR(address, context);
+	case MN_AXS: return CYCLES + AXS(address, context);
+	case MN_DCP: return CYCLES + DCP(address, context);
+	case MN_ISC: return CYCLES + ISC(address, context);
+	case MN_LAX: return CYCLES + LAX(address, context);
+	case MN_RLA: return CYCLES + RLA(address, context);
+	case MN_RRA: return CYCLES + RRA(address, context);
+	case MN_SAX: return CYCLES + SAX(address, context);
+	case MN_SLO: return CYCLES + SLO(address, context);
+	case MN_SRE: return CYCLES + SRE(address, context);
+	default: return ERR(address, context);
+	}
+}
+
+template <size_t... OPCODES>
+constexpr CPU::OpcodeTable CPU::make_opcode_table(std::index_sequence<OPCODES...>) {
+	return OpcodeTable{ {
+		OpInfo{ &run_opcode<OPCODES>, decode_addr_mode(OPCODES), decode_mnemonic(OPCODES), decode_access(OPCODES),
+			decode_cycles(OPCODES), decode_page_cross_cycle(OPCODES) }...
+	} };
+}
+
+//Each opcode serves as an index into this table. Opcodes that aren't emulated have
+//ADDR_MODE_NONE and run ERR, which will raise an exception.
+const CPU::OpcodeTable CPU::opcodeVector = CPU::make_opcode_table(std::make_index_sequence<0x100>());
+
+//regA + operand + flagC -> regA
+FORCEINLINE void CPU::add_with_carry(const MAGSNES::byte operand) {
+	word result = operand + regA + get_C();
+
+	set_C(result > 0xFF);
 
 	result &= 0xFF;
 
@@ -338,72 +1277,44 @@ MAGSNES::byte CPU::ADC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 	//checks if pos + pos = neg OR neg + neg = pos
 	//For example, we would expect two positives to always sum to a positive, but the signed byte
 	//may say otherwise (i.e. 64 + 65 = 129, but signed it is -127)
-	context.flagV = (!((context.regA ^ operand) & 0x80) && ((context.regA ^ result) & 0x80)) ? true : false;
-	context.flagZ = (result == 0) ? true : false;
-	context.flagN = (result & 0x80) ? true : false;
+	set_V(~(regA ^ operand) & (regA ^ result));
+	set_NZ(result);
 
-	context.regA = result;
+	regA = result;
+}
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+/*
+These are the functions which encapsulate instruction logic. Each instruction returns the
+cycles it takes beyond its opcodeVector entry, which is only ever nonzero for a branch taken.
+They are called through run_opcode, which can be pointed to by an OpCallback pointer.
+
+Note that these functions set refBus's readBus and writeBus appropriately.
+*/
+
+//Add memory and regA with carry
+MAGSNES::byte CPU::ADC(word address, CPU &context) {
+	context.add_with_carry(context.read_byte(address));
+
+	return 0;
 }
 
 
 //AND regA with memory
-MAGSNES::byte CPU::AND(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::AND(word address, CPU &context) {
 	word operand = context.read_byte(address);
 
 	context.regA &= operand;
 	word result = context.regA;
-	context.flagN = (result & 0x80) ? true : false;
-	context.flagZ = (result == 0) ? true : false;
+	context.set_NZ(result);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ZERO_PAGE_Y:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Shift memory or accumulator left by one bit.
 //Can operate directly on memory.
 //flagC = memory OR regA & 0x80; memory/regA <<= 1
-MAGSNES::byte CPU::ASL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+template <MAGSNES::byte ADDR_MODE>
+MAGSNES::byte CPU::ASL(word address, CPU &context) {
 	word operand;
 
 	//Operate on regA (addr is the val of regA)
@@ -419,35 +1330,21 @@ MAGSNES::byte CPU::ASL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.write_byte(address, operand);
 	}
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = ((operand & 0xFF) == 0) ? true : false;
-	context.flagC = (operand > 0xFF) ? true : false;
+	context.set_NZ(operand);
+	context.set_C(operand > 0xFF);
 
-	switch (ADDR_MODE) {
-	case ACCUMULATOR:
-		return 2;
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return  6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Branch on flagC === false (Carry Clear)
-MAGSNES::byte CPU::BCC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BCC(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (!context.flagC) {
+	if (!context.get_C()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -457,18 +1354,18 @@ MAGSNES::byte CPU::BCC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Branch on flagC === true (Carry Set)
-MAGSNES::byte CPU::BCS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BCS(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (context.flagC) {
+	if (context.get_C()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -478,18 +1375,18 @@ MAGSNES::byte CPU::BCS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Branch on flagZ === true (Equals Zero)
-MAGSNES::byte CPU::BEQ(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BEQ(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (context.flagZ) {
+	if (context.get_Z()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -499,40 +1396,32 @@ MAGSNES::byte CPU::BEQ(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Test bits in memory with regA
 //set flagN if bit 7 is set in operand
 //set flagV if bit 6 is set in operand
 //set flagZ if regA & operand === 0
-MAGSNES::byte CPU::BIT(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BIT(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
 	MAGSNES::byte tmp = context.regA & operand;
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagV = (operand & 0x40) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(operand, tmp);
+	context.set_V(operand << 1);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Branch on flagN === true (result MInus)
-MAGSNES::byte CPU::BMI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BMI(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (context.flagN) {
+	if (context.get_N()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -542,18 +1431,18 @@ MAGSNES::byte CPU::BMI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Branch on flagZ === false (Not Zero)
-MAGSNES::byte CPU::BNE(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BNE(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (!context.flagZ) {
+	if (!context.get_Z()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -563,18 +1452,18 @@ MAGSNES::byte CPU::BNE(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Branch on flagN === false (result PLus)
-MAGSNES::byte CPU::BPL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BPL(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (!context.flagN) {
+	if (!context.get_N()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -587,7 +1476,7 @@ MAGSNES::byte CPU::BPL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		i++;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Force an IRQ.
@@ -595,7 +1484,7 @@ MAGSNES::byte CPU::BPL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 //then pushes the flags onto the stack.
 //Attends to the IRQ by putting the word at $FFFE into regPC.
 //Sets flagI to show that we are attending to an IRQ.
-MAGSNES::byte CPU::BRK(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BRK(word address, CPU &context) {
 	//Increment the PC we push to point past the current instruction, 
 	//otherwise we would return to the same instruction. Also, 6502 has a 'bug'
 	//where the return address skips over the MAGSNES::byte after the BRK instruction, 
@@ -611,21 +1500,21 @@ MAGSNES::byte CPU::BRK(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 	context.refMM[context.regSP + 0x100] = tmp;
 	context.regSP = (context.regSP - 1) & 0xFF;
 
-	context.flagI = true;
+	context.set_I(true);
 	context.regPC = context.refMM[VECTOR_IRQ] | (context.refMM[VECTOR_IRQ + 1] << 8);
 
-	return 7;
+	return 0;
 }
 
 //Branch on flagV === false (oVerflow Clear)
-MAGSNES::byte CPU::BVC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BVC(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (!context.flagV) {
+	if (!context.get_V()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -635,18 +1524,18 @@ MAGSNES::byte CPU::BVC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //Branch on flagV === true (oVerflow Set)
-MAGSNES::byte CPU::BVS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::BVS(word address, CPU &context) {
 	MAGSNES::byte extraCycles = 0;
 
 	word operand = context.refMM[address];
 	//Convert to signed byte
 	operand = (operand < 128) ? operand : operand - 256;
 
-	if (context.flagV) {
+	if (context.get_V()) {
 		word tmp = context.regPC + operand;
 		if ((context.regPC & 0xFF00) != (tmp & 0xFF00)) {
 			extraCycles = 2;
@@ -656,265 +1545,177 @@ MAGSNES::byte CPU::BVS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.regPC = tmp;
 	}
 
-	return extraCycles + 2;
+	return extraCycles;
 }
 
 //CLear flagC
-MAGSNES::byte CPU::CLC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagC = false;
-	return 2;
+MAGSNES::byte CPU::CLC(word address, CPU &context) {
+	context.set_C(false);
+	return 0;
 }
 
 //CLear flagD
-MAGSNES::byte CPU::CLD(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagD = false;
-	return 2;
+MAGSNES::byte CPU::CLD(word address, CPU &context) {
+	context.set_D(false);
+	return 0;
 }
 
 //CLear flagI
-MAGSNES::byte CPU::CLI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagI = false;
-	return 2;
+MAGSNES::byte CPU::CLI(word address, CPU &context) {
+	context.set_I(false);
+	return 0;
 }
 
 //CLear flagV
-MAGSNES::byte CPU::CLV(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagV = false;
-	return 2;
+MAGSNES::byte CPU::CLV(word address, CPU &context) {
+	context.set_V(0);
+	return 0;
 }
 
 //Compares memory and regA
-MAGSNES::byte CPU::CMP(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::CMP(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
 	MAGSNES::byte ra = context.regA;
 	MAGSNES::byte tmp = (ra - operand);
 
-	context.flagZ = (tmp == 0) ? true : false;
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagC = (ra >= operand) ? true : false;
+	context.set_NZ(tmp);
+	context.set_C(ra >= operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Compares memory and regX
-MAGSNES::byte CPU::CPX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::CPX(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
 	MAGSNES::byte rx = context.regX;
 	MAGSNES::byte tmp = (rx - operand);
 
-	context.flagZ = (tmp == 0) ? true : false;
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagC = (rx >= operand) ? true : false;
+	context.set_NZ(tmp);
+	context.set_C(rx >= operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Compares memory and regY
-MAGSNES::byte CPU::CPY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::CPY(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
 	MAGSNES::byte ry = context.regY;
 	MAGSNES::byte tmp = (ry - operand) & 0xFF;
 
-	context.flagZ = (tmp == 0) ? true : false;
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagC = (ry >= operand) ? true : false;
+	context.set_NZ(tmp);
+	context.set_C(ry >= operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Decrement a memory address by one
-MAGSNES::byte CPU::DEC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::DEC(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 	operand -= 1;
 	context.write_byte(address, operand);
 
 	MAGSNES::byte tmp = operand;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return 6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Decrement regX by one
-MAGSNES::byte CPU::DEX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::DEX(word address, CPU &context) {
 	context.regX--;
 	MAGSNES::byte tmp = context.regX;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Decrement regY by one
-MAGSNES::byte CPU::DEY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::DEY(word address, CPU &context) {
 	context.regY--;
 	MAGSNES::byte tmp = context.regY;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Exclusive OR (aka XOR) memory with regA, 
 //store result in regA
 //regA ^ operand -> regA
-MAGSNES::byte CPU::EOR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::EOR(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
 	MAGSNES::byte tmp = context.regA ^ operand;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
 	context.regA = tmp;
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //All invalid opcodes point to this callback. 
 //Note that this is not an actual 6502 instruction.
-MAGSNES::byte CPU::ERR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::ERR(word address, CPU &context) {
+#ifdef CPU_TRACE
+	//What led up to it is the most useful thing to have
+	if (context.trace != nullptr) {
+		context.trace->write_snapshot(CPU_TRACE_PATH);
+	}
+#endif
+
 	context.sysCore.alert_error("Invalid opcode detected! This most likely means that your ROM is invalid or corrupted. Closing ROM...");
 	return 0;
 }
 
 //INCremement a memory address by 1
-MAGSNES::byte CPU::INC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::INC(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 	operand += 1;
 	context.write_byte(address, operand);
 
 	MAGSNES::byte tmp = operand;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return 6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //INcrement regX by 1
-MAGSNES::byte CPU::INX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::INX(word address, CPU &context) {
 	context.regX++;
 	MAGSNES::byte tmp = context.regX;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //INcrement regY by 1
-MAGSNES::byte CPU::INY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::INY(word address, CPU &context) {
 	context.regY++;
 	MAGSNES::byte tmp = context.regY;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Unconditional jump to anywhere in memory
 //Move the address into PC
-MAGSNES::byte CPU::JMP(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::JMP(word address, CPU &context) {
 	context.regPC = address;
 
-	switch (ADDR_MODE) {
-	case ABSOLUTE:
-		return 3;
-	case ABSOLUTE_INDIRECT:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Unconditional Jump and Save Return address (a.k.a. Jump to SubRoutine)
-MAGSNES::byte CPU::JSR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::JSR(word address, CPU &context) {
 	word tmpPC = context.regPC - 1;
 	context.refMM[context.regSP + 0x100] = (tmpPC & 0xFF00) >> 8;
 	context.regSP = (context.regSP - 1) & 0xFF;
@@ -923,93 +1724,46 @@ MAGSNES::byte CPU::JSR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 
 	context.regPC = address;
 
-	return 6;
+	return 0;
 }
 
-//LoaD memory into regA, then set
-//flagN and flagZ accordingly
-MAGSNES::byte CPU::LDA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	MAGSNES::byte operand = context.read_byte(address);
-	context.regA = operand;
-
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
-
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+//LoaD memory into regA, then set
+//flagN and flagZ accordingly
+MAGSNES::byte CPU::LDA(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	context.regA = operand;
+
+	context.set_NZ(operand);
+
+	return 0;
 }
 
 //LoaD memory into regX
-MAGSNES::byte CPU::LDX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::LDX(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 	context.regX = operand;
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
+	context.set_NZ(operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_Y:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //LoaD memory into regY
-MAGSNES::byte CPU::LDY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::LDY(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 	context.regY = operand;
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
+	context.set_NZ(operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Shift right regA or value at address by 1.
 //bit that is shifted off the end is placed in flagC.
 //Since a 0 will always be shifted into bit 7, flagN is
 //always set to false. Set flagZ if result === 0.
-MAGSNES::byte CPU::LSR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+template <MAGSNES::byte ADDR_MODE>
+MAGSNES::byte CPU::LSR(word address, CPU &context) {
 	MAGSNES::byte bitShiftedOff;
 	word operand;
 
@@ -1026,194 +1780,138 @@ MAGSNES::byte CPU::LSR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 		context.write_byte(address, operand);
 	}
 
-	context.flagN = false;
-	context.flagZ = (operand == 0) ? true : false;
-	context.flagC = (bitShiftedOff == 1) ? true : false;
+	context.set_NZ(operand); //Bit 7 is always clear, so flagN ends up false
+	context.set_C(bitShiftedOff == 1);
 
-	switch (ADDR_MODE) {
-	case ACCUMULATOR:
-		return 2;
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return  6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //No OPeration
-MAGSNES::byte CPU::NOP(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	//Does nothing
+//The unofficial NOPs with a memory operand still read it
+template <MAGSNES::byte ADDR_MODE>
+MAGSNES::byte CPU::NOP(word address, CPU &context) {
+	if ((ADDR_MODE != IMPLIED) && (ADDR_MODE != IMMEDIATE)) {
+		context.read_byte(address);
+	}
+
 	return 0;
 }
 
 //OR memory with regA, store result in regA.
 //Adjust flagN and flagZ according to result.
-MAGSNES::byte CPU::ORA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::ORA(word address, CPU &context) {
 	MAGSNES::byte operand = (context.read_byte(address)) | context.regA;
 
 	context.regA = operand;
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
+	context.set_NZ(operand);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //PusH regA
-MAGSNES::byte CPU::PHA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::PHA(word address, CPU &context) {
 	context.refMM[context.regSP + 0x100] = context.regA;
 	context.regSP--;
 
-	return 3;
+	return 0;
 }
 
 //PusH regP (flags)
-MAGSNES::byte CPU::PHP(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::PHP(word address, CPU &context) {
 	//The documentation for this is obscure, but the 6502 DOES set the 
 	//B flag (bit 4 of P register) BEFORE pushing the flags. It is also expected
 	//that bit 5 (an unused flag) will be unaffected (always on).
 	context.refMM[context.regSP + 0x100] = context.flagsToP() | 0x30;
 	context.regSP--;
 
-	return 3;
+	return 0;
 }
 
 //Pop (aka PulL) from stack, place into regA
 //set flagN and flagZ accordingly
-MAGSNES::byte CPU::PLA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::PLA(word address, CPU &context) {
 	context.regSP++;
 	MAGSNES::byte tmp = context.refMM[context.regSP + 0x100];
 	context.regA = tmp;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 4;
+	return 0;
 }
 
 //Pop (aka PulL) from stack, place into flags
-MAGSNES::byte CPU::PLP(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::PLP(word address, CPU &context) {
 	context.regSP++;;
 	MAGSNES::byte tmp = context.refMM[context.regSP + 0x100];
 	context.pToFlags(tmp & 0xEF);
 
-	return 4;
+	return 0;
 }
 
 //ROtate regA or memory Left
 //flagC is shifted IN to bit 0
 //Store shifted off bit in flagC
 //Adjust flagN and flagZ accordingly
-MAGSNES::byte CPU::ROL(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+template <MAGSNES::byte ADDR_MODE>
+MAGSNES::byte CPU::ROL(word address, CPU &context) {
 	MAGSNES::byte bitShiftedOff, tmp, operand;
 
 	if (ADDR_MODE == ACCUMULATOR) {
 		bitShiftedOff = address & 0x80;
 		operand = address << 1;
-		operand |= context.flagC;
+		operand |= context.get_C();
 		context.regA = operand;
 	} else {
 		operand = context.read_byte(address);
 
 		bitShiftedOff = operand & 0x80;
 		operand <<= 1;
-		operand |= context.flagC;
+		operand |= context.get_C();
 
 		context.write_byte(address, operand);
 	}
 
-	context.flagC = (bitShiftedOff) ? true : false;
+	context.set_C(bitShiftedOff);
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
+	context.set_NZ(operand);
 
-	switch (ADDR_MODE) {
-	case ACCUMULATOR:
-		return 2;
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return  6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //ROtate regA or memory Right
 //same logic as ROL
-MAGSNES::byte CPU::ROR(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+template <MAGSNES::byte ADDR_MODE>
+MAGSNES::byte CPU::ROR(word address, CPU &context) {
 	MAGSNES::byte bitShiftedOff, operand;
 
 	if (ADDR_MODE == ACCUMULATOR) {
 		bitShiftedOff = address & 0x01;
 		operand = address >> 1;
-		operand = (context.flagC) ? (operand | 0x80) : operand;
+		operand = (context.get_C()) ? (operand | 0x80) : operand;
 		context.regA = operand;
 	} else {
 		operand = context.read_byte(address);
 
 		bitShiftedOff = operand & 0x01;
 		operand >>= 1;
-		operand = (context.flagC) ? (operand | 0x80) : operand;
+		operand = (context.get_C()) ? (operand | 0x80) : operand;
 
 		context.write_byte(address, operand);
 	}
 
-	context.flagC = (bitShiftedOff) ? true : false;
+	context.set_C(bitShiftedOff);
 
-	context.flagN = (operand & 0x80) ? true : false;
-	context.flagZ = (operand == 0) ? true : false;
+	context.set_NZ(operand);
 
-	switch (ADDR_MODE) {
-	case ACCUMULATOR:
-		return 2;
-	case ZERO_PAGE:
-		return 5;
-	case ABSOLUTE:
-		return  6;
-	case ZERO_PAGE_X:
-		return 6;
-	case ABSOLUTE_X:
-		return 7;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //ReTurn from Interrupt
 //First, pop MAGSNES::byte representing flags off of stack, 
 //and restore flags. Then, pop word off of stack, 
 //which will be put in PC.
-MAGSNES::byte CPU::RTI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::RTI(word address, CPU &context) {
 	context.regSP++;
 	MAGSNES::byte tmp = context.refMM[context.regSP + 0x100];
 
@@ -1227,13 +1925,13 @@ MAGSNES::byte CPU::RTI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 
 	context.regPC = tmp | (tmphi << 8);
 
-	return 6;
+	return 0;
 }
 
 //ReTurn from Subroutine
 //Pops word off the stack, then put it into regPC.
 //Flags are NOT affected!
-MAGSNES::byte CPU::RTS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::RTS(word address, CPU &context) {
 	context.regSP++;
 	MAGSNES::byte tmp = context.refMM[context.regSP + 0x100];
 
@@ -1243,7 +1941,7 @@ MAGSNES::byte CPU::RTS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 	//TODO: should the +1 cross a page boundary or wrap?
 	context.regPC = (tmp | (tmphi << 8)) + 1;
 
-	return 6;
+	return 0;
 }
 
 //SuBtract with Carry
@@ -1256,179 +1954,281 @@ MAGSNES::byte CPU::RTS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
 //differ, meaning the signed result was less than -128 or greater than
 //+127.
 //Set flagN and flagZ accordingly.
-MAGSNES::byte CPU::SBC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::SBC(word address, CPU &context) {
 	MAGSNES::byte operand = context.read_byte(address);
 
-	signed int result = context.regA - operand - (!context.flagC);
+	signed int result = context.regA - operand - (!context.get_C());
 
-	context.flagC = (result >= 0) ? true : false;
+	context.set_C(result >= 0);
 
 	result &= 0xFF;
 
 	//See ADC for overflow explanation
 	//Set overflow if pos - neg = neg OR neg - pos = pos
-	context.flagV = (((context.regA ^ operand) & 0x80) && ((context.regA ^ result) & 0x80)) ? true : false;
+	context.set_V((context.regA ^ operand) & (context.regA ^ result));
 
 	context.regA = result;
 
-	context.flagN = (result & 0x80) ? true : false;
-	context.flagZ = (result == 0) ? true : false;
+	context.set_NZ(result);
 
-	switch (ADDR_MODE) {
-	case IMMEDIATE:
-		return 2;
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //SEt flagC
-MAGSNES::byte CPU::SEC(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagC = true;
+MAGSNES::byte CPU::SEC(word address, CPU &context) {
+	context.set_C(true);
 
-	return 2;
+	return 0;
 }
 
 //SEt flagD
-MAGSNES::byte CPU::SED(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagD = true;
+MAGSNES::byte CPU::SED(word address, CPU &context) {
+	context.set_D(true);
 
-	return 2;
+	return 0;
 }
 
 //SEt flagI
-MAGSNES::byte CPU::SEI(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
-	context.flagI = true;
+MAGSNES::byte CPU::SEI(word address, CPU &context) {
+	context.set_I(true);
 
-	return 2;
+	return 0;
 }
 
 //STore regA in memory
-MAGSNES::byte CPU::STA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::STA(word address, CPU &context) {
 	context.write_byte(address, context.regA);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	case ABSOLUTE_X:
-		return 4;
-	case ABSOLUTE_Y:
-		return 4;
-	case INDIRECT_X:
-		return 6;
-	case INDIRECT_Y:
-		return 5;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //STore regX in memory
-MAGSNES::byte CPU::STX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::STX(word address, CPU &context) {
 	context.write_byte(address, context.regX);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_Y:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //STore regY in memory
-MAGSNES::byte CPU::STY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::STY(word address, CPU &context) {
 	context.write_byte(address, context.regY);
 
-	switch (ADDR_MODE) {
-	case ZERO_PAGE:
-		return 3;
-	case ABSOLUTE:
-		return 4;
-	case ZERO_PAGE_X:
-		return 4;
-	default:
-		return 3;
-	}
+	return 0;
 }
 
 //Transfer regA to regX
 //Value of regA does not change, adjust flagN and flagZ according to
 //the value transferred
-MAGSNES::byte CPU::TAX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TAX(word address, CPU &context) {
 	MAGSNES::byte tmp = context.regX = context.regA;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Transfer regA to regY
-MAGSNES::byte CPU::TAY(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TAY(word address, CPU &context) {
 	MAGSNES::byte tmp = context.regY = context.regA;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Transfer regSp to regX
-MAGSNES::byte CPU::TSX(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TSX(word address, CPU &context) {
 	MAGSNES::byte tmp = context.regX = context.regSP;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Transfer regX to regA
-MAGSNES::byte CPU::TXA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TXA(word address, CPU &context) {
 	MAGSNES::byte tmp = context.regA = context.regX;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
 }
 
 //Transfer regX to regSp
 //DOES NOT AFFECT FLAGS!!!
-MAGSNES::byte CPU::TXS(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TXS(word address, CPU &context) {
 	context.regSP = context.regX;
 
-	return 2;
+	return 0;
 }
 
 //Transfer regY to regA
-MAGSNES::byte CPU::TYA(word address, MAGSNES::byte ADDR_MODE, CPU &context) {
+MAGSNES::byte CPU::TYA(word address, CPU &context) {
 	MAGSNES::byte tmp = context.regA = context.regY;
 
-	context.flagN = (tmp & 0x80) ? true : false;
-	context.flagZ = (tmp == 0) ? true : false;
+	context.set_NZ(tmp);
 
-	return 2;
+	return 0;
+}
+
+/*
+Unofficial opcodes. Most do two official instructions in one, on a single
+read (and write) of memory.
+*/
+
+//AND regA with the operand, then LSR regA
+MAGSNES::byte CPU::ALR(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address) & context.regA;
+
+	context.set_C(operand & 0x01);
+	operand >>= 1;
+	context.regA = operand;
+
+	context.set_NZ(operand);
+
+	return 0;
+}
+
+//AND regA with the operand, and copy flagN into flagC
+MAGSNES::byte CPU::ANC(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address) & context.regA;
+	context.regA = operand;
+
+	context.set_NZ(operand);
+	context.set_C(operand & 0x80);
+
+	return 0;
+}
+
+//AND regA with the operand, then ROR regA.
+//flagC comes from bit 6 of the result, and flagV from bit 6 XOR bit 5.
+MAGSNES::byte CPU::ARR(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address) & context.regA;
+
+	operand >>= 1;
+	operand = (context.get_C()) ? (operand | 0x80) : operand;
+	context.regA = operand;
+
+	context.set_NZ(operand);
+	context.set_C(operand & 0x40);
+	context.set_V((operand << 1) ^ (operand << 2));
+
+	return 0;
+}
+
+//(regA AND regX) - operand -> regX, setting flags like CMP
+MAGSNES::byte CPU::AXS(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	MAGSNES::byte ax = context.regA & context.regX;
+
+	context.regX = ax - operand;
+
+	context.set_NZ(context.regX);
+	context.set_C(ax >= operand);
+
+	return 0;
+}
+
+//DEC memory, then CMP it with regA
+MAGSNES::byte CPU::DCP(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	operand -= 1;
+	context.write_byte(address, operand);
+
+	MAGSNES::byte ra = context.regA;
+	context.set_NZ(ra - operand);
+	context.set_C(ra >= operand);
+
+	return 0;
+}
+
+//INC memory, then SBC it from regA
+MAGSNES::byte CPU::ISC(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	operand += 1;
+	context.write_byte(address, operand);
+
+	//regA - operand - (NOT)flagC is regA + (NOT)operand + flagC
+	context.add_with_carry(operand ^ 0xFF);
+
+	return 0;
+}
+
+//LoaD memory into both regA and regX
+MAGSNES::byte CPU::LAX(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	context.regA = operand;
+	context.regX = operand;
+
+	context.set_NZ(operand);
+
+	return 0;
+}
+
+//ROL memory, then AND it with regA
+MAGSNES::byte CPU::RLA(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	MAGSNES::byte bitShiftedOff = operand & 0x80;
+
+	operand <<= 1;
+	operand |= context.get_C();
+	context.write_byte(address, operand);
+
+	context.set_C(bitShiftedOff);
+
+	context.regA &= operand;
+	context.set_NZ(context.regA);
+
+	return 0;
+}
+
+//ROR memory, then ADC it to regA
+MAGSNES::byte CPU::RRA(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+	MAGSNES::byte bitShiftedOff = operand & 0x01;
+
+	operand >>= 1;
+	operand = (context.get_C()) ? (operand | 0x80) : operand;
+	context.write_byte(address, operand);
+
+	//The carry shifted out is the one added in
+	context.set_C(bitShiftedOff);
+	context.add_with_carry(operand);
+
+	return 0;
+}
+
+//Store regA AND regX in memory; no flags are affected
+MAGSNES::byte CPU::SAX(word address, CPU &context) {
+	context.write_byte(address, context.regA & context.regX);
+
+	return 0;
+}
+
+//ASL memory, then ORA it with regA
+MAGSNES::byte CPU::SLO(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+
+	context.set_C(operand & 0x80);
+	operand <<= 1;
+	context.write_byte(address, operand);
+
+	context.regA |= operand;
+	context.set_NZ(context.regA);
+
+	return 0;
+}
+
+//LSR memory, then EOR it with regA
+MAGSNES::byte CPU::SRE(word address, CPU &context) {
+	MAGSNES::byte operand = context.read_byte(address);
+
+	context.set_C(operand & 0x01);
+	operand >>= 1;
+	context.write_byte(address, operand);
+
+	context.regA ^= operand;
+	context.set_NZ(context.regA);
+
+	return 0;
 }
@@ -3,32 +3,103 @@
 #include "Bus.h"
 #include "Core.h"
 
+#include <utility>
+
+//How the CPU stores its status flags; define at most one. With neither, each flag is a bool updated on every instruction.
+//CPU_LAZY_FLAGS: ALU instructions only store their result, and N/Z/V are worked out from it when something reads them (see set_NZ).
+//CPU_PACKED_FLAGS: all flags live in regP, with N/Z looked up in NZ_TABLE, so pushing and pulling P is a plain copy.
+//Neither has measured faster than the bools yet, so both are opt-in. The recompiler needs CPU_LAZY_FLAGS.
+//#define CPU_LAZY_FLAGS
+//#define CPU_PACKED_FLAGS
+
+#if defined(CPU_LAZY_FLAGS) && defined(CPU_PACKED_FLAGS)
+#error "CPU_LAZY_FLAGS and CPU_PACKED_FLAGS are mutually exclusive"
+#endif
+
+//Decode instructions in PRG ROM once and keep the result until their bank is switched out (see execute_decoded). Off until a
+//release build shows it beating plain decoding on real ROMs; so far it measures even to slightly slower.
+//#define CPU_DECODE_CACHE
+//Run common pairs of decoded instructions (DEX/BNE, CMP/BEQ, LDA/STA, PPUSTATUS polling, ...) as one step (see CPU::fuse)
+//#define CPU_FUSE_INSTRUCTIONS
+
+//Skip the passes of a loop that only waits for an interrupt (see CPU::track_idle_loop)
+#define CPU_IDLE_SKIP
+
+//Allow every instruction to be recorded in a ring that can be written out and compared offline (see CPUTrace).
+//Core::cpuRegs.traceInstructions (Options > CPU > Trace Instructions) turns it on at runtime; undefine it to leave out even
+//the check for it.
+#define CPU_TRACE
+
+#if defined(CPU_FUSE_INSTRUCTIONS) && !defined(CPU_DECODE_CACHE)
+#error "CPU_FUSE_INSTRUCTIONS needs CPU_DECODE_CACHE"
+#endif
+
+//The recompiler emits x86-64 and relies on the lazy flag layout; Core::cpuRegs.useRecompiler turns it on at runtime
+#if defined(CPU_LAZY_FLAGS) && !defined(X86_BUILD)
+#define CPU_RECOMPILER
+#endif
+
 namespace MAGSNES {
 
+class Recompiler;
+class CPUTrace;
+
 class CPU {
 
 	friend class Mapper;
 	friend class PPU;
+	friend class Recompiler;
 	DECLARE_DEBUGGER_ACCESS
 
 public:
 
 	CPU(Bus *refBus);
+	~CPU();
 
 	void total_reset();
 	void post_interrupt(const byte INTERRUPT_TYPE);
 
+	//Holds the CPU off the bus for cycles while something else uses it (the APU's DMC reading a sample byte). They are taken as a step
+	//of their own before the next instruction.
+	void steal_cycles(const byte cycles) { stolenCycles += cycles; }
+
 	//Initializes CPU PC register to reset vector. Must be called after loading banks into main memory.
 	void initialize_PC();
 
+	//The P register as the 6502 would push it; for save states and the debugger, which shouldn't care how the flags are stored
+	const byte get_status() { return flagsToP(); }
+	void set_status(const byte val) { pToFlags(val); }
+
 	byte execute_next();
 	byte execute(const byte opcode);
 
+	//Called by the mapper after it copies PRG ROM into main memory; prgChunk is the 8KB chunk of PRG ROM copied to startAddr
+	void map_prg_bank(const word startAddr, const dword length, const dword prgChunk);
+
+	//Runs everything but the CPU for some CPU cycles, checking the bus on the first of them
+	typedef void(*ClockCallback)(void *context, const byte cycles);
+
+	//Switches to cycle stepped mode (Core::cpuRegs.cycleAccurate): before and during each I/O register or mapper access, the
+	//CPU calls callback to bring the rest of the system up to that cycle
+	void connect_clock(ClockCallback callback, void *context) {
+		clockCallback = callback;
+		clockContext = context;
+	}
+
+	//How many cycles of the last step the CPU already ran the rest of the system for; only nonzero in cycle stepped mode
+	const byte take_clocked_cycles() {
+		const byte clocked = clockedCycles;
+		clockedCycles = 0;
+		return clocked;
+	}
+
 	//Allow CPU to access to access parts of the PPU, since we can't pass a direct reference to it.
-	void connect_to_ppu(byte *pdata, byte *ppalettes, word *paddr) {
+	void connect_to_ppu(byte *pdata, byte *ppalettes, word *paddr, const word *ppixel, const word *pscanline) {
 		pPPUDATAbuff = pdata;
 		pPPUPALETTES = ppalettes;
 		pPPUADDR = paddr;
+		pPPUPIXEL = ppixel;
+		pPPUSCANLINE = pscanline;
 	}
 
 	//Some symbols we need are defined in Windows.h
@@ -67,22 +138,97 @@ public:
 		INTERRUPT_TOTAL
 	};
 
+	//What an opcode does, whatever its addressing mode. The unofficial ones come after MN_TYA; MN_ERR is every opcode that
+	//isn't emulated (KIL and the unstable ones).
+	enum {
+		MN_ADC, MN_AND, MN_ASL, MN_BCC, MN_BCS, MN_BEQ, MN_BIT, MN_BMI, MN_BNE, MN_BPL, MN_BRK, MN_BVC, MN_BVS, MN_CLC,
+		MN_CLD, MN_CLI, MN_CLV, MN_CMP, MN_CPX, MN_CPY, MN_DEC, MN_DEX, MN_DEY, MN_EOR, MN_INC, MN_INX, MN_INY, MN_JMP,
+		MN_JSR, MN_LDA, MN_LDX, MN_LDY, MN_LSR, MN_NOP, MN_ORA, MN_PHA, MN_PHP, MN_PLA, MN_PLP, MN_ROL, MN_ROR, MN_RTI,
+		MN_RTS, MN_SBC, MN_SEC, MN_SED, MN_SEI, MN_STA, MN_STX, MN_STY, MN_TAX, MN_TAY, MN_TSX, MN_TXA, MN_TXS, MN_TYA,
+		MN_ALR, MN_ANC, MN_ARR, MN_AXS, MN_DCP, MN_ISC, MN_LAX, MN_RLA, MN_RRA, MN_SAX, MN_SLO, MN_SRE,
+		MN_ERR,
+		MN_TOTAL
+	};
+
+	//How an instruction uses its operand address
+	enum {
+		ACCESS_NONE,
+		ACCESS_READ,
+		ACCESS_WRITE,
+		ACCESS_RMW
+	};
+
 	//Callbacks used to execute the CPU instruction; returns num cycles taken
-	typedef byte(*OpCallback)(word, byte, CPU&);
+	typedef byte(*OpCallback)(word, CPU&);
 
 private:
 
 	/*	Instance variables */
+	//Everything a typical instruction touches comes first; it's well under 64 bytes, so it shares one cache line
+	word regPC;
 	byte regA, regX, regY, regP, regSP, regInterrupt, regExtraCycles, regPageCross;
+#if defined(CPU_LAZY_FLAGS)
+	//Low byte is the last result, which N and Z come from. When N is given separately (BIT, pToFlags), bit 15 holds it and the
+	//low byte is just 1 or 0 for Z clear or set.
+	word lazyNZ;
+	//flagV is bit 7
+	byte lazyV;
+	bool flagTrash, flagB, flagD, flagI, flagC;
+#elif !defined(CPU_PACKED_FLAGS)
 	bool flagN, flagV, flagTrash, flagB, flagD, flagI, flagZ, flagC;
-	word regPC, DMACounter, DMAAddress, &refReadBus, &refWriteBus;
+#endif
+	word DMACounter, DMAAddress, &refReadBus, &refWriteBus;
 	Bus &refBus;
 	Core &sysCore;
 	byte(&refMM)[MM_SIZE];
 
+	//nullptr unless Core::cpuRegs.useRecompiler was set
+	Recompiler *recompiler;
+
+	//nullptr unless Core::cpuRegs.traceInstructions was set
+	CPUTrace *trace;
+
+	//Nonzero for each page of RAM holding recompiled code, which a write must invalidate; all zero without the recompiler
+	const byte *codePages;
+
+	//nullptr unless in cycle stepped mode (see connect_clock)
+	ClockCallback clockCallback;
+	void *clockContext;
+	//Cycles of the current step spent before the instruction (on an interrupt), and of the step the rest of the system has run
+	byte instructionStart, clockedCycles;
+	//Cycles taken by steal_cycles since the last step
+	byte stolenCycles;
+	//Cycle of the current instruction, counting from 1, in which it reads or writes its operand
+	byte readCycle, writeCycle;
+
 	//Allows the CPU to immediately access the value in the PPUDATA buffer while avoiding cross references
 	byte *pPPUDATAbuff, *pPPUPALETTES; //pPPUPALETTES is a pointer to VRAM $3F00, which allows us to instantly retrieve a palette upon a PPUDATA read
 	word *pPPUADDR;
+	//Where the PPU is in the frame, to know how long PPUSTATUS polling will last
+	const word *pPPUPIXEL, *pPPUSCANLINE;
+
+	//A step can't take more than 84 cycles (see System::step), and an interrupt before the instruction can add 7, so this is the
+	//most that skipping loop passes may bring a step to
+	static const byte MAX_SKIP_CYCLES = 77;
+
+#ifdef CPU_IDLE_SKIP
+	//Longest jump back that can close an idle loop
+	static const word IDLE_MAX_LOOP_BYTES = 16;
+
+	//The loop being watched, from the branch target at head to the jump back at end, and the registers the last time it reached head
+	struct IdleLoop {
+		bool isTracking;
+		word head, end;
+		//Last loop found not to be idle, by its head and the PC of the step that jumped back to it
+		word rejectedHead, rejectedPC;
+		byte a, x, y, p, sp;
+		dword passCycles;
+	} idleLoop;
+
+	struct IdleStats {
+		qword passesSkipped, cyclesSkipped;
+	} idleStats;
+#endif
 
 	//Contains information about each opcode
 	struct OpInfo {
@@ -90,9 +236,68 @@ private:
 		CPU::OpCallback instr;
 		//Addressing mode to get operand for the instruction
 		byte addrMode;
+		byte mnemonic, access;
+		//Cycles taken, not counting branches taken and page crosses
+		byte cycles;
+		//Extra cycle for a page cross in ABSOLUTE_X, ABSOLUTE_Y and INDIRECT_Y; only instructions that just read their operand
+		//take it
+		byte pageCrossCycle;
+	};
+
+	//Generated from the opcode bits at compile time by make_opcode_table
+	struct OpcodeTable {
+		OpInfo ops[0x100];
+
+		const OpInfo & operator[](const byte opcode) const { return ops[opcode]; }
+	};
+
+	static const OpcodeTable opcodeVector;
+
+	//The OpCallback of each opcode; calls its instruction and adds the cycles
+	template <byte OPCODE>
+	static byte run_opcode(word, CPU&);
+	template <size_t... OPCODES>
+	static constexpr OpcodeTable make_opcode_table(std::index_sequence<OPCODES...>);
+
+#ifdef CPU_DECODE_CACHE
+	//An instruction in PRG ROM, decoded the first time it runs so the opcode and operand bytes aren't looked at again
+	//until its bank is switched out
+	struct DecodedOp {
+		//nullptr until decoded
+		CPU::OpCallback instr;
+		//The final address for modes that don't depend on a register; the base address or zero page pointer otherwise
+		word operand;
+		//pageCrossCycle is the opcode's OpInfo::pageCrossCycle
+		byte addrMode, length, pageCrossCycle;
+#ifdef CPU_FUSE_INSTRUCTIONS
+		//What this instruction is fused with the next one as; for FUSE_DEX_BNE/FUSE_DEY_BNE, operand is the branch target and
+		//takenCycles is what the pair takes when it branches
+		byte fusion, takenCycles;
+#endif
+	};
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+	enum {
+		FUSE_NONE,
+		FUSE_PAIR,				//Both run through their handlers, back to back
+		FUSE_DEX_BNE,
+		FUSE_DEY_BNE,
+		FUSE_STATUS_SPIN		//LDA/BIT $2002 + BPL back to it
 	};
+#endif
+
+	static const dword DECODE_SLOT_SIZE = 0x2000;
+	static const dword DECODE_NO_CHUNK = 0xFFFFFFFF;
 
-	static const OpInfo opcodeVector[0x100];
+	//One entry for each address in $8000-$FFFF
+	DecodedOp *decodeCache;
+	//PRG chunk decoded in each 8KB slot, so a mapper reloading the bank that's already there keeps its entries
+	dword decodedChunks[4];
+
+	struct DecodeStats {
+		qword hits, misses, invalidations, fusedRuns, spinPassesSkipped;
+	} decodeStats;
+#endif
 
 	//Implements mirroring in main memory
 	FORCEINLINE const word coerce_address(const word address) {
@@ -117,27 +322,119 @@ private:
 
 	byte pop_byte();
 
+	//ADC's arithmetic, which RRA and ISC share
+	void add_with_carry(const byte operand);
+
+	//Bits of the P register
+	enum {
+		FLAG_C = 0x01,
+		FLAG_Z = 0x02,
+		FLAG_I = 0x04,
+		FLAG_D = 0x08,
+		FLAG_B = 0x10,
+		FLAG_TRASH = 0x20,
+		FLAG_V = 0x40,
+		FLAG_N = 0x80
+	};
+
+#ifdef CPU_PACKED_FLAGS
+	//FLAG_N and FLAG_Z for every possible result
+	static const byte NZ_TABLE[0x100];
+#endif
+
+	//Set flagN and flagZ from an 8 bit result
+	FORCEINLINE void set_NZ(const byte result) {
+#if defined(CPU_LAZY_FLAGS)
+		lazyNZ = result;
+#elif defined(CPU_PACKED_FLAGS)
+		regP = (regP & ~(FLAG_N | FLAG_Z)) | NZ_TABLE[result];
+#else
+		flagN = (result & 0x80) ? true : false;
+		flagZ = (result == 0) ? true : false;
+#endif
+	}
+
+	//Set flagN from bit 7 of nSource and flagZ from zSource; only BIT needs them to differ
+	FORCEINLINE void set_NZ(const byte nSource, const byte zSource) {
+#if defined(CPU_LAZY_FLAGS)
+		//get_N also looks at bit 7 of the low byte, so only whether zSource is zero goes there
+		lazyNZ = ((nSource & 0x80) << 8) | ((zSource != 0) ? 1 : 0);
+#elif defined(CPU_PACKED_FLAGS)
+		regP = (regP & ~(FLAG_N | FLAG_Z)) | (nSource & FLAG_N) | (NZ_TABLE[zSource] & FLAG_Z);
+#else
+		flagN = (nSource & 0x80) ? true : false;
+		flagZ = (zSource == 0) ? true : false;
+#endif
+	}
+
+	//Set flagV from bit 7 of overflow, so ADC/SBC can pass their sign bit test straight through
+	FORCEINLINE void set_V(const byte overflow) {
+#if defined(CPU_LAZY_FLAGS)
+		lazyV = overflow;
+#elif defined(CPU_PACKED_FLAGS)
+		regP = (regP & ~FLAG_V) | ((overflow >> 1) & FLAG_V);
+#else
+		flagV = (overflow & 0x80) ? true : false;
+#endif
+	}
+
+#ifdef CPU_PACKED_FLAGS
+	FORCEINLINE void set_C(const bool val) { regP = (regP & ~FLAG_C) | (val ? FLAG_C : 0); }
+	FORCEINLINE void set_I(const bool val) { regP = (regP & ~FLAG_I) | (val ? FLAG_I : 0); }
+	FORCEINLINE void set_D(const bool val) { regP = (regP & ~FLAG_D) | (val ? FLAG_D : 0); }
+
+	FORCEINLINE const bool get_N() const { return (regP & FLAG_N) != 0; }
+	FORCEINLINE const bool get_Z() const { return (regP & FLAG_Z) != 0; }
+	FORCEINLINE const bool get_V() const { return (regP & FLAG_V) != 0; }
+	FORCEINLINE const bool get_C() const { return (regP & FLAG_C) != 0; }
+	FORCEINLINE const bool get_I() const { return (regP & FLAG_I) != 0; }
+
+	//regP never holds flagB, and always holds flagTrash
+	FORCEINLINE byte flagsToP() {
+		return regP;
+	}
+
+	FORCEINLINE void pToFlags(byte val) {
+		regP = (val & ~FLAG_B) | FLAG_TRASH;
+	}
+#else
+	FORCEINLINE void set_C(const bool val) { flagC = val; }
+	FORCEINLINE void set_I(const bool val) { flagI = val; }
+	FORCEINLINE void set_D(const bool val) { flagD = val; }
+
+#ifdef CPU_LAZY_FLAGS
+	FORCEINLINE const bool get_N() const { return (lazyNZ & 0x8080) != 0; }
+	FORCEINLINE const bool get_Z() const { return (lazyNZ & 0xFF) == 0; }
+	FORCEINLINE const bool get_V() const { return (lazyV & 0x80) != 0; }
+#else
+	FORCEINLINE const bool get_N() const { return flagN; }
+	FORCEINLINE const bool get_Z() const { return flagZ; }
+	FORCEINLINE const bool get_V() const { return flagV; }
+#endif
+	FORCEINLINE const bool get_C() const { return flagC; }
+	FORCEINLINE const bool get_I() const { return flagI; }
+
 	FORCEINLINE byte flagsToP() {
 		return	(flagC) |
-			(flagZ << 1) |
+			(get_Z() << 1) |
 			(flagI << 2) |
 			(flagD << 3) |
 			(flagB << 4) |
 			0x20 | //A;ways have flagTrash on
-			(flagV << 6) |
-			(flagN << 7);
+			(get_V() << 6) |
+			(get_N() << 7);
 	}
 
 	FORCEINLINE void pToFlags(byte val) {
 		flagC = (val & 0x1) ? true : false;
-		flagZ = (val & 0x2) ? true : false;
 		flagI = (val & 0x4) ? true : false;
 		flagD = (val & 0x8) ? true : false;
 		flagB = false; //Bit 4 is IGNORED when restoring flags from the stack
 		flagTrash = true; //Bit 5 is always on
-		flagV = (val & 0x40) ? true : false;
-		flagN = (val & 0x80) ? true : false;
+		set_NZ(val, (val & 0x2) ? 0 : 1);
+		set_V(val << 1);
 	}
+#endif
 
 	//Functions to retrieve the desired operand from memory. RESPONSIBLE FOR
 	//INCREMENTING PC. Returns the formatted operand.
@@ -284,16 +581,43 @@ private:
 		return memAddr;
 	}
 
+	//Only I/O registers are timing sensitive to read; mapper registers are also sensitive to writes
+	FORCEINLINE const bool is_timed_read(const word addr) const { return (word)(addr - 0x2000) < 0x2020; }
+	FORCEINLINE const bool is_timed_write(const word addr) const { return ((word)(addr - 0x2000) < 0x2020) || (addr & 0x8000); }
+
 	FORCEINLINE byte read_byte(const word addr) {
+		if ((clockCallback != nullptr) && is_timed_read(addr)) {
+			return read_byte_stepped(addr);
+		}
+
+		return bus_read(addr);
+	}
+
+	FORCEINLINE void write_byte(const word addr, const byte val) {
+		if ((clockCallback != nullptr) && is_timed_write(addr)) {
+			write_byte_stepped(addr, val);
+		} else {
+			bus_write(addr, val);
+		}
+	}
+
+	byte read_byte_stepped(const word addr);
+	void write_byte_stepped(const word addr, const byte val);
+	//Runs the rest of the system until the end of the given cycle of the current instruction
+	void clock_to(const byte cycle);
+	//Works out readCycle and writeCycle for the instruction about to run
+	void set_access_cycles(const OpInfo &opinfo, const byte pageCrossCycle);
+
+	FORCEINLINE byte bus_read(const word addr) {
 		refBus.readBus = addr;
 
 		//Note that PPU handles the increment of ppuAddr, and putting the VRAM data into the data buffer
 		if (addr == 0x2007) {	//Must handle PPUDATA read as a special case, b/c the CPU expects to immediately receive the value of the PPU data buffer
 
 			// Return a palette immediately
-			if (*pPPUADDR >= 0x3F00) {
-				word tmpAddr = coercePPUAddress(*pPPUADDR); //We need to coerce the address to account for PPU mirroring
-				byte offset = *pPPUADDR & 0x1F;	//Get offset into the palette RAM
+			if ((*pPPUADDR & 0x3FFF) >= 0x3F00) { //The PPU's address is 15 bits, of which only 14 go to the VRAM
+				//Get offset into the palette RAM; $3F10, $3F14, $3F18 and $3F1C are mirrors of the address 0x10 bytes lower
+				byte offset = *pPPUADDR & ((*pPPUADDR & 0x03) ? 0x1F : 0x0F);
 				return *(pPPUPALETTES + offset);
 
 			} else {
@@ -305,46 +629,7 @@ private:
 		}
 	}
 
-	//Helper function, copy of PPU::coercePPUAddress(word)
-	FORCEINLINE word coercePPUAddress(word addr) {
-		//Mirror $0 to $3FFF
-		addr &= 0x3FFF; //Mask to 14 bits; same as addr %= 4000
-
-										//Mirror $2000 to $2EFF
-		if (addr > 0x2FFF && addr < 0x3F00) {
-			return addr - 0x1000;
-
-		} else if (addr > 0x3EFF && addr < 0x4000) {
-			addr = (addr & 0x1F) + 0x3F00; //Don't return yet; this area is mirrored even further...
-
-																			//These 4 addresses are mirrors of the address 0x10 bytes lower
-			switch (addr) {
-			case 0x3F10:
-				return 0x3F00;
-				break;
-
-			case 0x3F14:
-				return 0x3F04;
-				break;
-
-			case 0x3F18:
-				return 0x3F08;
-				break;
-
-			case 0x3F1C:
-				return 0x3F0C;
-				break;
-
-			default:
-				return addr;
-				break;
-			}
-		} else {
-			return addr;
-		}
-	}
-
-	FORCEINLINE void write_byte(const word addr, const byte val) {
+	FORCEINLINE void bus_write(const word addr, const byte val) {
 		refBus.writeBus = addr;
 
 		//We want PRG_ROM to be immutable, so we put the data that would have been written to the address on the bus
@@ -353,19 +638,65 @@ private:
 		} else {
 			if (addr != 0x2002) { //PPUSTATUS is read-only
 				refMM[addr] = val;
+
+				if (codePages[addr >> 8]) {
+					invalidate_code_page(addr >> 8);
+				}
 			}
 		}
 	}
 
+	void invalidate_code_page(const byte page);
+
+#ifdef CPU_DECODE_CACHE
+	//Runs the instruction at regPC (which must be in PRG ROM) from the decode cache
+	byte execute_decoded();
+	//Decodes the instruction at pc if it isn't yet; nullptr for an illegal opcode, or one whose bytes run into the next 8KB slot
+	DecodedOp * get_decoded(const word pc);
+	byte run_decoded(const DecodedOp &op);
+	void clear_decode_cache();
+#endif
+
+#ifdef CPU_FUSE_INSTRUCTIONS
+	void fuse(const word pc, DecodedOp &op);
+	//Whether the instruction at pc can only read or write RAM, whatever its index registers hold
+	const bool only_accesses_RAM(const word pc);
+	//Whether any interrupt raised during an instruction of this many cycles would only be taken after the next one anyway
+	const bool can_defer_interrupts(const byte cycles) const;
+	byte run_fused_pair(const DecodedOp &op);
+	byte run_status_spin(const DecodedOp &op);
+#endif
+
+	//Runs the instruction (or block) at regPC, after any interrupt has been handled
+	byte execute_at_PC();
+
+#ifdef CPU_TRACE
+	//execute_next when tracing: records each instruction before running it, one at a time
+	byte execute_traced();
+	//Gives the trace the disassembly of every opcode, for the snapshots it writes
+	__CLASSMETHOD__ void describe_opcodes(CPUTrace &target);
+#endif
+
+#ifdef CPU_IDLE_SKIP
+	//Called after every step with the PC it started at; returns the cycles of any idle passes skipped
+	byte track_idle_loop(const word pc, const byte cycles);
+	const bool is_idle_loop_body(const word head, const word pc, word &end);
+#endif
+
+	//PPU ticks left until vblank is set (and an NMI may be taken)
+	const dword get_ppu_ticks_to_vblank() const;
+
+	__CLASSMETHOD__ const byte get_instruction_length(const byte addrMode);
+
 	const byte handle_interrupt();
 	const byte execute_DMA_step();
 
 	void start_DMA(const word startAddr);
 
 	/*
-	The functions which encapsulate instruction logic. Each instruction returns the
-	number of cycles taken, based on the given addressing mode. Each of these functions
-	can be pointed to by an OpCallback pointer.
+	The functions which encapsulate instruction logic. Each opcode's run_opcode instance adds the cycles from its
+	opcodeVector entry, so an instruction only returns cycles beyond those (a branch taken). Instructions that
+	behave differently per addressing mode are templates on it, so each opcode gets its own copy with no check at run time.
 
 	Make these static to enforce statelessness. This will also make it easy to
 	point to the function by enforcing only one instance of each function; moreover,
@@ -373,64 +704,79 @@ private:
 	static function can access members (public AND private, b/c the functions are still private
 	members themselves) of the specific CPU instance. The static state
 	also allows the functions to be called dynamically by a CPU instance.
+
 	*/
-	static byte ADC(word, byte, CPU&);
-	static byte AND(word, byte, CPU&);
-	static byte ASL(word, byte, CPU&);
-	static byte BCC(word, byte, CPU&);
-	static byte BCS(word, byte, CPU&);
-	static byte BEQ(word, byte, CPU&);
-	static byte BIT(word, byte, CPU&);
-	static byte BMI(word, byte, CPU&);
-	static byte BNE(word, byte, CPU&);
-	static byte BPL(word, byte, CPU&);
-	static byte BRK(word, byte, CPU&);
-	static byte BVC(word, byte, CPU&);
-	static byte BVS(word, byte, CPU&);
-	static byte CLC(word, byte, CPU&);
-	static byte CLD(word, byte, CPU&);
-	static byte CLI(word, byte, CPU&);
-	static byte CLV(word, byte, CPU&);
-	static byte CMP(word, byte, CPU&);
-	static byte CPX(word, byte, CPU&);
-	static byte CPY(word, byte, CPU&);
-	static byte DEC(word, byte, CPU&);
-	static byte DEX(word, byte, CPU&);
-	static byte DEY(word, byte, CPU&);
-	static byte EOR(word, byte, CPU&);
-	static byte ERR(word, byte, CPU&); //NOT a real opcode; meant to throw an error when given an illegal opcode.
-	static byte INC(word, byte, CPU&);
-	static byte INX(word, byte, CPU&);
-	static byte INY(word, byte, CPU&);
-	static byte JMP(word, byte, CPU&);
-	static byte JSR(word, byte, CPU&);
-	static byte LDA(word, byte, CPU&);
-	static byte LDX(word, byte, CPU&);
-	static byte LDY(word, byte, CPU&);
-	static byte LSR(word, byte, CPU&);
-	static byte NOP(word, byte, CPU&);
-	static byte ORA(word, byte, CPU&);
-	static byte PHA(word, byte, CPU&);
-	static byte PHP(word, byte, CPU&);
-	static byte PLA(word, byte, CPU&);
-	static byte PLP(word, byte, CPU&);
-	static byte ROL(word, byte, CPU&);
-	static byte ROR(word, byte, CPU&);
-	static byte RTI(word, byte, CPU&);
-	static byte RTS(word, byte, CPU&);
-	static byte SBC(word, byte, CPU&);
-	static byte SEC(word, byte, CPU&);
-	static byte SED(word, byte, CPU&);
-	static byte SEI(word, byte, CPU&);
-	static byte STA(word, byte, CPU&);
-	static byte STX(word, byte, CPU&);
-	static byte STY(word, byte, CPU&);
-	static byte TAX(word, byte, CPU&);
-	static byte TAY(word, byte, CPU&);
-	static byte TSX(word, byte, CPU&);
-	static byte TXA(word, byte, CPU&);
-	static byte TXS(word, byte, CPU&);
-	static byte TYA(word, byte, CPU&);
+	static byte ADC(word, CPU&);
+	static byte AND(word, CPU&);
+	template <byte ADDR_MODE> static byte ASL(word, CPU&);
+	static byte BCC(word, CPU&);
+	static byte BCS(word, CPU&);
+	static byte BEQ(word, CPU&);
+	static byte BIT(word, CPU&);
+	static byte BMI(word, CPU&);
+	static byte BNE(word, CPU&);
+	static byte BPL(word, CPU&);
+	static byte BRK(word, CPU&);
+	static byte BVC(word, CPU&);
+	static byte BVS(word, CPU&);
+	static byte CLC(word, CPU&);
+	static byte CLD(word, CPU&);
+	static byte CLI(word, CPU&);
+	static byte CLV(word, CPU&);
+	static byte CMP(word, CPU&);
+	static byte CPX(word, CPU&);
+	static byte CPY(word, CPU&);
+	static byte DEC(word, CPU&);
+	static byte DEX(word, CPU&);
+	static byte DEY(word, CPU&);
+	static byte EOR(word, CPU&);
+	static byte ERR(word, CPU&); //NOT a real opcode; meant to throw an error when given an illegal opcode.
+	static byte INC(word, CPU&);
+	static byte INX(word, CPU&);
+	static byte INY(word, CPU&);
+	static byte JMP(word, CPU&);
+	static byte JSR(word, CPU&);
+	static byte LDA(word, CPU&);
+	static byte LDX(word, CPU&);
+	static byte LDY(word, CPU&);
+	template <byte ADDR_MODE> static byte LSR(word, CPU&);
+	template <byte ADDR_MODE> static byte NOP(word, CPU&);
+	static byte ORA(word, CPU&);
+	static byte PHA(word, CPU&);
+	static byte PHP(word, CPU&);
+	static byte PLA(word, CPU&);
+	static byte PLP(word, CPU&);
+	template <byte ADDR_MODE> static byte ROL(word, CPU&);
+	template <byte ADDR_MODE> static byte ROR(word, CPU&);
+	static byte RTI(word, CPU&);
+	static byte RTS(word, CPU&);
+	static byte SBC(word, CPU&);
+	static byte SEC(word, CPU&);
+	static byte SED(word, CPU&);
+	static byte SEI(word, CPU&);
+	static byte STA(word, CPU&);
+	static byte STX(word, CPU&);
+	static byte STY(word, CPU&);
+	static byte TAX(word, CPU&);
+	static byte TAY(word, CPU&);
+	static byte TSX(word, CPU&);
+	static byte TXA(word, CPU&);
+	static byte TXS(word, CPU&);
+	static byte TYA(word, CPU&);
+
+	//Unofficial opcodes
+	static byte ALR(word, CPU&);
+	static byte ANC(word, CPU&);
+	static byte ARR(word, CPU&);
+	static byte AXS(word, CPU&);
+	static byte DCP(word, CPU&);
+	static byte ISC(word, CPU&);
+	static byte LAX(word, CPU&);
+	static byte RLA(word, CPU&);
+	static byte RRA(word, CPU&);
+	static byte SAX(word, CPU&);
+	static byte SLO(word, CPU&);
+	static byte SRE(word, CPU&);
 };
 
 } /* namespace NESPP */
\ No newline at end of file
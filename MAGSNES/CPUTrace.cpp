@@ -0,0 +1,68 @@
+#include "CPUTrace.h"
+
+#include "Core.h"
+
+#include <cstring>
+
+using namespace MAGSNES;
+
+CPUTrace::CPUTrace()
+	: writeCount(0), cycles(0) {
+
+	ring = new Record[RING_SIZE];
+	std::memset(opcodes, 0, sizeof(opcodes));
+}
+
+CPUTrace::~CPUTrace() {
+	delete[] ring;
+}
+
+void CPUTrace::set_opcode_info(const byte opcode, const char * const mnemonic, const OperandFormat format, const bool isUnofficial) {
+	OpcodeInfo &info = opcodes[opcode];
+
+	strcpy_s(info.mnemonic, mnemonic);
+	info.format = format;
+	info.isUnofficial = isUnofficial ? 1 : 0;
+}
+
+const bool CPUTrace::write_snapshot(const char * const path) const {
+	Core &sysCore = Core::get_sys_core();
+
+	std::FILE *file;
+	if (fopen_s(&file, path, "wb") != 0) {
+		sysCore.logerr("Unable to open the CPU trace file");
+		return false;
+	}
+
+	const qword count = (writeCount < RING_SIZE) ? writeCount : RING_SIZE;
+
+	FileHeader header;
+	std::memset(&header, 0, sizeof(FileHeader));
+	std::memcpy(header.magic, get_magic(), sizeof(header.magic));
+	header.version = FILE_VERSION;
+	header.recordSize = sizeof(Record);
+	header.recordCount = (dword)count;
+	std::memcpy(header.opcodes, opcodes, sizeof(opcodes));
+
+	std::fwrite(&header, sizeof(FileHeader), 1, file);
+
+	//Oldest first: from the write position to the end of the ring, then from the start of it
+	const dword first = (dword)((writeCount - count) & RING_MASK);
+	const dword untilEnd = ((first + count) > RING_SIZE) ? (RING_SIZE - first) : (dword)count;
+	std::fwrite(&ring[first], sizeof(Record), untilEnd, file);
+	std::fwrite(ring, sizeof(Record), (size_t)(count - untilEnd), file);
+
+	const bool wasWritten = (std::ferror(file) == 0);
+	std::fclose(file);
+
+	char msg[MAX_PATH + 64];
+	if (wasWritten) {
+		sprintf_s(msg, "CPU trace (%llu instructions) written to %s", count, path);
+		sysCore.logmsg(msg);
+	} else {
+		sprintf_s(msg, "Unable to write the CPU trace to %s", path);
+		sysCore.logerr(msg);
+	}
+
+	return wasWritten;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Binary trace of every instruction the CPU runs, for comparing against other emulators' logs (e.g. nestest.log). Each instruction
+//is a fixed size Record in a ring that only the exec thread writes, so recording is a handful of stores; once the ring is full the
+//oldest records are overwritten. A snapshot writes the ring out as it stands, and TraceDecode turns it into text offline.
+//Only depends on defs.h so that TraceDecode can share the file layout.
+class CPUTrace {
+public:
+	//How TraceDecode prints an instruction's operand
+	enum OperandFormat {
+		OPERAND_NONE,
+		OPERAND_ACCUMULATOR,
+		OPERAND_IMMEDIATE,
+		OPERAND_ZERO_PAGE,
+		OPERAND_ZERO_PAGE_X,
+		OPERAND_ZERO_PAGE_Y,
+		OPERAND_ABSOLUTE,
+		OPERAND_ABSOLUTE_X,
+		OPERAND_ABSOLUTE_Y,
+		OPERAND_RELATIVE,
+		OPERAND_INDIRECT_X,
+		OPERAND_INDIRECT_Y,
+		OPERAND_INDIRECT
+	};
+
+	//The state before one instruction runs
+	struct Record {
+		qword cycle;				//CPU cycles since the ROM was loaded
+		word pc, scanline, dot;		//dot is the PPU's pixel within the scanline
+		byte opcode, operandLo, operandHi;
+		byte a, x, y, p, sp;
+	};
+
+	//Disassembly for one opcode, written with each snapshot so TraceDecode doesn't need the CPU's tables
+	struct OpcodeInfo {
+		char mnemonic[4];
+		byte format;		//OperandFormat
+		byte isUnofficial;
+		byte padding[2];
+	};
+
+	//A snapshot file is a FileHeader followed by recordCount Records, oldest first
+	struct FileHeader {
+		char magic[8];
+		dword version, recordSize, recordCount, reserved;
+		OpcodeInfo opcodes[0x100];
+	};
+
+	static const dword FILE_VERSION = 1;
+
+	__CLASSMETHOD__ const char * get_magic() { return "MAGTRACE"; }
+
+	__CLASSMETHOD__ const byte get_operand_bytes(const byte format) {
+		switch (format) {
+		case OPERAND_NONE:
+		case OPERAND_ACCUMULATOR:
+			return 0;
+		case OPERAND_ABSOLUTE:
+		case OPERAND_ABSOLUTE_X:
+		case OPERAND_ABSOLUTE_Y:
+		case OPERAND_INDIRECT:
+			return 2;
+		default:
+			return 1;
+		}
+	}
+
+	CPUTrace();
+	~CPUTrace();
+
+	void set_opcode_info(const byte opcode, const char * const mnemonic, const OperandFormat format, const bool isUnofficial);
+
+	//Called by the CPU before each instruction, from the exec thread only
+	FORCEINLINE void record(const word pc, const byte opcode, const byte operandLo, const byte operandHi, const byte a, const byte x,
+		const byte y, const byte p, const byte sp, const word scanline, const word dot) {
+
+		Record &rec = ring[writeCount & RING_MASK];
+		rec.cycle = cycles;
+		rec.pc = pc;
+		rec.scanline = scanline;
+		rec.dot = dot;
+		rec.opcode = opcode;
+		rec.operandLo = operandLo;
+		rec.operandHi = operandHi;
+		rec.a = a;
+		rec.x = x;
+		rec.y = y;
+		rec.p = p;
+		rec.sp = sp;
+		writeCount++;
+	}
+
+	FORCEINLINE void add_cycles(const byte count) { cycles += count; }
+
+	//Writes the ring to path, oldest record first; must be called from the exec thread
+	const bool write_snapshot(const char * const path) const;
+
+private:
+	//24MB; about 35 frames of typical code
+	static const dword RING_SIZE = 1 << 20;
+	static const dword RING_MASK = RING_SIZE - 1;
+
+	Record *ring;
+	qword writeCount, cycles;
+
+	OpcodeInfo opcodes[0x100];
+};
+
+} /* namespace MAGSNES */
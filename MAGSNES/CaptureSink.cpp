@@ -0,0 +1,349 @@
+#include "CaptureSink.h"
+
+#include "Core.h"
+
+#include <cstring>
+
+__FILESCOPE__{
+	//How many encoded frames are collected before each write to the video file
+	const MAGSNES::dword VIDEO_BATCH_FRAMES = 8;
+	const MAGSNES::dword AUDIO_BATCH_BYTES = 256 * 1024;
+
+	const char * const Y4M_FRAME_HEADER = "FRAME\n";
+	const MAGSNES::dword Y4M_FRAME_HEADER_LENGTH = 6;
+
+	const MAGSNES::dword WAV_HEADER_SIZE = 44;
+	const MAGSNES::word WAV_FORMAT_IEEE_FLOAT = 3;
+
+	FORCEINLINE void put_word(MAGSNES::byte *dst, const MAGSNES::word val) {
+		dst[0] = val & 0xFF;
+		dst[1] = (val >> 8) & 0xFF;
+	}
+
+	FORCEINLINE void put_dword(MAGSNES::byte *dst, const MAGSNES::dword val) {
+		put_word(dst, val & 0xFFFF);
+		put_word(dst + 2, (val >> 16) & 0xFFFF);
+	}
+}
+
+using namespace MAGSNES;
+
+CaptureSink::CaptureSink()
+	: capturing(false), activeSubmitters(0), writerShouldRun(false), writerThread(nullptr), framesDropped(0), audioBlocksDropped(0),
+		videoFile(nullptr), audioFile(nullptr), sampleRate(0), audioBytesWritten(0), framesWritten(0),
+		rgbaFrame(nullptr), scaledFrame(nullptr), videoBatch(nullptr), audioBatch(nullptr),
+		videoBatchUsed(0), audioBatchUsed(0), videoBatchSize(0), audioBatchSize(0) {
+
+}
+
+CaptureSink::~CaptureSink() {
+	if (is_capturing()) {
+		stop();
+	}
+}
+
+void CaptureSink::load_palette(const dword * const nesPalette) {
+	converter.load_palette(nesPalette);
+}
+
+const bool CaptureSink::start(const char * const basePath, const dword sampleRate, const FrameScaler::Filter filter) {
+	Core &sysCore = Core::get_sys_core();
+	char path[MAX_PATH];
+
+	if (is_capturing()) {
+		return false;
+	}
+
+	//With the RGBA framebuffer the PPU has no frames to hand over, and the recording would silently be audio only
+	if (!sysCore.videoRegs.usePaletteIndexFramebuffer) {
+		sysCore.logerr("Recording needs the palette index framebuffer");
+		return false;
+	}
+
+	//Both paths are checked before either file is created, so a base path that only fits with one extension leaves nothing behind
+	char audioPath[MAX_PATH];
+	if ((_snprintf_s(path, _TRUNCATE, "%s.y4m", basePath) < 0) || (_snprintf_s(audioPath, _TRUNCATE, "%s.wav", basePath) < 0)) {
+		sysCore.logerr("The capture file path is too long");
+		return false;
+	}
+
+	if (fopen_s(&videoFile, path, "wb") != 0) {
+		sysCore.logerr("Unable to open the video capture file");
+		videoFile = nullptr;
+		return false;
+	}
+
+	if (fopen_s(&audioFile, audioPath, "wb") != 0) {
+		sysCore.logerr("Unable to open the audio capture file");
+		std::fclose(videoFile);
+		videoFile = audioFile = nullptr;
+		return false;
+	}
+
+	//We batch the writes ourselves, so the CRT's buffering would only add a copy
+	setvbuf(videoFile, NULL, _IONBF, 0);
+	setvbuf(audioFile, NULL, _IONBF, 0);
+
+	scaler.set_filter(filter);
+	const dword pixelCount = scaler.get_output_width() * scaler.get_output_height();
+
+	rgbaFrame = new dword[FRAME_PIXEL_COUNT];
+	scaledFrame = (filter != FrameScaler::Filter::NONE) ? new dword[pixelCount] : nullptr;
+
+	videoBatchSize = (Y4M_FRAME_HEADER_LENGTH + (pixelCount * 3)) * VIDEO_BATCH_FRAMES;
+	audioBatchSize = AUDIO_BATCH_BYTES;
+	videoBatch = new MAGSNES::byte[videoBatchSize];
+	audioBatch = new MAGSNES::byte[audioBatchSize];
+	videoBatchUsed = audioBatchUsed = 0;
+
+	//4:4:4 so that the 1 pixel detail of NES graphics survives; the frame rate is the NTSC NES's exact ~60.0988 Hz
+	std::fprintf(videoFile, "YUV4MPEG2 W%d H%d F39375000:655171 Ip A1:1 C444\n", scaler.get_output_width(), scaler.get_output_height());
+
+	//Sizes are patched in when the capture stops
+	this->sampleRate = sampleRate;
+	write_wav_header(0);
+
+	framesWritten = audioBytesWritten = 0;
+	framesDropped.store(0);
+	audioBlocksDropped.store(0);
+	frameQueue.reset();
+	audioQueue.reset();
+
+	writerShouldRun.store(true);
+	writerThread = new std::thread(CaptureSink::writer_proc, this);
+
+	capturing.store(true, std::memory_order_release);
+
+	//Only a log message, so a long path is simply cut short
+	_snprintf_s(path, _TRUNCATE, "Capturing to %s.y4m/.wav", basePath);
+	sysCore.logmsg(path);
+
+	return true;
+}
+
+void CaptureSink::stop() {
+	if (!is_capturing()) {
+		return;
+	}
+
+	//Producers check this before touching the queues. One that got past the check before it changed may still be copying into a
+	//queue, so wait for it; the writer then drains whatever they managed to queue.
+	capturing.store(false, std::memory_order_seq_cst);
+	while (activeSubmitters.load(std::memory_order_seq_cst) != 0) {
+		std::this_thread::yield();
+	}
+
+	writerShouldRun.store(false);
+	writerThread->join();
+	delete writerThread;
+	writerThread = nullptr;
+
+	write_wav_header(audioBytesWritten);
+
+	std::fclose(videoFile);
+	std::fclose(audioFile);
+	videoFile = audioFile = nullptr;
+
+	release_buffers();
+
+	char statsMsg[128];
+	sprintf_s(statsMsg, "Capture stopped: %u frames written, %u frames dropped, %u audio blocks dropped",
+		framesWritten, framesDropped.load(), audioBlocksDropped.load());
+	Core::get_sys_core().logmsg(statsMsg);
+}
+
+const bool CaptureSink::begin_submit() {
+	//Announce the submit before checking, so stop either sees it and waits, or has already cleared capturing and this sees that
+	activeSubmitters.fetch_add(1, std::memory_order_seq_cst);
+
+	if (!capturing.load(std::memory_order_seq_cst)) {
+		end_submit();
+		return false;
+	}
+
+	return true;
+}
+
+void CaptureSink::submit_frame(const FrameBuffer &frame) {
+	if (!begin_submit()) {
+		return;
+	}
+
+	CapturedFrame *slot = frameQueue.begin_push();
+
+	if (slot == nullptr) {
+		framesDropped.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		std::memcpy(slot->indices, frame.indices, sizeof(slot->indices));
+		std::memcpy(slot->emphasis, frame.emphasis, sizeof(slot->emphasis));
+		frameQueue.end_push();
+	}
+
+	end_submit();
+}
+
+void CaptureSink::submit_audio(const float * const samples, const dword frameCount) {
+	if (!begin_submit()) {
+		return;
+	}
+
+	dword offset = 0;
+
+	while (offset < frameCount) {
+		CapturedAudio *slot = audioQueue.begin_push();
+
+		if (slot == nullptr) {
+			audioBlocksDropped.fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+
+		slot->frameCount = ((frameCount - offset) < AUDIO_BLOCK_FRAMES) ? (frameCount - offset) : AUDIO_BLOCK_FRAMES;
+		std::memcpy(slot->samples, samples + (offset * AUDIO_CHANNELS), slot->frameCount * AUDIO_CHANNELS * sizeof(float));
+		audioQueue.end_push();
+
+		offset += slot->frameCount;
+	}
+
+	end_submit();
+}
+
+int CaptureSink::writer_proc(CaptureSink *context) {
+	context->writer_loop();
+	return 0;
+}
+
+void CaptureSink::writer_loop() {
+	while (writerShouldRun.load()) {
+		//Not short circuited; both queues are serviced every pass
+		const bool didWork = drain_frames() | drain_audio();
+
+		if (!didWork) {
+			Sleep(1);
+		}
+	}
+
+	//Pick up anything queued between the last pass and stop() being called
+	drain_frames();
+	drain_audio();
+
+	flush_video();
+	flush_audio();
+}
+
+const bool CaptureSink::drain_frames() {
+	bool didWork = false;
+
+	for (CapturedFrame *frame = frameQueue.front(); frame != nullptr; frame = frameQueue.front()) {
+		encode_frame(*frame);
+		frameQueue.pop();
+		didWork = true;
+	}
+
+	return didWork;
+}
+
+const bool CaptureSink::drain_audio() {
+	bool didWork = false;
+
+	for (CapturedAudio *block = audioQueue.front(); block != nullptr; block = audioQueue.front()) {
+		const dword bytes = block->frameCount * AUDIO_CHANNELS * sizeof(float);
+
+		if ((audioBatchUsed + bytes) > audioBatchSize) {
+			flush_audio();
+		}
+
+		std::memcpy(audioBatch + audioBatchUsed, block->samples, bytes);
+		audioBatchUsed += bytes;
+		audioBytesWritten += bytes;
+
+		audioQueue.pop();
+		didWork = true;
+	}
+
+	return didWork;
+}
+
+void CaptureSink::encode_frame(const CapturedFrame &frame) {
+	std::memcpy(converter.indices, frame.indices, sizeof(frame.indices));
+	std::memcpy(converter.emphasis, frame.emphasis, sizeof(frame.emphasis));
+	converter.convert_to_rgba(rgbaFrame);
+
+	const dword *pixels = rgbaFrame;
+	if (scaledFrame != nullptr) {
+		scaler.scale(rgbaFrame, scaledFrame);
+		pixels = scaledFrame;
+	}
+
+	const dword pixelCount = scaler.get_output_width() * scaler.get_output_height();
+
+	if ((videoBatchUsed + Y4M_FRAME_HEADER_LENGTH + (pixelCount * 3)) > videoBatchSize) {
+		flush_video();
+	}
+
+	MAGSNES::byte *out = videoBatch + videoBatchUsed;
+	std::memcpy(out, Y4M_FRAME_HEADER, Y4M_FRAME_HEADER_LENGTH);
+	out += Y4M_FRAME_HEADER_LENGTH;
+
+	MAGSNES::byte *planeY = out, *planeU = out + pixelCount, *planeV = out + (pixelCount * 2);
+
+	//BT.601, studio range
+	for (dword i = 0; i < pixelCount; i++) {
+		const int r = pixels[i] & 0xFF, g = (pixels[i] >> 8) & 0xFF, b = (pixels[i] >> 16) & 0xFF;
+
+		planeY[i] = (MAGSNES::byte)((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+		planeU[i] = (MAGSNES::byte)((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+		planeV[i] = (MAGSNES::byte)((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+	}
+
+	videoBatchUsed += Y4M_FRAME_HEADER_LENGTH + (pixelCount * 3);
+	framesWritten++;
+}
+
+void CaptureSink::flush_video() {
+	if (videoBatchUsed > 0) {
+		std::fwrite(videoBatch, 1, videoBatchUsed, videoFile);
+		videoBatchUsed = 0;
+	}
+}
+
+void CaptureSink::flush_audio() {
+	if (audioBatchUsed > 0) {
+		std::fwrite(audioBatch, 1, audioBatchUsed, audioFile);
+		audioBatchUsed = 0;
+	}
+}
+
+//Canonical 44 byte RIFF header for 32 bit float stereo
+void CaptureSink::write_wav_header(const dword dataBytes) {
+	MAGSNES::byte header[WAV_HEADER_SIZE];
+	const word blockAlign = AUDIO_CHANNELS * sizeof(float);
+
+	std::memcpy(header, "RIFF", 4);
+	put_dword(header + 4, (WAV_HEADER_SIZE - 8) + dataBytes);
+	std::memcpy(header + 8, "WAVE", 4);
+
+	std::memcpy(header + 12, "fmt ", 4);
+	put_dword(header + 16, 16);
+	put_word(header + 20, WAV_FORMAT_IEEE_FLOAT);
+	put_word(header + 22, AUDIO_CHANNELS);
+	put_dword(header + 24, sampleRate);
+	put_dword(header + 28, sampleRate * blockAlign);
+	put_word(header + 32, blockAlign);
+	put_word(header + 34, sizeof(float) * 8);
+
+	std::memcpy(header + 36, "data", 4);
+	put_dword(header + 40, dataBytes);
+
+	std::fseek(audioFile, 0, SEEK_SET);
+	std::fwrite(header, 1, WAV_HEADER_SIZE, audioFile);
+}
+
+void CaptureSink::release_buffers() {
+	delete[] rgbaFrame;
+	delete[] scaledFrame;
+	delete[] videoBatch;
+	delete[] audioBatch;
+
+	rgbaFrame = scaledFrame = nullptr;
+	videoBatch = audioBatch = nullptr;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "FrameBuffer.h"
+#include "FrameScaler.h"
+#include "SPSCQueue.h"
+
+namespace MAGSNES {
+
+//Records gameplay to an uncompressed Y4M (video) and WAV (audio) pair.
+//The exec thread hands over each finished frame, and the audio thread each block of samples it renders; both are copied into
+//preallocated queue slots and everything else (color conversion, scaling, disk I/O) happens on the sink's own writer thread.
+//A producer never waits: if the writer falls behind and a queue is full, the frame/block is dropped and counted instead.
+class CaptureSink {
+public:
+	CaptureSink();
+	~CaptureSink();
+
+	//Opens <basePath>.y4m and <basePath>.wav and starts the writer thread. Frames are scaled with filter before being encoded.
+	//Fails without the palette index framebuffer (Core::videoRegs.usePaletteIndexFramebuffer), since frames are only handed over in that form.
+	const bool start(const char * const basePath, const dword sampleRate, const FrameScaler::Filter filter = FrameScaler::Filter::NONE);
+
+	//Waits for any submit already under way, then flushes everything still queued, finalizes the WAV header, and closes both files
+	void stop();
+
+	const bool is_capturing() const { return capturing.load(std::memory_order_acquire); }
+
+	//Same palette the PPU gives its FrameBuffer
+	void load_palette(const dword * const nesPalette);
+
+	//Called from the exec thread when a frame is complete
+	void submit_frame(const FrameBuffer &frame);
+
+	//Called from the audio thread with interleaved stereo float samples
+	void submit_audio(const float * const samples, const dword frameCount);
+
+private:
+	static const dword FRAME_QUEUE_SIZE = 32;		//Just over half a second of video
+	static const dword AUDIO_BLOCK_FRAMES = 1024;
+	static const dword AUDIO_QUEUE_SIZE = 256;		//~5 seconds at 48KHz
+	static const dword AUDIO_CHANNELS = 2;
+
+	struct CapturedFrame {
+		MAGSNES::byte indices[FRAME_PIXEL_COUNT];
+		MAGSNES::byte emphasis[NES_SCREEN_HEIGHT];
+	};
+
+	struct CapturedAudio {
+		dword frameCount;
+		float samples[AUDIO_BLOCK_FRAMES * AUDIO_CHANNELS];
+	};
+
+	SPSCQueue<CapturedFrame, FRAME_QUEUE_SIZE> frameQueue;
+	SPSCQueue<CapturedAudio, AUDIO_QUEUE_SIZE> audioQueue;
+
+	std::atomic<bool> capturing;
+	//Producers inside submit_frame/submit_audio; stop waits for this to reach 0 before the writer drains the queues for the last time
+	std::atomic<dword> activeSubmitters;
+	std::atomic<bool> writerShouldRun;
+	std::thread *writerThread;
+
+	//Counted by the producers, reported when the capture stops
+	std::atomic<dword> framesDropped;
+	std::atomic<dword> audioBlocksDropped;
+
+	//*****Owned by the writer thread while capturing*****
+	std::FILE *videoFile, *audioFile;
+	dword sampleRate;
+	dword audioBytesWritten;
+	dword framesWritten;
+
+	FrameBuffer converter;
+	FrameScaler scaler;
+	dword *rgbaFrame, *scaledFrame;
+
+	//Output is collected here and written in large chunks
+	MAGSNES::byte *videoBatch, *audioBatch;
+	dword videoBatchUsed, audioBatchUsed;
+	dword videoBatchSize, audioBatchSize;
+
+	//A producer calls begin_submit before touching a queue, and only goes ahead (then calls end_submit) if it returns true
+	const bool begin_submit();
+	void end_submit() { activeSubmitters.fetch_sub(1, std::memory_order_release); }
+
+	__CLASSMETHOD__ int writer_proc(CaptureSink *context);
+	void writer_loop();
+
+	//Returns true if anything was dequeued
+	const bool drain_frames();
+	const bool drain_audio();
+
+	void encode_frame(const CapturedFrame &frame);
+	void flush_video();
+	void flush_audio();
+
+	void write_wav_header(const dword dataBytes);
+	void release_buffers();
+};
+
+} /* namespace MAGSNES */
@@ -1,11 +1,15 @@
 #include "Core.h"
 
 #include <ShObjIdl.h> //For file dialog
+#include <ctime>
+#include <cstring>
 
 //Many of these are cached variables that are used in WndProc
 __FILESCOPE__{
 	const wchar_t * const APP_NAME = L"MAGSNES";
 	const wchar_t * const WINDOW_TITLE = L"MAGSNES - SNES Emulator by Matt Gukowsky";
+	const char * const TELEMETRY_DUMP_PATH = "MAGSNES_timings.json";
+
 	const wchar_t * const APP_ABOUT = L"Thanks for using MAGSNES \xA9 2016, an SNES emulator by Matt Gukowsky."\
 																		" Check it out on GitHub at www.github.com/mgukowsky/magsnes";
 
@@ -21,8 +25,8 @@ __FILESCOPE__{
 using namespace MAGSNES;
 
 Core::Core()
-	: hwnd(NULL), shouldRun(true), shouldHalt(false), shouldDrawFrame(false), shouldEmulate(false), isExecRunning(false),
-		threadManager(nullptr), framesDrawn(0),
+	: hwnd(NULL), shouldRun(true), shouldHalt(false), shouldDumpTrace(false), shouldEmulate(false), isExecRunning(false),
+		threadManager(nullptr), captureSink(nullptr), telemetry(nullptr), syncPacer(nullptr), apuSampleQueue(nullptr), framesDrawn(0),
 		bootProc(nullptr) { 
 
 	std::memset(&audioRegs, 0, sizeof(AudioRegs));
@@ -32,7 +36,20 @@ Core::Core()
 	audioRegs.triangleImplicitOff = true;
 	audioRegs.baseAmp = 0.01; //Adjust for mixing purposes
 
+	std::memset(&videoRegs, 0, sizeof(VideoRegs));
+	videoRegs.usePaletteIndexFramebuffer = true;
+	videoRegs.useStreamingUpload = true;
+	videoRegs.presentFilter = FrameScaler::Filter::NONE;
+	videoRegs.captureFilter = FrameScaler::Filter::NONE;
+
+	std::memset(&cpuRegs, 0, sizeof(CPURegs));
+	cpuRegs.syncPolicy = SyncPacer::Policy::AUDIO;
+
 	threadManager = new ThreadManager(GetCurrentThreadId());
+	captureSink = new CaptureSink();
+	telemetry = new Telemetry();
+	syncPacer = new SyncPacer();
+	apuSampleQueue = new SPSCQueue<APUSampleBlock, 64>();
 	QueryPerformanceFrequency(&CPU_FREQ);
 	QueryPerformanceCounter(&PROGRAM_START);
 	for (int i = 0; i < 256; i++) {
@@ -42,6 +59,10 @@ Core::Core()
 
 Core::~Core() {
 	delete threadManager;
+	delete captureSink;
+	delete telemetry;
+	delete syncPacer;
+	delete apuSampleQueue;
 
 	//Windows cleanup
 	if (hwnd != NULL) {
@@ -91,6 +112,56 @@ LRESULT CALLBACK Core::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam
 		case IDM_MENU_EMULATION_RESUME:
 			sysCore.shouldHalt = false;
 			break;
+		case IDM_MENU_EMULATION_RECORD_START:
+			if (sysCore.start_capture()) {
+				EnableMenuItem(hmenuCached, IDM_MENU_EMULATION_RECORD_START, MF_DISABLED);
+				EnableMenuItem(hmenuCached, IDM_MENU_EMULATION_RECORD_STOP, MF_ENABLED);
+			}
+			break;
+		case IDM_MENU_EMULATION_RECORD_STOP:
+			sysCore.captureSink->stop();
+			EnableMenuItem(hmenuCached, IDM_MENU_EMULATION_RECORD_START, MF_ENABLED);
+			EnableMenuItem(hmenuCached, IDM_MENU_EMULATION_RECORD_STOP, MF_DISABLED);
+			break;
+		case IDM_MENU_EMULATION_DUMP_TIMINGS:
+			sysCore.telemetry->dump(TELEMETRY_DUMP_PATH);
+			break;
+		case IDM_MENU_EMULATION_DUMP_TRACE:
+			sysCore.shouldDumpTrace = true;
+			break;
+		//Read at the start of every frame
+		case IDM_MENU_OPTIONS_FRAMESKIP_0:
+		case IDM_MENU_OPTIONS_FRAMESKIP_1:
+		case IDM_MENU_OPTIONS_FRAMESKIP_2:
+		case IDM_MENU_OPTIONS_FRAMESKIP_3:
+			sysCore.videoRegs.framesToSkip = (dword)(wParam - IDM_MENU_OPTIONS_FRAMESKIP_0);
+			CheckMenuRadioItem(hmenuCached, IDM_MENU_OPTIONS_FRAMESKIP_0, IDM_MENU_OPTIONS_FRAMESKIP_3, (UINT)wParam, MF_BYCOMMAND);
+			break;
+		//Read when the next ROM starts; the items are in SyncPacer::Policy order
+		case IDM_MENU_OPTIONS_SYNC_TIMER:
+		case IDM_MENU_OPTIONS_SYNC_AUDIO:
+		case IDM_MENU_OPTIONS_SYNC_VSYNC:
+		case IDM_MENU_OPTIONS_SYNC_FREE_RUN:
+			sysCore.cpuRegs.syncPolicy = (SyncPacer::Policy)(wParam - IDM_MENU_OPTIONS_SYNC_TIMER);
+			CheckMenuRadioItem(hmenuCached, IDM_MENU_OPTIONS_SYNC_TIMER, IDM_MENU_OPTIONS_SYNC_FREE_RUN, (UINT)wParam, MF_BYCOMMAND);
+			break;
+		//CPU options are read when the next ROM is loaded
+		case IDM_MENU_OPTIONS_CPU_RECOMPILER:
+			sysCore.cpuRegs.useRecompiler = !sysCore.cpuRegs.useRecompiler;
+			CheckMenuItem(hmenuCached, IDM_MENU_OPTIONS_CPU_RECOMPILER, sysCore.cpuRegs.useRecompiler ? MF_CHECKED : MF_UNCHECKED);
+			break;
+		case IDM_MENU_OPTIONS_CPU_CHECK_RECOMPILER:
+			sysCore.cpuRegs.checkRecompiler = !sysCore.cpuRegs.checkRecompiler;
+			CheckMenuItem(hmenuCached, IDM_MENU_OPTIONS_CPU_CHECK_RECOMPILER, sysCore.cpuRegs.checkRecompiler ? MF_CHECKED : MF_UNCHECKED);
+			break;
+		case IDM_MENU_OPTIONS_CPU_CYCLE_ACCURATE:
+			sysCore.cpuRegs.cycleAccurate = !sysCore.cpuRegs.cycleAccurate;
+			CheckMenuItem(hmenuCached, IDM_MENU_OPTIONS_CPU_CYCLE_ACCURATE, sysCore.cpuRegs.cycleAccurate ? MF_CHECKED : MF_UNCHECKED);
+			break;
+		case IDM_MENU_OPTIONS_CPU_TRACE:
+			sysCore.cpuRegs.traceInstructions = !sysCore.cpuRegs.traceInstructions;
+			CheckMenuItem(hmenuCached, IDM_MENU_OPTIONS_CPU_TRACE, sysCore.cpuRegs.traceInstructions ? MF_CHECKED : MF_UNCHECKED);
+			break;
 		case IDM_MENU_ABOUT:
 			sysCore.shouldHalt = true;
 			MessageBoxW(NULL, APP_ABOUT, L"MAGSNES - About", MB_ICONINFORMATION | MB_OK | MB_TASKMODAL);
@@ -252,6 +323,36 @@ const bool Core::select_file() {
 	return true;
 }
 
+const bool Core::start_capture() {
+	if (!shouldEmulate) {
+		alert_message("Open a ROM before starting a recording.");
+		return false;
+	}
+
+	//Strip the extension from the ROM's path
+	char basePath[MAX_PATH];
+	strcpy_s(basePath, fileSelection);
+
+	char *extension = std::strrchr(basePath, '.');
+	if (extension != nullptr) {
+		*extension = '\0';
+	}
+
+	//The timestamp keeps recordings from overwriting each other; a path this long would be cut short, so don't record at all
+	char capturePath[MAX_PATH];
+	if (_snprintf_s(capturePath, _TRUNCATE, "%s_%llu", basePath, (qword)std::time(nullptr)) < 0) {
+		alert_error("The ROM's path is too long to record next to it.");
+		return false;
+	}
+
+	if (!captureSink->start(capturePath, audioRegs.SAMPLE_FREQUENCY, videoRegs.captureFilter)) {
+		alert_error("Unable to start recording.");
+		return false;
+	}
+
+	return true;
+}
+
 void Core::execute_keyboard_shortcut(const WPARAM wParam) {
 	switch (wParam) {
 	case 'P':
@@ -260,5 +361,11 @@ void Core::execute_keyboard_shortcut(const WPARAM wParam) {
 	case 'R':
 		PostMessage(hwnd, WM_COMMAND, IDM_MENU_EMULATION_RESUME, NULL);
 		break;
+	case 'T':
+		PostMessage(hwnd, WM_COMMAND, IDM_MENU_EMULATION_DUMP_TIMINGS, NULL);
+		break;
+	case 'D':
+		PostMessage(hwnd, WM_COMMAND, IDM_MENU_EMULATION_DUMP_TRACE, NULL);
+		break;
 	}
 }
\ No newline at end of file
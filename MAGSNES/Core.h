@@ -5,6 +5,11 @@
 #include <gl/glew.h>
 
 #include "resource.h"
+#include "FrameScaler.h"
+#include "CaptureSink.h"
+#include "Telemetry.h"
+#include "SyncPacer.h"
+#include "SPSCQueue.h"
 
 namespace MAGSNES {
 	
@@ -21,6 +26,10 @@ public:
 	Callback bootProc;
 
 	struct AudioRegs {
+		//Rate the channels are synthesized at, whatever the device runs at; the AudioManager resamples it to SAMPLE_FREQUENCY
+		static const dword APU_SAMPLE_FREQUENCY = SyncPacer::CPU_CYCLES_PER_SECOND / 40;
+
+		//The audio device's rate
 		dword SAMPLE_FREQUENCY;
 		float baseAmp, triangleAmp;
 		float square0Period, square0positiveAmp, square0negativeAmp,
@@ -30,6 +39,51 @@ public:
 		bool square0ImplicitOff, square1ImplicitOff, triangleImplicitOff;
 	} audioRegs;
 
+	struct VideoRegs {
+		//When set, the PPU writes 1 byte palette indices into the GLManager's FrameBuffer, and conversion to RGBA is deferred
+		//until the frame is presented. Otherwise the PPU expands each line to RGBA dwords in the frame it is drawing.
+		bool usePaletteIndexFramebuffer;
+
+		//When set (and the driver supports GL 3.0), frames are streamed to an immutable texture through a pair of pixel buffer objects
+		//and drawn with a shader quad. Otherwise the legacy glTexSubImage2D + immediate mode path is used.
+		bool useStreamingUpload;
+
+		//CPU-side filter applied to each frame before it is uploaded. Read once when GL is set up, since it fixes the texture size.
+		FrameScaler::Filter presentFilter;
+
+		//Filter applied to recorded frames; read when a capture starts
+		FrameScaler::Filter captureFilter;
+
+		//How many frames the PPU skips drawing after each one it draws (0 draws every frame; set from Options > Frame Skip), for
+		//fast-forwarding and batch runs. Skipped frames still produce everything the CPU can see (vblank, NMI, sprite overflow and
+		//sprite 0 hit), so games run exactly the same. Read at the start of every frame.
+		dword framesToSkip;
+	} videoRegs;
+
+	struct CPURegs {
+		//When set (and the CPU was built with CPU_RECOMPILER), runs of 6502 code are translated to x86-64 and run natively.
+		//Read when the CPU is created, i.e. when a ROM is loaded.
+		bool useRecompiler;
+
+		//When set along with useRecompiler, every recompiled block is rerun on the interpreter and any difference is logged.
+		//Far slower than either alone; only meant for tracking down recompiler bugs.
+		bool checkRecompiler;
+
+		//When set, the CPU runs every instruction on the interpreter and brings the PPU, APU, controller and mapper up to date
+		//at each I/O register or mapper access, so they see it in the cycle it happens in. Otherwise they are run once per
+		//instruction (or block) afterwards. Slower, but the reference to check the fast paths against. Read when the ROM is loaded,
+		//and turns off every fast path: useRecompiler, the decode cache, instruction fusion and idle loop skipping.
+		bool cycleAccurate;
+
+		//When set (and the CPU was built with CPU_TRACE), every instruction is recorded in a ring that is written out on an
+		//invalid opcode or when asked for (shouldDumpTrace). Read when the ROM is loaded, and turns off useRecompiler.
+		bool traceInstructions;
+
+		//Which clock the exec thread paces emulation by (see SyncPacer::Policy); AUDIO unless changed from Options > Sync To.
+		//Read each time emulation starts. Set back to TIMER if the audio clock stops (no audio device, or it failed).
+		SyncPacer::Policy syncPolicy;
+	} cpuRegs;
+
 	//*****TODO: put these flags into a struct*****
 	//This flag controls when the main message pump should continue running
 	bool shouldRun;
@@ -40,8 +94,8 @@ public:
 	//This flag controls whether the child threads should execute or remain idle
 	bool shouldHalt;
 
-	//Controls when the video thread should draw the contents of one of its buffers
-	bool shouldDrawFrame;
+	//Asks the exec thread to write out the CPU trace; it clears this once it has
+	bool shouldDumpTrace;
 
 	//Signals to the video thread that the execution thread is still running, so it must not exit and delete the dependencies it owns which the
 	//execution thread is still using
@@ -52,6 +106,23 @@ public:
 
 	ThreadManager *threadManager;
 
+	//Gameplay recording. The PPU and AudioManager feed it while is_capturing() is true.
+	CaptureSink *captureSink;
+
+	//Frame timing samples from the exec, video, and audio threads
+	Telemetry *telemetry;
+
+	//Paces the exec thread by the clock cpuRegs.syncPolicy picks; the audio and video threads drive their clocks through it
+	SyncPacer *syncPacer;
+
+	//Noise and DMC run on the exec thread at CPU cycle resolution, so rather than registers they hand the audio thread finished samples
+	//at APU_SAMPLE_FREQUENCY, a block at a time, to mix in with the other channels
+	struct APUSampleBlock {
+		static const dword SAMPLE_COUNT = 256;
+		float samples[SAMPLE_COUNT];
+	};
+	SPSCQueue<APUSampleBlock, 64> *apuSampleQueue;
+
 	char fileSelection[MAX_PATH];
 	bool activeKeys[256];
 
@@ -107,13 +178,13 @@ public:
 	void set_channel_period(const float rawFrequency, const Core::AudioChannelID id) {
 		switch (id) {
 		case Core::AudioChannelID::SQUARE_0:
-			audioRegs.square0Period = audioRegs.SAMPLE_FREQUENCY / rawFrequency;
+			audioRegs.square0Period = AudioRegs::APU_SAMPLE_FREQUENCY / rawFrequency;
 			break;
 		case Core::AudioChannelID::SQUARE_1:
-			audioRegs.square1Period = audioRegs.SAMPLE_FREQUENCY / rawFrequency;
+			audioRegs.square1Period = AudioRegs::APU_SAMPLE_FREQUENCY / rawFrequency;
 			break;
 		case Core::AudioChannelID::TRIANGLE:
-			audioRegs.trianglePeriod = audioRegs.SAMPLE_FREQUENCY / rawFrequency;
+			audioRegs.trianglePeriod = AudioRegs::APU_SAMPLE_FREQUENCY / rawFrequency;
 			break;
 		}
 	}
@@ -140,6 +211,9 @@ private:
 	qword framesDrawn;
 
 	const bool select_file();
+
+	//Starts recording next to the loaded ROM, as <ROM name>_<timestamp>.y4m/.wav
+	const bool start_capture();
 	void execute_keyboard_shortcut(const WPARAM wParam); //Post messages when keys are pressed when CTRL is held
 };
 
@@ -2,8 +2,310 @@
 
 #ifdef TEST_BUILD
 
-__FILE_SCOPE__{
-	
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioResampler.h"
+#include "CPU.h"
+#include "FrameScaler.h"
+#include "LineCompositor.h"
+
+__FILESCOPE__{
+	//Each filter has to leave plenty of the 16.6ms frame for emulation
+	const MAGSNES::qword SCALER_BUDGET_MICROSECONDS = 1000;
+	//Compositing all 240 lines is part of emulating every frame
+	const MAGSNES::qword COMPOSITOR_BUDGET_MICROSECONDS = 500;
+	const int BENCHMARK_FRAMES = 200;
+
+	//Resampling a second of audio should cost next to nothing next to emulating it
+	const MAGSNES::qword RESAMPLER_BUDGET_MICROSECONDS = 2000;
+	const MAGSNES::dword BENCHMARK_AUDIO_SECONDS = 10;
+	const MAGSNES::dword BENCHMARK_DEVICE_RATE = 48000;
+	//About what the audio thread asks for each time it wakes up
+	const MAGSNES::dword BENCHMARK_AUDIO_CHUNK = 800;
+	const double BENCHMARK_TONE_FREQUENCY = 1000.0;
+	//The filter is good for ~75dB; anything much worse means the phases or the history are off
+	const double RESAMPLER_MIN_SNR_DB = 70.0;
+
+	//*****CPU test data, relative to the working directory*****
+	const char * const NESTEST_ROM_PATH = "tests/nestest.nes";
+	const char * const NESTEST_LOG_PATH = "tests/nestest.log";
+	//One file of per-opcode vectors (initial state, final state, bus cycles) for each opcode, in the nes6502 JSON format
+	const char * const TEST_VECTOR_PATH_FORMAT = "tests/nes6502/%02x.json";
+
+	const MAGSNES::dword INES_HEADER_SIZE = 16;
+	const MAGSNES::dword PRG_BANK_SIZE = 0x4000;
+	//nestest.log starts counting after the reset sequence
+	const MAGSNES::qword NESTEST_START_CYCLE = 7;
+
+	const bool read_file(const char * const path, std::vector<char> &contents) {
+		std::FILE *file;
+		if (fopen_s(&file, path, "rb") != 0) {
+			return false;
+		}
+
+		std::fseek(file, 0, SEEK_END);
+		const long size = std::ftell(file);
+		std::fseek(file, 0, SEEK_SET);
+
+		contents.resize((size > 0) ? size : 0);
+		const bool wasRead = (size > 0) && (std::fread(contents.data(), 1, size, file) == (size_t)size);
+		std::fclose(file);
+
+		return wasRead;
+	}
+
+	//The CPU state at the start of one line of nestest.log
+	struct NestestState {
+		MAGSNES::dword pc, a, x, y, p, sp;
+		MAGSNES::qword cycle;
+	};
+
+	//Lines look like "C000  4C F5 C5  JMP $C5F5   ...   A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7"
+	const bool parse_nestest_line(const char * const line, NestestState &state) {
+		const char * const registers = std::strstr(line, "A:");
+		const char * const cycle = std::strstr(line, "CYC:");
+
+		return (registers != nullptr) && (cycle != nullptr) &&
+			(sscanf_s(line, "%4x", &state.pc) == 1) &&
+			(sscanf_s(registers, "A:%2x X:%2x Y:%2x P:%2x SP:%2x", &state.a, &state.x, &state.y, &state.p, &state.sp) == 5) &&
+			(sscanf_s(cycle, "CYC:%llu", &state.cycle) == 1);
+	}
+
+	void format_nestest_state(const NestestState &state, char * const dst, const size_t size) {
+		sprintf_s(dst, size, "%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu", state.pc, state.a, state.x, state.y, state.p, state.sp,
+			state.cycle);
+	}
+
+	//*****Test vectors*****
+	struct RAMValue {
+		MAGSNES::word addr;
+		MAGSNES::byte val;
+	};
+
+	struct VectorState {
+		MAGSNES::word pc;
+		MAGSNES::byte s, a, x, y, p;
+		std::vector<RAMValue> ram;
+	};
+
+	struct BusCycle {
+		MAGSNES::word addr;
+		bool isWrite;
+	};
+
+	struct TestVector {
+		std::string name;
+		VectorState initial, final;
+		std::vector<BusCycle> cycles;
+	};
+
+	//Just enough JSON for the test vectors: objects, arrays, strings without escapes, and unsigned integers. Anything unexpected
+	//stops the reader, after which every accept() fails, so loops over its input always end.
+	class JSONReader {
+	public:
+		JSONReader(const char * const text)
+			: cursor(text), isValid(true) {}
+
+		const bool is_valid() const { return isValid; }
+
+		//Consumes c if it comes next
+		const bool accept(const char c) {
+			skip_whitespace();
+			if (*cursor != c) {
+				return false;
+			}
+
+			cursor++;
+			return true;
+		}
+
+		void expect(const char c) {
+			if (!accept(c)) {
+				stop();
+			}
+		}
+
+		const MAGSNES::dword read_number() {
+			skip_whitespace();
+			if ((*cursor < '0') || (*cursor > '9')) {
+				stop();
+				return 0;
+			}
+
+			MAGSNES::dword val = 0;
+			while ((*cursor >= '0') && (*cursor <= '9')) {
+				val = (val * 10) + (*cursor++ - '0');
+			}
+			return val;
+		}
+
+		const std::string read_string() {
+			expect('"');
+			const char * const start = cursor;
+			while ((*cursor != '"') && (*cursor != '\0')) {
+				cursor++;
+			}
+
+			const std::string val(start, cursor);
+			expect('"');
+			return val;
+		}
+
+		void skip_value() {
+			skip_whitespace();
+			if (*cursor == '"') {
+				read_string();
+			} else if (accept('[')) {
+				if (!accept(']')) {
+					do { skip_value(); } while (accept(','));
+					expect(']');
+				}
+			} else if (accept('{')) {
+				if (!accept('}')) {
+					do { read_string(); expect(':'); skip_value(); } while (accept(','));
+					expect('}');
+				}
+			} else {
+				read_number();
+			}
+		}
+
+	private:
+		const char *cursor;
+		bool isValid;
+
+		void skip_whitespace() {
+			while ((*cursor == ' ') || (*cursor == '\n') || (*cursor == '\r') || (*cursor == '\t')) {
+				cursor++;
+			}
+		}
+
+		void stop() {
+			isValid = false;
+			cursor = "";
+		}
+	};
+
+	void read_vector_state(JSONReader &json, VectorState &state) {
+		state.ram.clear();
+
+		json.expect('{');
+		do {
+			const std::string key = json.read_string();
+			json.expect(':');
+
+			if (key == "pc") {
+				state.pc = (MAGSNES::word)json.read_number();
+			} else if (key == "s") {
+				state.s = (MAGSNES::byte)json.read_number();
+			} else if (key == "a") {
+				state.a = (MAGSNES::byte)json.read_number();
+			} else if (key == "x") {
+				state.x = (MAGSNES::byte)json.read_number();
+			} else if (key == "y") {
+				state.y = (MAGSNES::byte)json.read_number();
+			} else if (key == "p") {
+				state.p = (MAGSNES::byte)json.read_number();
+			} else if ((key == "ram") && json.accept('[') && !json.accept(']')) {
+				do {
+					RAMValue ram;
+					json.expect('[');
+					ram.addr = (MAGSNES::word)json.read_number();
+					json.expect(',');
+					ram.val = (MAGSNES::byte)json.read_number();
+					json.expect(']');
+					state.ram.push_back(ram);
+				} while (json.accept(','));
+				json.expect(']');
+			} else if (key != "ram") {
+				json.skip_value();
+			}
+		} while (json.accept(','));
+		json.expect('}');
+	}
+
+	//Reads the next vector of the array; false at the end of it
+	const bool read_test_vector(JSONReader &json, TestVector &vec) {
+		if (!json.accept('{')) {
+			return false;
+		}
+
+		vec.cycles.clear();
+
+		do {
+			const std::string key = json.read_string();
+			json.expect(':');
+
+			if (key == "name") {
+				vec.name = json.read_string();
+			} else if (key == "initial") {
+				read_vector_state(json, vec.initial);
+			} else if (key == "final") {
+				read_vector_state(json, vec.final);
+			} else if ((key == "cycles") && json.accept('[') && !json.accept(']')) {
+				do {
+					BusCycle cycle;
+					json.expect('[');
+					cycle.addr = (MAGSNES::word)json.read_number();
+					json.expect(',');
+					json.skip_value();		//The value on the bus
+					json.expect(',');
+					cycle.isWrite = (json.read_string() == "write");
+					json.expect(']');
+					vec.cycles.push_back(cycle);
+				} while (json.accept(','));
+				json.expect(']');
+			} else if (key != "cycles") {
+				json.skip_value();
+			}
+		} while (json.accept(','));
+		json.expect('}');
+
+		//Separates this vector from the next
+		json.accept(',');
+		return json.is_valid();
+	}
+
+	//The vectors assume 64KB of plain RAM. Here $0800-$1FFF mirror $0000-$07FF, $2000-$401F are I/O registers and writes to
+	//$8000-$FFFF go to the mapper, so vectors that touch any of those are skipped. So are instructions that run past $FFFF, since
+	//the CPU reads an instruction's bytes without wrapping.
+	const bool fits_plain_memory(const TestVector &vec) {
+		if (vec.initial.pc > 0xFFFD) {
+			return false;
+		}
+
+		for (const BusCycle &cycle : vec.cycles) {
+			if (((cycle.addr >= 0x0800) && (cycle.addr < 0x4020)) || (cycle.isWrite && (cycle.addr & 0x8000))) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	//Resamples input to output in chunks, the way the audio thread does, with the ratio wobbling by up to wobble either side of 1
+	void resample_in_chunks(MAGSNES::AudioResampler &resampler, const std::vector<float> &input, std::vector<float> &output, const float wobble) {
+		MAGSNES::dword consumed = 0;
+
+		for (MAGSNES::dword done = 0, chunk = 0; done < output.size(); done += BENCHMARK_AUDIO_CHUNK, chunk++) {
+			const MAGSNES::dword count = ((output.size() - done) < BENCHMARK_AUDIO_CHUNK) ? (MAGSNES::dword)(output.size() - done) : BENCHMARK_AUDIO_CHUNK;
+			const float ratio = 1.0f + (wobble * (float)std::sin(chunk * 0.1));
+
+			MAGSNES::dword needed = resampler.get_input_needed(count, ratio);
+			needed = ((consumed + needed) > input.size()) ? (MAGSNES::dword)(input.size() - consumed) : needed;
+
+			std::memcpy(resampler.begin_push(needed), input.data() + consumed, needed * sizeof(float));
+			resampler.end_push(needed);
+			consumed += needed;
+
+			resampler.pull(output.data() + done, count, 1, ratio);
+		}
+	}
 }
 
 using namespace MAGSNES;
@@ -21,11 +323,427 @@ void Debugger::run_all_tests() {
 	set_output_color(ScreenColor::LIGHT_BLUE);
 	std::cout << "Running all tests...\n\n";
 	run_cpu_tests();
+	run_video_benchmarks();
+	run_audio_benchmarks();
 }
 
 void Debugger::run_cpu_tests() {
 	set_output_color(ScreenColor::LIGHT_BLUE);
 	std::cout << "Running CPU tests...\n";
+	set_output_color(ScreenColor::WHITE);
+
+	run_nestest(false);
+#ifdef CPU_DECODE_CACHE
+	run_nestest(true);
+#endif
+	run_test_vectors();
+}
+
+MAGSNES::byte Debugger::step_cpu(CPU &cpu, const bool useDecodeCache) {
+#ifdef CPU_DECODE_CACHE
+	if (useDecodeCache && (cpu.regPC & 0x8000)) {
+		const CPU::DecodedOp * const op = cpu.get_decoded(cpu.regPC);
+		if (op != nullptr) {
+			return cpu.run_decoded(*op);
+		}
+	}
+#endif
+
+	return cpu.execute(cpu.refMM[cpu.regPC]);
+}
+
+void Debugger::run_nestest(const bool useDecodeCache) {
+	std::cout << "\tnestest (" << (useDecodeCache ? "decode cache" : "interpreter") << ") ... ";
+
+	std::vector<char> rom;
+	std::FILE *logFile;
+	if (!read_file(NESTEST_ROM_PATH, rom) || (rom.size() < (INES_HEADER_SIZE + PRG_BANK_SIZE))) {
+		report_skipped("tests/nestest.nes not found");
+		return;
+	}
+	if (fopen_s(&logFile, NESTEST_LOG_PATH, "r") != 0) {
+		report_skipped("tests/nestest.log not found");
+		return;
+	}
+
+	Bus *bus = new Bus();
+	CPU *cpu = new CPU(bus);
+
+	//Nothing here touches the PPU, but the CPU needs somewhere to point
+	byte ppuData = 0, ppuPalettes[0x20] = {};
+	word ppuAddr = 0;
+	const word ppuPixel = 0, ppuScanline = 0;
+	cpu->connect_to_ppu(&ppuData, ppuPalettes, &ppuAddr, &ppuPixel, &ppuScanline);
+
+	//NROM with a single 16KB bank, which appears at both $8000 and $C000
+	std::memcpy(&bus->mainMemory[0x8000], &rom[INES_HEADER_SIZE], PRG_BANK_SIZE);
+	std::memcpy(&bus->mainMemory[0xC000], &rom[INES_HEADER_SIZE], PRG_BANK_SIZE);
+	cpu->map_prg_bank(0x8000, PRG_BANK_SIZE, 0);
+	cpu->map_prg_bank(0xC000, PRG_BANK_SIZE, 0);
+
+	cpu->regPC = 0xC000;
+	cpu->regSP = 0xFD;
+	cpu->set_status(0x24);
+
+	NestestState expected, actual;
+	actual.cycle = NESTEST_START_CYCLE;
+
+	char line[256], expectedText[96], actualText[96];
+	dword lineCount = 0;
+	bool matches = true;
+
+	while (std::fgets(line, sizeof(line), logFile) && parse_nestest_line(line, expected)) {
+		actual.pc = cpu->regPC;
+		actual.a = cpu->regA;
+		actual.x = cpu->regX;
+		actual.y = cpu->regY;
+		actual.p = cpu->get_status();
+		actual.sp = cpu->regSP;
+
+		if ((actual.pc != expected.pc) || (actual.a != expected.a) || (actual.x != expected.x) || (actual.y != expected.y) ||
+			(actual.p != expected.p) || (actual.sp != expected.sp) || (actual.cycle != expected.cycle)) {
+
+			format_nestest_state(expected, expectedText, sizeof(expectedText));
+			format_nestest_state(actual, actualText, sizeof(actualText));
+			std::cout << "\n\t\tline " << (lineCount + 1) << " differs\n\t\texpected: " << expectedText << "\n\t\tgot:      " << actualText
+				<< "\n\t\t";
+			matches = false;
+			break;
+		}
+
+		lineCount++;
+		actual.cycle += step_cpu(*cpu, useDecodeCache);
+	}
+	std::fclose(logFile);
+
+	//nestest leaves the number of the first failing test of official and unofficial opcodes at $02 and $03
+	const byte officialResult = bus->mainMemory[0x02], unofficialResult = bus->mainMemory[0x03];
+	if (matches) {
+		std::cout << lineCount << " lines matched, result codes $" << std::hex << (dword)officialResult << " $" << (dword)unofficialResult
+			<< std::dec << " ... ";
+	}
+	report_result(matches && (lineCount > 0) && (officialResult == 0) && (unofficialResult == 0));
+
+	delete cpu;
+	delete bus;
+}
+
+void Debugger::run_test_vectors() {
+	std::cout << "\tJSON test vectors ... ";
+
+	VectorJob *job = new VectorJob();
+	job->nextOpcode.store(0);
+	std::memset(job->results, 0, sizeof(job->results));
+
+	const dword threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<std::thread *> workers;
+	for (dword i = 0; i < threadCount; i++) {
+		workers.push_back(new std::thread(Debugger::vector_worker_proc, job));
+	}
+	for (std::thread *worker : workers) {
+		worker->join();
+		delete worker;
+	}
+
+	dword passed = 0, failed = 0, skipped = 0, missing = 0;
+	for (int opcode = 0; opcode < 0x100; opcode++) {
+		const VectorResults &results = job->results[opcode];
+
+		if (results.isMissing) {
+			missing++;
+			continue;
+		}
+
+		passed += results.passed;
+		failed += results.failed;
+		skipped += results.skipped;
+
+		if (results.failed > 0) {
+			char msg[160];
+			sprintf_s(msg, "\n\t\t$%02X: %u of %u failed, first %s", opcode, results.failed, results.passed + results.failed, results.firstFailure);
+			std::cout << msg;
+		}
+	}
+	delete job;
+
+	if (missing == 0x100) {
+		report_skipped("no test vectors in tests/nes6502");
+		return;
+	}
+
+	std::cout << ((failed > 0) ? "\n\t\t" : "") << passed << " passed, " << failed << " failed, " << skipped << " skipped, "
+		<< missing << " opcodes without vectors ... ";
+	report_result(failed == 0);
+}
+
+void Debugger::vector_worker_proc(VectorJob *job) {
+	//Every thread has a CPU and memory of its own; only the job is shared
+	Bus *bus = new Bus();
+	CPU *cpu = new CPU(bus);
+
+	byte ppuData = 0, ppuPalettes[0x20] = {};
+	word ppuAddr = 0;
+	const word ppuPixel = 0, ppuScanline = 0;
+	cpu->connect_to_ppu(&ppuData, ppuPalettes, &ppuAddr, &ppuPixel, &ppuScanline);
+
+	for (int opcode = job->nextOpcode++; opcode < 0x100; opcode = job->nextOpcode++) {
+		run_opcode_vectors((byte)opcode, *cpu, job->results[opcode]);
+	}
+
+	delete cpu;
+	delete bus;
+}
+
+void Debugger::run_opcode_vectors(const byte opcode, CPU &cpu, VectorResults &results) {
+	char path[MAX_PATH];
+	sprintf_s(path, TEST_VECTOR_PATH_FORMAT, opcode);
+
+	std::vector<char> text;
+	if (!read_file(path, text)) {
+		results.isMissing = true;
+		return;
+	}
+	text.push_back('\0');
+
+	//KIL and the unstable opcodes would stop the emulator (see CPU::ERR)
+	const bool isEmulated = (CPU::opcodeVector[opcode].mnemonic != CPU::MN_ERR);
+	byte * const mainMemory = cpu.refBus.mainMemory;
+
+	JSONReader json(text.data());
+	json.expect('[');
+
+	TestVector vec;
+	while (read_test_vector(json, vec)) {
+		if (!isEmulated || !fits_plain_memory(vec)) {
+			results.skipped++;
+			continue;
+		}
+
+		//Each vector runs through CPU::execute, and through the decode cache when it starts in PRG ROM
+#ifdef CPU_DECODE_CACHE
+		const int passCount = (vec.initial.pc & 0x8000) ? 2 : 1;
+#else
+		const int passCount = 1;
+#endif
+		const char *difference = nullptr;
+		int pass;
+
+		for (pass = 0; (pass < passCount) && (difference == nullptr); pass++) {
+			for (const RAMValue &ram : vec.initial.ram) {
+				mainMemory[ram.addr] = ram.val;
+			}
+
+			cpu.regPC = vec.initial.pc;
+			cpu.regSP = vec.initial.s;
+			cpu.regA = vec.initial.a;
+			cpu.regX = vec.initial.x;
+			cpu.regY = vec.initial.y;
+			cpu.set_status(vec.initial.p);
+			cpu.regInterrupt = CPU::INTERRUPT_NONE;
+#ifdef CPU_DECODE_CACHE
+			//The bytes at PC are different in every vector
+			cpu.decodeCache[vec.initial.pc & 0x7FFF].instr = nullptr;
+#endif
+
+			const byte cycles = step_cpu(cpu, pass == 1);
+
+			//Bits 4 and 5 of P aren't flags; the CPU always has them as 0 and 1
+			if (cpu.regPC != vec.final.pc) {
+				difference = "PC";
+			} else if (cpu.regSP != vec.final.s) {
+				difference = "S";
+			} else if (cpu.regA != vec.final.a) {
+				difference = "A";
+			} else if (cpu.regX != vec.final.x) {
+				difference = "X";
+			} else if (cpu.regY != vec.final.y) {
+				difference = "Y";
+			} else if ((cpu.get_status() ^ vec.final.p) & 0xCF) {
+				difference = "P";
+			} else if (cycles != vec.cycles.size()) {
+				difference = "cycle count";
+			}
+
+			for (const RAMValue &ram : vec.final.ram) {
+				if ((difference == nullptr) && (mainMemory[ram.addr] != ram.val)) {
+					difference = "RAM";
+				}
+				mainMemory[ram.addr] = 0;
+			}
+			for (const RAMValue &ram : vec.initial.ram) {
+				mainMemory[ram.addr] = 0;
+			}
+		}
+
+		if (difference == nullptr) {
+			results.passed++;
+		} else {
+			if (results.failed == 0) {
+				sprintf_s(results.firstFailure, "\"%s\": %s differs (%s)", vec.name.c_str(), difference,
+					(pass == 2) ? "decode cache" : "interpreter");
+			}
+			results.failed++;
+		}
+	}
+}
+
+void Debugger::run_video_benchmarks() {
+	set_output_color(ScreenColor::LIGHT_BLUE);
+	std::cout << "Running video benchmarks...\n";
+
+	//Mostly flat areas with some noise, so the Scale2x/3x kernels see both edges and runs of equal pixels
+	std::vector<dword> frame(NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT);
+	dword seed = 0x12345678;
+	for (dword i = 0; i < frame.size(); i++) {
+		seed = (seed * 1103515245) + 12345;
+		frame[i] = (((seed >> 16) & 0x03) * 0x3F3F3F00) | 0xFF;
+	}
+
+	std::vector<dword> vectorOutput(FrameScaler::MAX_OUTPUT_PIXEL_COUNT), scalarOutput(FrameScaler::MAX_OUTPUT_PIXEL_COUNT);
+
+	for (int i = (int)FrameScaler::Filter::NEAREST_2X; i < (int)FrameScaler::Filter::FILTER_TOTAL; i++) {
+		const FrameScaler::Filter filter = (FrameScaler::Filter)i;
+
+		FrameScaler scaler, reference;
+		reference.forceScalar = true;
+		scaler.set_filter(filter);
+		reference.set_filter(filter);
+
+		scaler.scale(frame.data(), vectorOutput.data());
+		reference.scale(frame.data(), scalarOutput.data());
+
+		const dword outputBytes = scaler.get_output_width() * scaler.get_output_height() * sizeof(dword);
+		const bool matches = std::memcmp(vectorOutput.data(), scalarOutput.data(), outputBytes) == 0;
+
+		const qword microsecondsPerFrame = time_microseconds(BENCHMARK_FRAMES, [&]() { scaler.scale(frame.data(), vectorOutput.data()); });
+
+		report_benchmark(FrameScaler::get_filter_name(filter), microsecondsPerFrame, "frame", SCALER_BUDGET_MICROSECONDS, matches);
+	}
+
+	//Random tiles, palettes and sprite lines, with every fine X, so all of the compositing rules and sprite 0 hit positions come up
+	std::vector<LineCompositor::BackgroundTiles> tiles(NES_SCREEN_HEIGHT);
+	std::vector<byte> sprites(NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT);
+	byte paletteRAM[0x20];
+
+	for (LineCompositor::BackgroundTiles &line : tiles) {
+		for (int i = 0; i < LineCompositor::TILE_BUFFER_SIZE; i++) {
+			seed = (seed * 1103515245) + 12345;
+			line.patternLo[i] = (seed >> 16) & 0xFF;
+			line.patternHi[i] = (seed >> 24) & 0xFF;
+			line.palette[i] = ((seed >> 8) & 0x03) << 2;
+		}
+	}
+	for (dword i = 0; i < sprites.size(); i++) {
+		seed = (seed * 1103515245) + 12345;
+		//About half of the pixels have no sprite, like a busy scanline; opaque sprite pixels never use color 0
+		const byte color = ((seed >> 17) % 3) + 1;
+		sprites[i] = ((seed >> 16) & 0x01) ? (byte)(0x10 | ((seed >> 20) & 0x6C) | color) : 0;
+	}
+	for (int i = 0; i < 0x20; i++) {
+		paletteRAM[i] = (byte)((i * 7) + 3);
+	}
+
+	LineCompositor compositor, referenceCompositor;
+	referenceCompositor.forceScalar = true;
+	referenceCompositor.select_kernel();
+
+	std::vector<byte> vectorLine(NES_SCREEN_WIDTH), scalarLine(NES_SCREEN_WIDTH), indexFrame(NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT);
+	bool compositorMatches = true;
+
+	for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+		const byte fineX = y & 0x07, colorMask = (y & 0x08) ? 0x30 : 0x3F;
+		const byte * const lineSprites = sprites.data() + (y * NES_SCREEN_WIDTH);
+
+		const word vectorHit = compositor.composite(tiles[y], fineX, lineSprites, paletteRAM, colorMask, vectorLine.data());
+		const word scalarHit = referenceCompositor.composite(tiles[y], fineX, lineSprites, paletteRAM, colorMask, scalarLine.data());
+
+		if ((vectorHit != scalarHit) || (std::memcmp(vectorLine.data(), scalarLine.data(), NES_SCREEN_WIDTH) != 0)) {
+			compositorMatches = false;
+		}
+	}
+
+	const qword compositorMicrosecondsPerFrame = time_microseconds(BENCHMARK_FRAMES, [&]() {
+		for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+			compositor.composite(tiles[y], y & 0x07, sprites.data() + (y * NES_SCREEN_WIDTH), paletteRAM, 0x3F,
+				indexFrame.data() + (y * NES_SCREEN_WIDTH));
+		}
+	});
+
+	report_benchmark("Line compositor", compositorMicrosecondsPerFrame, "frame", COMPOSITOR_BUDGET_MICROSECONDS, compositorMatches);
+}
+
+void Debugger::run_audio_benchmarks() {
+	set_output_color(ScreenColor::LIGHT_BLUE);
+	std::cout << "Running audio benchmarks...\n";
+
+	const dword inputRate = Core::AudioRegs::APU_SAMPLE_FREQUENCY;
+	const double PI = 3.14159265358979323846;
+
+	//A tone at the APU's rate, with a little extra input so the last chunk at the fastest ratio never runs out
+	std::vector<float> tone(((inputRate * BENCHMARK_AUDIO_SECONDS * 101) / 100) + (AudioResampler::TAP_COUNT * 2));
+	for (dword i = 0; i < tone.size(); i++) {
+		tone[i] = 0.5f * (float)std::sin((2.0 * PI * BENCHMARK_TONE_FREQUENCY * i) / inputRate);
+	}
+
+	//The vector kernels against the scalar one, with the ratio moving about as much as sync moves it
+	AudioResampler resampler, reference;
+	reference.forceScalar = true;
+	resampler.set_rates(inputRate, BENCHMARK_DEVICE_RATE, BENCHMARK_AUDIO_CHUNK);
+	reference.set_rates(inputRate, BENCHMARK_DEVICE_RATE, BENCHMARK_AUDIO_CHUNK);
+
+	std::vector<float> vectorOutput(BENCHMARK_DEVICE_RATE), scalarOutput(BENCHMARK_DEVICE_RATE);
+	resample_in_chunks(resampler, tone, vectorOutput, 0.005f);
+	resample_in_chunks(reference, tone, scalarOutput, 0.005f);
+
+	//Only the order the taps are summed in differs
+	float maxDifference = 0;
+	for (dword i = 0; i < vectorOutput.size(); i++) {
+		const float difference = std::fabs(vectorOutput[i] - scalarOutput[i]);
+		maxDifference = (difference > maxDifference) ? difference : maxDifference;
+	}
+	const bool matches = maxDifference < 1e-5f;
+
+	//At a fixed ratio, output sample i falls on input sample i * inputRate / deviceRate, so the tone can be checked exactly
+	resampler.set_rates(inputRate, BENCHMARK_DEVICE_RATE, BENCHMARK_AUDIO_CHUNK);
+	resample_in_chunks(resampler, tone, vectorOutput, 0.0f);
+
+	double signalPower = 0, noisePower = 0;
+	for (dword i = AudioResampler::TAP_COUNT; i < vectorOutput.size(); i++) {
+		const double ideal = 0.5 * std::sin((2.0 * PI * BENCHMARK_TONE_FREQUENCY * i) / BENCHMARK_DEVICE_RATE);
+		signalPower += ideal * ideal;
+		noisePower += (vectorOutput[i] - ideal) * (vectorOutput[i] - ideal);
+	}
+	const double snr = 10.0 * std::log10(signalPower / noisePower);
+
+	//Cost per second of audio, in the audio thread's chunk sizes
+	std::vector<float> benchmarkOutput(BENCHMARK_DEVICE_RATE * BENCHMARK_AUDIO_SECONDS);
+
+	resampler.set_rates(inputRate, BENCHMARK_DEVICE_RATE, BENCHMARK_AUDIO_CHUNK);
+	const qword microsecondsPerSecond = time_microseconds(1, [&]() { resample_in_chunks(resampler, tone, benchmarkOutput, 0.005f); })
+		/ BENCHMARK_AUDIO_SECONDS;
+
+	const std::string name = "Resampler (" + std::to_string(inputRate) + " Hz -> " + std::to_string(BENCHMARK_DEVICE_RATE) + " Hz, SNR "
+		+ std::to_string((int)snr) + " dB)";
+	report_benchmark(name.c_str(), microsecondsPerSecond, "second of audio", RESAMPLER_BUDGET_MICROSECONDS, matches, snr > RESAMPLER_MIN_SNR_DB);
+}
+
+void Debugger::report_result(const bool passed) {
+	set_output_color(passed ? ScreenColor::LIGHT_GREEN : ScreenColor::LIGHT_RED);
+	std::cout << (passed ? "PASS\n" : "FAIL\n");
+	set_output_color(ScreenColor::WHITE);
+}
+
+void Debugger::report_benchmark(const char * const name, const qword microseconds, const char * const unit, const qword budgetMicroseconds,
+	const bool matchesScalar, const bool otherChecksPassed) {
+
+	std::cout << "\t" << name << ": " << microseconds << " us/" << unit << ", matches scalar: " << (matchesScalar ? "yes" : "no") << " ... ";
+	report_result(matchesScalar && otherChecksPassed && (microseconds < budgetMicroseconds));
+}
+
+void Debugger::report_skipped(const char * const reason) {
+	set_output_color(ScreenColor::LIGHT_YELLOW);
+	std::cout << "SKIPPED (" << reason << ")\n";
+	set_output_color(ScreenColor::WHITE);
 }
 
 #endif /* ifdef TEST_BUILD */
\ No newline at end of file
@@ -4,11 +4,14 @@
 
 #include <iostream>
 #include <cassert>
+#include <atomic>
 
 #include "Core.h"
 
 namespace MAGSNES {
 
+class CPU;
+
 class Debugger {
 public:
 	Debugger();
@@ -16,6 +19,8 @@ public:
 
 	void run_all_tests();
 	void run_cpu_tests();
+	void run_video_benchmarks();
+	void run_audio_benchmarks();
 
 private:
 	//Text colors for windows console (always on black background). 
@@ -40,6 +45,19 @@ private:
 		COLOR_TOTAL
 	};
 
+	//Outcome of one opcode's JSON test vectors
+	struct VectorResults {
+		bool isMissing;			//No test file for the opcode
+		dword passed, failed, skipped;
+		char firstFailure[96];
+	};
+
+	//Shared by the threads running the test vectors; each one takes the next opcode until all 256 are done
+	struct VectorJob {
+		std::atomic<int> nextOpcode;
+		VectorResults results[0x100];
+	};
+
 	Core &refCore;
 	HANDLE hstdout;
 
@@ -47,6 +65,43 @@ private:
 		SetConsoleTextAttribute(hstdout, (word)color);
 	}
 
+	//Prints PASS/FAIL in green/red, then restores the default color
+	void report_result(const bool passed);
+	//For tests whose data files aren't there
+	void report_skipped(const char * const reason);
+
+	//Average microseconds per call of work, over iterations calls
+	template <typename Work>
+	const qword time_microseconds(const int iterations, Work work) {
+		LARGE_INTEGER start, end, elapsed;
+
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < iterations; i++) {
+			work();
+		}
+		QueryPerformanceCounter(&end);
+		refCore.get_elapsed_microseconds(start, end, elapsed);
+
+		return elapsed.QuadPart / iterations;
+	}
+
+	//Prints a benchmark's timing, and passes it if the kernel under test matched the forced-scalar reference, any checks of its own
+	//passed, and it came in under budget
+	void report_benchmark(const char * const name, const qword microseconds, const char * const unit, const qword budgetMicroseconds,
+		const bool matchesScalar, const bool otherChecksPassed = true);
+
+	//Runs nestest.nes from $C000 (its automation mode), comparing the CPU with each line of nestest.log before every instruction
+	void run_nestest(const bool useDecodeCache);
+
+	//Runs every opcode's JSON test vectors, spread across one thread per core
+	void run_test_vectors();
+	__CLASSMETHOD__ void vector_worker_proc(VectorJob *job);
+	__CLASSMETHOD__ void run_opcode_vectors(const byte opcode, CPU &cpu, VectorResults &results);
+
+	//Runs one instruction with no fusion, idle skipping or interrupts, so each one lines up with a line of a log or a test vector.
+	//With useDecodeCache, PRG ROM runs from the decode cache like execute_at_PC; otherwise through CPU::execute.
+	__CLASSMETHOD__ byte step_cpu(CPU &cpu, const bool useDecodeCache);
+
 };
 
 } /* namespace MAGSNES */
@@ -0,0 +1,172 @@
+#include "FrameBuffer.h"
+
+#include <cstring>
+
+__FILESCOPE__{
+	//How much the channels which are NOT emphasized are darkened for each emphasis bit that is set
+	const float EMPHASIS_ATTENUATION = 0.75f;
+
+	//PPUMASK emphasis bits (after shifting right by 5), in the order R, G, B
+	const MAGSNES::byte EMPHASIS_RED = 0x01,
+											EMPHASIS_GREEN = 0x02,
+											EMPHASIS_BLUE = 0x04;
+
+	FORCEINLINE MAGSNES::byte attenuate(const MAGSNES::byte channel, const MAGSNES::byte emphasisMode, const MAGSNES::byte channelBit) {
+		float result = channel;
+
+		for (MAGSNES::byte bit = EMPHASIS_RED; bit <= EMPHASIS_BLUE; bit <<= 1) {
+			if ((emphasisMode & bit) && (bit != channelBit)) {
+				result *= EMPHASIS_ATTENUATION;
+			}
+		}
+
+		return (MAGSNES::byte)result;
+	}
+}
+
+using namespace MAGSNES;
+
+FrameBuffer::FrameBuffer() {
+	std::memset(indices, 0, sizeof(indices));
+	std::memset(emphasis, 0, sizeof(emphasis));
+	std::memset(rgbaPalette, 0, sizeof(rgbaPalette));
+	std::memset(planeR, 0, sizeof(planeR));
+	std::memset(planeG, 0, sizeof(planeG));
+	std::memset(planeB, 0, sizeof(planeB));
+
+	if (SIMD::has_avx2()) {
+		lineKernel = &FrameBuffer::convert_line_avx2;
+	} else if (SIMD::has_ssse3()) {
+		lineKernel = &FrameBuffer::convert_line_ssse3;
+	} else {
+		lineKernel = &FrameBuffer::convert_line_scalar;
+	}
+}
+
+//No cleanup needed
+FrameBuffer::~FrameBuffer() {}
+
+void FrameBuffer::load_palette(const dword * const nesPalette) {
+	for (int mode = 0; mode < NUM_EMPHASIS_MODES; mode++) {
+		for (int i = 0; i < 0x40; i++) {
+			const dword color = nesPalette[i];
+
+			MAGSNES::byte r = attenuate((color >> 24) & 0xFF, mode, EMPHASIS_RED),
+										g = attenuate((color >> 16) & 0xFF, mode, EMPHASIS_GREEN),
+										b = attenuate((color >> 8) & 0xFF, mode, EMPHASIS_BLUE);
+
+			planeR[mode][i] = r;
+			planeG[mode][i] = g;
+			planeB[mode][i] = b;
+
+			//Little endian, so R ends up as the first byte in memory
+			rgbaPalette[mode][i] = r | (g << 8) | (b << 16) | 0xFF000000;
+		}
+	}
+}
+
+void FrameBuffer::convert_to_rgba(dword * const dst) const {
+	for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+		const dword offset = y * NES_SCREEN_WIDTH;
+		(this->*lineKernel)(indices + offset, dst + offset, emphasis[y] & 0x07);
+	}
+}
+
+void FrameBuffer::convert_line_scalar(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const {
+	const dword * const table = rgbaPalette[emphasisMode];
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+		dst[x] = table[src[x] & 0x3F];
+	}
+}
+
+/*
+The pshufb kernels treat each 64 entry byte plane as four 16 entry tables. For every table, the index's lo nibble is used as the
+shuffle control, and bit 7 of the control is set unless the index's hi nibble selects that table (pshufb writes 0 when bit 7 is set).
+ORing the four shuffles together gives the full 64 entry lookup; the R, G, B, and constant A planes are then interleaved into dwords.
+*/
+void FrameBuffer::convert_line_ssse3(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const {
+	const __m128i	indexMask = _mm_set1_epi8(0x3F),
+								nibbleMask = _mm_set1_epi8(0x0F),
+								zeroFlag = _mm_set1_epi8((char)0x80),
+								alpha = _mm_set1_epi8((char)0xFF);
+
+	__m128i tableR[4], tableG[4], tableB[4], tableID[4];
+
+	for (int k = 0; k < 4; k++) {
+		tableR[k] = _mm_load_si128((const __m128i *)(planeR[emphasisMode] + (k * 16)));
+		tableG[k] = _mm_load_si128((const __m128i *)(planeG[emphasisMode] + (k * 16)));
+		tableB[k] = _mm_load_si128((const __m128i *)(planeB[emphasisMode] + (k * 16)));
+		tableID[k] = _mm_set1_epi8(k);
+	}
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x += 16) {
+		__m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + x)), indexMask);
+		__m128i lo = _mm_and_si128(idx, nibbleMask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(idx, 4), nibbleMask);
+
+		__m128i r = _mm_setzero_si128(), g = _mm_setzero_si128(), b = _mm_setzero_si128();
+
+		for (int k = 0; k < 4; k++) {
+			__m128i control = _mm_or_si128(lo, _mm_andnot_si128(_mm_cmpeq_epi8(hi, tableID[k]), zeroFlag));
+			r = _mm_or_si128(r, _mm_shuffle_epi8(tableR[k], control));
+			g = _mm_or_si128(g, _mm_shuffle_epi8(tableG[k], control));
+			b = _mm_or_si128(b, _mm_shuffle_epi8(tableB[k], control));
+		}
+
+		__m128i rgLo = _mm_unpacklo_epi8(r, g), rgHi = _mm_unpackhi_epi8(r, g);
+		__m128i baLo = _mm_unpacklo_epi8(b, alpha), baHi = _mm_unpackhi_epi8(b, alpha);
+
+		__m128i *out = (__m128i *)(dst + x);
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+	}
+}
+
+//Same algorithm as the SSSE3 kernel, 32 pixels at a time. vpshufb and the unpacks work within each 128 bit lane, so the tables are
+//broadcast to both lanes and the lanes are put back in pixel order with vperm2i128 at the end.
+void FrameBuffer::convert_line_avx2(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const {
+	const __m256i	indexMask = _mm256_set1_epi8(0x3F),
+								nibbleMask = _mm256_set1_epi8(0x0F),
+								zeroFlag = _mm256_set1_epi8((char)0x80),
+								alpha = _mm256_set1_epi8((char)0xFF);
+
+	__m256i tableR[4], tableG[4], tableB[4], tableID[4];
+
+	for (int k = 0; k < 4; k++) {
+		tableR[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(planeR[emphasisMode] + (k * 16))));
+		tableG[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(planeG[emphasisMode] + (k * 16))));
+		tableB[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(planeB[emphasisMode] + (k * 16))));
+		tableID[k] = _mm256_set1_epi8(k);
+	}
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x += 32) {
+		__m256i idx = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + x)), indexMask);
+		__m256i lo = _mm256_and_si256(idx, nibbleMask);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(idx, 4), nibbleMask);
+
+		__m256i r = _mm256_setzero_si256(), g = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+
+		for (int k = 0; k < 4; k++) {
+			__m256i control = _mm256_or_si256(lo, _mm256_andnot_si256(_mm256_cmpeq_epi8(hi, tableID[k]), zeroFlag));
+			r = _mm256_or_si256(r, _mm256_shuffle_epi8(tableR[k], control));
+			g = _mm256_or_si256(g, _mm256_shuffle_epi8(tableG[k], control));
+			b = _mm256_or_si256(b, _mm256_shuffle_epi8(tableB[k], control));
+		}
+
+		__m256i rgLo = _mm256_unpacklo_epi8(r, g), rgHi = _mm256_unpackhi_epi8(r, g);
+		__m256i baLo = _mm256_unpacklo_epi8(b, alpha), baHi = _mm256_unpackhi_epi8(b, alpha);
+
+		//Lane 0 holds pixels 0-15 of this group and lane 1 holds pixels 16-31
+		__m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo), p1 = _mm256_unpackhi_epi16(rgLo, baLo),
+						p2 = _mm256_unpacklo_epi16(rgHi, baHi), p3 = _mm256_unpackhi_epi16(rgHi, baHi);
+
+		__m256i *out = (__m256i *)(dst + x);
+		_mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "SIMD.h"
+
+namespace MAGSNES {
+
+const dword FRAME_PIXEL_COUNT = NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT;
+
+//Holds one NES frame as 1-byte palette indices (0x00 - 0x3F) rather than RGBA dwords, which cuts the bandwidth of writing a frame by 4x.
+//Color emphasis (PPUMASK bits 5-7) is stored once per scanline, since games only change PPUMASK between lines.
+//Conversion to RGBA is deferred until a consumer actually needs it, and is then done for the whole frame in one pass.
+class FrameBuffer {
+public:
+	FrameBuffer();
+	~FrameBuffer();
+
+	//Builds the RGBA lookup tables (one per emphasis combination) from a 64 entry palette in 0xRRGGBB00 format
+	void load_palette(const dword * const nesPalette);
+
+	//Expands the whole frame into RGBA dwords (bytes R, G, B, A in memory, as GL_RGBA/GL_UNSIGNED_BYTE expects)
+	void convert_to_rgba(dword * const dst) const;
+
+	//Expands a single line of palette indices (not necessarily from this frame) the same way
+	void convert_line(const MAGSNES::byte * const src, dword * const dst, const MAGSNES::byte emphasisMode) const {
+		(this->*lineKernel)(src, dst, emphasisMode & 0x07);
+	}
+
+	//Written directly by the PPU
+	ALIGN32 MAGSNES::byte indices[FRAME_PIXEL_COUNT];
+	MAGSNES::byte emphasis[NES_SCREEN_HEIGHT];
+
+private:
+	static const int NUM_EMPHASIS_MODES = 8;
+
+	typedef void (FrameBuffer::*LineKernel)(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const;
+
+	//The fastest of the convert_line_* kernels the CPU supports; picked once
+	LineKernel lineKernel;
+
+	ALIGN32 dword rgbaPalette[NUM_EMPHASIS_MODES][0x40];
+
+	//The same table split into byte planes, 16 entries per row, for the pshufb kernel
+	ALIGN32 MAGSNES::byte planeR[NUM_EMPHASIS_MODES][0x40];
+	ALIGN32 MAGSNES::byte planeG[NUM_EMPHASIS_MODES][0x40];
+	ALIGN32 MAGSNES::byte planeB[NUM_EMPHASIS_MODES][0x40];
+
+	//Each converts a single scanline using the lookup table for that line's emphasis
+	void convert_line_scalar(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const;
+	void convert_line_ssse3(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const;
+	void convert_line_avx2(const MAGSNES::byte *src, dword *dst, const MAGSNES::byte emphasisMode) const;
+};
+
+} /* namespace MAGSNES */
@@ -0,0 +1,391 @@
+#include "FrameScaler.h"
+
+#include <cstring>
+
+__FILESCOPE__{
+	//Pixels handled per iteration by each vector kernel; the same number of pixels at each end of a line is left to the scalar span
+	const int SSE2_PIXELS = 4,
+						AVX2_PIXELS = 8;
+
+	FORCEINLINE __m128i select_sse2(const __m128i mask, const __m128i a, const __m128i b) {
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	FORCEINLINE __m256i select_avx2(const __m256i mask, const __m256i a, const __m256i b) {
+		return _mm256_blendv_epi8(b, a, mask);
+	}
+
+	//Stores a0 b0 c0 a1 b1 c1 a2 b2 c2 a3 b3 c3
+	FORCEINLINE void store_interleaved3_sse2(MAGSNES::dword *dst, const __m128i a, const __m128i b, const __m128i c) {
+		const __m128 abLo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b)), abHi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b)),
+								bcLo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c)), bcHi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c)),
+								caLo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a)), caHi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));
+
+		_mm_storeu_si128((__m128i *)dst, _mm_castps_si128(_mm_shuffle_ps(abLo, caLo, _MM_SHUFFLE(3, 0, 1, 0))));
+		_mm_storeu_si128((__m128i *)(dst + 4), _mm_castps_si128(_mm_shuffle_ps(bcLo, abHi, _MM_SHUFFLE(1, 0, 3, 2))));
+		_mm_storeu_si128((__m128i *)(dst + 8), _mm_castps_si128(_mm_shuffle_ps(caHi, bcHi, _MM_SHUFFLE(3, 2, 3, 0))));
+	}
+}
+
+using namespace MAGSNES;
+
+FrameScaler::FrameScaler()
+	: filter(Filter::NONE), scaleFactor(1), rowKernel(nullptr), forceScalar(false) {
+
+}
+
+//No cleanup needed
+FrameScaler::~FrameScaler() {}
+
+const int FrameScaler::get_filter_scale_factor(const Filter filter) {
+	switch (filter) {
+	case Filter::NEAREST_2X:
+	case Filter::SCALE2X:
+		return 2;
+	case Filter::NEAREST_3X:
+	case Filter::SCALE3X:
+		return 3;
+	case Filter::NEAREST_4X:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+const char * FrameScaler::get_filter_name(const Filter filter) {
+	switch (filter) {
+	case Filter::NEAREST_2X:
+		return "Nearest 2x";
+	case Filter::NEAREST_3X:
+		return "Nearest 3x";
+	case Filter::NEAREST_4X:
+		return "Nearest 4x";
+	case Filter::SCALE2X:
+		return "Scale2x/EPX";
+	case Filter::SCALE3X:
+		return "Scale3x";
+	default:
+		return "None";
+	}
+}
+
+void FrameScaler::set_filter(const Filter filter) {
+	this->filter = filter;
+	scaleFactor = get_filter_scale_factor(filter);
+
+	const bool useAVX2 = !forceScalar && SIMD::has_avx2(),
+							useSSE2 = !forceScalar && SIMD::has_sse2();
+
+	switch (filter) {
+	case Filter::NEAREST_2X:
+	case Filter::NEAREST_3X:
+	case Filter::NEAREST_4X:
+		rowKernel = useAVX2 ? &FrameScaler::nearest_row_avx2 : (useSSE2 ? &FrameScaler::nearest_row_sse2 : &FrameScaler::nearest_row_scalar);
+		break;
+	case Filter::SCALE2X:
+		rowKernel = useAVX2 ? &FrameScaler::scale2x_row_avx2 : (useSSE2 ? &FrameScaler::scale2x_row_sse2 : &FrameScaler::scale2x_row_scalar);
+		break;
+	case Filter::SCALE3X:
+		//No AVX2 version; the 3-way interleave of the output doesn't map well onto 128 bit lanes
+		rowKernel = useSSE2 ? &FrameScaler::scale3x_row_sse2 : &FrameScaler::scale3x_row_scalar;
+		break;
+	default:
+		rowKernel = nullptr;
+		break;
+	}
+}
+
+void FrameScaler::scale(const dword * const src, dword * const dst) const {
+	if (rowKernel == nullptr) {
+		std::memcpy(dst, src, NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT * sizeof(dword));
+		return;
+	}
+
+	const dword outputRowSize = get_output_width() * scaleFactor;
+
+	for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+		const dword *cur = src + (y * NES_SCREEN_WIDTH);
+		const dword *up = (y > 0) ? (cur - NES_SCREEN_WIDTH) : cur;
+		const dword *down = (y < (NES_SCREEN_HEIGHT - 1)) ? (cur + NES_SCREEN_WIDTH) : cur;
+
+		(this->*rowKernel)(up, cur, down, dst + (y * outputRowSize));
+	}
+}
+
+void FrameScaler::replicate_line(dword *dst) const {
+	const int outputWidth = get_output_width();
+
+	for (int i = 1; i < scaleFactor; i++) {
+		std::memcpy(dst + (i * outputWidth), dst, outputWidth * sizeof(dword));
+	}
+}
+
+/*
+*****Nearest neighbour*****
+Each pixel is repeated scaleFactor times across, then the whole line is repeated scaleFactor times down.
+*/
+
+void FrameScaler::nearest_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	dword *out = dst;
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+		for (int i = 0; i < scaleFactor; i++) {
+			*out++ = cur[x];
+		}
+	}
+
+	replicate_line(dst);
+}
+
+void FrameScaler::nearest_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	__m128i *out = (__m128i *)dst;
+
+	switch (scaleFactor) {
+	case 2:
+		for (int x = 0; x < NES_SCREEN_WIDTH; x += SSE2_PIXELS) {
+			const __m128i p = _mm_loadu_si128((const __m128i *)(cur + x));
+			_mm_storeu_si128(out++, _mm_unpacklo_epi32(p, p));
+			_mm_storeu_si128(out++, _mm_unpackhi_epi32(p, p));
+		}
+		break;
+	case 3:
+		for (int x = 0; x < NES_SCREEN_WIDTH; x += SSE2_PIXELS) {
+			const __m128i p = _mm_loadu_si128((const __m128i *)(cur + x));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+		}
+		break;
+	case 4:
+		for (int x = 0; x < NES_SCREEN_WIDTH; x += SSE2_PIXELS) {
+			const __m128i p = _mm_loadu_si128((const __m128i *)(cur + x));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(0, 0, 0, 0)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 1, 1, 1)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 2, 2)));
+			_mm_storeu_si128(out++, _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 3)));
+		}
+		break;
+	}
+
+	replicate_line(dst);
+}
+
+//vpermd crosses lanes, so any factor is just scaleFactor permutes per 8 input pixels: output dword j of vector k is input pixel (8k + j) / scaleFactor
+void FrameScaler::nearest_row_avx2(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	__m256i permutes[MAX_SCALE_FACTOR];
+
+	for (int k = 0; k < scaleFactor; k++) {
+		int lanes[AVX2_PIXELS];
+
+		for (int j = 0; j < AVX2_PIXELS; j++) {
+			lanes[j] = ((k * AVX2_PIXELS) + j) / scaleFactor;
+		}
+
+		permutes[k] = _mm256_setr_epi32(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], lanes[7]);
+	}
+
+	__m256i *out = (__m256i *)dst;
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x += AVX2_PIXELS) {
+		const __m256i p = _mm256_loadu_si256((const __m256i *)(cur + x));
+
+		for (int k = 0; k < scaleFactor; k++) {
+			_mm256_storeu_si256(out++, _mm256_permutevar8x32_epi32(p, permutes[k]));
+		}
+	}
+
+	replicate_line(dst);
+}
+
+/*
+*****Scale2x*****
+With B above, D left, F right and H below the source pixel E, each pixel becomes
+	E0 E1
+	E2 E3
+where, unless B == H or D == F (in which case all four are E):
+	E0 = D == B ? D : E		E1 = B == F ? F : E
+	E2 = D == H ? D : E		E3 = H == F ? F : E
+The vector kernels evaluate the same rules with dword compares and masks, so their output is bit exact with the scalar one.
+*/
+
+void FrameScaler::scale2x_span_scalar(const dword *up, const dword *cur, const dword *down, dword *dst, const int xStart, const int xEnd) const {
+	dword *row0 = dst, *row1 = dst + (NES_SCREEN_WIDTH * 2);
+
+	for (int x = xStart; x < xEnd; x++) {
+		const int left = (x > 0) ? (x - 1) : x, right = (x < (NES_SCREEN_WIDTH - 1)) ? (x + 1) : x;
+		const dword B = up[x], D = cur[left], E = cur[x], F = cur[right], H = down[x];
+
+		if ((B != H) && (D != F)) {
+			row0[x * 2] = (D == B) ? D : E;
+			row0[(x * 2) + 1] = (B == F) ? F : E;
+			row1[x * 2] = (D == H) ? D : E;
+			row1[(x * 2) + 1] = (H == F) ? F : E;
+		} else {
+			row0[x * 2] = row0[(x * 2) + 1] = row1[x * 2] = row1[(x * 2) + 1] = E;
+		}
+	}
+}
+
+void FrameScaler::scale2x_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	scale2x_span_scalar(up, cur, down, dst, 0, NES_SCREEN_WIDTH);
+}
+
+void FrameScaler::scale2x_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	const __m128i allOnes = _mm_set1_epi32(-1);
+	dword *row0 = dst, *row1 = dst + (NES_SCREEN_WIDTH * 2);
+
+	scale2x_span_scalar(up, cur, down, dst, 0, SSE2_PIXELS);
+
+	for (int x = SSE2_PIXELS; x < (NES_SCREEN_WIDTH - SSE2_PIXELS); x += SSE2_PIXELS) {
+		const __m128i B = _mm_loadu_si128((const __m128i *)(up + x)),
+									D = _mm_loadu_si128((const __m128i *)(cur + x - 1)),
+									E = _mm_loadu_si128((const __m128i *)(cur + x)),
+									F = _mm_loadu_si128((const __m128i *)(cur + x + 1)),
+									H = _mm_loadu_si128((const __m128i *)(down + x));
+
+		const __m128i active = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), allOnes);
+
+		const __m128i E0 = select_sse2(_mm_and_si128(active, _mm_cmpeq_epi32(D, B)), D, E),
+									E1 = select_sse2(_mm_and_si128(active, _mm_cmpeq_epi32(B, F)), F, E),
+									E2 = select_sse2(_mm_and_si128(active, _mm_cmpeq_epi32(D, H)), D, E),
+									E3 = select_sse2(_mm_and_si128(active, _mm_cmpeq_epi32(H, F)), F, E);
+
+		_mm_storeu_si128((__m128i *)(row0 + (x * 2)), _mm_unpacklo_epi32(E0, E1));
+		_mm_storeu_si128((__m128i *)(row0 + (x * 2) + 4), _mm_unpackhi_epi32(E0, E1));
+		_mm_storeu_si128((__m128i *)(row1 + (x * 2)), _mm_unpacklo_epi32(E2, E3));
+		_mm_storeu_si128((__m128i *)(row1 + (x * 2) + 4), _mm_unpackhi_epi32(E2, E3));
+	}
+
+	scale2x_span_scalar(up, cur, down, dst, NES_SCREEN_WIDTH - SSE2_PIXELS, NES_SCREEN_WIDTH);
+}
+
+void FrameScaler::scale2x_row_avx2(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	const __m256i allOnes = _mm256_set1_epi32(-1);
+	dword *row0 = dst, *row1 = dst + (NES_SCREEN_WIDTH * 2);
+
+	scale2x_span_scalar(up, cur, down, dst, 0, AVX2_PIXELS);
+
+	for (int x = AVX2_PIXELS; x < (NES_SCREEN_WIDTH - AVX2_PIXELS); x += AVX2_PIXELS) {
+		const __m256i B = _mm256_loadu_si256((const __m256i *)(up + x)),
+									D = _mm256_loadu_si256((const __m256i *)(cur + x - 1)),
+									E = _mm256_loadu_si256((const __m256i *)(cur + x)),
+									F = _mm256_loadu_si256((const __m256i *)(cur + x + 1)),
+									H = _mm256_loadu_si256((const __m256i *)(down + x));
+
+		const __m256i active = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(B, H), _mm256_cmpeq_epi32(D, F)), allOnes);
+
+		const __m256i E0 = select_avx2(_mm256_and_si256(active, _mm256_cmpeq_epi32(D, B)), D, E),
+									E1 = select_avx2(_mm256_and_si256(active, _mm256_cmpeq_epi32(B, F)), F, E),
+									E2 = select_avx2(_mm256_and_si256(active, _mm256_cmpeq_epi32(D, H)), D, E),
+									E3 = select_avx2(_mm256_and_si256(active, _mm256_cmpeq_epi32(H, F)), F, E);
+
+		//The unpacks work per 128 bit lane: lo holds pixels 0-1 | 4-5 and hi holds 2-3 | 6-7, so the lanes are swapped back into order
+		const __m256i top0 = _mm256_unpacklo_epi32(E0, E1), top1 = _mm256_unpackhi_epi32(E0, E1),
+									bottom0 = _mm256_unpacklo_epi32(E2, E3), bottom1 = _mm256_unpackhi_epi32(E2, E3);
+
+		_mm256_storeu_si256((__m256i *)(row0 + (x * 2)), _mm256_permute2x128_si256(top0, top1, 0x20));
+		_mm256_storeu_si256((__m256i *)(row0 + (x * 2) + 8), _mm256_permute2x128_si256(top0, top1, 0x31));
+		_mm256_storeu_si256((__m256i *)(row1 + (x * 2)), _mm256_permute2x128_si256(bottom0, bottom1, 0x20));
+		_mm256_storeu_si256((__m256i *)(row1 + (x * 2) + 8), _mm256_permute2x128_si256(bottom0, bottom1, 0x31));
+	}
+
+	scale2x_span_scalar(up, cur, down, dst, NES_SCREEN_WIDTH - AVX2_PIXELS, NES_SCREEN_WIDTH);
+}
+
+/*
+*****Scale3x*****
+With the 3x3 neighbourhood
+	A B C
+	D E F
+	G H I
+each pixel becomes E0-E8 (row major), all equal to E unless B != H and D != F, in which case:
+	E0 = D == B ? D : E
+	E1 = (D == B && E != C) || (B == F && E != A) ? B : E
+	E2 = B == F ? F : E
+	E3 = (D == B && E != G) || (D == H && E != A) ? D : E
+	E4 = E
+	E5 = (B == F && E != I) || (H == F && E != C) ? F : E
+	E6 = D == H ? D : E
+	E7 = (D == H && E != I) || (H == F && E != G) ? H : E
+	E8 = H == F ? F : E
+*/
+
+void FrameScaler::scale3x_span_scalar(const dword *up, const dword *cur, const dword *down, dword *dst, const int xStart, const int xEnd) const {
+	const int outputWidth = NES_SCREEN_WIDTH * 3;
+	dword *row0 = dst, *row1 = dst + outputWidth, *row2 = dst + (outputWidth * 2);
+
+	for (int x = xStart; x < xEnd; x++) {
+		const int left = (x > 0) ? (x - 1) : x, right = (x < (NES_SCREEN_WIDTH - 1)) ? (x + 1) : x;
+		const dword A = up[left], B = up[x], C = up[right],
+								D = cur[left], E = cur[x], F = cur[right],
+								G = down[left], H = down[x], I = down[right];
+
+		dword *out0 = row0 + (x * 3), *out1 = row1 + (x * 3), *out2 = row2 + (x * 3);
+
+		if ((B != H) && (D != F)) {
+			out0[0] = (D == B) ? D : E;
+			out0[1] = (((D == B) && (E != C)) || ((B == F) && (E != A))) ? B : E;
+			out0[2] = (B == F) ? F : E;
+			out1[0] = (((D == B) && (E != G)) || ((D == H) && (E != A))) ? D : E;
+			out1[1] = E;
+			out1[2] = (((B == F) && (E != I)) || ((H == F) && (E != C))) ? F : E;
+			out2[0] = (D == H) ? D : E;
+			out2[1] = (((D == H) && (E != I)) || ((H == F) && (E != G))) ? H : E;
+			out2[2] = (H == F) ? F : E;
+		} else {
+			out0[0] = out0[1] = out0[2] = out1[0] = out1[1] = out1[2] = out2[0] = out2[1] = out2[2] = E;
+		}
+	}
+}
+
+void FrameScaler::scale3x_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	scale3x_span_scalar(up, cur, down, dst, 0, NES_SCREEN_WIDTH);
+}
+
+void FrameScaler::scale3x_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const {
+	const int outputWidth = NES_SCREEN_WIDTH * 3;
+	const __m128i allOnes = _mm_set1_epi32(-1);
+	dword *row0 = dst, *row1 = dst + outputWidth, *row2 = dst + (outputWidth * 2);
+
+	scale3x_span_scalar(up, cur, down, dst, 0, SSE2_PIXELS);
+
+	for (int x = SSE2_PIXELS; x < (NES_SCREEN_WIDTH - SSE2_PIXELS); x += SSE2_PIXELS) {
+		const __m128i A = _mm_loadu_si128((const __m128i *)(up + x - 1)),
+									B = _mm_loadu_si128((const __m128i *)(up + x)),
+									C = _mm_loadu_si128((const __m128i *)(up + x + 1)),
+									D = _mm_loadu_si128((const __m128i *)(cur + x - 1)),
+									E = _mm_loadu_si128((const __m128i *)(cur + x)),
+									F = _mm_loadu_si128((const __m128i *)(cur + x + 1)),
+									G = _mm_loadu_si128((const __m128i *)(down + x - 1)),
+									H = _mm_loadu_si128((const __m128i *)(down + x)),
+									I = _mm_loadu_si128((const __m128i *)(down + x + 1));
+
+		const __m128i active = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)), allOnes);
+
+		const __m128i DB = _mm_and_si128(active, _mm_cmpeq_epi32(D, B)),
+									BF = _mm_and_si128(active, _mm_cmpeq_epi32(B, F)),
+									DH = _mm_and_si128(active, _mm_cmpeq_epi32(D, H)),
+									HF = _mm_and_si128(active, _mm_cmpeq_epi32(H, F));
+
+		//E != X masks
+		const __m128i neA = _mm_andnot_si128(_mm_cmpeq_epi32(E, A), allOnes),
+									neC = _mm_andnot_si128(_mm_cmpeq_epi32(E, C), allOnes),
+									neG = _mm_andnot_si128(_mm_cmpeq_epi32(E, G), allOnes),
+									neI = _mm_andnot_si128(_mm_cmpeq_epi32(E, I), allOnes);
+
+		const __m128i E0 = select_sse2(DB, D, E),
+									E1 = select_sse2(_mm_or_si128(_mm_and_si128(DB, neC), _mm_and_si128(BF, neA)), B, E),
+									E2 = select_sse2(BF, F, E),
+									E3 = select_sse2(_mm_or_si128(_mm_and_si128(DB, neG), _mm_and_si128(DH, neA)), D, E),
+									E5 = select_sse2(_mm_or_si128(_mm_and_si128(BF, neI), _mm_and_si128(HF, neC)), F, E),
+									E6 = select_sse2(DH, D, E),
+									E7 = select_sse2(_mm_or_si128(_mm_and_si128(DH, neI), _mm_and_si128(HF, neG)), H, E),
+									E8 = select_sse2(HF, F, E);
+
+		store_interleaved3_sse2(row0 + (x * 3), E0, E1, E2);
+		store_interleaved3_sse2(row1 + (x * 3), E3, E, E5);
+		store_interleaved3_sse2(row2 + (x * 3), E6, E7, E8);
+	}
+
+	scale3x_span_scalar(up, cur, down, dst, NES_SCREEN_WIDTH - SSE2_PIXELS, NES_SCREEN_WIDTH);
+}
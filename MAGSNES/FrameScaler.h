@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SIMD.h"
+
+namespace MAGSNES {
+
+//Post-processing stage that sits between a finished RGBA frame (see FrameBuffer::convert_to_rgba) and whatever consumes it: the GL texture,
+//a capture file, an encoder... Each sink owns its own FrameScaler and destination buffer, so they can run different filters.
+//Input is always NES_SCREEN_WIDTH x NES_SCREEN_HEIGHT; output is get_output_width() x get_output_height().
+class FrameScaler {
+	DECLARE_DEBUGGER_ACCESS
+
+public:
+	enum class Filter {
+		NONE,
+		NEAREST_2X,
+		NEAREST_3X,
+		NEAREST_4X,
+		SCALE2X,		//AdvMAME2x; gives identical output to EPX
+		SCALE3X,		//AdvMAME3x
+		FILTER_TOTAL
+	};
+
+	//Largest output any filter produces, for sinks that want to allocate once
+	static const int MAX_SCALE_FACTOR = 4;
+	static const dword MAX_OUTPUT_PIXEL_COUNT = (NES_SCREEN_WIDTH * MAX_SCALE_FACTOR) * (NES_SCREEN_HEIGHT * MAX_SCALE_FACTOR);
+
+	FrameScaler();
+	~FrameScaler();
+
+	//Also picks the fastest kernel the CPU supports for that filter
+	void set_filter(const Filter filter);
+	const Filter get_filter() const { return filter; }
+
+	const int get_scale_factor() const { return scaleFactor; }
+	const int get_output_width() const { return NES_SCREEN_WIDTH * scaleFactor; }
+	const int get_output_height() const { return NES_SCREEN_HEIGHT * scaleFactor; }
+
+	//dst must hold get_output_width() * get_output_height() dwords, and must not overlap src
+	void scale(const dword * const src, dword * const dst) const;
+
+	__CLASSMETHOD__ const int get_filter_scale_factor(const Filter filter);
+	__CLASSMETHOD__ const char * get_filter_name(const Filter filter);
+
+private:
+	//Writes all of the output lines for one input line. up and down are the neighbouring input lines, clamped at the frame edges.
+	typedef void (FrameScaler::*RowKernel)(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+
+	Filter filter;
+	int scaleFactor;
+	RowKernel rowKernel;
+
+	//Lets the Debugger compare the vectorized kernels against the scalar ones
+	bool forceScalar;
+
+	void nearest_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+	void nearest_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+	void nearest_row_avx2(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+
+	void scale2x_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+	void scale2x_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+	void scale2x_row_avx2(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+
+	void scale3x_row_scalar(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+	void scale3x_row_sse2(const dword *up, const dword *cur, const dword *down, dword *dst) const;
+
+	//The vector kernels handle the pixels whose left/right neighbours fall outside the line with these
+	void scale2x_span_scalar(const dword *up, const dword *cur, const dword *down, dword *dst, const int xStart, const int xEnd) const;
+	void scale3x_span_scalar(const dword *up, const dword *cur, const dword *down, dword *dst, const int xStart, const int xEnd) const;
+
+	//Copies the first output line of a row over the remaining scaleFactor - 1 lines
+	void replicate_line(dword *dst) const;
+};
+
+} /* namespace MAGSNES */
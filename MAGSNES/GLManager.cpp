@@ -1,21 +1,40 @@
 #include "GLManager.h"
 
+#include <gl/wglew.h>
+
 __FILESCOPE__{
 	const MAGSNES::dword SCREEN_DWORD_SIZE = MAGSNES::NES_SCREEN_WIDTH * MAGSNES::NES_SCREEN_HEIGHT;
 }
 
 using namespace MAGSNES;
 
+VideoFrame::VideoFrame() {
+	std::memset(rgba, 0, sizeof(rgba));
+}
+
 GLManager::GLManager(Core &refCore)
 	: refCore(refCore), CPU_FREQ(this->refCore.get_cpu_freq()), hwnd(this->refCore.get_main_window()),
-		hdc(NULL), hglrc(NULL), bufferToggle(true) {
-	
+		hdc(NULL), hglrc(NULL), bufferToggle(true), isVsyncRequested(false), isVsyncEnabled(false), scaledBuffer(nullptr) {
+	std::memset(vbufferA, 0, sizeof(vbufferA));
+	std::memset(&presentStats, 0, sizeof(PresentStats));
 }
 
 GLManager::~GLManager() {
-	glDeleteTextures(1, &textureID);
+	if (presentStats.frames > 0) {
+		char statsMsg[128];
+		sprintf_s(statsMsg, "update_screen (%s): %llu frames, avg %llu us, max %llu us", presenter.is_streaming() ? "streaming" : "legacy",
+			presentStats.frames, presentStats.totalMicroseconds / presentStats.frames, presentStats.maxMicroseconds);
+		refCore.logmsg(statsMsg);
+
+		sprintf_s(statsMsg, "Frame exchange: %llu frames dropped, %llu frames repeated", frames.get_dropped_count(), frames.get_repeated_count());
+		refCore.logmsg(statsMsg);
+	}
+
+	presenter.release();
 	wglMakeCurrent(NULL, NULL);
 
+	delete[] scaledBuffer;
+
 	if (hglrc != NULL) {
 		wglDeleteContext(hglrc);
 	}
@@ -64,6 +83,19 @@ const bool GLManager::hook_up_gl() {
 	//Connect the current thread so that it renders to our context
 	wglMakeCurrent(hdc, hglrc);
 
+	//The filter determines the texture size, so it has to be chosen before any GL objects are created
+	scaler.set_filter(refCore.videoRegs.presentFilter);
+	if (scaler.get_filter() != FrameScaler::Filter::NONE) {
+		scaledBuffer = new dword[scaler.get_output_width() * scaler.get_output_height()];
+		std::memset(scaledBuffer, 0, get_texture_bytes());
+	}
+
+	//GLEW loads the post-1.1 entry points, which requires a current context
+	const bool isGlewReady = (glewInit() == GLEW_OK);
+	if (!isGlewReady) {
+		refCore.logerr("Unable to initialize GLEW; using legacy presentation");
+	}
+
 	resize_gl();
 
 	//With retro graphics, modern video quality is of little importance
@@ -73,7 +105,17 @@ const bool GLManager::hook_up_gl() {
 	glHint(GL_POLYGON_SMOOTH_HINT, GL_FASTEST);
 	glHint(GL_GENERATE_MIPMAP_HINT, GL_FASTEST);
 
-	init_texture();
+	GLPresenter::Capabilities caps = { false, false };
+	if (isGlewReady) {
+		caps.hasGL30 = GLEW_VERSION_3_0 ? true : false;
+		caps.hasTextureStorage = GLEW_ARB_texture_storage ? true : false;
+	}
+
+	if (!presenter.init(scaler.get_output_width(), scaler.get_output_height(), isGlewReady && refCore.videoRegs.useStreamingUpload, caps)) {
+		refCore.logerr(presenter.get_error());
+	} else if (presenter.is_streaming()) {
+		refCore.logmsg("Using streaming (PBO) presentation");
+	}
 
 #ifdef _DEBUG
 
@@ -116,45 +158,98 @@ const bool GLManager::hook_up_gl() {
 }
 
 void GLManager::update_screen() {
-	
-	//Don't bother clearing screen, since we're always rendering to the whole screen
+	LARGE_INTEGER start, end, elapsed;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 240, 0, GL_RGBA,
-		GL_UNSIGNED_BYTE, vbufferA);
+	QueryPerformanceCounter(&start);
 
-	//TODO: try more efficient OpenGL methods (mipmaps et al), although the app seems to be running OK...
+	//Don't bother clearing screen, since we're always rendering to the whole screen
+	if (presenter.is_streaming()) {
+		present_streaming();
+	} else {
+		present_legacy();
+	}
 
-	glBegin(GL_QUADS);
-		//Note we start at the top right to match the coord system used in the software NES implementation (GL usually starts at bottom left); 
-		//the picture would be flipped otherwise.
-		glTexCoord2d(0.0f, 0.0f); glVertex2d(-1.0f, +1.0f);
-		glTexCoord2d(1.0f, 0.0f); glVertex2d(+1.0f, +1.0f);
-		glTexCoord2d(1.0f, 1.0f); glVertex2d(+1.0f, -1.0f);
-		glTexCoord2d(0.0f, 1.0f); glVertex2d(-1.0f, -1.0f);
-	glEnd();
+	QueryPerformanceCounter(&end);
+	refCore.get_elapsed_microseconds(start, end, elapsed);
+	refCore.telemetry->record(Telemetry::METRIC_PRESENT, (dword)elapsed.QuadPart);
+
+	presentStats.frames++;
+	presentStats.totalMicroseconds += elapsed.QuadPart;
+	if ((qword)elapsed.QuadPart > presentStats.maxMicroseconds) {
+		presentStats.maxMicroseconds = elapsed.QuadPart;
+	}
 
 	SwapBuffers(hdc); //HDC takes care of double buffering magic
 }
 
-void GLManager::draw_pixel(const word x, const word y, dword color) {
-
-#ifdef X86_BUILD //MSVC only supports inline asm on x86 arch
-	//Assembly to quickly reverse endianess and OR in opacity
-	__asm {
-		push eax
-		mov eax, [color]
-		rol ax, 8
-		rol eax, 16
-		rol ax, 8
-		or eax, 0FF000000h //OR away PPU meta information in the color value
-		mov [color], eax
-		pop eax
-	}
-#else
-	color = _byteswap_ulong(color | 0xFF);
-#endif
-	vbufferA[x + (y * NES_SCREEN_WIDTH)] = color;
+void GLManager::set_vsync(const bool enabled) {
+	if (enabled == isVsyncRequested) {
+		return;
+	}
 
+	isVsyncRequested = enabled;
+
+	//glewInit loads the WGL extensions as well
+	if (!WGLEW_EXT_swap_control) {
+		if (enabled) {
+			refCore.logerr("WGL_EXT_swap_control is not available; presenting at a fixed 60Hz instead of vsync");
+		}
+
+		isVsyncEnabled = false;
+		return;
+	}
+
+	isVsyncEnabled = (wglSwapIntervalEXT(enabled ? 1 : 0) == TRUE) && enabled;
+}
+
+void GLManager::load_palette(const dword * const nesPalette) {
+	//Called by the PPU as it is created, before it draws or publishes anything
+	for (int i = 0; i < TripleBuffer<VideoFrame>::SLOT_COUNT; i++) {
+		frames.get_slot(i).load_palette(nesPalette);
+	}
+}
+
+void GLManager::present_legacy() {
+	const VideoFrame &frame = frames.get_front();
+	const dword *pixels = frame.rgba;
+
+	if (refCore.videoRegs.usePaletteIndexFramebuffer) {
+		frame.convert_to_rgba(vbufferA);
+		pixels = vbufferA;
+	}
+
+	if (scaledBuffer != nullptr) {
+		scaler.scale(pixels, scaledBuffer);
+		pixels = scaledBuffer;
+	}
+
+	presenter.present_legacy(pixels);
+}
+
+//The frame is written straight into the PBO GLPresenter maps for it
+void GLManager::present_streaming() {
+	dword * const dst = presenter.begin_streaming_frame();
+	const VideoFrame &frame = frames.get_front();
+
+	if (dst != NULL) {
+		if (scaledBuffer != nullptr) {
+			const dword *pixels = frame.rgba;
+
+			if (refCore.videoRegs.usePaletteIndexFramebuffer) {
+				frame.convert_to_rgba(vbufferA);
+				pixels = vbufferA;
+			}
+
+			scaler.scale(pixels, dst);
+		} else if (refCore.videoRegs.usePaletteIndexFramebuffer) {
+			//Expand straight into driver memory; vbufferA isn't touched at all
+			frame.convert_to_rgba(dst);
+		} else {
+			std::memcpy(dst, frame.rgba, get_texture_bytes());
+		}
+	}
+
+	presenter.end_streaming_frame();
 }
 
 void GLManager::resize_gl() {
@@ -169,18 +264,3 @@ void GLManager::resize_gl() {
 	gluOrtho2D(-1.0, 1.0, -1.0, 1.0);
 
 }
-
-void GLManager::init_texture() {
-	glEnable(GL_TEXTURE_2D);
-
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-		//GL_NEAREST_MIPMAP_NEAREST);
-		GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-		//GL_NEAREST_MIPMAP_NEAREST);
-		GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-}
\ No newline at end of file
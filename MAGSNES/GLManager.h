@@ -1,9 +1,22 @@
 #pragma once
 
 #include "Core.h"
+#include "FrameBuffer.h"
+#include "FrameScaler.h"
+#include "GLPresenter.h"
+#include "TripleBuffer.h"
 
 namespace MAGSNES {
 
+//One frame as the PPU delivers it: the palette indices and emphasis of a FrameBuffer when Core::videoRegs.usePaletteIndexFramebuffer is set,
+//or RGBA lines (expanded with the FrameBuffer's tables) when it isn't
+class VideoFrame : public FrameBuffer {
+public:
+	VideoFrame();
+
+	ALIGN32 dword rgba[FRAME_PIXEL_COUNT];
+};
+
 //Handles all OpenGL backend. Expected to be created in the video thread. 
 //Note that ONLY the thread which owns the GLManager instance will be able to draw to the window;
 class GLManager {
@@ -14,11 +27,28 @@ public:
 	//Create an OpenGL context from our window; GL boilerplate init goes here
 	const bool hook_up_gl();
 
-	void draw_pixel(const word x, const word y, dword color);
+	//Allows the PPU to write each frame straight into the back buffer, and publish it when it is done
+	TripleBuffer<VideoFrame> * expose_frames() { return &frames; }
+
+	//Gives every frame buffer the RGBA lookup tables for a 64 entry palette in 0xRRGGBB00 format
+	void load_palette(const dword * const nesPalette);
+
+	//Makes the newest frame the exec thread finished the one to present; false if there isn't one since the last call
+	const bool take_frame() { return frames.take(); }
+
+	//For when the screen was due a new frame but there wasn't one, so the current one stays up for another interval
+	void count_repeated_frame() { frames.count_repeat(); }
 
-	//Flip buffers
+	//Present the frame from the last take_frame, and flip buffers
 	void update_screen();
 
+	//Makes SwapBuffers wait for (or not wait for) the display's refresh, through WGL_EXT_swap_control. Until the first call with true,
+	//the driver's default is left alone.
+	void set_vsync(const bool enabled);
+
+	//Whether SwapBuffers is known to wait for the refresh; false when the driver lacks swap control
+	const bool is_vsync_enabled() const { return isVsyncEnabled; }
+
 private:
 	Core &refCore;
   const LARGE_INTEGER &CPU_FREQ;
@@ -27,21 +57,40 @@ private:
 	HGLRC hglrc;
 
 	bool bufferToggle;
+	bool isVsyncRequested, isVsyncEnabled;
 
-	//Initially had a vbufferA and vbufferB for software (read: redundant) double buffering, thinking that we don't want the 
-	//exec thread to start drawing into the top of the buffer before it makes it to the screen, which would cause random garbage on the top
-	//portion of the screen. This is not a concern however, as A) the rendering operation is fairly quick and B) there are unseen scanlines that need
-	//to be drawn/omitted during VBLANK that ensure that during the critical time between when the frame is completed and it is rendered to the screen, the execution
-	//thread will not yet be drawing to the buffer until it is presented to the user.
+	//Frames go from the exec thread to this one through a triple buffer, so the PPU never draws into the frame being presented and neither
+	//thread waits on the other. When more than one frame is finished between presents, only the newest is shown.
+	TripleBuffer<VideoFrame> frames;
+
+	//The front frame expanded to RGBA, when it holds palette indices and something (the legacy upload or the scaler) needs it in memory
 	dword vbufferA[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
 
+	//Optional upscaling between the RGBA frame and the texture. scaledBuffer is only allocated when a filter is in use.
+	FrameScaler scaler;
+	dword *scaledBuffer;
+
 	/*dword (&_vbufferA)[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];
 	dword (&_vbufferB)[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT];*/
 
-	GLuint textureID;
+	//Owns the texture and whichever upload path Core::videoRegs.useStreamingUpload picked
+	GLPresenter presenter;
+
+	//Time spent inside update_screen before SwapBuffers, i.e. how long the video thread is stalled on the upload
+	struct PresentStats {
+		qword frames;
+		qword totalMicroseconds;
+		qword maxMicroseconds;
+	} presentStats;
 
 	void resize_gl();
-	void init_texture();
+
+	const GLsizeiptr get_texture_bytes() const {
+		return scaler.get_output_width() * scaler.get_output_height() * sizeof(dword);
+	}
+
+	void present_legacy();
+	void present_streaming();
 };
 
 } /* namespace MAGSNES */
\ No newline at end of file
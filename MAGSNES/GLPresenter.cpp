@@ -0,0 +1,233 @@
+#include "GLPresenter.h"
+
+#include <cstring>
+#include <vector>
+
+__FILESCOPE__{
+	//Attribute locations are bound before linking, so the VAO setup doesn't have to query them
+	const GLuint ATTRIB_POSITION = 0,
+							ATTRIB_TEXCOORD = 1;
+
+	const char * const VERTEX_SHADER_SOURCE =
+		"#version 130\n"
+		"in vec2 position;\n"
+		"in vec2 texCoord;\n"
+		"out vec2 uv;\n"
+		"void main() {\n"
+		"	uv = texCoord;\n"
+		"	gl_Position = vec4(position, 0.0, 1.0);\n"
+		"}\n";
+
+	const char * const FRAGMENT_SHADER_SOURCE =
+		"#version 130\n"
+		"uniform sampler2D screen;\n"
+		"in vec2 uv;\n"
+		"out vec4 color;\n"
+		"void main() {\n"
+		"	color = texture(screen, uv);\n"
+		"}\n";
+
+	//x, y, u, v for a triangle strip covering the viewport. As in the legacy path, texture row 0 is mapped to the top of the screen.
+	const GLfloat QUAD_VERTICES[] = {
+		-1.0f, +1.0f, 0.0f, 0.0f,
+		+1.0f, +1.0f, 1.0f, 0.0f,
+		-1.0f, -1.0f, 0.0f, 1.0f,
+		+1.0f, -1.0f, 1.0f, 1.0f
+	};
+}
+
+using namespace MAGSNES;
+
+GLPresenter::GLPresenter()
+	: width(0), height(0), textureID(0), useStreamingPath(false), pboIndex(0), isMapped(false), vaoID(0), vboID(0), shaderProgram(0) {
+	std::memset(pboIDs, 0, sizeof(pboIDs));
+	errorMsg[0] = '\0';
+}
+
+//No cleanup needed
+GLPresenter::~GLPresenter() {}
+
+const bool GLPresenter::init(const int width, const int height, const bool wantStreaming, const Capabilities &caps) {
+	this->width = width;
+	this->height = height;
+
+	useStreamingPath = wantStreaming && init_streaming_path(caps);
+	init_texture(caps.hasTextureStorage);
+
+	return useStreamingPath || !wantStreaming;
+}
+
+void GLPresenter::release() {
+	if (useStreamingPath) {
+		glDeleteBuffers(2, pboIDs);
+		glDeleteBuffers(1, &vboID);
+		glDeleteVertexArrays(1, &vaoID);
+		glDeleteProgram(shaderProgram);
+	}
+
+	glDeleteTextures(1, &textureID);
+
+	std::memset(pboIDs, 0, sizeof(pboIDs));
+	textureID = vaoID = vboID = shaderProgram = 0;
+	useStreamingPath = false;
+}
+
+void GLPresenter::present_legacy(const dword * const pixels) {
+	//Storage was allocated in init_texture, so only the contents are replaced here
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+	glBegin(GL_QUADS);
+		//Note we start at the top right to match the coord system used in the software NES implementation (GL usually starts at bottom left);
+		//the picture would be flipped otherwise.
+		glTexCoord2d(0.0f, 0.0f); glVertex2d(-1.0f, +1.0f);
+		glTexCoord2d(1.0f, 0.0f); glVertex2d(+1.0f, +1.0f);
+		glTexCoord2d(1.0f, 1.0f); glVertex2d(+1.0f, -1.0f);
+		glTexCoord2d(0.0f, 1.0f); glVertex2d(-1.0f, -1.0f);
+	glEnd();
+}
+
+dword * GLPresenter::begin_streaming_frame() {
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboIDs[pboIndex]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	pboIndex ^= 1;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboIDs[pboIndex]);
+
+	//Invalidating lets the driver hand back fresh storage rather than wait for any pending transfer out of this buffer
+	dword * const dst = (dword *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, get_frame_bytes(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	isMapped = (dst != NULL);
+
+	return dst;
+}
+
+void GLPresenter::end_streaming_frame() {
+	if (isMapped) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		isMapped = false;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glUseProgram(shaderProgram);
+	glBindVertexArray(vaoID);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+void GLPresenter::init_texture(const bool hasTextureStorage) {
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+		//GL_NEAREST_MIPMAP_NEAREST);
+		GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+		//GL_NEAREST_MIPMAP_NEAREST);
+		GL_NEAREST);
+
+	if (useStreamingPath) {
+		//Single level, never redefined. Immutable storage also spares the driver from revalidating the texture on each upload.
+		if (hasTextureStorage) {
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	} else {
+		glEnable(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+
+		//Allocate once; present_legacy only replaces the contents
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+}
+
+const bool GLPresenter::init_streaming_path(const Capabilities &caps) {
+	//PBOs (2.1), glMapBufferRange, VAOs, and GLSL 1.30 are all core in 3.0
+	if (!caps.hasGL30) {
+		std::snprintf(errorMsg, sizeof(errorMsg), "OpenGL 3.0 is not available; using legacy presentation");
+		return false;
+	}
+
+	GLuint vertexShader = compile_shader(GL_VERTEX_SHADER, VERTEX_SHADER_SOURCE);
+	GLuint fragmentShader = compile_shader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER_SOURCE);
+
+	if ((vertexShader == 0) || (fragmentShader == 0)) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return false;
+	}
+
+	shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertexShader);
+	glAttachShader(shaderProgram, fragmentShader);
+	glBindAttribLocation(shaderProgram, ATTRIB_POSITION, "position");
+	glBindAttribLocation(shaderProgram, ATTRIB_TEXCOORD, "texCoord");
+	glLinkProgram(shaderProgram);
+
+	//Flagged for deletion; freed along with the program
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		std::snprintf(errorMsg, sizeof(errorMsg), "Unable to link the presentation shader; using legacy presentation");
+		glDeleteProgram(shaderProgram);
+		shaderProgram = 0;
+		return false;
+	}
+
+	glUseProgram(shaderProgram);
+	glUniform1i(glGetUniformLocation(shaderProgram, "screen"), 0);
+	glUseProgram(0);
+
+	glGenVertexArrays(1, &vaoID);
+	glBindVertexArray(vaoID);
+
+	glGenBuffers(1, &vboID);
+	glBindBuffer(GL_ARRAY_BUFFER, vboID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_VERTICES), QUAD_VERTICES, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const void *)0);
+	glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const void *)(2 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Both start out black, since the first present sources the texture from a PBO that was never written
+	const std::vector<dword> blankFrame(width * height, 0);
+
+	glGenBuffers(2, pboIDs);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboIDs[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, get_frame_bytes(), blankFrame.data(), GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	return true;
+}
+
+const GLuint GLPresenter::compile_shader(const GLenum type, const char * const source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+	if (compiled != GL_TRUE) {
+		char infoLog[512];
+		glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+		std::snprintf(errorMsg, sizeof(errorMsg), "Unable to compile presentation shader: %s", infoLog);
+
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>	//Needed before the GL headers
+#include <gl/glew.h>
+#else
+#define GL_GLEXT_PROTOTYPES	//libOpenGL exports every core entry point, so nothing has to be loaded by hand
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//The GL side of presenting a frame: the texture, and either the legacy upload (glTexSubImage2D from client memory, drawn with
+//immediate mode) or the streaming one (double-buffered PBOs, drawn with a VBO and shader). Holds nothing platform specific, so
+//GLManager runs it in its WGL context and PresentBench in a headless EGL one. Every call needs the context it was set up in to be current.
+class GLPresenter {
+public:
+	//What the context offers; GLManager fills this in from GLEW, PresentBench from the GL version
+	struct Capabilities {
+		bool hasGL30;				//PBOs, glMapBufferRange, VAOs and GLSL 1.30
+		bool hasTextureStorage;		//glTexStorage2D (ARB_texture_storage, core in 4.2)
+	};
+
+	GLPresenter();
+	//GL objects aren't freed here, since the context may already be gone; see release
+	~GLPresenter();
+
+	//Creates the texture for width x height RGBA frames, plus the streaming path's objects when wantStreaming is set. Returns false
+	//when streaming was wanted but can't be used (get_error says why); the legacy path is set up instead.
+	const bool init(const int width, const int height, const bool wantStreaming, const Capabilities &caps);
+
+	//Frees every GL object made by init
+	void release();
+
+	const bool is_streaming() const { return useStreamingPath; }
+	const char * get_error() const { return errorMsg; }
+
+	//Legacy path: replaces the texture's contents with pixels and draws it
+	void present_legacy(const dword * const pixels);
+
+	/*
+	Streaming path, in two calls. begin_streaming_frame queues the upload of the frame written on the previous call, which comes
+	from one PBO, and maps the other one for this frame's pixels (nullptr if the mapping failed). end_streaming_frame unmaps it and
+	draws the texture. With a buffer bound to GL_PIXEL_UNPACK_BUFFER, glTexSubImage2D only queues the transfer and returns, so the
+	copy of frame N into the texture overlaps with the caller writing frame N+1. This costs one frame of latency, in exchange for
+	never stalling on the driver.
+	*/
+	dword * begin_streaming_frame();
+	void end_streaming_frame();
+
+private:
+	int width, height;
+
+	GLuint textureID;
+
+	//Streaming path objects. Two PBOs are used round-robin: while the texture is sourced from one, the next frame is written into the other.
+	bool useStreamingPath;
+	GLuint pboIDs[2];
+	byte pboIndex;
+	bool isMapped;
+	GLuint vaoID, vboID, shaderProgram;
+
+	char errorMsg[640];
+
+	const GLsizeiptr get_frame_bytes() const {
+		return (GLsizeiptr)width * height * sizeof(dword);
+	}
+
+	void init_texture(const bool hasTextureStorage);
+
+	//Returns false if the context lacks anything the streaming path needs
+	const bool init_streaming_path(const Capabilities &caps);
+	const GLuint compile_shader(const GLenum type, const char * const source);
+};
+
+} /* namespace MAGSNES */
@@ -0,0 +1,236 @@
+#include "LineCompositor.h"
+
+__FILESCOPE__{
+	//Background pixels expanded from the tiles, before fine X is applied
+	const int BACKGROUND_BUFFER_SIZE = MAGSNES::LineCompositor::TILE_BUFFER_SIZE * 8;
+
+	//Mask of the bits in a sprite line entry that hold the palette RAM address
+	const MAGSNES::byte SPRITE_PALETTE_BITS = 0x1F;
+
+	FORCEINLINE MAGSNES::word lowest_set_bit(MAGSNES::dword bits) {
+		MAGSNES::word bit = 0;
+		while (!(bits & 1)) {
+			bits >>= 1;
+			bit++;
+		}
+		return bit;
+	}
+}
+
+using namespace MAGSNES;
+
+LineCompositor::LineCompositor()
+	: lineKernel(nullptr), forceScalar(false) {
+
+	select_kernel();
+}
+
+//No cleanup needed
+LineCompositor::~LineCompositor() {}
+
+void LineCompositor::select_kernel() {
+	if (!forceScalar && SIMD::has_avx2()) {
+		lineKernel = &LineCompositor::composite_avx2;
+	} else if (!forceScalar && SIMD::has_ssse3()) {
+		lineKernel = &LineCompositor::composite_ssse3;
+	} else {
+		lineKernel = &LineCompositor::composite_scalar;
+	}
+}
+
+const word LineCompositor::composite(const BackgroundTiles &tiles, const byte fineX, const byte * const sprites,
+	const byte * const paletteRAM, const byte colorMask, byte * const dst) const {
+
+	return (this->*lineKernel)(tiles, fineX, sprites, paletteRAM, colorMask, dst);
+}
+
+/*
+The reference for the vector kernels; they must give identical output. For each pixel:
+
+1) The background pixel is the 2 bit color from the tile's pattern rows, ORed with the tile's palette, or 0 (the universal background
+color at $3F00) if the color is 0.
+
+2) An opaque sprite pixel is drawn if it is in front of the background, or if the background pixel is transparent.
+
+3) Sprite 0 hits when one of its opaque pixels is over an opaque background pixel, whichever of the two ends up drawn.
+*/
+const word LineCompositor::composite_scalar(const BackgroundTiles &tiles, const byte fineX, const byte *sprites,
+	const byte *paletteRAM, const byte colorMask, byte *dst) const {
+
+	byte background[BACKGROUND_BUFFER_SIZE];
+
+	for (int tile = 0; tile < TILES_PER_LINE; tile++) {
+		for (int col = 0; col < 8; col++) {
+			const byte bit = 7 - col; //The leftmost pixel is bit 7
+			const byte colorSelect = ((tiles.patternLo[tile] >> bit) & 0x01) | (((tiles.patternHi[tile] >> bit) & 0x01) << 1);
+
+			background[(tile * 8) + col] = (colorSelect != 0) ? (tiles.palette[tile] | colorSelect) : 0;
+		}
+	}
+
+	word spriteZeroHit = NO_SPRITE_ZERO_HIT;
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+		const byte	ntPixel = background[fineX + x],
+			sprPixel = sprites[x];
+
+		const bool	isBackgroundOpaque = (ntPixel != 0),
+			isSpriteOpaque = (sprPixel & 0x03) != 0;
+
+		if (isSpriteOpaque && isBackgroundOpaque && (sprPixel & SPRITE_ZERO) && (spriteZeroHit == NO_SPRITE_ZERO_HIT)) {
+			spriteZeroHit = x;
+		}
+
+		const bool shouldDrawSprite = isSpriteOpaque && (!(sprPixel & SPRITE_BEHIND_BACKGROUND) || !isBackgroundOpaque);
+		const byte paletteAddr = shouldDrawSprite ? (sprPixel & SPRITE_PALETTE_BITS) : ntPixel;
+
+		dst[x] = paletteRAM[paletteAddr] & colorMask;
+	}
+
+	return spriteZeroHit;
+}
+
+/*
+Each pair of tiles is expanded to 16 pixels by broadcasting their pattern bytes with pshufb and testing one bit per pixel. The
+composite then works on masks from compares, and the 32 entry palette lookup is two 16 entry pshufb lookups (see FrameBuffer) where
+bit 4 of the address picks which one is used.
+*/
+const word LineCompositor::composite_ssse3(const BackgroundTiles &tiles, const byte fineX, const byte *sprites,
+	const byte *paletteRAM, const byte colorMask, byte *dst) const {
+
+	ALIGN32 byte background[BACKGROUND_BUFFER_SIZE];
+
+	const __m128i	zero = _mm_setzero_si128(),
+								one = _mm_set1_epi8(0x01),
+								two = _mm_set1_epi8(0x02),
+								tileSelect = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1),
+								pixelBits = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+									(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+	for (int tile = 0; tile < TILES_PER_LINE; tile += 2) {
+		const __m128i	lo = _mm_shuffle_epi8(_mm_cvtsi32_si128(*(const int *)(tiles.patternLo + tile)), tileSelect),
+									hi = _mm_shuffle_epi8(_mm_cvtsi32_si128(*(const int *)(tiles.patternHi + tile)), tileSelect),
+									palette = _mm_shuffle_epi8(_mm_cvtsi32_si128(*(const int *)(tiles.palette + tile)), tileSelect);
+
+		const __m128i	loSet = _mm_cmpeq_epi8(_mm_and_si128(lo, pixelBits), pixelBits),
+									hiSet = _mm_cmpeq_epi8(_mm_and_si128(hi, pixelBits), pixelBits),
+									colorSelect = _mm_or_si128(_mm_and_si128(loSet, one), _mm_and_si128(hiSet, two));
+
+		_mm_store_si128((__m128i *)(background + (tile * 8)),
+			_mm_andnot_si128(_mm_cmpeq_epi8(colorSelect, zero), _mm_or_si128(colorSelect, palette)));
+	}
+
+	const __m128i	colorBits = _mm_set1_epi8(0x03),
+								paletteBits = _mm_set1_epi8(SPRITE_PALETTE_BITS),
+								behindBackground = _mm_set1_epi8(SPRITE_BEHIND_BACKGROUND),
+								spriteZero = _mm_set1_epi8(SPRITE_ZERO),
+								upperTable = _mm_set1_epi8(0x10),
+								zeroFlag = _mm_set1_epi8((char)0x80),
+								outputMask = _mm_set1_epi8(colorMask),
+								tableLo = _mm_loadu_si128((const __m128i *)paletteRAM),
+								tableHi = _mm_loadu_si128((const __m128i *)(paletteRAM + 16));
+
+	word spriteZeroHit = NO_SPRITE_ZERO_HIT;
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x += 16) {
+		const __m128i	ntPixel = _mm_loadu_si128((const __m128i *)(background + fineX + x)),
+									sprPixel = _mm_loadu_si128((const __m128i *)(sprites + x));
+
+		const __m128i	isBackgroundTransparent = _mm_cmpeq_epi8(ntPixel, zero),
+									isSpriteTransparent = _mm_cmpeq_epi8(_mm_and_si128(sprPixel, colorBits), zero),
+									isSpriteInFront = _mm_cmpeq_epi8(_mm_and_si128(sprPixel, behindBackground), zero),
+									isSpriteZero = _mm_cmpeq_epi8(_mm_and_si128(sprPixel, spriteZero), spriteZero);
+
+		if (spriteZeroHit == NO_SPRITE_ZERO_HIT) {
+			const int hits = _mm_movemask_epi8(_mm_andnot_si128(_mm_or_si128(isSpriteTransparent, isBackgroundTransparent), isSpriteZero));
+			if (hits != 0) {
+				spriteZeroHit = x + lowest_set_bit(hits);
+			}
+		}
+
+		const __m128i	shouldDrawSprite = _mm_andnot_si128(isSpriteTransparent, _mm_or_si128(isSpriteInFront, isBackgroundTransparent)),
+									paletteAddr = _mm_or_si128(_mm_and_si128(shouldDrawSprite, _mm_and_si128(sprPixel, paletteBits)),
+										_mm_andnot_si128(shouldDrawSprite, ntPixel)),
+									isUpper = _mm_cmpeq_epi8(_mm_and_si128(paletteAddr, upperTable), upperTable);
+
+		const __m128i color = _mm_or_si128(_mm_shuffle_epi8(tableLo, _mm_or_si128(paletteAddr, _mm_and_si128(isUpper, zeroFlag))),
+			_mm_shuffle_epi8(tableHi, _mm_or_si128(paletteAddr, _mm_andnot_si128(isUpper, zeroFlag))));
+
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_and_si128(color, outputMask));
+	}
+
+	return spriteZeroHit;
+}
+
+//Same algorithm as the SSSE3 kernel, 4 tiles and then 32 pixels at a time. Each lane broadcasts its own pair of tiles, and the palette
+//tables are broadcast to both lanes; the pixels never cross lanes, so nothing needs to be permuted.
+const word LineCompositor::composite_avx2(const BackgroundTiles &tiles, const byte fineX, const byte *sprites,
+	const byte *paletteRAM, const byte colorMask, byte *dst) const {
+
+	ALIGN32 byte background[BACKGROUND_BUFFER_SIZE];
+
+	const __m256i	zero = _mm256_setzero_si256(),
+								one = _mm256_set1_epi8(0x01),
+								two = _mm256_set1_epi8(0x02),
+								tileSelect = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+									2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3),
+								pixelBits = _mm256_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+									(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+									(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+									(char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+	for (int tile = 0; tile < TILES_PER_LINE; tile += 4) {
+		const __m256i	lo = _mm256_shuffle_epi8(_mm256_set1_epi32(*(const int *)(tiles.patternLo + tile)), tileSelect),
+									hi = _mm256_shuffle_epi8(_mm256_set1_epi32(*(const int *)(tiles.patternHi + tile)), tileSelect),
+									palette = _mm256_shuffle_epi8(_mm256_set1_epi32(*(const int *)(tiles.palette + tile)), tileSelect);
+
+		const __m256i	loSet = _mm256_cmpeq_epi8(_mm256_and_si256(lo, pixelBits), pixelBits),
+									hiSet = _mm256_cmpeq_epi8(_mm256_and_si256(hi, pixelBits), pixelBits),
+									colorSelect = _mm256_or_si256(_mm256_and_si256(loSet, one), _mm256_and_si256(hiSet, two));
+
+		_mm256_store_si256((__m256i *)(background + (tile * 8)),
+			_mm256_andnot_si256(_mm256_cmpeq_epi8(colorSelect, zero), _mm256_or_si256(colorSelect, palette)));
+	}
+
+	const __m256i	colorBits = _mm256_set1_epi8(0x03),
+								paletteBits = _mm256_set1_epi8(SPRITE_PALETTE_BITS),
+								behindBackground = _mm256_set1_epi8(SPRITE_BEHIND_BACKGROUND),
+								spriteZero = _mm256_set1_epi8(SPRITE_ZERO),
+								upperTable = _mm256_set1_epi8(0x10),
+								zeroFlag = _mm256_set1_epi8((char)0x80),
+								outputMask = _mm256_set1_epi8(colorMask),
+								tableLo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)paletteRAM)),
+								tableHi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(paletteRAM + 16)));
+
+	word spriteZeroHit = NO_SPRITE_ZERO_HIT;
+
+	for (int x = 0; x < NES_SCREEN_WIDTH; x += 32) {
+		const __m256i	ntPixel = _mm256_loadu_si256((const __m256i *)(background + fineX + x)),
+									sprPixel = _mm256_loadu_si256((const __m256i *)(sprites + x));
+
+		const __m256i	isBackgroundTransparent = _mm256_cmpeq_epi8(ntPixel, zero),
+									isSpriteTransparent = _mm256_cmpeq_epi8(_mm256_and_si256(sprPixel, colorBits), zero),
+									isSpriteInFront = _mm256_cmpeq_epi8(_mm256_and_si256(sprPixel, behindBackground), zero),
+									isSpriteZero = _mm256_cmpeq_epi8(_mm256_and_si256(sprPixel, spriteZero), spriteZero);
+
+		if (spriteZeroHit == NO_SPRITE_ZERO_HIT) {
+			const dword hits = (dword)_mm256_movemask_epi8(_mm256_andnot_si256(_mm256_or_si256(isSpriteTransparent, isBackgroundTransparent),
+				isSpriteZero));
+			if (hits != 0) {
+				spriteZeroHit = x + lowest_set_bit(hits);
+			}
+		}
+
+		const __m256i	shouldDrawSprite = _mm256_andnot_si256(isSpriteTransparent, _mm256_or_si256(isSpriteInFront, isBackgroundTransparent)),
+									paletteAddr = _mm256_blendv_epi8(ntPixel, _mm256_and_si256(sprPixel, paletteBits), shouldDrawSprite),
+									isUpper = _mm256_cmpeq_epi8(_mm256_and_si256(paletteAddr, upperTable), upperTable);
+
+		const __m256i color = _mm256_or_si256(
+			_mm256_shuffle_epi8(tableLo, _mm256_or_si256(paletteAddr, _mm256_and_si256(isUpper, zeroFlag))),
+			_mm256_shuffle_epi8(tableHi, _mm256_or_si256(paletteAddr, _mm256_andnot_si256(isUpper, zeroFlag))));
+
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_and_si256(color, outputMask));
+	}
+
+	return spriteZeroHit;
+}
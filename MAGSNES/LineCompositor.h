@@ -0,0 +1,69 @@
+#pragma once
+
+#include "SIMD.h"
+
+namespace MAGSNES {
+
+//Builds one scanline of palette indices at a time, from the background tiles the PPU fetched for it and its sprite line buffer.
+//Expanding the tile rows, picking each pixel's palette, layering the sprites and the palette lookup are all done 16 or 32 pixels at
+//a time, so the PPU only has to act on the sprite 0 hit during the line.
+class LineCompositor {
+	DECLARE_DEBUGGER_ACCESS
+
+public:
+	//A scanline starts up to 7 pixels into its first tile, so it can touch 33 tiles. The tile arrays are padded to a whole number of
+	//AVX2 iterations (4 tiles each).
+	static const int TILES_PER_LINE = 33;
+	static const int TILE_BUFFER_SIZE = 36;
+
+	//Returned by composite when sprite 0 doesn't hit the background on the line
+	static const word NO_SPRITE_ZERO_HIT = 0xFFFF;
+
+	/*
+	Sprite line buffer entries, one byte per pixel, with 0 meaning no (opaque) sprite:
+
+	-SZ PPPPP
+	 || +++++-- palette RAM address of the color ($10 - $1F); the low 2 bits are never 0 for an opaque pixel
+	 |+-------- behind the background (OAM attribute bit 5)
+	 +--------- pixel belongs to sprite 0
+	*/
+	static const MAGSNES::byte SPRITE_BEHIND_BACKGROUND = 0x20;
+	static const MAGSNES::byte SPRITE_ZERO = 0x40;
+
+	//The background tiles for one scanline, in the order they are drawn
+	struct BackgroundTiles {
+		MAGSNES::byte patternLo[TILE_BUFFER_SIZE];	//Row of the tile's low bit plane on this scanline
+		MAGSNES::byte patternHi[TILE_BUFFER_SIZE];
+		MAGSNES::byte palette[TILE_BUFFER_SIZE];		//Palette RAM address of the tile's palette ($00, $04, $08 or $0C)
+	};
+
+	LineCompositor();
+	~LineCompositor();
+
+	//Writes NES_SCREEN_WIDTH palette indices (ANDed with colorMask) to dst. The line starts fineX pixels into the first tile, and
+	//paletteRAM is the 32 bytes at $3F00. Returns the X coord of the first sprite 0 hit, or NO_SPRITE_ZERO_HIT.
+	const word composite(const BackgroundTiles &tiles, const MAGSNES::byte fineX, const MAGSNES::byte * const sprites,
+		const MAGSNES::byte * const paletteRAM, const MAGSNES::byte colorMask, MAGSNES::byte * const dst) const;
+
+private:
+	typedef const word(LineCompositor::*LineKernel)(const BackgroundTiles &tiles, const MAGSNES::byte fineX, const MAGSNES::byte *sprites,
+		const MAGSNES::byte *paletteRAM, const MAGSNES::byte colorMask, MAGSNES::byte *dst) const;
+
+	LineKernel lineKernel;
+
+	//Lets the Debugger compare the vectorized kernels against the scalar one
+	bool forceScalar;
+
+	//Picks the fastest kernel the CPU supports
+	void select_kernel();
+
+	//The vector kernels need pshufb to broadcast tile rows and look up the palette, so there is no plain SSE2 version
+	const word composite_scalar(const BackgroundTiles &tiles, const MAGSNES::byte fineX, const MAGSNES::byte *sprites,
+		const MAGSNES::byte *paletteRAM, const MAGSNES::byte colorMask, MAGSNES::byte *dst) const;
+	const word composite_ssse3(const BackgroundTiles &tiles, const MAGSNES::byte fineX, const MAGSNES::byte *sprites,
+		const MAGSNES::byte *paletteRAM, const MAGSNES::byte colorMask, MAGSNES::byte *dst) const;
+	const word composite_avx2(const BackgroundTiles &tiles, const MAGSNES::byte fineX, const MAGSNES::byte *sprites,
+		const MAGSNES::byte *paletteRAM, const MAGSNES::byte colorMask, MAGSNES::byte *dst) const;
+};
+
+} /* namespace MAGSNES */
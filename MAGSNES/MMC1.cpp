@@ -72,8 +72,21 @@ void MMC1::monitor() {
 
 		switch (regSelect) {
 		case 0: //$8000 - $9FFF
-						//In reality there are more mirroring types than this controls
-			newMirroringType = (regShift & 1) ? PPU::MIRROR_HORIZONTAL : PPU::MIRROR_VERTICAL;
+			//The lowest 2 bits select the mirroring type
+			switch (regShift & 0x03) {
+			case 0:
+				newMirroringType = PPU::MIRROR_SINGLE_SCREEN_LO;
+				break;
+			case 1:
+				newMirroringType = PPU::MIRROR_SINGLE_SCREEN_HI;
+				break;
+			case 2:
+				newMirroringType = PPU::MIRROR_VERTICAL;
+				break;
+			case 3:
+				newMirroringType = PPU::MIRROR_HORIZONTAL;
+				break;
+			}
 			refPPU.loadMirroringType(newMirroringType);
 
 			if (!(regShift & 0x8)) {
@@ -4,6 +4,8 @@
 #include "CPU.h"
 #include "PPU.h"
 
+#include <cstring>
+
 namespace MAGSNES {
 
 	const int ADDR_PRG_LOWER_BANK = 0x8000,
@@ -61,6 +63,8 @@ namespace MAGSNES {
 			for (int i = 0; i < PRG_BANK_SIZE; i++) {
 				refCPU.refMM[startAddr + i] = tmp.data[i];
 			}
+
+			refCPU.map_prg_bank(startAddr, PRG_BANK_SIZE, bankID * 2);
 		}
 
 		//Loads an 8KB PRG_ROM bank into CPU main memory
@@ -72,15 +76,15 @@ namespace MAGSNES {
 			for (int i = 0; i < LIMIT; i++) {
 				refCPU.refMM[startAddr + i] = tmp.data[i + BANK_OFFSET];
 			}
+
+			refCPU.map_prg_bank(startAddr, LIMIT, (bankID * 2) + (shouldUseUpperHalf ? 1 : 0));
 		}
 
 		//Loads a 4KB CHR_ROM bank into VRAM
 		void load_bank_vm(const word bankID, const word startAddr) {
 			const BankCHR &tmp = *(refROM.get_chr_bank(bankID));
 
-			for (int i = 0; i < CHR_BANK_SIZE; i++) {
-				refPPU.refVM[startAddr + i] = tmp.data[i];
-			}
+			copy_chr(&tmp.data[0], startAddr, CHR_BANK_SIZE);
 		}
 
 		//Loads a 2KB CHR_ROM bank into VRAM
@@ -89,9 +93,7 @@ namespace MAGSNES {
 			const word LIMIT = CHR_BANK_SIZE / 2;
 			const word BANK_OFFSET = (shouldUseUpperHalf) ? LIMIT : 0;
 
-			for (int i = 0; i < LIMIT; i++) {
-				refPPU.refVM[startAddr + i] = tmp.data[i + BANK_OFFSET];
-			}
+			copy_chr(&tmp.data[BANK_OFFSET], startAddr, LIMIT);
 		}
 
 		//Loads a 1KB CHR_ROM bank into VRAM; note that we need the enum to pick which quarter of the bank to select
@@ -124,12 +126,21 @@ namespace MAGSNES {
 			//Don't need default b/c we are using an enum class
 			}
 
-			for (int i = 0; i < LIMIT; i++) {
-				refPPU.refVM[startAddr + i] = tmp.data[i + BANK_OFFSET];
-			}
+			copy_chr(&tmp.data[BANK_OFFSET], startAddr, LIMIT);
 		}
 
 	private:
+		//Copies CHR data into the pattern tables. The PPU redraws scanlines from pattern data only when it changes, so switching to a bank
+		//that is already there (which games do a lot) doesn't count.
+		void copy_chr(const MAGSNES::byte * const src, const word startAddr, const word size) {
+			MAGSNES::byte * const dst = &refPPU.refVM[startAddr];
+
+			if (std::memcmp(dst, src, size) != 0) {
+				std::memcpy(dst, src, size);
+				refPPU.patternVersion++;
+			}
+		}
+
 		//This function loads ROM data into RAM and VRAM, and MUST set the CPU PC register to the appropriate value (usually the reset vector)
 		virtual void initialize_memory() = 0;
 	};
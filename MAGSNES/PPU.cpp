@@ -1,5 +1,7 @@
 #include "PPU.h"
 
+#include <cstring>
+
 #define byte		MAGSNES::byte
 
 //Memory-mapped I/O registers
@@ -15,38 +17,23 @@
 
 //VRAM addresses to check on
 #define UNIVERSAL_BACKGROUND_ADDR							0x3F00 
-#define BACKGROUND_PALETTE_ZERO								0x3F01
-#define BACKGROUND_PALETTE_ONE								0x3F05 
-#define BACKGROUND_PALETTE_TWO								0x3F09
-#define BACKGROUND_PALETTE_THREE							0x3F0D 
-#define SPRITE_PALETTE_ZERO										0x3F11
-#define SPRITE_PALETTE_ONE										0x3F15 
-#define SPRITE_PALETTE_TWO										0x3F19
-#define SPRITE_PALETTE_THREE									0x3F1D
-
-
-//The get_*_pixel functions OR these values into the lowest byte of the palette entries they return, as meta information about the pixel.
-#define TRANSPARENT_BACKGROUND								0x12
-#define OPAQUE_BACKGROUND											0x34
-#define TRANSPARENT_SPRITE										0x56
-#define OPAQUE_SPRITE													0x78
-#define OPAQUE_SPRITE_PRIORITY_FOREGROUND			0x41
-#define SPRITE_ZERO_TRANSPARENT								0x9A
-#define SPRITE_ZERO_OPAQUE										0xBC
 
 //Magic number that indicates no more sprites are in range of the current scanline;
 //will not collide with sprite indices b/c currentSprites holds multiples of 4 only
 #define NULL_SPRITE														0xFE
 
-//Start addresses of the 4 nametables
+//Start addresses in VRAM of the 4 nametables' RAM; only four screen mirroring uses C and D
 #define NTADDR_A															0x2000
 #define NTADDR_B															0x2400
 #define NTADDR_C															0x2800
 #define NTADDR_D															0x2C00
 
+//Bits of ppuAddr/tempAddr copied at the end of each scanline (coarse X, horizontal NT) and before each frame (fine Y, vertical NT, coarse Y)
+#define HORIZONTAL_SCROLL_BITS								0x041F
+#define VERTICAL_SCROLL_BITS									0x7BE0
+
 //Other magic numbers
-#define SCANLINE_LIMIT												240
-#define PIXEL_LIMIT														256								
+#define PRERENDER_SCANLINE										261
 
 using namespace MAGSNES;
 
@@ -55,17 +42,41 @@ PPU::PPU(Bus *pBus, CPU *pCPU, Core &refCore, GLManager *pGLManager)
 	refCPU(*pCPU),
 	refCore(refCore),
 	refGLM(*pGLManager),
+	refFrames(*pGLManager->expose_frames()),
 	refMM(this->refBus.mainMemory),
 	refVM(this->refBus.VM),
+	spriteZeroHitPixel(LineCompositor::NO_SPRITE_ZERO_HIT),
+	lineStartAddr(0),
+	isLineRendered(false),
+	areLineTilesFetched(false),
+	isSkippingFrame(false),
+	framesSkipped(0),
+	patternVersion(0),
+	paletteVersion(0),
+	linesComposited(0),
+	linesReused(0),
 	regs(nullptr) {
 
+	std::memset(spriteLines, 0, sizeof(spriteLines));
+	std::memset(emptySpriteLine, 0, sizeof(emptySpriteLine));
+	std::memset(&backgroundTiles, 0, sizeof(backgroundTiles));
+	std::memset(lineIndices, 0, sizeof(lineIndices));
+	//Nothing has been drawn yet; hasSprites and hasLine are false
+	std::memset(lineCache, 0, sizeof(lineCache));
+	std::memset(nameTableRowVersions, 0, sizeof(nameTableRowVersions));
+
 	regs = new PPUREGISTERS{
-		//All bool flags except shouldGenerateNMI are true
-		/*bools*/true, true, true, false, true, true, true, true,
-		/*words*/0, 0x2000 /*nameTableBaseAddr*/, 0, 0, 0, 0,
-		/*bytes*/0, 1 /*ppuIncr*/, 0, 0, 0
+		//All bool flags except isSecondWrite and shouldGenerateNMI are true
+		/*bools*/false, true, false, true, true, true, true,
+		/*words*/0, 0, 0, 0, 0, 0,
+		/*bytes*/0, 1 /*ppuIncr*/, 0, 0, 0, 0x3F /*greyscaleMask*/
 	};
 
+	loadMirroringType(regs->mirroringType);
+
+	refGLM.load_palette(NES_COLOR_PALETTE);
+	refCore.captureSink->load_palette(NES_COLOR_PALETTE);
+
 }
 
 PPU::~PPU() {
@@ -80,8 +91,51 @@ void PPU::tick(const bool shouldMonitor) {
 	emulateCRT();
 }
 
+void PPU::tick_group(const word ticks) {
+	monitorAddresses();
+	emulateCRT();
+
+	for (word ppuCounter = 1; ppuCounter < ticks; ppuCounter++) {
+		emulateCRT();
+	}
+}
+
 void PPU::loadMirroringType(const byte mirroringType) {
 	regs->mirroringType = mirroringType;
+
+	byte	*ntA = &refVM[NTADDR_A], *ntB = &refVM[NTADDR_B],
+		*ntC = &refVM[NTADDR_C], *ntD = &refVM[NTADDR_D];
+
+	switch (mirroringType) {
+	case MIRROR_VERTICAL:
+		nameTableSlots[0] = ntA;
+		nameTableSlots[1] = ntB;
+		nameTableSlots[2] = ntA;
+		nameTableSlots[3] = ntB;
+		break;
+	case MIRROR_SINGLE_SCREEN_LO:
+		nameTableSlots[0] = nameTableSlots[1] = nameTableSlots[2] = nameTableSlots[3] = ntA;
+		break;
+	case MIRROR_SINGLE_SCREEN_HI:
+		nameTableSlots[0] = nameTableSlots[1] = nameTableSlots[2] = nameTableSlots[3] = ntB;
+		break;
+	case MIRROR_FOUR_SCREEN:
+		nameTableSlots[0] = ntA;
+		nameTableSlots[1] = ntB;
+		nameTableSlots[2] = ntC;
+		nameTableSlots[3] = ntD;
+		break;
+	default: //MIRROR_HORIZONTAL
+		nameTableSlots[0] = ntA;
+		nameTableSlots[1] = ntA;
+		nameTableSlots[2] = ntB;
+		nameTableSlots[3] = ntB;
+		break;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		nameTablePages[i] = (byte)((nameTableSlots[i] - ntA) / 0x400);
+	}
 }
 
 const dword PPU::NES_COLOR_PALETTE[0x40] = {
@@ -165,61 +219,27 @@ const dword PPU::NES_COLOR_PALETTE[0x40] = {
 	0x00000000
 };
 
-FORCEINLINE word PPU::coercePPUAddress(word addr) {
+FORCEINLINE byte & PPU::vram_at(word addr) {
 	//Mirror $0 to $3FFF
 	addr &= 0x3FFF; //Mask to 14 bits; same as addr %= 4000
 
-									//Mirror $2000 to $2EFF
-	if (addr > 0x2FFF && addr < 0x3F00) {
-		return addr - 0x1000;
-	} else if (addr > 0x3EFF && addr < 0x4000) {
-		addr = (addr & 0x1F) + 0x3F00; //Don't return yet; this area is mirrored even further...
-
-																	 //These 4 addresses are mirrors of the address 0x10 bytes lower
-		switch (addr) {
-		case 0x3F10:
-			return 0x3F00;
-			break;
-
-		case 0x3F14:
-			return 0x3F04;
-			break;
-
-		case 0x3F18:
-			return 0x3F08;
-			break;
-
-		case 0x3F1C:
-			return 0x3F0C;
-			break;
-
-		default:
-			return addr;
-			break;
-		}
+	if (addr < 0x2000) {
+		//Pattern tables
+		return refVM[addr];
+	} else if (addr < 0x3F00) {
+		//Nametables; $3000 to $3EFF mirror $2000 to $2EFF, which falls out of only using bits 10-11 to select the slot
+		return nameTableSlots[(addr >> 10) & 0x03][addr & 0x03FF];
 	} else {
-		return addr;
+		//Palette RAM is mirrored every 0x20 bytes, and $3F10, $3F14, $3F18 and $3F1C are mirrors of the address 0x10 bytes lower
+		return refVM[0x3F00 | (addr & ((addr & 0x03) ? 0x1F : 0x0F))];
 	}
 }
 
 FORCEINLINE void PPU::checkPPUCTRL() {
-	byte	ppuctrlVal = refMM[PPUCTRL],
-		NTID = ppuctrlVal & 0x03;
+	byte	ppuctrlVal = refMM[PPUCTRL];
 
-	switch (NTID) {
-	case 0:
-		regs->nameTableBaseAddr = 0x2000;
-		break;
-	case 1:
-		regs->nameTableBaseAddr = 0x2400;
-		break;
-	case 2:
-		regs->nameTableBaseAddr = 0x2800;
-		break;
-	case 3:
-		regs->nameTableBaseAddr = 0x2C00;
-		break;
-	}
+	//The base nametable goes to bits 10-11 of tempAddr
+	regs->tempAddr = (regs->tempAddr & 0x73FF) | ((ppuctrlVal & 0x03) << 10);
 
 	regs->spriteSizeIs8x8 = (ppuctrlVal & 0x20) ? false : true;
 	regs->patternTableOffset = (ppuctrlVal & 0x10) ? 0x1000 : 0;
@@ -235,6 +255,8 @@ FORCEINLINE void PPU::checkPPUMASK() {
 	regs->shouldShowLeftmostSprites = (ppumaskVal & 0x04) ? true : false;
 	regs->shouldShowBackground = (ppumaskVal & 0x08) ? true : false;
 	regs->shouldShowSprites = (ppumaskVal & 0x10) ? true : false;
+	regs->greyscaleMask = (ppumaskVal & 0x01) ? 0x30 : 0x3F;
+	regs->colorEmphasis = (ppumaskVal & 0xE0) >> 5;
 }
 
 FORCEINLINE void PPU::readOAMDATA() {
@@ -246,75 +268,73 @@ FORCEINLINE void PPU::readOAMDATA() {
 
 FORCEINLINE void PPU::checkPPUSCROLL() {
 	byte ppuscrollVal = refMM[PPUSCROLL];
-	bool shouldChangeX = regs->usePPUSCROLLX;
 
-	/***** TODO: Should both registers only be updated when the toggle is off, a la checkPPUADDR? *****/
+	if (!regs->isSecondWrite) {
+		//X scroll: coarse X and fine X
+		regs->tempAddr = (regs->tempAddr & 0x7FE0) | (ppuscrollVal >> 3);
 
-	if (shouldChangeX) {
-		regs->fineXOffset = ppuscrollVal;
+		//Fine X picks the pixel out of the tile straight away, so a change mid-line shifts the rest of it
+		if (regs->fineX != (ppuscrollVal & 0x07)) {
+			regs->fineX = ppuscrollVal & 0x07;
+			split_scanline(false);
+		}
 	} else {
-		regs->fineYOffset = ppuscrollVal;
+		//Y scroll: coarse Y and fine Y
+		regs->tempAddr = (regs->tempAddr & 0x0C1F) | ((ppuscrollVal & 0xF8) << 2) | ((ppuscrollVal & 0x07) << 12);
 	}
 
-	regs->usePPUSCROLLX = !shouldChangeX;
+	regs->isSecondWrite = !regs->isSecondWrite;
 }
 
 FORCEINLINE void PPU::checkPPUADDR() {
 	byte ppuaddrVal = refMM[PPUADDR];
-	bool shouldWriteHI = regs->usePPUADDRHI;
 
-	static word addrHiByte = 0x00;	//We don't change the address register until both bytes have been written
-
-	if (shouldWriteHI) {
-		addrHiByte = ppuaddrVal;
+	//We don't change the address register until both bytes have been written. The hi byte only has 6 bits, and clears fine Y's top bit.
+	//Since ppuAddr is also the scroll position, writing it mid-frame moves the scroll too (e.g. to split the screen)
+	if (!regs->isSecondWrite) {
+		regs->tempAddr = (regs->tempAddr & 0x00FF) | ((ppuaddrVal & 0x3F) << 8);
 	} else {
+		regs->tempAddr = (regs->tempAddr & 0x7F00) | ppuaddrVal;
+		regs->ppuAddr = regs->tempAddr;
+		split_scanline(true);
+	}
 
-		/****************** BEGIN HACKY SECTION *******************/
+	regs->isSecondWrite = !regs->isSecondWrite;
+}
 
-		word newAddr = (addrHiByte << 8) | ppuaddrVal;
+FORCEINLINE void PPU::checkPPUDATA() {
+	byte &vramByte = vram_at(regs->ppuAddr);
 
-		/*
-		A request to write to a mirrored NT means that the ROM implicitly wants to change the base NT address, so we handle that here.
-		This is because changing PPUADDR during rendering changes the address in memory from which the PPU gets the next tile to draw.
+	//Games often rewrite VRAM with what is already there (e.g. the whole palette every frame), which doesn't need anything redrawn
+	if (vramByte != refMM[PPUDATA]) {
+		vramByte = refMM[PPUDATA];
+		mark_vram_write(regs->ppuAddr);
+	}
 
-		For example, in Super Mario Bros, two NTs are used: NTADDR_A and NTADDR_B. As part of vertical scrolling, the PPU alternates between
-		A and B as the player advances right. To draw the status bar on top of the screen, however, the PPU uses the NT data from A. Therefore,
-		when the PPU rolls over to B at the end of mirroring, the ROM writes the new NT base address to PPUCTRL as expected, but as it renders the
-		status bar on top it writes to an address in a NTADDR_C, understanding that this will instruct the PPU to use the data from A
-		due to vertical mirroring. When it detects the sprite0 hit, it writes to PPUCTRL and changes the NT back to B.
+	regs->ppuAddr += regs->ppuIncr;
+}
 
-		In short, without this code, SMB will never detect the sprite0 hit which tells it to stop rendering the status bar and return to the playfield,
-		and thus the game will freeze.
+FORCEINLINE void PPU::mark_vram_write(word addr) {
+	addr &= 0x3FFF;
 
-		A nearly identical issue is described (and solved) here: http://forums.nesdev.com/viewtopic.php?f=3&t=12185
-		An in depth explanation can be found here: http://forums.nesdev.com/viewtopic.php?t=664
+	if (addr < 0x2000) {
+		patternVersion++;
+	} else if (addr < 0x3F00) {
+		const word offset = addr & 0x03FF;
+		dword (&rowVersions)[32] = nameTableRowVersions[nameTablePages[(addr >> 10) & 0x03]];
 
-		*/
+		rowVersions[offset >> 5]++;
 
-		if (regs->mirroringType == MIRROR_VERTICAL && newAddr >= NTADDR_C) {
-			newAddr -= 0x800;
-			if (newAddr > 0x23FF) {
-				regs->nameTableBaseAddr = NTADDR_A;
-			} else {
-				regs->nameTableBaseAddr = NTADDR_B;
+		//Each attribute byte covers 4 tile rows
+		if (offset >= 0x3C0) {
+			const word firstRow = ((offset - 0x3C0) >> 3) * 4;
+			for (word row = firstRow; row < (firstRow + 4); row++) {
+				rowVersions[row]++;
 			}
 		}
-
-		/********************* END HACKY SECTION ******************/
-
-		regs->ppuAddr = (addrHiByte << 8) | ppuaddrVal;
+	} else {
+		paletteVersion++;
 	}
-
-
-	regs->usePPUADDRHI = !shouldWriteHI;
-}
-
-FORCEINLINE void PPU::checkPPUDATA() {
-	word dstAddr = coercePPUAddress(regs->ppuAddr);
-
-	refVM[dstAddr] = refMM[PPUDATA];
-
-	regs->ppuAddr += regs->ppuIncr;
 }
 
 FORCEINLINE void PPU::monitorAddresses() {
@@ -326,31 +346,29 @@ FORCEINLINE void PPU::monitorAddresses() {
 		switch (refBus.readBus) {
 		case PPUSTATUS:
 			//Reset bit 7 of PPUSTATUS if it was just read from.
-			//TODO: documentation is unclear if this also resets PPUSCROLL and PPUADDR?			
 			refMM[PPUSTATUS] = refMM[PPUSTATUS] & 0x7F;
-			//Reset PPU toggle
-			regs->usePPUADDRHI = true;
-			regs->usePPUSCROLLX = true;
+			//Reset PPU toggle, shared by PPUSCROLL and PPUADDR
+			regs->isSecondWrite = false;
 			break;
 
 		case PPUDATA:
 			//A read to PPUDATA needs to be handled as a special case
-			word coercedAddr = coercePPUAddress(regs->ppuAddr);
+			byte &vramByte = vram_at(regs->ppuAddr);
 			byte buffedVal;
 
 			//CPU retrieves the actual data from the databuffer or palette RAM. PPU is responsible for incrementing ppuAddr and 
 			//placing the correct value into the buffer on a read of PPUDATA
-			if (coercedAddr >= 0x3F00) { //Return a palette entry immediately
-				buffedVal = refVM[coercedAddr];
+			if ((regs->ppuAddr & 0x3FFF) >= 0x3F00) { //Return a palette entry immediately
+				buffedVal = vramByte;
 				regs->ppuDataBuff = buffedVal;
 			} else {
 				//Send the data in the buffer to PPUDATA, then put the value at the coerced address into the buffer
 				buffedVal = regs->ppuDataBuff;
-				regs->ppuDataBuff = refVM[coercedAddr];
+				regs->ppuDataBuff = vramByte;
 			}
 
 			//Don't need to actually place anything at refMM[PPUDATA] ***** TODO: Should we put the value there? ******
-			//refMM[PPUDATA] = refVM[coercedAddr];
+			//refMM[PPUDATA] = vramByte;
 
 			//Increment PPU's VRAM address by 1 or 32 on a read to PPUDATA
 			regs->ppuAddr += regs->ppuIncr;
@@ -405,63 +423,76 @@ FORCEINLINE void PPU::emulateCRT() {
 
 		//Render on first 256 pixels per scanline
 		if (regs->pixelCounter < NES_SCREEN_WIDTH) {
-			//Get NT pixel
-			//TODO: cache NT every 8 pixels?
 			if (regs->shouldShowBackground) {
-				dword ntPx, sprPx;
-
-				if (regs->shouldShowBackground) {
-					ntPx = get_NT_pixel();
-				} else {
-					ntPx = 0;
+				//The whole line is drawn at once, at its first pixel; the only thing left to do during the line is the sprite 0 hit.
+				//Skipped frames only need the lines sprite 0 is on (it is always first in currentSprites when it is in range).
+				if ((regs->pixelCounter == 0) && (!isSkippingFrame || (currentSprites[0] == 0))) {
+					render_scanline();
 				}
 
-				if (regs->shouldShowSprites) {
-					sprPx = get_SPR_pixel();
-				} else {
-					sprPx = NULL_SPRITE;
+				if (regs->pixelCounter == spriteZeroHitPixel) {
+					refMM[PPUSTATUS] |= 0x40;	//Set sprite0 hit flag
 				}
-
-				refGLM.draw_pixel(regs->pixelCounter, regs->scanlineCounter, multiplex(ntPx, sprPx));
+			} else if ((regs->pixelCounter == 0) && !isSkippingFrame) {
+				//A line without the background shows whatever was last drawn there
+				copy_published_line();
 			}
 		}
 
 	}
 
+	//ppuAddr follows the scroll position on the visible and pre-render scanlines whenever rendering is on; the dots below are the
+	//hardware's (pixelCounter + 1)
+	if ((regs->shouldShowBackground || regs->shouldShowSprites) &&
+		((regs->scanlineCounter < NES_SCREEN_HEIGHT) || (regs->scanlineCounter == PRERENDER_SCANLINE))) {
+
+		if (((regs->pixelCounter & 0x07) == 0x07) &&
+			((regs->pixelCounter < NES_SCREEN_WIDTH) || (regs->pixelCounter == 327) || (regs->pixelCounter == 335))) {
+			//Dots 8, 16 ... 256, 328 and 336: the end of each tile fetch, which moves on to the next tile. Dot 256 also moves down a row.
+			increment_coarse_x(regs->ppuAddr);
+
+			if (regs->pixelCounter == (NES_SCREEN_WIDTH - 1)) {
+				increment_fine_y();
+			}
+		} else if (regs->pixelCounter == NES_SCREEN_WIDTH) {
+			//Dot 257: back to the left edge of the scroll for the next scanline
+			regs->ppuAddr = (regs->ppuAddr & ~HORIZONTAL_SCROLL_BITS) | (regs->tempAddr & HORIZONTAL_SCROLL_BITS);
+		} else if ((regs->scanlineCounter == PRERENDER_SCANLINE) && (regs->pixelCounter >= 279) && (regs->pixelCounter < 304)) {
+			//Dots 280-304: back to the top of the scroll for the next frame
+			regs->ppuAddr = (regs->ppuAddr & ~VERTICAL_SCROLL_BITS) | (regs->tempAddr & VERTICAL_SCROLL_BITS);
+		}
+	}
+
 	if (regs->pixelCounter > 340) {
 		regs->pixelCounter = 0;
 		regs->scanlineCounter++;
+		spriteZeroHitPixel = LineCompositor::NO_SPRITE_ZERO_HIT;
+		isLineRendered = false;
 
-		//Do a linear search for the 8 sprites to draw if we are rendering the scanline
-		if (regs->scanlineCounter < 240) {
-			int	diff;
-			byte	numSpritesDrawn = 0, spriteLimit = (regs->spriteSizeIs8x8) ? 8 : 16;
-
-			byte tmpIdx;
-			for (int i = 0; i < 64; i++) {
-				tmpIdx = i * 4;
-				diff = regs->scanlineCounter - (refBus.OAM[tmpIdx] + 1); //Y coord is stored -1
-
-				if ((diff >= 0) && (diff < spriteLimit)) { //Is the Y coord in range (Similar to algorithm on actual NES PPU)?
-					currentSprites[numSpritesDrawn] = tmpIdx;
-					numSpritesDrawn++;
-					if (numSpritesDrawn == 8) { //Actual NES hardware only renders first 8 sprites it finds in range of the current scanline
-																			//Set sprite overflow flag
-						refMM[PPUSTATUS] |= 0x20;
-						break;
-					}
-				}
-			}
+		if (regs->scanlineCounter > 261) {
+			regs->scanlineCounter = 0;
 
-			//Clear out remainder of sprite buffer if necessary.
-			for (int i = numSpritesDrawn; i < 8; i++) {
-				currentSprites[i] = NULL_SPRITE; //Indicate that no more sprites were found   
+			//Decide whether to draw the new frame before its first sprites are evaluated
+			if (framesSkipped < refCore.videoRegs.framesToSkip) {
+				isSkippingFrame = true;
+				framesSkipped++;
+			} else {
+				isSkippingFrame = false;
+				framesSkipped = 0;
 			}
 		}
 
-		if (regs->scanlineCounter > 261) {
-			regs->scanlineCounter = 0;
-		} else if (regs->scanlineCounter == 0) {
+		//Find and draw the sprites if we are rendering the scanline
+		if (regs->scanlineCounter < NES_SCREEN_HEIGHT) {
+			evaluate_sprites();
+		}
+
+		//Emphasis is latched once per visible line; a skipped frame leaves the last drawn frame's alone
+		if ((regs->scanlineCounter < NES_SCREEN_HEIGHT) && !isSkippingFrame) {
+			refFrames.get_back().emphasis[regs->scanlineCounter] = regs->colorEmphasis;
+		}
+
+		if (regs->scanlineCounter == 0) {
 			//TODO: cache values here (since rendering starts here)
 			//Cache: colors, maybe patterns, sprites?
 
@@ -477,578 +508,356 @@ FORCEINLINE void PPU::emulateCRT() {
 
 			//refGLM.update_screen();
 
-			//Signal to the video thread to draw the next frame
-			refCore.shouldDrawFrame = true;
-		}
+			refCore.telemetry->end_emulated_frame();
 
-	} else {
-		regs->pixelCounter++;
-	}
-}
-
-FORCEINLINE const dword PPU::get_NT_pixel() {
-
-	word	tmpX = (word)regs->pixelCounter + (word)regs->fineXOffset,
-				tmpY = (word)regs->scanlineCounter + (word)regs->fineYOffset,
-				tileAddr, ntAddr, patternAddr, ntOffset = regs->nameTableBaseAddr; //Initialize to the current NT
-
-	bool xOverflow = false;
-
-	if (tmpX >= PIXEL_LIMIT) {					//We will get a seam btwn the NTs if we don't check for equality
-		xOverflow = true;
-
-		switch (regs->mirroringType) {
-		case MIRROR_HORIZONTAL:		//Roll back to start of same NT
-			ntOffset = regs->nameTableBaseAddr;
-			break;
-		case MIRROR_VERTICAL:			//Roll over to next NT
-			switch (regs->nameTableBaseAddr) {
-			case NTADDR_A:
-				ntOffset = NTADDR_B;
-				break;
-			case NTADDR_B:
-				ntOffset = NTADDR_A;
-				break;
-			case NTADDR_C:
-				ntOffset = NTADDR_D;
-				break;
-			case NTADDR_D:
-				ntOffset = NTADDR_C;
-				break;
-			default:
-				refCore.alert_error("Invalid value in PPU nameTableBaseAddr register; must be one of: 0x2000, 0x2400, 0x2800, or 0x2C00");
-				break;
+			//Only the palette index framebuffer is small enough to hand off every frame; CaptureSink won't start without it. A skipped
+			//frame is recorded as a repeat of the last drawn one, so the video keeps to the Y4M's frame rate and in step with the WAV.
+			if (refCore.videoRegs.usePaletteIndexFramebuffer && refCore.captureSink->is_capturing()) {
+				refCore.captureSink->submit_frame(isSkippingFrame ? refFrames.get_published() : refFrames.get_back());
 			}
 
-			break;
-		default:
-			refCore.alert_error("Invalid mirroring type detected");
-			break;
-		}
-		tmpX = regs->pixelCounter - (PIXEL_LIMIT - regs->fineXOffset); //Take offset off of tmpX
-	}
+			if (!isSkippingFrame) {
+				refCore.telemetry->add_scanlines(linesComposited, linesReused);
+				linesComposited = linesReused = 0;
 
-	if (tmpY >= SCANLINE_LIMIT) {			//Will get a seam btwn NTs if we don't check for equality
-		switch (regs->mirroringType) {
-		case MIRROR_HORIZONTAL:		//Roll over to next NT
-			switch (regs->nameTableBaseAddr) {
-			case NTADDR_A:
-				ntOffset = NTADDR_C;
-				break;
-			case NTADDR_B:
-				ntOffset = NTADDR_D;
-				break;
-			case NTADDR_C:
-				ntOffset = NTADDR_A;
-				break;
-			case NTADDR_D:
-				ntOffset = NTADDR_B;
-				break;
-			default:
-				refCore.alert_error("Invalid value in PPU nameTableBaseAddr register; must be one of: 0x2000, 0x2400, 0x2800, or 0x2C00");
-				break;
+				//Hand the frame to the video thread, and start drawing the next one into whichever buffer it isn't using
+				refFrames.publish();
 			}
-			break;
-		case MIRROR_VERTICAL:			//Roll back to start of same NT ONLY if we have not overflowed on tmpX (otherwise the NT will incorrectly wrap on the X axis)
-			if (!xOverflow) {				//Note that this is a little hacky...
-				ntOffset = regs->nameTableBaseAddr;
-			}
-			break;
-		default:
-			refCore.alert_error("Invalid mirroring type detected");
-			break;
 		}
-		tmpY = regs->scanlineCounter - (SCANLINE_LIMIT - regs->fineYOffset); //Take offset off of tmpX.
-		/*
-			IMPORTANT:
-				The -16 here is due to the fact that there are 240 scanlines as opposed to 256. This means that tmpY must account for this discrepancy when overflowing,
-				otherwise the NT will be drawn 16 scanlines too high. The -16 also ensures that the tileAddr will be correct by making sure that the NT will wrap/crossover
-				to the top of the same/next NT instead of incorrectly accessing the attribute tables as NT data.
-
-		*/
-		//if (regs->mirroringType == MIRROR_HORIZONTAL) { tmpY += 16; }
-
-	} /* if (tmpY > SCANLINE_LIMIT) */
-
-	tileAddr = (tmpX >> 3) + ((tmpY >> 3) << 5); //Divide pixel counter by 8, divide scanline counter by 8 then mult. by 32
-	ntAddr = tileAddr + ntOffset;
-	patternAddr = (refVM[ntAddr] * 16) + regs->patternTableOffset; //New pattern every 16 bytes
 
-																																 //Which row of the pattern entry to use
-	byte patternYIndex = tmpY & 0x07;
-
-	//Which bit in the row to use
-	byte tmpMask;
-
-	switch (tmpX & 0x07) {
-	case 0:
-		tmpMask = 0x80;
-		break;
-	case 1:
-		tmpMask = 0x40;
-		break;
-	case 2:
-		tmpMask = 0x20;
-		break;
-	case 3:
-		tmpMask = 0x10;
-		break;
-	case 4:
-		tmpMask = 0x08;
-		break;
-	case 5:
-		tmpMask = 0x04;
-		break;
-	case 6:
-		tmpMask = 0x02;
-		break;
-	case 7:
-		tmpMask = 0x01;
-		break;
+	} else {
+		regs->pixelCounter++;
 	}
+}
 
-	byte lobit = (refVM[patternAddr + patternYIndex] & tmpMask) ? 0x01 : 0x00;
-	byte hibit = refVM[patternAddr + patternYIndex + 8] & tmpMask ? 0x02 : 0x00;
-	byte colorSelect = lobit | hibit;
-
-	//Return the universal background color if 0; no need for attr. logic
-	if (colorSelect == 0) {
-		return NES_COLOR_PALETTE[refVM[UNIVERSAL_BACKGROUND_ADDR] & 0x3F] | TRANSPARENT_BACKGROUND;  //OR in meta info
+FORCEINLINE void PPU::increment_coarse_x(word &vramAddr) {
+	if ((vramAddr & 0x001F) == 31) {
+		//Wrap to column 0 of the horizontally adjacent nametable
+		vramAddr &= ~0x001F;
+		vramAddr ^= 0x0400;
+	} else {
+		vramAddr++;
 	}
+}
 
-	//Getting the attribute entry is a pain in the ass :/
-
-	//First, we coerce the offset of the name table entry to an index into the corresponding attribute table.
-	//Since there are 32 tiles are in 1 row, and each byte maps to 4x4 tiles, every 128 tiles maps to
-	//one row of the attribute table
-
-	//32x32 attr tiles, so we rsh by 5 (same as divide by 32)
-	word attrHi = tmpY >> 5, attrLo = tmpX >> 5;
-	//Convert the shifted counters into an index into the 8x8 attr table
-	word attrIdx = (attrHi << 3) | attrLo;
-	//word attrEntryOffset = ((tileAddr / 128) * 8) + ((tileAddr & 0x1F) / 4);
-	word attrEntryAddr = attrIdx + 0x3C0 /*Attr table starts at 0x3C0th NT byte*/ + ntOffset;
-	//attrEntryAddr = coercePPUAddress(attrEntryAddr);
-	byte attribByte = refVM[attrEntryAddr];
-
-	//Then, we have to figure out which quadrant the entry will use:
-	//Using the result, we can determine how to mask the byte we retrieved from the attribute table,
-	//which will select the palette to use for the pattern we got from the NT
-	//byte locationInfo = attrEntryOffset & 0x42; //01000010
-	byte paletteSelection;
-
-	byte locationInfo = ((tmpX & 0x10) >> 4) |  //Pixel counter has bit 5 set is the tile is on the bottom of the attr entry
-		((tmpY & 0x10) >> 3); // //Pixel counter has bit 5 set is the tile is on the right of the attr entry
-
-	switch (locationInfo) {
-	case 0x00:
-		paletteSelection = attribByte & 0x03; //Top left
-		break;
-
-	case 0x01:
-		paletteSelection = (attribByte & 0x0C) >> 2; //Top right
-		break;
-
-	case 0x02:
-		paletteSelection = (attribByte & 0x30) >> 4; //Bottom left
-		break;
-
-	case 0x03:
-		paletteSelection = (attribByte & 0xC0) >> 6; //Bottom right
-		break;
+FORCEINLINE void PPU::increment_fine_y() {
+	if ((regs->ppuAddr & 0x7000) != 0x7000) {
+		regs->ppuAddr += 0x1000;
+		return;
 	}
 
-	word basePaletteAddr;
+	//Fine Y overflows into coarse Y
+	regs->ppuAddr &= ~0x7000;
+	word coarseY = (regs->ppuAddr & 0x03E0) >> 5;
 
-	switch (paletteSelection) {
-	case 0:
-		basePaletteAddr = BACKGROUND_PALETTE_ZERO;
-		break;
-	case 1:
-		basePaletteAddr = BACKGROUND_PALETTE_ONE;
-		break;
-	case 2:
-		basePaletteAddr = BACKGROUND_PALETTE_TWO;
-		break;
-	case 3:
-		basePaletteAddr = BACKGROUND_PALETTE_THREE;
-		break;
+	if (coarseY == 29) {
+		//Last tile row; wrap to row 0 of the vertically adjacent nametable
+		coarseY = 0;
+		regs->ppuAddr ^= 0x0800;
+	} else if (coarseY == 31) {
+		//Rows 30 and 31 are the attribute table; a scroll there wraps within the same nametable
+		coarseY = 0;
+	} else {
+		coarseY++;
 	}
 
-	//FINALLY, get the damn color!
-	switch (colorSelect) {
-	case 1:
-		return NES_COLOR_PALETTE[refVM[basePaletteAddr] & 0x3F] | OPAQUE_BACKGROUND;
-		break;
-	case 2:
-		return NES_COLOR_PALETTE[refVM[basePaletteAddr + 1] & 0x3F] | OPAQUE_BACKGROUND;
-		break;
-	case 3:
-		return NES_COLOR_PALETTE[refVM[basePaletteAddr + 2] & 0x3F] | OPAQUE_BACKGROUND;
-		break;
-	}
+	regs->ppuAddr = (regs->ppuAddr & ~0x03E0) | (coarseY << 5);
 }
 
+FORCEINLINE void PPU::render_scanline() {
+	//On a skipped frame the line is only composited for the sprite 0 hit, and the pixels are thrown away
+	const bool isDrawing = !isSkippingFrame;
+	ScanlineCache &cache = lineCache[regs->scanlineCounter];
+
+	//ppuAddr is already two tiles in, since the line's first two tiles were fetched at the end of the last one (dots 321-336)
+	const word coarseX = regs->ppuAddr & 0x001F;
+	lineStartAddr = (word)((regs->ppuAddr & ~0x001F) | ((coarseX - 2) & 0x001F));
+	if (coarseX < 2) {
+		lineStartAddr ^= 0x0400;
+	}
+	isLineRendered = true;
+
+	if (isDrawing) {
+		const byte	slot = (lineStartAddr >> 10) & 0x03,
+			coarseY = (lineStartAddr >> 5) & 0x1F;
+
+		ScanlineInputs inputs;
+		std::memset(&inputs, 0, sizeof(ScanlineInputs)); //So the padding compares equal too
+		inputs.ppuAddr = lineStartAddr;
+		inputs.patternTableOffset = regs->patternTableOffset;
+		inputs.patternVersion = patternVersion;
+		inputs.paletteVersion = paletteVersion;
+		//The line's 33 tiles may run into the next nametable across
+		inputs.nameTablePages[0] = nameTablePages[slot];
+		inputs.nameTablePages[1] = nameTablePages[slot ^ 0x01];
+		inputs.nameTableRowVersions[0] = nameTableRowVersions[inputs.nameTablePages[0]][coarseY];
+		inputs.nameTableRowVersions[1] = nameTableRowVersions[inputs.nameTablePages[1]][coarseY];
+		inputs.fineX = regs->fineX;
+		inputs.greyscaleMask = regs->greyscaleMask;
+		inputs.colorEmphasis = regs->colorEmphasis;
+		inputs.shouldShowSprites = regs->shouldShowSprites;
+		inputs.usePaletteIndexFramebuffer = refCore.videoRegs.usePaletteIndexFramebuffer;
+
+		if (cache.hasLine && (std::memcmp(&cache.line, &inputs, sizeof(ScanlineInputs)) == 0)) {
+			copy_published_line();
+			spriteZeroHitPixel = cache.spriteZeroHitPixel;
+			areLineTilesFetched = false;
+			linesReused++;
+			return;
+		}
 
-/*
-Retrieve the sprite pixel to draw.
+		cache.line = inputs;
+		linesComposited++;
+	}
 
-The algorithm is as follows:
+	fetch_background_tiles(lineStartAddr, 0);
+	areLineTilesFetched = true;
 
-1) Return NULL_SPRITE if the first sprite in currentSprites is NULL_SPRITE (no sprites on the current scanline).
+	VideoFrame &frame = refFrames.get_back();
+	const dword lineOffset = regs->scanlineCounter * NES_SCREEN_WIDTH;
+	byte * const dst = (refCore.videoRegs.usePaletteIndexFramebuffer && isDrawing) ? (frame.indices + lineOffset) : lineIndices;
 
-2) Find the first sprite in currentSprites that is in range of the current pixel; return NULL_SPRITE if none are in range.
+	spriteZeroHitPixel = compositor.composite(backgroundTiles, regs->fineX,
+		regs->shouldShowSprites ? spriteLines[regs->scanlineCounter] : emptySpriteLine, &refVM[UNIVERSAL_BACKGROUND_ADDR], regs->greyscaleMask, dst);
 
-3) Assess sprite attributes, and find the appropriate pattern data using an algorithm determined by the flip type.
+	if (isDrawing) {
+		if (!refCore.videoRegs.usePaletteIndexFramebuffer) {
+			frame.convert_line(lineIndices, frame.rgba + lineOffset, regs->colorEmphasis);
+		}
 
-4) Return the universal background color if the pattern data is 00, otherwise use the retrieved attributes to determine the color ro return.
-*/
-FORCEINLINE const dword PPU::get_SPR_pixel() {
-	if (currentSprites[0] == NULL_SPRITE) { //Don't bother if no sprites on the current scanline
-		return NULL_SPRITE;
+		cache.spriteZeroHitPixel = spriteZeroHitPixel;
+		cache.hasLine = true;
 	}
+}
 
-	int diff, i = 0;
-	bool foundSprite = false;
-	byte currentIdx, idxToDraw;
+FORCEINLINE void PPU::fetch_background_tiles(word vramAddr, const int firstTile) {
+	const byte patternYIndex = (vramAddr >> 12) & 0x07; //Which row of the pattern entries to use
 
-	//TODO: replace this ugly goto & label!
-FINDSPRITE:
+	for (int tile = firstTile; tile < LineCompositor::TILES_PER_LINE; tile++) {
+		const byte * const nameTable = nameTableSlots[(vramAddr >> 10) & 0x03];
 
-	for (; i < 8; i++) {
-		currentIdx = currentSprites[i];
-		if (currentSprites[i] == NULL_SPRITE) { //NULL_SPRITEs will incorrectly trigger the diff condition below, and cause 'ghost' sprites to appear on the left of the screen
-			continue;
-		}
+		//Coarse Y and coarse X are the tile's index in the 32x30 tile map
+		const word patternAddr = (nameTable[vramAddr & 0x03FF] * 16) + regs->patternTableOffset + patternYIndex; //New pattern every 16 bytes
 
-		diff = ((dword)refBus.OAM[currentIdx + 3] + 7) - (regs->pixelCounter);		//Offset xPos by 7 to display the sprite in the right place
+		backgroundTiles.patternLo[tile] = refVM[patternAddr];
+		backgroundTiles.patternHi[tile] = refVM[patternAddr + 8];
 
-		if ((diff >= 0) && (diff < 8)) { //Is the X coord in range?
-			idxToDraw = currentIdx;
+		//Each attribute byte covers 4x4 tiles, so its index in the 8x8 attribute table is the top 3 bits of coarse Y and of coarse X
+		byte attribByte = nameTable[0x3C0 /*Attr table starts at 0x3C0th NT byte*/ | ((vramAddr >> 4) & 0x38) | ((vramAddr >> 2) & 0x07)];
 
-			foundSprite = true;
-			break;
-		}
-	}
+		//Bit 1 of coarse Y and of coarse X pick which 2x2 tile quadrant of the entry we are in: top left, top right, bottom left or bottom right
+		//are bits 0-1, 2-3, 4-5 and 6-7 of the attribute byte
+		byte quadrantShift = ((vramAddr >> 4) & 0x04) | (vramAddr & 0x02);
+		backgroundTiles.palette[tile] = ((attribByte >> quadrantShift) & 0x03) << 2;
 
-	if (!foundSprite) {
-		return NULL_SPRITE;
+		increment_coarse_x(vramAddr);
 	}
+}
 
-	//8x16 sprites can use either pattern table: they ignore the spritePatternTableOffset and instead go by bit 0 of the second byte in the OAM entry.
-	//8x16 patterns in the 0x1000 pattern table need to be one entry lower (i.e. 16 bytes) less in this implementation (TODO: WHY?).
-	word tmpPatternOffset;
-	bool patternCorrection;
-	if (regs->spriteSizeIs8x8) {
-		tmpPatternOffset = regs->spritePatternTableOffset;
-		patternCorrection = false;
-	} else {
-		tmpPatternOffset = (refBus.OAM[idxToDraw + 1] & 0x01) ? 0x1000 : 0;
-		if (refBus.OAM[idxToDraw + 1] & 0x01) {
-			tmpPatternOffset = 0x1000;
-			patternCorrection = true;
-		} else {
-			tmpPatternOffset = 0;
-			patternCorrection = false;
-		}
-	}
-
-	//Extract sprite info from OAM.
-	word	yPos = refBus.OAM[idxToDraw] + 1,
-		patternAddr = (refBus.OAM[idxToDraw + 1] * 16) + tmpPatternOffset,
-		tmpAttrs = refBus.OAM[idxToDraw + 2],
-		xPos = refBus.OAM[idxToDraw + 3] + 7;	//Offset xPos by 7 to display the sprite in the right place
-
-	byte colorSelect;
+FORCEINLINE void PPU::split_scanline(const bool isNewAddr) {
+	const word pixel = regs->pixelCounter;
 
-	//Go to next bitmap when rendering lower half of an 8x16 sprite
-	if ((!(regs->spriteSizeIs8x8)) && ((regs->scanlineCounter - yPos) >= 8)) {
-		patternAddr += 16;
+	//Only a line drawn at its first pixel can be split, and only the pixels not yet reached change
+	if (!isLineRendered || !regs->shouldShowBackground || (pixel >= NES_SCREEN_WIDTH)) {
+		return;
 	}
 
-	if (patternCorrection) {
-		patternAddr -= 16;
+	//After a reused line, backgroundTiles still hold some other line's tiles
+	if (!areLineTilesFetched) {
+		fetch_background_tiles(lineStartAddr, 0);
+		areLineTilesFetched = true;
 	}
 
-	//Get pattern data according to flip type
-	switch (tmpAttrs & 0xC0) { //Bit 6 -> flip horizontal; bit 7 -> flip vertical
-	case 0:
-		colorSelect = get_pattern_no_flip(xPos, yPos, patternAddr);
-		break;
-	case 0x40:
-		colorSelect = get_pattern_flip_horizontal(xPos, yPos, patternAddr);
-		break;
-	case 0x80:
-		colorSelect = get_pattern_flip_vertical(xPos, yPos, patternAddr);
-		break;
-	case 0xC0:
-		colorSelect = get_pattern_flip_horizontal_and_vertical(xPos, yPos, patternAddr);
-		break;
-	}
+	word firstPixel = pixel;
 
-	//Return the universal background color if 0; no need for attr. logic
-	if (colorSelect == 0) {
-		//An opaque sprite behind a transparent sprite must be chosen!
-		//TODO: get rid of this ugly goto!
-		if (i < 8) {
-			i++;
-			goto FINDSPRITE;
+	if (isNewAddr) {
+		//Each tile is fetched over 8 dots, two tiles ahead of the one being drawn, so the new address is first used by the fetch starting
+		//at the next multiple of 8. A fetch already under way still steps coarse X when it ends, moving the new address along one tile.
+		const int firstTile = ((pixel + 7) >> 3) + 2;
+		if (firstTile >= LineCompositor::TILES_PER_LINE) {
+			return;
 		}
-		return NES_COLOR_PALETTE[refVM[UNIVERSAL_BACKGROUND_ADDR] & 0x3F] | TRANSPARENT_SPRITE;  //OR in meta info
-	}
 
-	word basePaletteAddr;
+		word vramAddr = regs->ppuAddr;
+		if ((pixel & 0x07) != 0) {
+			increment_coarse_x(vramAddr);
+		}
 
-	switch (tmpAttrs & 0x03) {
-	case 0:
-		basePaletteAddr = SPRITE_PALETTE_ZERO;
-		break;
-	case 1:
-		basePaletteAddr = SPRITE_PALETTE_ONE;
-		break;
-	case 2:
-		basePaletteAddr = SPRITE_PALETTE_TWO;
-		break;
-	case 3:
-		basePaletteAddr = SPRITE_PALETTE_THREE;
-		break;
+		fetch_background_tiles(vramAddr, firstTile);
+		firstPixel = (word)((firstTile * 8) - regs->fineX);
 	}
 
-	dword wordOut;
+	//Composite the whole line again, then keep only the part from firstPixel on
+	const word hitPixel = compositor.composite(backgroundTiles, regs->fineX,
+		regs->shouldShowSprites ? spriteLines[regs->scanlineCounter] : emptySpriteLine, &refVM[UNIVERSAL_BACKGROUND_ADDR], regs->greyscaleMask,
+		lineIndices);
 
-	switch (colorSelect) {
-	case 1:
-		wordOut = NES_COLOR_PALETTE[refVM[basePaletteAddr] & 0x3F];
-		break;
-	case 2:
-		wordOut = NES_COLOR_PALETTE[refVM[basePaletteAddr + 1] & 0x3F];
-		break;
-	case 3:
-		wordOut = NES_COLOR_PALETTE[refVM[basePaletteAddr + 2] & 0x3F];
-		break;
+	//A hit in the pixels already drawn stands; otherwise it is wherever the new pixels put it
+	if (spriteZeroHitPixel >= firstPixel) {
+		spriteZeroHitPixel = (hitPixel >= firstPixel) ? hitPixel : LineCompositor::NO_SPRITE_ZERO_HIT;
 	}
 
-	//Catch if we are returning an opaque sprite0 pixel
-	if (idxToDraw == 0) {
-		return wordOut | SPRITE_ZERO_OPAQUE;
+	if (isSkippingFrame) {
+		return;
 	}
 
-	//Finally, return the pixel ORed with the priority state
-	if (!(tmpAttrs & 0x20)) { //0 means in FRONT of background
-		return wordOut | OPAQUE_SPRITE_PRIORITY_FOREGROUND;
+	VideoFrame &frame = refFrames.get_back();
+	const dword lineOffset = regs->scanlineCounter * NES_SCREEN_WIDTH;
+
+	if (refCore.videoRegs.usePaletteIndexFramebuffer) {
+		std::memcpy(frame.indices + lineOffset + firstPixel, lineIndices + firstPixel, NES_SCREEN_WIDTH - firstPixel);
 	} else {
-		return wordOut | OPAQUE_SPRITE;
+		dword rgbaLine[NES_SCREEN_WIDTH];
+		frame.convert_line(lineIndices, rgbaLine, regs->colorEmphasis);
+		std::memcpy(frame.rgba + lineOffset + firstPixel, rgbaLine + firstPixel, (NES_SCREEN_WIDTH - firstPixel) * sizeof(dword));
 	}
 
+	//The cache can't tell a split line from an unsplit one with the same start, so the line is drawn whole again next frame
+	lineCache[regs->scanlineCounter].hasLine = false;
 }
 
-FORCEINLINE const dword PPU::multiplex(const dword ntPixel, const dword sprPixel) {
-	if (sprPixel == NULL_SPRITE) {
-		return ntPixel;
-	}
-
-	//Sprite zero hit when opaque sprite0 overlaps opaque background
-	if (((sprPixel & 0xFF) == SPRITE_ZERO_OPAQUE) && ((ntPixel & 0xFF) == OPAQUE_BACKGROUND)) {
-		refMM[PPUSTATUS] |= 0x40;	//Set sprite0 hit flag
-
-															//Draw the sprite0 pixel only if it is priority
-		byte tmpAttrs = refBus.OAM[2];
-		if (tmpAttrs & 0x20) {
-			return ntPixel;
-		} else {
-			return sprPixel;
-		}
-	}
-
-	//For a sprite pixel to be displayed, it must not be transparent, and it either needs to hold priority or be against a transparent background
-	if ((((sprPixel & 0xFF) == OPAQUE_SPRITE_PRIORITY_FOREGROUND) || ((ntPixel & 0xFF) == TRANSPARENT_BACKGROUND)) && ((sprPixel & 0xFF) != TRANSPARENT_SPRITE)) {
-		return sprPixel;
+FORCEINLINE void PPU::copy_published_line() {
+	const dword lineOffset = regs->scanlineCounter * NES_SCREEN_WIDTH;
+	const VideoFrame &published = refFrames.get_published();
+	VideoFrame &frame = refFrames.get_back();
 
+	//Emphasis is latched into the back frame for every line anyway
+	if (refCore.videoRegs.usePaletteIndexFramebuffer) {
+		std::memcpy(frame.indices + lineOffset, published.indices + lineOffset, NES_SCREEN_WIDTH);
 	} else {
-		return ntPixel;
+		std::memcpy(frame.rgba + lineOffset, published.rgba + lineOffset, NES_SCREEN_WIDTH * sizeof(dword));
 	}
 }
 
-//To flip across y axis: reverse bitmap order
-//To flip across x axis: do ((yPos - regs->scanlineCounter) & 0x07) for patternYIndex
+/*
+Find the sprites on the current scanline, then draw them into its spriteLines entry.
 
-//TODO: DRY these 4 functions up
+The algorithm is as follows:
 
-FORCEINLINE const byte PPU::get_pattern_no_flip(const word xPos, const word yPos, word patternAddr) {
-	//Which row of the pattern entry to use (diff btwn sprite Y and current scanline)
-	byte patternYIndex = (regs->scanlineCounter - yPos) & 0x07;
+1) Do a linear search of OAM for the first 8 sprites whose Y coord is in range of the scanline.
 
-	//Which bit in the row to use
-	byte tmpMask;
+2) Unless the line's sprites are the same as when it was last drawn, clear the line to 0 (no sprite at that pixel).
 
-	switch ((xPos - regs->pixelCounter) & 0x07) {
-	case 0:
-		tmpMask = 0x01; //Use leftmost bit if diff(xPos, pixelCounter) == 0
-		break;
-	case 1:
-		tmpMask = 0x02;
-		break;
-	case 2:
-		tmpMask = 0x04;
-		break;
-	case 3:
-		tmpMask = 0x08;
-		break;
-	case 4:
-		tmpMask = 0x10;
-		break;
-	case 5:
-		tmpMask = 0x20;
-		break;
-	case 6:
-		tmpMask = 0x40;
-		break;
-	case 7:
-		tmpMask = 0x80;
-		break;
+3) For each sprite, in OAM order, work out the row of its pattern on this scanline (accounting for vertical flip and 8x16 sprites), then
+walk its 8 pixels (reversed for horizontal flip), in the format LineCompositor expects.
+
+4) An earlier sprite's opaque pixel always wins, but a transparent one is replaced by a later sprite's opaque pixel at the same X coord.
+*/
+FORCEINLINE void PPU::evaluate_sprites() {
+	int	diff;
+	byte	numSpritesDrawn = 0, spriteLimit = (regs->spriteSizeIs8x8) ? 8 : 16;
+
+	byte tmpIdx;
+	for (int i = 0; i < 64; i++) {
+		tmpIdx = i * 4;
+		diff = regs->scanlineCounter - (refBus.OAM[tmpIdx] + 1); //Y coord is stored -1
+
+		if ((diff >= 0) && (diff < spriteLimit)) { //Is the Y coord in range (Similar to algorithm on actual NES PPU)?
+			currentSprites[numSpritesDrawn] = tmpIdx;
+			numSpritesDrawn++;
+			if (numSpritesDrawn == 8) { //Actual NES hardware only renders first 8 sprites it finds in range of the current scanline
+																	//Set sprite overflow flag
+				refMM[PPUSTATUS] |= 0x20;
+				break;
+			}
+		}
 	}
 
-	byte lobit = (refVM[patternAddr + patternYIndex] & tmpMask) ? 0x01 : 0x00;
-	byte hibit = refVM[patternAddr + patternYIndex + 8] & tmpMask ? 0x02 : 0x00;
-	return lobit | hibit;
-}
+	//Clear out remainder of sprite buffer if necessary.
+	for (int i = numSpritesDrawn; i < 8; i++) {
+		currentSprites[i] = NULL_SPRITE; //Indicate that no more sprites were found   
+	}
 
-FORCEINLINE const byte PPU::get_pattern_flip_horizontal(const word xPos, const word yPos, word patternAddr) {
-	//Which row of the pattern entry to use (diff btwn sprite Y and current scanline)
-	byte patternYIndex = (regs->scanlineCounter - yPos) & 0x07;
+	ScanlineCache &cache = lineCache[regs->scanlineCounter];
 
-	//Which bit in the row to use
-	byte tmpMask;
+	//Skipped frames only draw sprites for the sprite 0 hit. Sprite 0 is drawn first, so its opaque pixels are never covered by the others
+	//and it can be drawn alone; on lines without it, the sprites are never looked at.
+	if (isSkippingFrame) {
+		if (currentSprites[0] != 0) {
+			return;
+		}
+		numSpritesDrawn = 1;
 
-	switch ((xPos - regs->pixelCounter) & 0x07) {
-	case 0:
-		tmpMask = 0x80;
-		break;
-	case 1:
-		tmpMask = 0x40;
-		break;
-	case 2:
-		tmpMask = 0x20;
-		break;
-	case 3:
-		tmpMask = 0x10;
-		break;
-	case 4:
-		tmpMask = 0x08;
-		break;
-	case 5:
-		tmpMask = 0x04;
-		break;
-	case 6:
-		tmpMask = 0x02;
-		break;
-	case 7:
-		tmpMask = 0x01;
-		break;
+		//With only sprite 0 drawn, the next drawn frame has to draw the line's sprites again
+		cache.hasSprites = false;
+	} else {
+		SpriteLineInputs inputs;
+		std::memset(&inputs, 0, sizeof(SpriteLineInputs));
+		for (int i = 0; i < numSpritesDrawn; i++) {
+			std::memcpy(&inputs.entries[i * 4], &refBus.OAM[currentSprites[i]], 4);
+		}
+		inputs.spriteCount = numSpritesDrawn;
+		inputs.spriteSizeIs8x8 = regs->spriteSizeIs8x8;
+		inputs.spritePatternTableOffset = regs->spritePatternTableOffset;
+		inputs.patternVersion = patternVersion;
+
+		if (cache.hasSprites && (std::memcmp(&cache.sprites, &inputs, sizeof(SpriteLineInputs)) == 0)) {
+			return;
+		}
+
+		cache.sprites = inputs;
+		cache.hasSprites = true;
+		cache.hasLine = false;
 	}
 
-	byte lobit = (refVM[patternAddr + patternYIndex] & tmpMask) ? 0x01 : 0x00;
-	byte hibit = refVM[patternAddr + patternYIndex + 8] & tmpMask ? 0x02 : 0x00;
-	return lobit | hibit;
-}
+	byte * const spriteLine = spriteLines[regs->scanlineCounter];
+	std::memset(spriteLine, 0, NES_SCREEN_WIDTH);
 
-FORCEINLINE const byte PPU::get_pattern_flip_vertical(const word xPos, const word yPos, word patternAddr) {
-	//Which row of the pattern entry to use (diff btwn sprite Y and current scanline)
+	for (int i = 0; i < numSpritesDrawn; i++) {
+		const byte	idxToDraw = currentSprites[i],
+			tileID = refBus.OAM[idxToDraw + 1],
+			tmpAttrs = refBus.OAM[idxToDraw + 2],
+			xPos = refBus.OAM[idxToDraw + 3];
 
-	//Add 1 to make sure correct bitmap is selected when flipping vertically
-	//TODO: find a less hacky way to do this if possible
-	byte patternYIndex = (yPos - (regs->scanlineCounter + 1)) & 0x07;
+		//Which row of the sprite we're on (diff btwn sprite Y and current scanline; Y coord is stored -1)
+		word	patternRow = regs->scanlineCounter - (refBus.OAM[idxToDraw] + 1),
+			patternAddr;
 
-	if (!(regs->spriteSizeIs8x8)) {
-		//Reverse the order of the two bitmaps when flipping an 8x16 sprite vertically
-		if ((regs->scanlineCounter - yPos) >= 8) {
-			patternAddr -= 16;
+		if (regs->spriteSizeIs8x8) {
+			patternAddr = (tileID * 16) + regs->spritePatternTableOffset;
+			if (tmpAttrs & 0x80) { //Bit 7 -> flip vertical
+				patternRow = 7 - patternRow;
+			}
 		} else {
-			patternAddr += 16;
+			//8x16 sprites can use either pattern table: they ignore the spritePatternTableOffset and instead go by bit 0 of the tile ID.
+			//The top half is the even tile, and the bottom half the tile after it
+			patternAddr = ((tileID & 0xFE) * 16) + ((tileID & 0x01) ? 0x1000 : 0);
+			if (tmpAttrs & 0x80) {
+				patternRow = 15 - patternRow;
+			}
+			if (patternRow >= 8) {
+				patternAddr += 16;
+				patternRow -= 8;
+			}
 		}
-	}
 
-	//Which bit in the row to use
-	byte tmpMask;
+		const byte	patternLo = refVM[patternAddr + patternRow],
+			patternHi = refVM[patternAddr + patternRow + 8];
 
-	switch ((xPos - regs->pixelCounter) & 0x07) {
-	case 0:
-		tmpMask = 0x01; //Use leftmost bit if diff(xPos, pixelCounter) == 0
-		break;
-	case 1:
-		tmpMask = 0x02;
-		break;
-	case 2:
-		tmpMask = 0x04;
-		break;
-	case 3:
-		tmpMask = 0x08;
-		break;
-	case 4:
-		tmpMask = 0x10;
-		break;
-	case 5:
-		tmpMask = 0x20;
-		break;
-	case 6:
-		tmpMask = 0x40;
-		break;
-	case 7:
-		tmpMask = 0x80;
-		break;
-	}
+		//Sprite palettes start at $3F10 and are 4 bytes apart; the priority state (1 means BEHIND the background) is carried over from the
+		//attributes, and we catch if we are drawing sprite0
+		const byte spriteInfo = 0x10 | ((tmpAttrs & 0x03) << 2) | (tmpAttrs & LineCompositor::SPRITE_BEHIND_BACKGROUND) |
+			((idxToDraw == 0) ? LineCompositor::SPRITE_ZERO : 0);
 
-	byte lobit = (refVM[patternAddr + patternYIndex] & tmpMask) ? 0x01 : 0x00;
-	byte hibit = refVM[patternAddr + patternYIndex + 8] & tmpMask ? 0x02 : 0x00;
-	return lobit | hibit;
-}
-
-FORCEINLINE const byte PPU::get_pattern_flip_horizontal_and_vertical(const word xPos, const word yPos, word patternAddr) {
-	//Which row of the pattern entry to use (diff btwn sprite Y and current scanline)
-	//Add 1 to make sure correct bitmap is selected when flipping vertically
-	//TODO: find a less hacky way to do this if possible
-	byte patternYIndex = (yPos - (regs->scanlineCounter + 1)) & 0x07;
+		for (int col = 0; col < 8; col++) {
+			const int x = xPos + col;
+			if (x >= NES_SCREEN_WIDTH) {
+				break;
+			}
 
-	if (!(regs->spriteSizeIs8x8)) {
-		//Reverse the order of the two bitmaps when flipping an 8x16 sprite vertically
-		if ((regs->scanlineCounter - yPos) >= 8) {
-			patternAddr -= 16;
-		} else {
-			patternAddr += 16;
-		}
-	}
+			//An opaque pixel from an earlier sprite is in front of this one
+			if (spriteLine[x] != 0) {
+				continue;
+			}
 
-	//Which bit in the row to use
-	byte tmpMask;
+			//Bit 6 -> flip horizontal; otherwise the leftmost pixel is bit 7
+			const byte bit = (tmpAttrs & 0x40) ? col : (7 - col);
+			const byte colorSelect = ((patternLo >> bit) & 0x01) | (((patternHi >> bit) & 0x01) << 1);
 
-	switch ((xPos - regs->pixelCounter) & 0x07) {
-	case 0:
-		tmpMask = 0x80;
-		break;
-	case 1:
-		tmpMask = 0x40;
-		break;
-	case 2:
-		tmpMask = 0x20;
-		break;
-	case 3:
-		tmpMask = 0x10;
-		break;
-	case 4:
-		tmpMask = 0x08;
-		break;
-	case 5:
-		tmpMask = 0x04;
-		break;
-	case 6:
-		tmpMask = 0x02;
-		break;
-	case 7:
-		tmpMask = 0x01;
-		break;
+			//Transparent pixels are left empty, so that an opaque sprite behind this one is still chosen
+			if (colorSelect != 0) {
+				spriteLine[x] = spriteInfo | colorSelect;
+			}
+		}
 	}
-
-	byte lobit = (refVM[patternAddr + patternYIndex] & tmpMask) ? 0x01 : 0x00;
-	byte hibit = refVM[patternAddr + patternYIndex + 8] & tmpMask ? 0x02 : 0x00;
-	return lobit | hibit;
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "Core.h"
 #include "CPU.h"
 #include "GLManager.h"
+#include "FrameBuffer.h"
+#include "LineCompositor.h"
 
 namespace MAGSNES {
 
@@ -18,17 +20,24 @@ namespace MAGSNES {
 
 		//Called 3 times for every cycle returned by a call to CPU#executeNext()
 		void tick(const bool shouldMonitor);
+		//Runs one CPU step's worth of ticks at once (at least one); registers are only checked on the first
+		void tick_group(const word ticks);
 
 		void loadMirroringType(const MAGSNES::byte mirroringType);
 
 		//Allows the CPU to connect to these components
 		MAGSNES::byte * expose_ppudatabuffer() { return &(regs->ppuDataBuff); }
 		word * expose_ppuaddr() { return &(regs->ppuAddr); }
+		const word * expose_pixelcounter() { return &(regs->pixelCounter); }
+		const word * expose_scanlinecounter() { return &(regs->scanlineCounter); }
 		MAGSNES::byte * expose_ppupalettebaseaddr() { return &(refBus.VM[0x3F00]); }
 
 		enum {
 			MIRROR_HORIZONTAL,
-			MIRROR_VERTICAL
+			MIRROR_VERTICAL,
+			MIRROR_SINGLE_SCREEN_LO, //All 4 nametables are the first 1KB of the PPU's nametable RAM
+			MIRROR_SINGLE_SCREEN_HI, //All 4 nametables are the second 1KB
+			MIRROR_FOUR_SCREEN //The cartridge provides the RAM for 4 separate nametables
 		};
 
 	private:
@@ -36,15 +45,93 @@ namespace MAGSNES {
 		CPU &refCPU;
 		Core &refCore;
 		GLManager &refGLM;
+		TripleBuffer<VideoFrame> &refFrames; //Owned by the GLManager; each frame is drawn straight into the back buffer, then published
 		MAGSNES::byte(&refMM)[MM_SIZE];
 		MAGSNES::byte(&refVM)[VM_SIZE];
 
 		//The indices in OAM of the 8 sprites to draw; refreshed every scanline.
 		byte currentSprites[8];
 
+		//The sprite pixel for each pixel of each scanline, in LineCompositor's format; drawn from currentSprites when a line's sprites change.
+		byte spriteLines[NES_SCREEN_HEIGHT][NES_SCREEN_WIDTH];
+		//Stands in for a spriteLines entry while sprites are hidden
+		byte emptySpriteLine[NES_SCREEN_WIDTH];
+
+		//Builds each scanline from backgroundTiles and spriteLine
+		LineCompositor compositor;
+		LineCompositor::BackgroundTiles backgroundTiles;
+
+		//The finished scanline, when it isn't written straight into the back frame's palette indices
+		byte lineIndices[NES_SCREEN_WIDTH];
+
+		//Where on the current scanline the sprite 0 hit flag gets set, if anywhere
+		word spriteZeroHitPixel;
+
+		//The address of the current scanline's first tile, two tiles behind where ppuAddr was at its first pixel
+		word lineStartAddr;
+		//Set once render_scanline has drawn the current scanline, which a scroll change can then split
+		bool isLineRendered;
+		//Whether backgroundTiles hold the current scanline's tiles; not after a line is reused from the cache
+		bool areLineTilesFetched;
+
+		//Set for the frames Core::videoRegs.framesToSkip says not to draw. These only composite the scanlines sprite 0 is on, to find
+		//its hit, and nothing is written to the back frame or published.
+		bool isSkippingFrame;
+		//Frames skipped since the last one that was drawn
+		dword framesSkipped;
+
+		/*
+		Static screens are drawn the same way frame after frame, so each scanline keeps what it was last drawn from, and is only drawn again
+		when that changes; otherwise it is copied from the last published frame. What a line reads from VRAM is versioned: writes that change pattern data or the palette bump a single counter
+		each, and nametable writes bump the tile row they are in (attribute writes bump the 4 rows the byte covers). The OAM entries are
+		compared directly, since games copy OAM every frame whether or not it changed.
+		*/
+		struct SpriteLineInputs {
+			MAGSNES::byte entries[8 * 4]; //The OAM entries of currentSprites, in order; unused ones are 0
+			MAGSNES::byte spriteCount;
+			bool spriteSizeIs8x8;
+			word spritePatternTableOffset;
+			dword patternVersion;
+		};
+
+		struct ScanlineInputs {
+			word ppuAddr, //lineStartAddr
+				patternTableOffset;
+			dword patternVersion,
+				paletteVersion,
+				nameTableRowVersions[2]; //The line's tile row in its nametable, and in the one to the right of it
+			MAGSNES::byte nameTablePages[2],
+				fineX,
+				greyscaleMask,
+				colorEmphasis;
+			bool shouldShowSprites,
+				usePaletteIndexFramebuffer;
+		};
+
+		struct ScanlineCache {
+			SpriteLineInputs sprites;
+			ScanlineInputs line;
+			bool hasSprites, //spriteLines holds the line's sprites as sprites describes
+				hasLine; //The last published frame holds the line drawn from line and the line's spriteLines entry
+			word spriteZeroHitPixel;
+		} lineCache[NES_SCREEN_HEIGHT];
+
+		dword patternVersion, paletteVersion;
+		dword nameTableRowVersions[4][32];
+
+		//Which of the 4 1KB nametable RAM pages (at $2000, $2400, $2800 and $2C00 in refVM) each of the nameTableSlots points to
+		MAGSNES::byte nameTablePages[4];
+
+		//For the Telemetry; reset every drawn frame
+		dword linesComposited, linesReused;
+
+		//The 1KB of VRAM behind each of the 4 nametables ($2000, $2400, $2800 and $2C00), according to the mirroring type. Every nametable
+		//read and write goes through these, so mirroring costs nothing per access and mappers can change it at any time
+		MAGSNES::byte *nameTableSlots[4];
+
 		//Internal PPU values (i.e. NOT memory-mapped)
 		struct PPUREGISTERS {
-			bool	usePPUADDRHI, usePPUSCROLLX, //Internal PPU 'toggles'
+			bool	isSecondWrite, //The 'w' toggle shared by PPUSCROLL and PPUADDR
 				spriteSizeIs8x8, //Otherwise use 8x16
 				shouldGenerateNMI, //Cause CPU to execute NMI routine on VBLANK start
 				shouldShowLeftmostBackground,
@@ -52,8 +139,17 @@ namespace MAGSNES {
 				shouldShowBackground,
 				shouldShowSprites;
 
-			word	ppuAddr, //internal PPU VRAM pointer
-				nameTableBaseAddr, //Retrieved NT address are offset from here
+			/*
+			ppuAddr and tempAddr are the PPU's 15 bit 'v' and 't' registers. While rendering, ppuAddr is also the scroll position:
+
+			yyy NN YYYYY XXXXX
+			||| || ||||| +++++-- coarse X (tile column)
+			||| || +++++-------- coarse Y (tile row)
+			||| ++-------------- nametable select
+			+++----------------- fine Y (row within the tile)
+			*/
+			word	ppuAddr, //internal PPU VRAM pointer ('v')
+				tempAddr, //Holds the scroll written through PPUCTRL, PPUSCROLL and PPUADDR until it is copied to ppuAddr ('t')
 				patternTableOffset,
 				spritePatternTableOffset,
 				pixelCounter, //Where the PPU is drawing on the current scanline (0-341)
@@ -61,9 +157,10 @@ namespace MAGSNES {
 
 			MAGSNES::byte	ppuDataBuff, //The data to send to PPUDATA on a read of that register
 				ppuIncr, //How much to increment ppuAddr by after certain operations
-				fineXOffset,
-				fineYOffset,
-				mirroringType; //Will usially be MIRROR_HORIZONTAL or MIRROR_VERTICAL
+				fineX, //Pixel within the tile at coarse X where the scanline starts ('x')
+				mirroringType, //Will usially be MIRROR_HORIZONTAL or MIRROR_VERTICAL
+				colorEmphasis, //PPUMASK bits 5-7, shifted down to bits 0-2
+				greyscaleMask; //ANDed with every palette index; 0x30 in greyscale mode, 0x3F otherwise
 		} *regs;
 
 		//RGBA color values
@@ -75,8 +172,8 @@ namespace MAGSNES {
 		linker will not be able to find the inlined symbol.
 		*************************************/
 
-		//Implements PPU mirroring within range
-		word coercePPUAddress(word addr);
+		//The byte in VRAM at a PPU address, through the nametable slots and palette mirrors
+		MAGSNES::byte & vram_at(word addr);
 
 		void checkPPUCTRL();
 
@@ -85,15 +182,18 @@ namespace MAGSNES {
 		//Send a byte from main memory to the address in OAM specified in refMM[OAMADDR]
 		void readOAMDATA();
 
-		//Change x or y tile offset depending on internal toggle
+		//Change x or y scroll in tempAddr depending on internal toggle
 		void checkPPUSCROLL();
 
-		//Change hi or lo byte of PPU internal address pointer, depending on internal toggle
+		//Change hi or lo byte of tempAddr depending on internal toggle; the lo byte also copies it to ppuAddr
 		void checkPPUADDR();
 
 		//Write the byte in PPUDATA to the address in VRAM pointed to by the internal ppuAddr
 		void checkPPUDATA();
 
+		//Bumps the version of whatever a scanline reads from addr, after a write that changed it
+		void mark_vram_write(word addr);
+
 		//Listens for CPU R/W to PPU registers; only called on the FIRST cycle after the CPU
 		//completes a call to executeNext()
 		void monitorAddresses();
@@ -102,46 +202,45 @@ namespace MAGSNES {
 		//increments internal registers
 		void emulateCRT();
 
-		//The next two functions are responsible for retrieving the next nametable and sprite pixel to draw. Both store various
-		//meta-information (transparent pixel, sprite0, etc.) in the lowest byte of the returned dword.
-
-		/*
-		Retrieve the next nametable pixel to draw.
-
-		The algorithm is as follows:
+		//Finds the (up to) 8 sprites in range of the current scanline, and draws them into its spriteLines entry unless they are the same as
+		//last frame's. On skipped frames only sprite 0 is drawn, and only when it is in range.
+		void evaluate_sprites();
 
-		1) Determine tile in the 32x30 tile map (tileAddr), then retrieve the address in VRAM of the NT entry (ntAddr).
+		//Copy the current scanline from the last published frame into the back one, for lines that are the same as last frame or aren't drawn
+		void copy_published_line();
 
-		2) Read the NT entry to determine the address of the pattern table entry to read (patternAddr).
+		//Move a VRAM address one tile right, wrapping into the horizontally adjacent nametable. While rendering, ppuAddr is moved at the end
+		//of every 8 dot tile fetch.
+		void increment_coarse_x(word &vramAddr);
 
-		3) Depending on the X and Y pixel (NOT the tile) coordinate, figure out which byte of the pattern table to read and how to mask it
-		and retrieve the bits we need (tmpMask).
+		//Move ppuAddr one pixel down, wrapping after the 30th tile row into the vertically adjacent nametable
+		void increment_fine_y();
 
-		4) Check if both bits are 0; return the universal background color if they are.
+		/*
+		Draws the current scanline in one go, at its first pixel.
 
-		5) Otherwise, retreive the attribute byte to determine which palette to use, and use the retrieved pattern bits to select which of the
-		three palette colors to return.
-		*/
-		const dword get_NT_pixel();
+		The algorithm is as follows:
 
-		const dword get_SPR_pixel();
+		0) If nothing the line is drawn from changed since it was last drawn, keep it, along with its sprite 0 hit.
 
-		//Receives nametable and sprite pixels for the XY coord on the active (rendering) scanline, and queries the
-		//meta-information in their lowest byte to decide which pixel should be returned and rendered. Also sets 
-		//sprite0 hit flag if appropriate.
-		const dword multiplex(const dword ntPixel, const dword sprPixel);
+		1) Starting from lineStartAddr, fetch the 33 tiles the line touches: for each, the nametable entry in the slot selected by the address
+		(offset by its coarse X and Y bits), the row of the pattern entry it points to selected by fine Y, and the palette from the attribute byte.
 
-		//Retrieves sprite pattern data depending on flip type
-		const MAGSNES::byte get_pattern_no_flip(const word xPos, const word yPos, word patternAddr);
+		2) Hand the tiles, fine X and the line's sprites to the LineCompositor, which writes the palette indices and finds the sprite 0 hit.
 
-		//Flips a sprite around (along the y axis)
-		const MAGSNES::byte get_pattern_flip_horizontal(const word xPos, const word yPos, word patternAddr);
+		3) Without the palette index framebuffer, expand the indices to RGBA lines in the back frame.
+		*/
+		void render_scanline();
 
-		//Flips a sprite upside down (along the x axis)
-		const MAGSNES::byte get_pattern_flip_vertical(const word xPos, const word yPos, word patternAddr);
+		//Fill backgroundTiles from firstTile on with the tiles starting at vramAddr
+		void fetch_background_tiles(word vramAddr, const int firstTile);
 
-		//Flips a sprite along the x and y axes
-		const MAGSNES::byte get_pattern_flip_horizontal_and_vertical(const word xPos, const word yPos, word patternAddr);
+		/*
+		Redraws the rest of a line already drawn by render_scanline, after the CPU moved the scroll partway through it (a split screen).
+		A new ppuAddr (isNewAddr) is picked up by the next tile fetch, so it shows from the first pixel of that tile on; a new fine X shows
+		from the next pixel. The line is composited again and only the pixels not yet reached are replaced.
+		*/
+		void split_scanline(const bool isNewAddr);
 
 	};
 
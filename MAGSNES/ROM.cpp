@@ -98,6 +98,10 @@ const byte ROM::get_mirroring_type() {
 	return (options->hasVerticalMirroring) ? 1 : 0;
 }
 
+const bool ROM::has_four_screen_vram() {
+	return options->hasFourScreenVRAM;
+}
+
 const byte ROM::get_num_prg_banks() {
 	return PRGBanks.size();
 }
@@ -36,6 +36,7 @@ namespace MAGSNES {
 		//Needed by the emulator to select the correct mapper
 		const word get_mapper_id();
 		const MAGSNES::byte get_mirroring_type();
+		const bool has_four_screen_vram();
 
 		const MAGSNES::byte get_num_prg_banks();
 		const MAGSNES::byte get_num_chr_banks();
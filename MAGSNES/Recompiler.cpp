@@ -0,0 +1,958 @@
+#include "Recompiler.h"
+
+#include "CPU.h"
+
+#include <cstring>
+
+#ifdef CPU_RECOMPILER
+
+__FILESCOPE__{
+	typedef MAGSNES::X64Emitter X64;
+
+	//Host registers that hold 6502 state for the whole block. All are callee-saved in both the Windows and System V ABIs,
+	//and generated code never calls out, so nothing else needs preserving.
+	const X64::Reg REG_CPU = X64::RBX;
+	const X64::Reg REG_CODE_PAGES = X64::RBP;
+	const X64::Reg REG_MEM = X64::R12;
+	const X64::Reg REG_A = X64::R13;
+	const X64::Reg REG_X = X64::R14;
+	const X64::Reg REG_Y = X64::R15;
+	//Page cross cycles taken so far; caller-saved, but free since generated code never calls out
+	const X64::Reg REG_PAGE_CROSSES = X64::R9;
+
+#ifdef _WIN32
+	const X64::Reg REG_ARG0 = X64::RCX;
+#else
+	const X64::Reg REG_ARG0 = X64::RDI;
+#endif
+
+	const MAGSNES::word RAM_SIZE = 0x800;
+	const MAGSNES::word SRAM_START = 0x4020;
+	const MAGSNES::word SRAM_SIZE = 0x8000 - SRAM_START;
+
+	FORCEINLINE const bool is_io(const MAGSNES::word addr) {
+		return (addr >= 0x2000) && (addr < 0x4020);
+	}
+}
+
+using namespace MAGSNES;
+
+Recompiler::Recompiler(CPU &refCPU, const bool checkAgainstInterpreter)
+	: cpu(refCPU), mainMemory(refCPU.refMM), codeBuffer(nullptr), codeCursor(nullptr), blockAt(new Block *[0x10000]),
+		checkAgainstInterpreter(checkAgainstInterpreter), snapshotRAM(nullptr), snapshotSRAM(nullptr), nativeRAM(nullptr), nativeSRAM(nullptr) {
+
+	//Offsets from the CPU pointer the generated code receives
+	const MAGSNES::byte * const base = reinterpret_cast<const MAGSNES::byte *>(&cpu);
+	offA = (int)(&cpu.regA - base);
+	offX = (int)(&cpu.regX - base);
+	offY = (int)(&cpu.regY - base);
+	offSP = (int)(&cpu.regSP - base);
+	offPC = (int)(reinterpret_cast<const MAGSNES::byte *>(&cpu.regPC) - base);
+	offNZ = (int)(reinterpret_cast<const MAGSNES::byte *>(&cpu.lazyNZ) - base);
+	offV = (int)(&cpu.lazyV - base);
+	offC = (int)(reinterpret_cast<const MAGSNES::byte *>(&cpu.flagC) - base);
+	offD = (int)(reinterpret_cast<const MAGSNES::byte *>(&cpu.flagD) - base);
+	offI = (int)(reinterpret_cast<const MAGSNES::byte *>(&cpu.flagI) - base);
+
+	//Work out what each opcode does from the interpreter's own table, so the two can't disagree about decoding
+	const struct {
+		MAGSNES::byte mnemonic;
+		OpKind kind;
+	} KINDS[] = {
+		{ CPU::MN_LDA, OP_LDA }, { CPU::MN_LDX, OP_LDX }, { CPU::MN_LDY, OP_LDY }, { CPU::MN_STA, OP_STA }, { CPU::MN_STX, OP_STX }, { CPU::MN_STY, OP_STY },
+		{ CPU::MN_ADC, OP_ADC }, { CPU::MN_SBC, OP_SBC }, { CPU::MN_AND, OP_AND }, { CPU::MN_ORA, OP_ORA }, { CPU::MN_EOR, OP_EOR },
+		{ CPU::MN_CMP, OP_CMP }, { CPU::MN_CPX, OP_CPX }, { CPU::MN_CPY, OP_CPY }, { CPU::MN_BIT, OP_BIT },
+		{ CPU::MN_INC, OP_INC }, { CPU::MN_DEC, OP_DEC }, { CPU::MN_ASL, OP_ASL }, { CPU::MN_LSR, OP_LSR }, { CPU::MN_ROL, OP_ROL }, { CPU::MN_ROR, OP_ROR },
+		{ CPU::MN_INX, OP_INX }, { CPU::MN_INY, OP_INY }, { CPU::MN_DEX, OP_DEX }, { CPU::MN_DEY, OP_DEY },
+		{ CPU::MN_TAX, OP_TAX }, { CPU::MN_TAY, OP_TAY }, { CPU::MN_TXA, OP_TXA }, { CPU::MN_TYA, OP_TYA }, { CPU::MN_TSX, OP_TSX }, { CPU::MN_TXS, OP_TXS },
+		{ CPU::MN_CLC, OP_CLC }, { CPU::MN_SEC, OP_SEC }, { CPU::MN_CLD, OP_CLD }, { CPU::MN_SED, OP_SED }, { CPU::MN_CLI, OP_CLI }, { CPU::MN_SEI, OP_SEI },
+		{ CPU::MN_CLV, OP_CLV }, { CPU::MN_NOP, OP_NOP }, { CPU::MN_PHA, OP_PHA }, { CPU::MN_PLA, OP_PLA },
+		{ CPU::MN_BCC, OP_BCC }, { CPU::MN_BCS, OP_BCS }, { CPU::MN_BEQ, OP_BEQ }, { CPU::MN_BNE, OP_BNE },
+		{ CPU::MN_BMI, OP_BMI }, { CPU::MN_BPL, OP_BPL }, { CPU::MN_BVC, OP_BVC }, { CPU::MN_BVS, OP_BVS },
+		{ CPU::MN_JMP, OP_JMP }
+	};
+
+	for (int opcode = 0; opcode < 0x100; opcode++) {
+		opKind[opcode] = OP_NONE;
+
+		for (const auto &entry : KINDS) {
+			if (CPU::opcodeVector[opcode].mnemonic == entry.mnemonic) {
+				opKind[opcode] = entry.kind;
+			}
+		}
+
+		//Indirect JMP is left to the interpreter, as are the unofficial NOPs that read memory
+		if (((opKind[opcode] == OP_JMP) && (CPU::opcodeVector[opcode].addrMode != CPU::ABSOLUTE)) ||
+			((opKind[opcode] == OP_NOP) && (CPU::opcodeVector[opcode].addrMode != CPU::IMPLIED))) {
+			opKind[opcode] = OP_NONE;
+		}
+	}
+
+	for (int slot = 0; slot < 4; slot++) {
+		slotTags[slot] = UNMAPPED_TAG;
+	}
+
+	codeBuffer = (MAGSNES::byte *)VirtualAlloc(NULL, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (codeBuffer == nullptr) {
+		cpu.sysCore.logerr("Unable to allocate memory for recompiled code; falling back to the interpreter");
+	} else {
+		DWORD oldProtect;
+		if (!VirtualProtect(codeBuffer, CODE_BUFFER_SIZE, PAGE_EXECUTE_READ, &oldProtect)) {
+			cpu.sysCore.logerr("Unable to make the recompiled code buffer executable; falling back to the interpreter");
+			VirtualFree(codeBuffer, 0, MEM_RELEASE);
+			codeBuffer = nullptr;
+		}
+	}
+
+	if (checkAgainstInterpreter) {
+		snapshotRAM = new MAGSNES::byte[RAM_SIZE];
+		nativeRAM = new MAGSNES::byte[RAM_SIZE];
+		snapshotSRAM = new MAGSNES::byte[SRAM_SIZE];
+		nativeSRAM = new MAGSNES::byte[SRAM_SIZE];
+	}
+
+	flush();
+	std::memset(&stats, 0, sizeof(Stats));
+}
+
+Recompiler::~Recompiler() {
+	char statsMsg[256];
+	sprintf_s(statsMsg, "Recompiler: %llu blocks compiled, %llu blocks run (%llu instructions), %llu interpreter fallbacks, %llu flushes",
+		stats.blocksCompiled, stats.blocksRun, stats.instructionsRun, stats.interpreterFallbacks, stats.flushes);
+	cpu.sysCore.logmsg(statsMsg);
+
+	if (checkAgainstInterpreter) {
+		sprintf_s(statsMsg, "Recompiler: %llu blocks differed from the interpreter", stats.mismatches);
+		cpu.sysCore.logmsg(statsMsg);
+	}
+
+	for (auto &entry : allBlocks) {
+		delete entry.second;
+	}
+
+	if (codeBuffer != nullptr) {
+		VirtualFree(codeBuffer, 0, MEM_RELEASE);
+	}
+
+	delete[] blockAt;
+	delete[] snapshotRAM;
+	delete[] nativeRAM;
+	delete[] snapshotSRAM;
+	delete[] nativeSRAM;
+}
+
+const bool Recompiler::run(MAGSNES::byte &cycles) {
+	if (codeBuffer == nullptr) {
+		return false;
+	}
+
+	const word pc = cpu.regPC;
+	Block *block = blockAt[pc];
+
+	if (block == nullptr) {
+		block = find_or_compile(pc);
+		blockAt[pc] = block;
+	}
+
+	if (block->proc == nullptr) {
+		stats.interpreterFallbacks++;
+		return false;
+	}
+
+	const dword result = checkAgainstInterpreter ? run_checked(*block) : block->proc(&cpu);
+	const dword count = (result >> 8) & 0xFF;
+
+	//Side exit on the very first instruction
+	if (count == 0) {
+		stats.interpreterFallbacks++;
+		return false;
+	}
+
+	stats.blocksRun++;
+	stats.instructionsRun += count;
+
+	cycles = result & 0xFF;
+	return true;
+}
+
+void Recompiler::map_prg(const word startAddr, const dword length, const dword prgChunk) {
+	for (dword offset = 0; offset < length; offset += 0x2000) {
+		const dword slot = ((startAddr + offset) >> 13) & 3;
+		const dword tag = prgChunk + (offset >> 13);
+
+		//UNROM reloads the bank on every write to $8000-$FFFF, often with the bank that's already there
+		if (slotTags[slot] != tag) {
+			slotTags[slot] = tag;
+			std::memset(&blockAt[0x8000 + (slot << 13)], 0, 0x2000 * sizeof(Block *));
+		}
+	}
+}
+
+void Recompiler::invalidate_page(const MAGSNES::byte page) {
+	for (auto it = ramBlocks.begin(); it != ramBlocks.end();) {
+		Block *block = *it;
+
+		if (((block->startPC >> 8) <= page) && (((block->endPC - 1) >> 8) >= page)) {
+			allBlocks.erase(((qword)RAM_TAG << 16) | block->startPC);
+			blockAt[block->startPC] = nullptr;
+			delete block;
+			it = ramBlocks.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	//Other blocks may still share the page
+	std::memset(codePages, 0, sizeof(codePages));
+	for (const Block *block : ramBlocks) {
+		mark_code_pages(*block);
+	}
+}
+
+void Recompiler::flush() {
+	for (auto &entry : allBlocks) {
+		delete entry.second;
+	}
+
+	allBlocks.clear();
+	ramBlocks.clear();
+	std::memset(blockAt, 0, 0x10000 * sizeof(Block *));
+	std::memset(codePages, 0, sizeof(codePages));
+
+	codeCursor = codeBuffer;
+	stats.flushes++;
+}
+
+const bool Recompiler::protect_code(MAGSNES::byte * const start, const bool isWritable) {
+	DWORD oldProtect;
+	return VirtualProtect(start, MAX_BLOCK_BYTES, isWritable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &oldProtect) != 0;
+}
+
+const dword Recompiler::get_tag(const word pc) const {
+	return (pc & 0x8000) ? slotTags[(pc >> 13) & 3] : RAM_TAG;
+}
+
+//Blocks stay within one 8KB slot of PRG ROM (so one tag covers them), within SRAM, or within RAM outside the stack page.
+//The stack page is excluded because pushes write it directly rather than through CPU::write_byte.
+const dword Recompiler::get_region_end(const word pc) const {
+	if (pc >= 0x8000) {
+		return ((dword)pc | 0x1FFF) + 1;
+	} else if (pc >= 0x6000) {
+		return 0x8000;
+	} else if (pc < 0x100) {
+		return 0x100;
+	} else if ((pc >= 0x200) && (pc < RAM_SIZE)) {
+		return RAM_SIZE;
+	}
+
+	return 0;
+}
+
+void Recompiler::mark_code_pages(const Block &block) {
+	for (dword page = block.startPC >> 8; page <= (dword)((block.endPC - 1) >> 8); page++) {
+		codePages[page] = 1;
+	}
+}
+
+Recompiler::Block * Recompiler::find_or_compile(const word pc) {
+	const qword key = ((qword)get_tag(pc) << 16) | pc;
+
+	std::unordered_map<qword, Block *>::iterator found = allBlocks.find(key);
+	if (found != allBlocks.end()) {
+		return found->second;
+	}
+
+	if ((codeCursor + MAX_BLOCK_BYTES) > (codeBuffer + CODE_BUFFER_SIZE)) {
+		flush();
+	}
+
+	//Only the range this block can use is opened up for writing, and made executable again once it's emitted and patched
+	MAGSNES::byte * const blockStart = codeCursor;
+	Block *block;
+
+	if (protect_code(blockStart, true)) {
+		block = compile(pc);
+		protect_code(blockStart, false);
+
+		if (block->proc != nullptr) {
+			FlushInstructionCache(GetCurrentProcess(), blockStart, codeCursor - blockStart);
+		}
+	} else {
+		//Left to the interpreter, like any block that can't be compiled
+		block = new Block{ nullptr, pc, pc };
+	}
+
+	allBlocks[key] = block;
+
+	if (block->proc != nullptr) {
+		stats.blocksCompiled++;
+	}
+
+	//A RAM block goes when its code is overwritten, even when nothing could be compiled, since better code may be copied there
+	if (!(pc & 0x8000) && (block->endPC != block->startPC)) {
+		ramBlocks.push_back(block);
+		mark_code_pages(*block);
+	}
+
+	return block;
+}
+
+Recompiler::Block * Recompiler::compile(const word startPC) {
+	Block *block = new Block{ nullptr, startPC, startPC };
+
+	const dword regionEnd = get_region_end(startPC);
+	if (regionEnd == 0) {
+		return block;
+	}
+
+	X64 em(codeCursor, codeBuffer + CODE_BUFFER_SIZE);
+	exitStubs.clear();
+
+	em.push(X64::RBX);
+	em.push(X64::RBP);
+	em.push(X64::R12);
+	em.push(X64::R13);
+	em.push(X64::R14);
+	em.push(X64::R15);
+
+	em.mov64(REG_CPU, REG_ARG0);
+	em.mov_imm64(REG_MEM, (qword)mainMemory);
+	em.mov_imm64(REG_CODE_PAGES, (qword)codePages);
+	em.movzx8(REG_A, X64::mem(REG_CPU, offA));
+	em.movzx8(REG_X, X64::mem(REG_CPU, offX));
+	em.movzx8(REG_Y, X64::mem(REG_CPU, offY));
+	em.alu(X64::ALU_XOR, REG_PAGE_CROSSES, REG_PAGE_CROSSES);
+
+	//pageCrossCycles is the most the instructions so far could add for page crosses
+	dword pc = startPC, cycles = 0, pageCrossCycles = 0, count = 0;
+	bool terminated = false;
+
+	while (count < MAX_BLOCK_INSTRUCTIONS) {
+		const MAGSNES::byte opcode = mainMemory[pc];
+
+		if (opKind[opcode] == OP_NONE) {
+			break;
+		}
+
+		if ((pc + CPU::get_instruction_length(CPU::opcodeVector[opcode].addrMode)) > regionEnd) {
+			break;
+		}
+
+		//Leave room for the extra cycles of a taken branch, and of every page cross
+		if ((cycles + pageCrossCycles + CPU::opcodeVector[opcode].cycles + CPU::opcodeVector[opcode].pageCrossCycle + 2) > MAX_BLOCK_CYCLES) {
+			break;
+		}
+
+		const EmitResult result = emit_instruction(em, opcode, pc, cycles, count);
+
+		if (result == EMIT_REJECTED) {
+			break;
+		}
+
+		cycles += CPU::opcodeVector[opcode].cycles;
+		pageCrossCycles += CPU::opcodeVector[opcode].pageCrossCycle;
+		count++;
+		pc += CPU::get_instruction_length(CPU::opcodeVector[opcode].addrMode);
+
+		if (result == EMIT_TERMINATED) {
+			terminated = true;
+			break;
+		}
+	}
+
+	//Nothing worth compiling; the code emitted so far is simply overwritten by the next block
+	if (count == 0) {
+		block->endPC = startPC + 1;
+		return block;
+	}
+
+	if (!terminated) {
+		emit_exit(em, pc, cycles, count);
+	}
+
+	//Every exit stores PC and the result, then joins the epilogue
+	std::vector<MAGSNES::byte *> epilogueJumps;
+	for (const ExitStub &stub : exitStubs) {
+		X64::patch(stub.rel32, em.get_cursor());
+		em.store16_imm(X64::mem(REG_CPU, offPC), stub.pc);
+		em.mov_imm(X64::RAX, stub.cycles | (stub.count << 8));
+		epilogueJumps.push_back(em.jmp());
+	}
+
+	for (MAGSNES::byte *rel32 : epilogueJumps) {
+		X64::patch(rel32, em.get_cursor());
+	}
+
+	em.alu(X64::ALU_ADD, X64::RAX, REG_PAGE_CROSSES);
+
+	em.store8(X64::mem(REG_CPU, offA), REG_A);
+	em.store8(X64::mem(REG_CPU, offX), REG_X);
+	em.store8(X64::mem(REG_CPU, offY), REG_Y);
+
+	em.pop(X64::R15);
+	em.pop(X64::R14);
+	em.pop(X64::R13);
+	em.pop(X64::R12);
+	em.pop(X64::RBP);
+	em.pop(X64::RBX);
+	em.ret();
+
+	block->proc = reinterpret_cast<BlockProc>(codeCursor);
+	block->endPC = (word)pc;
+	codeCursor = em.get_cursor();
+
+	return block;
+}
+
+Recompiler::EmitResult Recompiler::emit_instruction(X64 &em, const MAGSNES::byte opcode, const word pc, const dword cycles, const dword count) {
+	const MAGSNES::byte addrMode = CPU::opcodeVector[opcode].addrMode;
+	const OpKind kind = (OpKind)opKind[opcode];
+	Operand op;
+
+	switch (kind) {
+	//*****Loads and ALU operations; the operand ends up in eax*****
+	case OP_LDA:
+	case OP_LDX:
+	case OP_LDY:
+	case OP_AND:
+	case OP_ORA:
+	case OP_EOR:
+	case OP_ADC:
+	case OP_SBC:
+	case OP_CMP:
+	case OP_CPX:
+	case OP_CPY:
+	case OP_BIT:
+		if (!emit_operand(em, addrMode, pc, false, cycles, count, op)) {
+			return EMIT_REJECTED;
+		}
+		emit_load(em, op);
+
+		switch (kind) {
+		case OP_LDA:
+			em.mov(REG_A, X64::RAX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_LDX:
+			em.mov(REG_X, X64::RAX);
+			emit_set_NZ(em, REG_X);
+			break;
+
+		case OP_LDY:
+			em.mov(REG_Y, X64::RAX);
+			emit_set_NZ(em, REG_Y);
+			break;
+
+		case OP_AND:
+			em.alu(X64::ALU_AND, REG_A, X64::RAX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_ORA:
+			em.alu(X64::ALU_OR, REG_A, X64::RAX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_EOR:
+			em.alu(X64::ALU_XOR, REG_A, X64::RAX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_ADC:
+			//ecx = A + operand + C
+			em.movzx8(X64::RCX, X64::mem(REG_CPU, offC));
+			em.alu(X64::ALU_ADD, X64::RCX, X64::RAX);
+			em.alu(X64::ALU_ADD, X64::RCX, REG_A);
+			em.alu_imm(X64::ALU_CMP, X64::RCX, 0xFF);
+			em.setcc(X64::COND_A, X64::mem(REG_CPU, offC));
+			em.alu_imm(X64::ALU_AND, X64::RCX, 0xFF);
+
+			//flagV = ~(A ^ operand) & (A ^ result)
+			em.mov(X64::RDX, REG_A);
+			em.alu(X64::ALU_XOR, X64::RDX, X64::RAX);
+			em.not_(X64::RDX);
+			em.mov(X64::R8, REG_A);
+			em.alu(X64::ALU_XOR, X64::R8, X64::RCX);
+			em.alu(X64::ALU_AND, X64::RDX, X64::R8);
+			em.store8(X64::mem(REG_CPU, offV), X64::RDX);
+
+			em.mov(REG_A, X64::RCX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_SBC:
+			//edx = A - operand - !C; it's only negative when there was a borrow
+			em.movzx8(X64::RCX, X64::mem(REG_CPU, offC));
+			em.alu_imm(X64::ALU_XOR, X64::RCX, 1);
+			em.mov(X64::RDX, REG_A);
+			em.alu(X64::ALU_SUB, X64::RDX, X64::RAX);
+			em.alu(X64::ALU_SUB, X64::RDX, X64::RCX);
+			em.setcc(X64::COND_NS, X64::mem(REG_CPU, offC));
+			em.alu_imm(X64::ALU_AND, X64::RDX, 0xFF);
+
+			//flagV = (A ^ operand) & (A ^ result)
+			em.mov(X64::RCX, REG_A);
+			em.alu(X64::ALU_XOR, X64::RCX, X64::RAX);
+			em.mov(X64::R8, REG_A);
+			em.alu(X64::ALU_XOR, X64::R8, X64::RDX);
+			em.alu(X64::ALU_AND, X64::RCX, X64::R8);
+			em.store8(X64::mem(REG_CPU, offV), X64::RCX);
+
+			em.mov(REG_A, X64::RDX);
+			emit_set_NZ(em, REG_A);
+			break;
+
+		case OP_CMP:
+		case OP_CPX:
+		case OP_CPY:
+			em.mov(X64::RDX, (kind == OP_CMP) ? REG_A : ((kind == OP_CPX) ? REG_X : REG_Y));
+			em.alu(X64::ALU_SUB, X64::RDX, X64::RAX);
+			em.setcc(X64::COND_AE, X64::mem(REG_CPU, offC));
+			em.alu_imm(X64::ALU_AND, X64::RDX, 0xFF);
+			emit_set_NZ(em, X64::RDX);
+			break;
+
+		default: //OP_BIT
+			//lazyNZ = ((operand & 0x80) << 8) | (A & operand). CPU::set_NZ keeps only whether A & operand is zero, but it can't have
+			//bit 7 set unless operand does, so N and Z read the same either way.
+			em.mov(X64::RDX, REG_A);
+			em.alu(X64::ALU_AND, X64::RDX, X64::RAX);
+			em.mov(X64::RCX, X64::RAX);
+			em.alu_imm(X64::ALU_AND, X64::RCX, 0x80);
+			em.shl(X64::RCX, 8);
+			em.alu(X64::ALU_OR, X64::RCX, X64::RDX);
+			em.store16(X64::mem(REG_CPU, offNZ), X64::RCX);
+
+			//flagV is bit 6 of the operand
+			em.alu(X64::ALU_ADD, X64::RAX, X64::RAX);
+			em.store8(X64::mem(REG_CPU, offV), X64::RAX);
+			break;
+		}
+		return EMIT_OK;
+
+	//*****Stores*****
+	case OP_STA:
+	case OP_STX:
+	case OP_STY:
+		if (!emit_operand(em, addrMode, pc, true, cycles, count, op)) {
+			return EMIT_REJECTED;
+		}
+		emit_store(em, op, (kind == OP_STA) ? REG_A : ((kind == OP_STX) ? REG_X : REG_Y));
+		return EMIT_OK;
+
+	//*****Read-modify-write; the value is in eax, and ecx holds a dynamic address throughout*****
+	case OP_INC:
+	case OP_DEC:
+	case OP_ASL:
+	case OP_LSR:
+	case OP_ROL:
+	case OP_ROR:
+		if (addrMode == CPU::ACCUMULATOR) {
+			em.mov(X64::RAX, REG_A);
+		} else {
+			if (!emit_operand(em, addrMode, pc, true, cycles, count, op)) {
+				return EMIT_REJECTED;
+			}
+			emit_load(em, op);
+		}
+
+		switch (kind) {
+		case OP_INC:
+			em.alu_imm(X64::ALU_ADD, X64::RAX, 1);
+			em.alu_imm(X64::ALU_AND, X64::RAX, 0xFF);
+			break;
+
+		case OP_DEC:
+			em.alu_imm(X64::ALU_SUB, X64::RAX, 1);
+			em.alu_imm(X64::ALU_AND, X64::RAX, 0xFF);
+			break;
+
+		case OP_ASL:
+			em.alu(X64::ALU_ADD, X64::RAX, X64::RAX);
+			em.alu_imm(X64::ALU_CMP, X64::RAX, 0xFF);
+			em.setcc(X64::COND_A, X64::mem(REG_CPU, offC));
+			em.alu_imm(X64::ALU_AND, X64::RAX, 0xFF);
+			break;
+
+		case OP_LSR:
+			em.mov(X64::RDX, X64::RAX);
+			em.alu_imm(X64::ALU_AND, X64::RDX, 0x01);
+			em.store8(X64::mem(REG_CPU, offC), X64::RDX);
+			em.shr(X64::RAX, 1);
+			break;
+
+		case OP_ROL:
+			em.movzx8(X64::RDX, X64::mem(REG_CPU, offC));
+			em.mov(X64::R8, X64::RAX);
+			em.shr(X64::R8, 7);
+			em.alu(X64::ALU_ADD, X64::RAX, X64::RAX);
+			em.alu(X64::ALU_OR, X64::RAX, X64::RDX);
+			em.alu_imm(X64::ALU_AND, X64::RAX, 0xFF);
+			em.store8(X64::mem(REG_CPU, offC), X64::R8);
+			break;
+
+		default: //OP_ROR
+			em.movzx8(X64::RDX, X64::mem(REG_CPU, offC));
+			em.shl(X64::RDX, 7);
+			em.mov(X64::R8, X64::RAX);
+			em.alu_imm(X64::ALU_AND, X64::R8, 0x01);
+			em.shr(X64::RAX, 1);
+			em.alu(X64::ALU_OR, X64::RAX, X64::RDX);
+			em.store8(X64::mem(REG_CPU, offC), X64::R8);
+			break;
+		}
+
+		if (addrMode == CPU::ACCUMULATOR) {
+			em.mov(REG_A, X64::RAX);
+		} else {
+			emit_store(em, op, X64::RAX);
+		}
+		emit_set_NZ(em, X64::RAX);
+		return EMIT_OK;
+
+	//*****Register operations*****
+	case OP_INX:
+	case OP_DEX:
+		em.alu_imm((kind == OP_INX) ? X64::ALU_ADD : X64::ALU_SUB, REG_X, 1);
+		em.alu_imm(X64::ALU_AND, REG_X, 0xFF);
+		emit_set_NZ(em, REG_X);
+		return EMIT_OK;
+
+	case OP_INY:
+	case OP_DEY:
+		em.alu_imm((kind == OP_INY) ? X64::ALU_ADD : X64::ALU_SUB, REG_Y, 1);
+		em.alu_imm(X64::ALU_AND, REG_Y, 0xFF);
+		emit_set_NZ(em, REG_Y);
+		return EMIT_OK;
+
+	case OP_TAX:
+		em.mov(REG_X, REG_A);
+		emit_set_NZ(em, REG_X);
+		return EMIT_OK;
+
+	case OP_TAY:
+		em.mov(REG_Y, REG_A);
+		emit_set_NZ(em, REG_Y);
+		return EMIT_OK;
+
+	case OP_TXA:
+		em.mov(REG_A, REG_X);
+		emit_set_NZ(em, REG_A);
+		return EMIT_OK;
+
+	case OP_TYA:
+		em.mov(REG_A, REG_Y);
+		emit_set_NZ(em, REG_A);
+		return EMIT_OK;
+
+	case OP_TSX:
+		em.movzx8(REG_X, X64::mem(REG_CPU, offSP));
+		emit_set_NZ(em, REG_X);
+		return EMIT_OK;
+
+	case OP_TXS:
+		em.store8(X64::mem(REG_CPU, offSP), REG_X);
+		return EMIT_OK;
+
+	//*****Flags*****
+	case OP_CLC:
+	case OP_SEC:
+		em.store8_imm(X64::mem(REG_CPU, offC), (kind == OP_SEC) ? 1 : 0);
+		return EMIT_OK;
+
+	case OP_CLD:
+	case OP_SED:
+		em.store8_imm(X64::mem(REG_CPU, offD), (kind == OP_SED) ? 1 : 0);
+		return EMIT_OK;
+
+	case OP_CLI:
+	case OP_SEI:
+		em.store8_imm(X64::mem(REG_CPU, offI), (kind == OP_SEI) ? 1 : 0);
+		return EMIT_OK;
+
+	case OP_CLV:
+		em.store8_imm(X64::mem(REG_CPU, offV), 0);
+		return EMIT_OK;
+
+	case OP_NOP:
+		return EMIT_OK;
+
+	//*****Stack*****
+	case OP_PHA:
+		em.movzx8(X64::RAX, X64::mem(REG_CPU, offSP));
+		em.store8(X64::mem(REG_MEM, X64::RAX, 0x100), REG_A);
+		em.alu_imm(X64::ALU_SUB, X64::RAX, 1);
+		em.store8(X64::mem(REG_CPU, offSP), X64::RAX);
+		return EMIT_OK;
+
+	case OP_PLA:
+		em.movzx8(X64::RAX, X64::mem(REG_CPU, offSP));
+		em.alu_imm(X64::ALU_ADD, X64::RAX, 1);
+		em.alu_imm(X64::ALU_AND, X64::RAX, 0xFF);
+		em.store8(X64::mem(REG_CPU, offSP), X64::RAX);
+		em.movzx8(REG_A, X64::mem(REG_MEM, X64::RAX, 0x100));
+		emit_set_NZ(em, REG_A);
+		return EMIT_OK;
+
+	//*****Block terminators*****
+	case OP_JMP: {
+		const word target = cpu.coerce_address(mainMemory[pc + 1] | (mainMemory[pc + 2] << 8));
+		emit_exit(em, target, cycles + CPU::opcodeVector[opcode].cycles, count + 1);
+		return EMIT_TERMINATED;
+	}
+
+	default: { //Branches
+		const word next = pc + 2;
+		const word target = next + (signed char)mainMemory[pc + 1];
+		const dword takenCycles = cycles + CPU::opcodeVector[opcode].cycles + (((next & 0xFF00) != (target & 0xFF00)) ? 2 : 1);
+		X64::Cond takenCond;
+
+		switch (kind) {
+		case OP_BCC:
+		case OP_BCS:
+			em.cmp8_imm(X64::mem(REG_CPU, offC), 0);
+			takenCond = (kind == OP_BCS) ? X64::COND_NE : X64::COND_E;
+			break;
+
+		case OP_BEQ:
+		case OP_BNE:
+			//Z is set when the low byte of lazyNZ is 0
+			em.cmp8_imm(X64::mem(REG_CPU, offNZ), 0);
+			takenCond = (kind == OP_BEQ) ? X64::COND_E : X64::COND_NE;
+			break;
+
+		case OP_BMI:
+		case OP_BPL:
+			em.test16_imm(X64::mem(REG_CPU, offNZ), 0x8080);
+			takenCond = (kind == OP_BMI) ? X64::COND_NE : X64::COND_E;
+			break;
+
+		default: //OP_BVC, OP_BVS
+			em.test8_imm(X64::mem(REG_CPU, offV), 0x80);
+			takenCond = (kind == OP_BVS) ? X64::COND_NE : X64::COND_E;
+			break;
+		}
+
+		emit_side_exit(em, takenCond, target, takenCycles, count + 1);
+		emit_exit(em, next, cycles + CPU::opcodeVector[opcode].cycles, count + 1);
+		return EMIT_TERMINATED;
+	}
+	}
+}
+
+//Works out where the operand is. Static addresses are checked here, and the instruction is rejected if it would touch I/O or
+//write to PRG ROM. Dynamic addresses are computed into ecx, mirrored as CPU::coerce_address would, and checked at runtime.
+const bool Recompiler::emit_operand(X64 &em, const MAGSNES::byte addrMode, const word pc, const bool isWrite, const dword cycles, const dword count, Operand &op) {
+	const MAGSNES::byte lo = mainMemory[pc + 1];
+	const MAGSNES::byte hi = mainMemory[(pc + 2) & 0xFFFF];
+
+	op.isImmediate = false;
+	op.isStatic = true;
+	op.value = 0;
+
+	//edx is set to 1 on a page cross, and added to REG_PAGE_CROSSES once the instruction can no longer side exit
+	const bool hasPageCrossCycle = CPU::opcodeVector[mainMemory[pc]].pageCrossCycle != 0;
+
+	switch (addrMode) {
+	case CPU::IMMEDIATE:
+		op.isImmediate = true;
+		op.value = lo;
+		return true;
+
+	case CPU::ZERO_PAGE:
+	case CPU::ABSOLUTE:
+		op.value = (addrMode == CPU::ZERO_PAGE) ? lo : cpu.coerce_address(lo | (hi << 8));
+
+		if (is_io(op.value) || (isWrite && (op.value & 0x8000))) {
+			return false;
+		}
+
+		//The write would invalidate compiled code, possibly this block
+		if (isWrite && (get_region_end(op.value) != 0) && (op.value < 0x8000)) {
+			em.cmp8_imm(X64::mem(REG_CODE_PAGES, op.value >> 8), 0);
+			emit_side_exit(em, X64::COND_NE, pc, cycles, count);
+		}
+		return true;
+
+	case CPU::ZERO_PAGE_X:
+	case CPU::ZERO_PAGE_Y:
+		op.isStatic = false;
+		em.mov(X64::RCX, (addrMode == CPU::ZERO_PAGE_X) ? REG_X : REG_Y);
+		em.alu_imm(X64::ALU_ADD, X64::RCX, lo);
+		em.alu_imm(X64::ALU_AND, X64::RCX, 0xFF);
+
+		if (isWrite) {
+			em.cmp8_imm(X64::mem(REG_CODE_PAGES, 0), 0);
+			emit_side_exit(em, X64::COND_NE, pc, cycles, count);
+		}
+		return true;
+
+	case CPU::ABSOLUTE_X:
+	case CPU::ABSOLUTE_Y:
+		op.isStatic = false;
+		em.mov(X64::RCX, (addrMode == CPU::ABSOLUTE_X) ? REG_X : REG_Y);
+
+		if (hasPageCrossCycle) {
+			em.mov(X64::RDX, X64::RCX);
+			em.alu_imm(X64::ALU_ADD, X64::RDX, lo);
+			em.shr(X64::RDX, 8);
+		}
+
+		em.alu_imm(X64::ALU_ADD, X64::RCX, lo | (hi << 8));
+		em.alu_imm(X64::ALU_AND, X64::RCX, 0xFFFF);
+		break;
+
+	case CPU::INDIRECT_X:
+		//The pointer is read from (operand + X) & 0xFF, and its high byte wraps within the zero page
+		op.isStatic = false;
+		em.mov(X64::RDX, REG_X);
+		em.alu_imm(X64::ALU_ADD, X64::RDX, lo);
+		em.alu_imm(X64::ALU_AND, X64::RDX, 0xFF);
+		em.movzx8(X64::RAX, X64::mem(REG_MEM, X64::RDX, 0));
+		em.alu_imm(X64::ALU_ADD, X64::RDX, 1);
+		em.alu_imm(X64::ALU_AND, X64::RDX, 0xFF);
+		em.movzx8(X64::RCX, X64::mem(REG_MEM, X64::RDX, 0));
+		em.shl(X64::RCX, 8);
+		em.alu(X64::ALU_OR, X64::RCX, X64::RAX);
+		break;
+
+	case CPU::INDIRECT_Y:
+		op.isStatic = false;
+		em.movzx8(X64::RAX, X64::mem(REG_MEM, lo));
+		em.movzx8(X64::RCX, X64::mem(REG_MEM, (lo + 1) & 0xFF));
+		em.shl(X64::RCX, 8);
+		em.alu(X64::ALU_OR, X64::RCX, X64::RAX);
+
+		if (hasPageCrossCycle) {
+			em.mov(X64::RDX, X64::RAX);
+			em.alu(X64::ALU_ADD, X64::RDX, REG_Y);
+			em.shr(X64::RDX, 8);
+		}
+
+		em.alu(X64::ALU_ADD, X64::RCX, REG_Y);
+		em.alu_imm(X64::ALU_AND, X64::RCX, 0xFFFF);
+		break;
+
+	default:
+		return false;
+	}
+
+	//Mirror $0800-$1FFF down to $0000-$07FF
+	em.mov(X64::RAX, X64::RCX);
+	em.alu_imm(X64::ALU_SUB, X64::RAX, 0x800);
+	em.alu_imm(X64::ALU_CMP, X64::RAX, 0x1800);
+	MAGSNES::byte *notMirrored = em.jcc(X64::COND_AE);
+	em.alu_imm(X64::ALU_AND, X64::RCX, 0x7FF);
+	X64::patch(notMirrored, em.get_cursor());
+
+	//$2000-$401F (including the PPU register mirrors) is left to the interpreter
+	em.mov(X64::RAX, X64::RCX);
+	em.alu_imm(X64::ALU_SUB, X64::RAX, 0x2000);
+	em.alu_imm(X64::ALU_CMP, X64::RAX, 0x2020);
+	emit_side_exit(em, X64::COND_B, pc, cycles, count);
+
+	if (isWrite) {
+		//Mapper registers
+		em.alu_imm(X64::ALU_CMP, X64::RCX, 0x8000);
+		emit_side_exit(em, X64::COND_AE, pc, cycles, count);
+
+		em.mov(X64::RAX, X64::RCX);
+		em.shr(X64::RAX, 8);
+		em.cmp8_imm(X64::mem(REG_CODE_PAGES, X64::RAX, 0), 0);
+		emit_side_exit(em, X64::COND_NE, pc, cycles, count);
+	}
+
+	if (hasPageCrossCycle) {
+		em.alu(X64::ALU_ADD, REG_PAGE_CROSSES, X64::RDX);
+	}
+
+	return true;
+}
+
+void Recompiler::emit_load(X64 &em, const Operand &op) {
+	if (op.isImmediate) {
+		em.mov_imm(X64::RAX, op.value);
+	} else if (op.isStatic) {
+		em.movzx8(X64::RAX, X64::mem(REG_MEM, op.value));
+	} else {
+		em.movzx8(X64::RAX, X64::mem(REG_MEM, X64::RCX, 0));
+	}
+}
+
+void Recompiler::emit_store(X64 &em, const Operand &op, const X64::Reg src) {
+	if (op.isStatic) {
+		em.store8(X64::mem(REG_MEM, op.value), src);
+	} else {
+		em.store8(X64::mem(REG_MEM, X64::RCX, 0), src);
+	}
+}
+
+void Recompiler::emit_side_exit(X64 &em, const X64::Cond cond, const word pc, const dword cycles, const dword count) {
+	exitStubs.push_back(ExitStub{ em.jcc(cond), pc, cycles, count });
+}
+
+void Recompiler::emit_exit(X64 &em, const word pc, const dword cycles, const dword count) {
+	exitStubs.push_back(ExitStub{ em.jmp(), pc, cycles, count });
+}
+
+//Values are always zero extended bytes, so the upper byte of lazyNZ (the separate N bit) is cleared too
+void Recompiler::emit_set_NZ(X64 &em, const X64::Reg src) {
+	em.store16(X64::mem(REG_CPU, offNZ), src);
+}
+
+const dword Recompiler::run_checked(const Block &block) {
+	struct State {
+		MAGSNES::byte a, x, y, sp, p;
+		word pc;
+	};
+
+	const State before = { cpu.regA, cpu.regX, cpu.regY, cpu.regSP, cpu.flagsToP(), cpu.regPC };
+	std::memcpy(snapshotRAM, mainMemory, RAM_SIZE);
+	std::memcpy(snapshotSRAM, mainMemory + SRAM_START, SRAM_SIZE);
+
+	const dword result = block.proc(&cpu);
+	const dword count = (result >> 8) & 0xFF;
+
+	const State native = { cpu.regA, cpu.regX, cpu.regY, cpu.regSP, cpu.flagsToP(), cpu.regPC };
+	std::memcpy(nativeRAM, mainMemory, RAM_SIZE);
+	std::memcpy(nativeSRAM, mainMemory + SRAM_START, SRAM_SIZE);
+
+	//Rewind, and have the interpreter run the same instructions; its results are the ones kept
+	cpu.regA = before.a;
+	cpu.regX = before.x;
+	cpu.regY = before.y;
+	cpu.regSP = before.sp;
+	cpu.pToFlags(before.p);
+	cpu.regPC = before.pc;
+	std::memcpy(mainMemory, snapshotRAM, RAM_SIZE);
+	std::memcpy(mainMemory + SRAM_START, snapshotSRAM, SRAM_SIZE);
+
+	dword interpretedCycles = 0;
+	for (dword i = 0; i < count; i++) {
+		interpretedCycles += cpu.execute(mainMemory[cpu.regPC]);
+	}
+
+	const State interpreted = { cpu.regA, cpu.regX, cpu.regY, cpu.regSP, cpu.flagsToP(), cpu.regPC };
+
+	const bool matches = (native.a == interpreted.a) && (native.x == interpreted.x) && (native.y == interpreted.y) &&
+		(native.sp == interpreted.sp) && (native.p == interpreted.p) && (native.pc == interpreted.pc) &&
+		((result & 0xFF) == interpretedCycles) &&
+		(std::memcmp(nativeRAM, mainMemory, RAM_SIZE) == 0) && (std::memcmp(nativeSRAM, mainMemory + SRAM_START, SRAM_SIZE) == 0);
+
+	if (!matches) {
+		stats.mismatches++;
+
+		char msg[256];
+		sprintf_s(msg, "Recompiled block at $%04X differs from the interpreter after %u instructions: "
+			"native A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X cycles=%u, interpreter A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X cycles=%u",
+			block.startPC, count,
+			native.a, native.x, native.y, native.sp, native.p, native.pc, result & 0xFF,
+			interpreted.a, interpreted.x, interpreted.y, interpreted.sp, interpreted.p, interpreted.pc, interpretedCycles);
+		cpu.sysCore.logerr(msg);
+	}
+
+	return (interpretedCycles & 0xFF) | (count << 8);
+}
+
+#endif
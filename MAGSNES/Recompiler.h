@@ -0,0 +1,154 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "defs.h"
+#include "X64Emitter.h"
+
+namespace MAGSNES {
+
+class CPU;
+
+//Translates straight-line runs of 6502 code (blocks) into x86-64 and runs them in place of the interpreter.
+//A block ends at a branch or JMP, before any instruction the recompiler doesn't handle, or once it could take too many cycles for
+//System::step. Each block returns how many cycles it took, so the rest of the system is simply ticked once per block.
+//Anything that touches $2000-$401F, writes to $8000-$FFFF, or writes over compiled RAM code leaves the block just before that
+//instruction (a side exit), and the interpreter runs it; PPU/APU/mapper registers are therefore only ever seen by the interpreter.
+//Blocks in PRG ROM are cached by (bank, address), so switching a bank back in reuses its blocks. Blocks in RAM are thrown away
+//when something writes to a page they occupy.
+class Recompiler {
+
+	DECLARE_DEBUGGER_ACCESS
+
+public:
+	Recompiler(CPU &refCPU, const bool checkAgainstInterpreter);
+	~Recompiler();
+
+	//Runs the block at the CPU's PC, compiling it first if needed. Returns false if nothing was run (no block can start there, or
+	//the first instruction took a side exit), in which case the interpreter must execute the next instruction.
+	const bool run(byte &cycles);
+
+	//Called when the mapper copies PRG ROM into [startAddr, startAddr + length); prgChunk is the 8KB chunk of PRG ROM it starts at
+	void map_prg(const word startAddr, const dword length, const dword prgChunk);
+
+	//Called when a write lands on a page with compiled code on it (see get_code_pages)
+	void invalidate_page(const byte page);
+
+	//Nonzero for every page of RAM that compiled code was read from; the CPU checks it on each write
+	const byte * get_code_pages() const { return codePages; }
+
+private:
+	static const dword CODE_BUFFER_SIZE = 8 * 1024 * 1024;
+	static const dword MAX_BLOCK_INSTRUCTIONS = 32;
+	//Worst case for one instruction, including its share of the exit stubs
+	static const dword MAX_INSTRUCTION_BYTES = 256;
+	//Most code one block can take, with its prologue, exit stubs and epilogue
+	static const dword MAX_BLOCK_BYTES = (MAX_BLOCK_INSTRUCTIONS * MAX_INSTRUCTION_BYTES) + 256;
+
+	//The PPU and APU only catch up once a block returns, so an NMI or IRQ raised during one is taken that much late. 72 cycles (216 PPU
+	//dots) keeps that under two thirds of a scanline. The hard limit is the byte the cycles are returned in: 248, leaving room for a 7
+	//cycle interrupt.
+	static const dword MAX_BLOCK_CYCLES = 72;
+
+	//Tag for blocks that aren't in PRG ROM
+	static const dword RAM_TAG = 0xFFFFFFFF;
+	static const dword UNMAPPED_TAG = 0xFFFFFFFE;
+
+	//Generated code returns the cycles taken in bits 0-7 and the number of instructions run in bits 8-15
+	typedef dword(*BlockProc)(CPU *);
+
+	struct Block {
+		BlockProc proc;		//nullptr when no block can start at startPC
+		word startPC, endPC;
+	};
+
+	//Where a side exit or block exit leaves the CPU
+	struct ExitStub {
+		byte *rel32;
+		word pc;
+		dword cycles, count;
+	};
+
+	//Result of the address part of an instruction; for dynamic addresses the effective address is in ecx
+	struct Operand {
+		bool isImmediate, isStatic;
+		word value;
+	};
+
+	//What each opcode does, from the CPU's opcodeVector; OP_NONE for anything not compiled
+	enum OpKind {
+		OP_NONE,
+		OP_LDA, OP_LDX, OP_LDY, OP_STA, OP_STX, OP_STY,
+		OP_ADC, OP_SBC, OP_AND, OP_ORA, OP_EOR, OP_CMP, OP_CPX, OP_CPY, OP_BIT,
+		OP_INC, OP_DEC, OP_ASL, OP_LSR, OP_ROL, OP_ROR,
+		OP_INX, OP_INY, OP_DEX, OP_DEY,
+		OP_TAX, OP_TAY, OP_TXA, OP_TYA, OP_TSX, OP_TXS,
+		OP_CLC, OP_SEC, OP_CLD, OP_SED, OP_CLI, OP_SEI, OP_CLV, OP_NOP,
+		OP_PHA, OP_PLA,
+		OP_BCC, OP_BCS, OP_BEQ, OP_BNE, OP_BMI, OP_BPL, OP_BVC, OP_BVS,
+		OP_JMP
+	};
+
+	enum EmitResult {
+		EMIT_OK,
+		EMIT_REJECTED,		//Nothing emitted; the block ends before this instruction
+		EMIT_TERMINATED		//The instruction ended the block
+	};
+
+	CPU &cpu;
+	byte * const mainMemory;
+
+	byte opKind[0x100];
+
+	//Offsets of the CPU members the generated code uses, relative to the CPU pointer it is given
+	int offA, offX, offY, offSP, offPC, offNZ, offV, offC, offD, offI;
+
+	byte *codeBuffer, *codeCursor;
+
+	//Blocks for whatever is mapped in right now, indexed by PC; filled in from allBlocks as PCs are reached
+	Block **blockAt;
+	//Every block compiled, keyed by (tag << 16) | startPC
+	std::unordered_map<qword, Block *> allBlocks;
+	std::vector<Block *> ramBlocks;
+
+	dword slotTags[4];		//One for each 8KB slot of $8000-$FFFF
+	byte codePages[0x100];
+
+	//Exits of the block being compiled
+	std::vector<ExitStub> exitStubs;
+
+	//Differential mode: every block is rerun on the interpreter from the same starting state and the results compared
+	bool checkAgainstInterpreter;
+	byte *snapshotRAM, *snapshotSRAM, *nativeRAM, *nativeSRAM;
+
+	struct Stats {
+		qword blocksCompiled, blocksRun, instructionsRun, interpreterFallbacks, flushes, mismatches;
+	} stats;
+
+	//Discards every block; used when the code buffer fills up
+	void flush();
+
+	//The code buffer is never writable and executable at once: it is executable (and read only) except while a block is being
+	//emitted, when the MAX_BLOCK_BYTES from start are writable instead. Returns false if the protection couldn't be changed.
+	const bool protect_code(byte * const start, const bool isWritable);
+
+	const dword get_tag(const word pc) const;
+	Block * find_or_compile(const word pc);
+	Block * compile(const word startPC);
+	//One past the last address a block starting at pc may cover, or 0 if no block can start there
+	const dword get_region_end(const word pc) const;
+	void mark_code_pages(const Block &block);
+
+	EmitResult emit_instruction(X64Emitter &em, const byte opcode, const word pc, const dword cycles, const dword count);
+	const bool emit_operand(X64Emitter &em, const byte addrMode, const word pc, const bool isWrite, const dword cycles, const dword count, Operand &op);
+	void emit_load(X64Emitter &em, const Operand &op);
+	void emit_store(X64Emitter &em, const Operand &op, const X64Emitter::Reg src);
+	void emit_side_exit(X64Emitter &em, const X64Emitter::Cond cond, const word pc, const dword cycles, const dword count);
+	void emit_exit(X64Emitter &em, const word pc, const dword cycles, const dword count);
+	void emit_set_NZ(X64Emitter &em, const X64Emitter::Reg src);
+
+	const dword run_checked(const Block &block);
+};
+
+} /* namespace MAGSNES */
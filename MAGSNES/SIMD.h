@@ -0,0 +1,71 @@
+#pragma once
+
+#include <intrin.h>		//__cpuid
+#include <immintrin.h>	//SSE2 through AVX2 intrinsics
+
+#include "defs.h"
+
+//Declares a variable aligned for 256 bit loads/stores
+#define ALIGN32						__declspec(align(32))
+
+namespace MAGSNES {
+
+//Runtime detection of the instruction sets used by the vectorized kernels. MSVC lets us emit any intrinsic regardless of /arch,
+//so each kernel checks these before running and falls back to scalar code otherwise.
+class SIMD {
+public:
+	__CLASSMETHOD__ const bool has_sse2() {
+		return get_features().sse2;
+	}
+
+	__CLASSMETHOD__ const bool has_ssse3() {
+		return get_features().ssse3;
+	}
+
+	__CLASSMETHOD__ const bool has_avx() {
+		return get_features().avx;
+	}
+
+	__CLASSMETHOD__ const bool has_avx2() {
+		return get_features().avx2;
+	}
+
+private:
+	struct Features {
+		bool sse2, ssse3, avx, avx2;
+	};
+
+	//Only queried once; the result is cached in a function-level static
+	__CLASSMETHOD__ const Features &get_features() {
+		static const Features features = query_features();
+		return features;
+	}
+
+	__CLASSMETHOD__ Features query_features() {
+		Features result = { false, false, false, false };
+		int info[4];
+
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		if (maxLeaf >= 1) {
+			__cpuid(info, 1);
+			result.sse2 = (info[3] & (1 << 26)) ? true : false;
+			result.ssse3 = (info[2] & (1 << 9)) ? true : false;
+
+			//AVX needs both CPU support AND the OS saving the YMM registers on a context switch (OSXSAVE + XCR0 bits 1 and 2)
+			const bool osSavesYMM = ((info[2] & (1 << 27)) && (info[2] & (1 << 28))) ? ((_xgetbv(0) & 0x06) == 0x06) : false;
+
+			result.avx = osSavesYMM;
+
+			if (osSavesYMM && (maxLeaf >= 7)) {
+				__cpuidex(info, 7, 0);
+				result.avx2 = (info[1] & (1 << 5)) ? true : false;
+			}
+		}
+
+		return result;
+	}
+};
+
+} /* namespace MAGSNES */
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Bounded, lock-free queue for exactly one producer thread and one consumer thread.
+//Slots are allocated up front and filled in place, so large items (i.e. whole frames) are only copied once: the producer asks for a
+//slot with begin_push, fills it, then publishes it with end_push. The consumer reads from front and releases the slot with pop.
+//Neither side ever blocks; begin_push returns nullptr when the queue is full and front returns nullptr when it is empty.
+template <typename T, dword CAPACITY>
+class SPSCQueue {
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SPSCQueue capacity must be a power of 2");
+
+public:
+	SPSCQueue()
+		: slots(new T[CAPACITY]), head(0), tail(0) {}
+
+	~SPSCQueue() {
+		delete[] slots;
+	}
+
+	//*****Producer side*****
+
+	T * begin_push() {
+		const dword currentTail = tail.load(std::memory_order_relaxed);
+
+		if ((currentTail - head.load(std::memory_order_acquire)) == CAPACITY) {
+			return nullptr;
+		}
+
+		return &slots[currentTail & (CAPACITY - 1)];
+	}
+
+	void end_push() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//*****Consumer side*****
+
+	T * front() {
+		const dword currentHead = head.load(std::memory_order_relaxed);
+
+		if (currentHead == tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+
+		return &slots[currentHead & (CAPACITY - 1)];
+	}
+
+	void pop() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//Items waiting; the producer may add more at any moment, but never fewer
+	const dword size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+	}
+
+	//Only safe while neither side is using the queue
+	void reset() {
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	T *slots;
+
+	//Kept on separate cache lines so the producer and consumer don't keep stealing the line from each other
+	alignas(64) std::atomic<dword> head;
+	alignas(64) std::atomic<dword> tail;
+};
+
+} /* namespace MAGSNES */
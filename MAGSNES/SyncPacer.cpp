@@ -0,0 +1,261 @@
+#include "SyncPacer.h"
+
+#include "Core.h"
+
+#include <cmath>
+#include <cstring>
+
+__FILESCOPE__{
+	//Largest change the audio thread makes to its rate, either way; 0.5% of pitch is too little to hear
+	const float MAX_RATE_ADJUSTMENT = 0.005f;
+
+	//Share of the way to the ratio the current lead asks for that is taken at each audio wake-up, so one slow slice doesn't wobble the pitch
+	const float RATE_SMOOTHING = 0.25f;
+
+	//How long the exec thread sleeps before checking the clock again, if nothing wakes it sooner
+	const DWORD WAIT_TIMEOUT_MILLISECONDS = 1;
+}
+
+using namespace MAGSNES;
+
+SyncPacer::SyncPacer()
+	: clockEvent(CreateEventW(NULL, FALSE, FALSE, NULL)), audioClockRemainder(0) {
+
+	policy.store(Policy::TIMER, std::memory_order_relaxed);
+	isActive.store(false, std::memory_order_relaxed);
+	emulatedCycles.store(0, std::memory_order_relaxed);
+	audioClockCycles.store(0, std::memory_order_relaxed);
+	vblankCount.store(0, std::memory_order_relaxed);
+	rateRatio.store(1.0f, std::memory_order_relaxed);
+	audioUnderruns.store(0, std::memory_order_relaxed);
+	isAudioStopped.store(false, std::memory_order_relaxed);
+
+	QueryPerformanceCounter(&wallStart);
+	std::memset(&stats, 0, sizeof(DriftStats));
+}
+
+SyncPacer::~SyncPacer() {
+	CloseHandle(clockEvent);
+}
+
+const char * SyncPacer::get_policy_name(const Policy policy) {
+	switch (policy) {
+	case Policy::TIMER:
+		return "timer";
+	case Policy::AUDIO:
+		return "audio";
+	case Policy::VSYNC:
+		return "vsync";
+	case Policy::FREE_RUN:
+		return "free run";
+	default:
+		return "unknown";
+	}
+}
+
+const qword SyncPacer::get_clock_cycles() const {
+	switch (get_policy()) {
+	case Policy::AUDIO:
+		return audioClockCycles.load(std::memory_order_acquire);
+	case Policy::VSYNC:
+		return vblankCount.load(std::memory_order_acquire) * CPU_CYCLES_PER_FRAME;
+	default: {
+		Core &sysCore = Core::get_sys_core();
+		LARGE_INTEGER now, elapsed, start = wallStart;
+
+		QueryPerformanceCounter(&now);
+		sysCore.get_elapsed_microseconds(start, now, elapsed);
+
+		return ((qword)elapsed.QuadPart * CPU_CYCLES_PER_SECOND) / MICROSECONDS_PER_SECOND;
+	}
+	}
+}
+
+void SyncPacer::begin(const Policy newPolicy) {
+	policy.store(newPolicy, std::memory_order_relaxed);
+
+	QueryPerformanceCounter(&wallStart);
+	std::memset(&stats, 0, sizeof(DriftStats));
+	stats.startVblanks = vblankCount.load(std::memory_order_relaxed);
+	stats.startUnderruns = audioUnderruns.load(std::memory_order_relaxed);
+	stats.minRatio = stats.maxRatio = 1.0f;
+
+	emulatedCycles.store(get_clock_cycles(), std::memory_order_relaxed);
+	isActive.store(true, std::memory_order_release);
+}
+
+void SyncPacer::resync() {
+	emulatedCycles.store(get_clock_cycles(), std::memory_order_relaxed);
+	stats.resyncs++;
+}
+
+void SyncPacer::fall_back_to_timer() {
+	Core &sysCore = Core::get_sys_core();
+
+	policy.store(Policy::TIMER, std::memory_order_relaxed);
+	resync();
+
+	sysCore.logmsg("Sync: the audio clock stopped moving; following the timer instead");
+	PostMessage(sysCore.get_main_window(), WM_COMMAND, IDM_MENU_OPTIONS_SYNC_TIMER, NULL);
+}
+
+const dword SyncPacer::pace(const dword cyclesRun) {
+	Core &sysCore = Core::get_sys_core();
+
+	//No audio device to follow (it failed to start, or stopped)
+	if ((get_policy() == Policy::AUDIO) && isAudioStopped.load(std::memory_order_acquire)) {
+		fall_back_to_timer();
+	}
+
+	const Policy current = get_policy();
+	const qword emulated = emulatedCycles.load(std::memory_order_relaxed) + cyclesRun;
+
+	emulatedCycles.store(emulated, std::memory_order_relaxed);
+	stats.cyclesRun += cyclesRun;
+
+	//How far past the clock emulation may get before it has to wait
+	qword allowance = 0;
+	if (current == Policy::AUDIO) {
+		allowance = TARGET_AUDIO_LEAD_CYCLES;
+	} else if (current == Policy::VSYNC) {
+		allowance = CPU_CYCLES_PER_FRAME;
+	}
+
+	LARGE_INTEGER waitStart, now, waited;
+	QueryPerformanceCounter(&waitStart);
+	waited.QuadPart = 0;
+
+	if (current != Policy::FREE_RUN) {
+		while (emulated > (get_clock_cycles() + allowance)) {
+			if (current != Policy::TIMER) {
+				WaitForSingleObject(clockEvent, WAIT_TIMEOUT_MILLISECONDS);
+			}
+
+			QueryPerformanceCounter(&now);
+			sysCore.get_elapsed_microseconds(waitStart, now, waited);
+
+			//Whatever drives the clock has stopped; stop waiting for it. The audio thread only stops giving audio to the device when
+			//it is in trouble, so rather than stalling like this every slice, the timer takes over.
+			const bool isAudioGone = (current == Policy::AUDIO) && isAudioStopped.load(std::memory_order_acquire);
+			if (isAudioGone || (waited.QuadPart > MAX_DRIFT_MICROSECONDS)) {
+				if (current == Policy::AUDIO) {
+					fall_back_to_timer();
+				} else {
+					resync();
+				}
+				break;
+			}
+		}
+	}
+
+	const double drift = cycles_to_microseconds((double)(long long)(emulatedCycles.load(std::memory_order_relaxed) - get_clock_cycles()));
+
+	stats.samples++;
+	stats.sumMicroseconds += drift;
+	stats.sumAbsMicroseconds += std::fabs(drift);
+	if ((stats.samples == 1) || (drift < stats.minMicroseconds)) {
+		stats.minMicroseconds = drift;
+	}
+	if ((stats.samples == 1) || (drift > stats.maxMicroseconds)) {
+		stats.maxMicroseconds = drift;
+	}
+
+	if (current == Policy::AUDIO) {
+		const float ratio = rateRatio.load(std::memory_order_relaxed);
+		stats.minRatio = (ratio < stats.minRatio) ? ratio : stats.minRatio;
+		stats.maxRatio = (ratio > stats.maxRatio) ? ratio : stats.maxRatio;
+	}
+
+	//Fallen too far behind (paused, or the host can't keep up) to catch up without a noticeable burst of speed. Free running has no
+	//real time to keep up with.
+	if ((current != Policy::FREE_RUN) && (drift < -(double)MAX_DRIFT_MICROSECONDS)) {
+		resync();
+	}
+
+	return (dword)waited.QuadPart;
+}
+
+void SyncPacer::end() {
+	Core &sysCore = Core::get_sys_core();
+	const Policy current = get_policy();
+
+	isActive.store(false, std::memory_order_relaxed);
+
+	if (stats.samples == 0) {
+		return;
+	}
+
+	LARGE_INTEGER now, wallElapsed;
+	QueryPerformanceCounter(&now);
+	sysCore.get_elapsed_microseconds(wallStart, now, wallElapsed);
+
+	char statsMsg[192];
+	sprintf_s(statsMsg, "Sync (%s): drift avg %+.2f ms (avg magnitude %.2f ms), min %+.2f ms, max %+.2f ms over %llu slices; %llu resyncs",
+		get_policy_name(current), (stats.sumMicroseconds / stats.samples) / 1000.0, (stats.sumAbsMicroseconds / stats.samples) / 1000.0,
+		stats.minMicroseconds / 1000.0, stats.maxMicroseconds / 1000.0, stats.samples, stats.resyncs);
+	sysCore.logmsg(statsMsg);
+
+	if (wallElapsed.QuadPart > 0) {
+		sprintf_s(statsMsg, "Sync (%s): emulated at %.2f%% of real time", get_policy_name(current),
+			(100.0 * cycles_to_microseconds((double)stats.cyclesRun)) / wallElapsed.QuadPart);
+		sysCore.logmsg(statsMsg);
+	}
+
+	if (current == Policy::AUDIO) {
+		sprintf_s(statsMsg, "Audio rate control: ratio %.4f - %.4f, %llu underruns", stats.minRatio, stats.maxRatio,
+			audioUnderruns.load(std::memory_order_relaxed) - stats.startUnderruns);
+		sysCore.logmsg(statsMsg);
+	} else if ((current == Policy::VSYNC) && (wallElapsed.QuadPart > 0)) {
+		const qword refreshes = vblankCount.load(std::memory_order_relaxed) - stats.startVblanks;
+		sprintf_s(statsMsg, "Vsync: %llu refreshes, %.3f Hz", refreshes, ((double)refreshes * MICROSECONDS_PER_SECOND) / wallElapsed.QuadPart);
+		sysCore.logmsg(statsMsg);
+	}
+}
+
+const float SyncPacer::advance_audio_clock(const dword frameCount, const dword sampleRate) {
+	float ratio = 1.0f;
+
+	if (isActive.load(std::memory_order_acquire) && (get_policy() == Policy::AUDIO)) {
+		const long long lead = (long long)(emulatedCycles.load(std::memory_order_relaxed) - audioClockCycles.load(std::memory_order_relaxed));
+
+		if (lead < 0) {
+			audioUnderruns.store(audioUnderruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		//Ahead of the target lead means the device is using up emulated time too slowly, so speed up a little, and vice versa
+		float error = (float)(lead - (long long)TARGET_AUDIO_LEAD_CYCLES) / TARGET_AUDIO_LEAD_CYCLES;
+		error = (error > 1.0f) ? 1.0f : ((error < -1.0f) ? -1.0f : error);
+
+		ratio = rateRatio.load(std::memory_order_relaxed);
+		ratio += ((1.0f + (error * MAX_RATE_ADJUSTMENT)) - ratio) * RATE_SMOOTHING;
+	}
+
+	rateRatio.store(ratio, std::memory_order_relaxed);
+
+	const double cycles = audioClockRemainder + (((double)frameCount * ratio * CPU_CYCLES_PER_SECOND) / sampleRate);
+	const qword wholeCycles = (qword)cycles;
+	audioClockRemainder = cycles - wholeCycles;
+
+	//The release pairs with the exec thread's acquire in get_clock_cycles
+	audioClockCycles.store(audioClockCycles.load(std::memory_order_relaxed) + wholeCycles, std::memory_order_release);
+	isAudioStopped.store(false, std::memory_order_relaxed);
+	SetEvent(clockEvent);
+
+	return ratio;
+}
+
+void SyncPacer::stop_audio_clock() {
+	isAudioStopped.store(true, std::memory_order_release);
+
+	//Don't leave the exec thread waiting out the timeout
+	SetEvent(clockEvent);
+}
+
+void SyncPacer::count_audio_underrun() {
+	audioUnderruns.store(audioUnderruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void SyncPacer::signal_vblank() {
+	vblankCount.store(vblankCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	SetEvent(clockEvent);
+}
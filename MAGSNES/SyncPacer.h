@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Decides how fast the exec thread emulates, by following one of several clocks (see Policy). The exec thread calls pace after each
+//slice of emulation, and waits in there for as long as the clock says it is ahead. The audio and video threads drive the clocks they
+//own, and wake the exec thread when they move. Drift (how far emulated time is from the clock being followed) is tracked for every
+//policy and logged when emulation stops.
+class SyncPacer {
+public:
+	enum class Policy {
+		TIMER,		//Busy-wait on the performance counter until real time catches up with emulated time
+		AUDIO,		//Stay a little ahead of the audio the device has been given; the audio thread adjusts its rate to keep that lead steady
+		VSYNC,		//Emulate one frame per display refresh; assumes a ~60Hz display
+		FREE_RUN,	//Never wait
+		POLICY_TOTAL
+	};
+
+	//NTSC 2A03 clock, and the CPU cycles in one NTSC frame (29780.5, rounded up)
+	static const dword CPU_CYCLES_PER_SECOND = 1789773;
+	static const dword CPU_CYCLES_PER_FRAME = 29781;
+
+	SyncPacer();
+	~SyncPacer();
+
+	const Policy get_policy() const { return policy.load(std::memory_order_relaxed); }
+
+	__CLASSMETHOD__ const char * get_policy_name(const Policy policy);
+
+	//*****Exec thread*****
+
+	//Starts following the clock for policy, with emulated time lined up to it
+	void begin(const Policy newPolicy);
+
+	//Accounts for cyclesRun more emulated cycles, and waits until the clock being followed allows the next slice. Returns how long it waited,
+	//in microseconds.
+	const dword pace(const dword cyclesRun);
+
+	//Stops following the clock, and logs the drift statistics
+	void end();
+
+	//*****Audio thread*****
+
+	//Called each time frameCount frames are given to the audio device. Returns the ratio of emulated time to device time they should be
+	//rendered at: 1.0 unless following the audio clock, in which case it is nudged (by at most 0.5%) so the exec thread's lead stays at
+	//TARGET_AUDIO_LEAD_CYCLES, rather than the buffer slowly running dry or filling up.
+	const float advance_audio_clock(const dword frameCount, const dword sampleRate);
+
+	//Called when the audio device can't be set up or stops working. Until audio is given to the device again, the exec thread follows
+	//the timer instead of the audio clock.
+	void stop_audio_clock();
+
+	//Called when a block of audio had to be dropped, so it shows up in the underrun count
+	void count_audio_underrun();
+
+	//*****Video thread*****
+
+	//Called after each buffer swap while following vsync
+	void signal_vblank();
+
+private:
+	//How far ahead of the audio clock the exec thread runs: about one wake-up of the audio thread, so the register values it renders are current
+	static const dword TARGET_AUDIO_LEAD_CYCLES = CPU_CYCLES_PER_FRAME;
+
+	//If the clock hasn't allowed the next slice after this long (the audio device or display stopped, or emulation was paused), or
+	//emulation has fallen this far behind, emulated time is lined up with the clock again rather than waiting or racing to catch up
+	static const dword MAX_DRIFT_MICROSECONDS = 100000;
+
+	//Only changed by the exec thread (begin, or falling back to the timer); the other threads read it to know whether their clock is
+	//being followed
+	std::atomic<Policy> policy;
+	std::atomic<bool> isActive;
+
+	//Set by the audio and video threads whenever their clock moves, so the exec thread can sleep instead of spinning
+	HANDLE clockEvent;
+
+	//Emulated time, in CPU cycles. Only written by the exec thread; the audio thread reads it to work out the lead.
+	std::atomic<qword> emulatedCycles;
+
+	//The clocks of the audio and video threads, each only written by its own thread: audio given to the device in CPU cycles, and
+	//display refreshes
+	std::atomic<qword> audioClockCycles, vblankCount;
+	double audioClockRemainder;		//Fraction of a cycle not yet added to audioClockCycles; audio thread only
+
+	//Rate ratio the audio thread last rendered at, and how often it found the exec thread behind the audio already given to the device or
+	//had to drop a block
+	std::atomic<float> rateRatio;
+	std::atomic<qword> audioUnderruns;
+
+	//Set by stop_audio_clock; cleared once the audio thread moves its clock again
+	std::atomic<bool> isAudioStopped;
+
+	//The wall clock, for the timer and free running policies, and to measure speed
+	LARGE_INTEGER wallStart;
+
+	//Exec thread only. Drift is emulated time minus the clock's time, sampled after every slice.
+	struct DriftStats {
+		qword samples, resyncs;
+		qword cyclesRun;
+		qword startVblanks, startUnderruns;
+		double sumMicroseconds, sumAbsMicroseconds;
+		double minMicroseconds, maxMicroseconds;
+		float minRatio, maxRatio;
+	} stats;
+
+	//The clock the current policy follows, in CPU cycles
+	const qword get_clock_cycles() const;
+
+	const double cycles_to_microseconds(const double cycles) const {
+		return (cycles * MICROSECONDS_PER_SECOND) / CPU_CYCLES_PER_SECOND;
+	}
+
+	//Lines emulated time back up with the clock
+	void resync();
+
+	//Stops following the audio clock, which isn't moving, and follows the timer instead. The Options menu is told too, so the next
+	//ROM starts out on the timer.
+	void fall_back_to_timer();
+};
+
+} /* namespace MAGSNES */
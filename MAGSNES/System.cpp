@@ -24,7 +24,12 @@ System::System(GLManager *pGLM)
 	currentMapper(nullptr),
 	isRunning(false) {
 
-	pCPU->connect_to_ppu(pPPU->expose_ppudatabuffer(), pPPU->expose_ppupalettebaseaddr(), pPPU->expose_ppuaddr());
+	pCPU->connect_to_ppu(pPPU->expose_ppudatabuffer(), pPPU->expose_ppupalettebaseaddr(), pPPU->expose_ppuaddr(),
+		pPPU->expose_pixelcounter(), pPPU->expose_scanlinecounter());
+
+	if (sysCore.cpuRegs.cycleAccurate) {
+		pCPU->connect_clock(&System::clock_peripherals, this);
+	}
 }
 
 System::~System() {
@@ -70,8 +75,8 @@ void System::loadROM(const char * const path) {
 		sysCore.alert_error("Unimplemented or invalid mapper requested");
 	}
 
-	//Load the mirroring type into the PPU
-	pPPU->loadMirroringType(currentROM->get_mirroring_type());
+	//Load the mirroring type into the PPU; four screen VRAM overrides the mirroring bit
+	pPPU->loadMirroringType(currentROM->has_four_screen_vram() ? PPU::MIRROR_FOUR_SCREEN : currentROM->get_mirroring_type());
 
 	/*std::string loadMsg("Opened ROM: ");
 	loadMsg.append(path);
@@ -83,23 +88,27 @@ void System::loadROM(const char * const path) {
 
 //Do one CPU instruction, and 3 PPU cycles for each cycle the CPU takes. Returns the number of CPU cycles.
 const MAGSNES::byte System::step() {
-	//Execute next instruction, then do 3 PPU cycles for every cycle the CPU took
-	MAGSNES::byte ppuCycles = pCPU->execute_next();
+	MAGSNES::byte cpuCycles = pCPU->execute_next();
+
+	//In cycle accurate mode the CPU has already run everything up to its last I/O access
+	const MAGSNES::byte clockedCycles = pCPU->take_clocked_cycles();
+
+	if ((clockedCycles == 0) || (cpuCycles > clockedCycles)) {
+		run_peripherals(cpuCycles - clockedCycles);
+	}
 
+	return cpuCycles;
+}
+
+void System::run_peripherals(const MAGSNES::byte cpuCycles) {
 	//APU knows to do one cycle per CPU cycle (real NES does one APU every 2 CPU cycles, but APU#tick accounts for that)
-	pAPU->tick(ppuCycles);
+	pAPU->tick(cpuCycles);
 
 	//Check for R/W to registers before invoking the PPU
 	pController->tick();
 	currentMapper->monitor();
-	//Only have the PPU check on the first tick of the group
-	pPPU->tick(true);
-	const MAGSNES::byte PPU_LIMIT = ppuCycles * 3;
-	for (MAGSNES::byte ppuCounter = 1; ppuCounter < PPU_LIMIT; ppuCounter++) {
-		pPPU->tick(false);
-	}
-
-	return ppuCycles;
+	//The PPU only checks for R/W on the first tick of the group
+	pPPU->tick_group(cpuCycles * 3);
 }
 
 void System::save_state() {
@@ -54,6 +54,13 @@ namespace MAGSNES {
 
 		bool isRunning;
 
+		//Runs everything but the CPU for some CPU cycles; peripherals check the bus on the first
+		void run_peripherals(const MAGSNES::byte cpuCycles);
+		//CPU::ClockCallback for cycle accurate mode
+		__CLASSMETHOD__ void clock_peripherals(void *context, const MAGSNES::byte cpuCycles) {
+			static_cast<System *>(context)->run_peripherals(cpuCycles);
+		}
+
 	};
 
 } /* namespace NESPP */
\ No newline at end of file
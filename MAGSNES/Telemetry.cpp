@@ -0,0 +1,159 @@
+#include "Telemetry.h"
+
+#include "Core.h"
+
+#include <algorithm>
+#include <vector>
+
+__FILESCOPE__{
+	//Nearest-rank percentile of an already sorted set
+	FORCEINLINE MAGSNES::dword percentile(const std::vector<MAGSNES::dword> &sorted, const MAGSNES::dword pct) {
+		if (sorted.empty()) {
+			return 0;
+		}
+
+		const std::size_t rank = ((sorted.size() * pct) + 99) / 100;
+		return sorted[(rank > 0) ? (rank - 1) : 0];
+	}
+}
+
+using namespace MAGSNES;
+
+Telemetry::Telemetry()
+	: pendingEmulation(0), pendingPacerWait(0), scanlinesComposited(0), scanlinesReused(0) {
+
+	for (int m = 0; m < METRIC_TOTAL; m++) {
+		rings[m].writeCount.store(0, std::memory_order_relaxed);
+
+		for (dword i = 0; i < RING_SIZE; i++) {
+			rings[m].samples[i].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+//No cleanup needed
+Telemetry::~Telemetry() {}
+
+const char * Telemetry::get_metric_name(const Metric metric) {
+	switch (metric) {
+	case METRIC_EMULATION:
+		return "emulation";
+	case METRIC_PACER_WAIT:
+		return "pacer_wait";
+	case METRIC_PRESENT:
+		return "present";
+	case METRIC_AUDIO_QUEUED:
+		return "audio_queued";
+	default:
+		return "unknown";
+	}
+}
+
+void Telemetry::record(const Metric metric, const dword microseconds) {
+	Ring &ring = rings[metric];
+
+	//Only one thread writes each ring, so a plain load/store pair is enough; the release lets readers trust samples below writeCount
+	const dword index = ring.writeCount.load(std::memory_order_relaxed);
+	ring.samples[index % RING_SIZE].store(microseconds, std::memory_order_relaxed);
+	ring.writeCount.store(index + 1, std::memory_order_release);
+}
+
+void Telemetry::add_exec_slice(const dword emulationMicroseconds, const dword pacerWaitMicroseconds) {
+	pendingEmulation += emulationMicroseconds;
+	pendingPacerWait += pacerWaitMicroseconds;
+}
+
+void Telemetry::end_emulated_frame() {
+	record(METRIC_EMULATION, pendingEmulation);
+	record(METRIC_PACER_WAIT, pendingPacerWait);
+	pendingEmulation = pendingPacerWait = 0;
+}
+
+void Telemetry::add_scanlines(const dword composited, const dword reused) {
+	//Only the exec thread adds, so there is no need for a read-modify-write
+	scanlinesComposited.store(scanlinesComposited.load(std::memory_order_relaxed) + composited, std::memory_order_relaxed);
+	scanlinesReused.store(scanlinesReused.load(std::memory_order_relaxed) + reused, std::memory_order_relaxed);
+}
+
+const dword Telemetry::snapshot(const Metric metric, dword * const dst) const {
+	const Ring &ring = rings[metric];
+	const dword written = ring.writeCount.load(std::memory_order_acquire);
+	const dword count = (written < RING_SIZE) ? written : RING_SIZE;
+
+	//The writer may lap the oldest few entries while we copy; for timing data that is an acceptable inaccuracy
+	for (dword i = 0; i < count; i++) {
+		dst[i] = ring.samples[(written - count + i) % RING_SIZE].load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+const Telemetry::Summary Telemetry::summarize(const Metric metric) const {
+	std::vector<dword> samples(RING_SIZE);
+	samples.resize(snapshot(metric, samples.data()));
+	std::sort(samples.begin(), samples.end());
+
+	Summary summary;
+	summary.count = (dword)samples.size();
+	summary.p50 = percentile(samples, 50);
+	summary.p95 = percentile(samples, 95);
+	summary.p99 = percentile(samples, 99);
+	summary.max = samples.empty() ? 0 : samples.back();
+
+	return summary;
+}
+
+const bool Telemetry::dump(const char * const path) const {
+	Core &sysCore = Core::get_sys_core();
+	char line[160];
+
+	sysCore.logmsg("Frame timings (microseconds):");
+	sysCore.logmsg("metric            count      p50      p95      p99      max");
+
+	for (int m = 0; m < METRIC_TOTAL; m++) {
+		const Summary summary = summarize((Metric)m);
+		sprintf_s(line, "%-14s %8u %8u %8u %8u %8u", get_metric_name((Metric)m), summary.count, summary.p50, summary.p95, summary.p99, summary.max);
+		sysCore.logmsg(line);
+	}
+
+	const qword composited = scanlinesComposited.load(std::memory_order_relaxed), reused = scanlinesReused.load(std::memory_order_relaxed);
+	sprintf_s(line, "Scanlines: %llu composited, %llu reused from the previous frame (%.2f%% skipped)", composited, reused,
+		(composited + reused) ? (100.0 * reused) / (composited + reused) : 0.0);
+	sysCore.logmsg(line);
+
+	std::FILE *file;
+	if (fopen_s(&file, path, "w") != 0) {
+		sysCore.logerr("Unable to open the telemetry file");
+		return false;
+	}
+
+	std::vector<dword> samples(RING_SIZE);
+
+	std::fprintf(file, "{\n\t\"units\": \"microseconds\",\n");
+	std::fprintf(file, "\t\"scanlines\": { \"composited\": %llu, \"reused\": %llu },\n", composited, reused);
+	std::fprintf(file, "\t\"metrics\": {\n");
+
+	for (int m = 0; m < METRIC_TOTAL; m++) {
+		const Summary summary = summarize((Metric)m);
+		const dword count = snapshot((Metric)m, samples.data());
+
+		std::fprintf(file, "\t\t\"%s\": {\n", get_metric_name((Metric)m));
+		std::fprintf(file, "\t\t\t\"count\": %u, \"p50\": %u, \"p95\": %u, \"p99\": %u, \"max\": %u,\n",
+			summary.count, summary.p50, summary.p95, summary.p99, summary.max);
+
+		//Oldest first, so stutter can be lined up across metrics
+		std::fprintf(file, "\t\t\t\"samples\": [");
+		for (dword i = 0; i < count; i++) {
+			std::fprintf(file, (i == 0) ? "%u" : ", %u", samples[i]);
+		}
+		std::fprintf(file, "]\n\t\t}%s\n", (m < (METRIC_TOTAL - 1)) ? "," : "");
+	}
+
+	std::fprintf(file, "\t}\n}\n");
+	std::fclose(file);
+
+	sprintf_s(line, "Frame timings written to %s", path);
+	sysCore.logmsg(line);
+
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Per-frame timing samples from each thread, for diagnosing stutter. Every metric has its own ring, written by exactly one thread
+//(see Metric) without locks; once a ring is full the oldest samples are overwritten. Any thread may summarize or dump them.
+class Telemetry {
+public:
+	enum Metric {
+		METRIC_EMULATION,		//Exec thread: time spent in System::step for one emulated frame
+		METRIC_PACER_WAIT,		//Exec thread: time blocked in SyncPacer::pace, under whichever sync policy is active, for one emulated frame
+		METRIC_PRESENT,			//Video thread: time spent in GLManager::update_screen
+		METRIC_AUDIO_QUEUED,	//Audio thread: audio left in the WASAPI buffer when the audio thread wakes; near 0 means starvation
+		METRIC_TOTAL
+	};
+
+	struct Summary {
+		dword count;
+		dword p50, p95, p99, max;
+	};
+
+	Telemetry();
+	~Telemetry();
+
+	//All values are in microseconds
+	void record(const Metric metric, const dword microseconds);
+
+	//The exec thread paces itself after each slice of emulation, and slices don't line up with frames; they are accumulated here
+	//and recorded as a single sample when the PPU finishes a frame. Both must only be called from the exec thread.
+	void add_exec_slice(const dword emulationMicroseconds, const dword pacerWaitMicroseconds);
+	void end_emulated_frame();
+
+	//Called by the PPU for each frame it draws: how many scanlines were composited, and how many were kept from an earlier frame because
+	//nothing they are drawn from changed. Only the totals are kept.
+	void add_scanlines(const dword composited, const dword reused);
+
+	const Summary summarize(const Metric metric) const;
+
+	//Logs a p50/p95/p99 table and writes the summaries plus raw samples to path as JSON
+	const bool dump(const char * const path) const;
+
+	__CLASSMETHOD__ const char * get_metric_name(const Metric metric);
+
+private:
+	static const dword RING_SIZE = 4096;		//~68 seconds at 60 samples per second
+
+	struct Ring {
+		std::atomic<dword> writeCount;
+		std::atomic<dword> samples[RING_SIZE];
+	};
+
+	Ring rings[METRIC_TOTAL];
+
+	dword pendingEmulation, pendingPacerWait;
+
+	std::atomic<qword> scanlinesComposited, scanlinesReused;
+
+	//Copies the newest samples (up to RING_SIZE) into dst, returning how many were copied
+	const dword snapshot(const Metric metric, dword * const dst) const;
+};
+
+} /* namespace MAGSNES */
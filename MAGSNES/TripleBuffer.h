@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Lock-free exchange of whole items (i.e. frames) from exactly one producer thread to exactly one consumer thread, which always gets the
+//newest one. Each side owns one of the 3 slots outright; the third is handed back and forth with a single atomic exchange. The producer
+//fills get_back, then publish swaps it in as the newest item. The consumer calls take to swap that in as get_front, and reads it for as
+//long as it likes. Neither side ever waits: an item published before the last one was taken is dropped, and a consumer that finds nothing
+//new keeps its current item.
+template <typename T>
+class TripleBuffer {
+public:
+	static const int SLOT_COUNT = 3;
+
+	TripleBuffer()
+		: slots(new T[SLOT_COUNT]), back(0), published(1), front(2), droppedCount(0), repeatedCount(0) {
+
+		//The slot in the middle holds nothing new to start with
+		middle.store(1, std::memory_order_relaxed);
+	}
+
+	~TripleBuffer() {
+		delete[] slots;
+	}
+
+	//*****Producer side*****
+
+	T & get_back() {
+		return slots[back];
+	}
+
+	//The item most recently published. Only the consumer ever reads it in the meantime, so it stays as it is until the next publish.
+	const T & get_published() const {
+		return slots[published];
+	}
+
+	void publish() {
+		//The release hands over everything written to the back slot; the acquire makes sure the consumer is done reading the one we get
+		const byte previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+
+		if (previous & FRESH) {
+			droppedCount.store(droppedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		published = back;
+		back = previous & INDEX_MASK;
+	}
+
+	//*****Consumer side*****
+
+	//Makes the newest published item the front one, returning false if nothing was published since the last take
+	const bool take() {
+		//Only the consumer clears FRESH, so once it is seen it will still be set by the exchange
+		if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+
+		const byte previous = middle.exchange(front, std::memory_order_acq_rel);
+		front = previous & INDEX_MASK;
+
+		return true;
+	}
+
+	const T & get_front() const {
+		return slots[front];
+	}
+
+	//For when the consumer was due an item but nothing new was published, so it had to show the front one again
+	void count_repeat() {
+		repeatedCount.store(repeatedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	//*****Either side*****
+
+	//Items that were replaced before the consumer took them, and times the consumer had to reuse its item
+	const qword get_dropped_count() const { return droppedCount.load(std::memory_order_relaxed); }
+	const qword get_repeated_count() const { return repeatedCount.load(std::memory_order_relaxed); }
+
+	//For setting up every slot the same way; only safe while neither side is using them
+	T & get_slot(const int index) { return slots[index]; }
+
+private:
+	static const byte INDEX_MASK = 0x03;
+	static const byte FRESH = 0x04; //Set in middle when it holds an item the consumer hasn't taken
+
+	T *slots;
+
+	//Each only touched by its own side
+	byte back, published;
+	byte front;
+
+	alignas(64) std::atomic<byte> middle;
+
+	//Each only written by one side
+	std::atomic<qword> droppedCount, repeatedCount;
+};
+
+} /* namespace MAGSNES */
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "defs.h"
+
+namespace MAGSNES {
+
+//Writes x86-64 machine code into a caller-owned buffer. Only the handful of instruction forms the Recompiler needs are here;
+//every memory operand is [base + index + disp32] so there is a single encoding path.
+//Callers check has_room() before each instruction group, since emitting past the end of the buffer is not checked.
+class X64Emitter {
+public:
+	enum Reg {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+		NO_REG
+	};
+
+	//Low nibble of the Jcc/SETcc opcodes
+	enum Cond {
+		COND_B = 0x2,		//Unsigned <, or carry set
+		COND_AE = 0x3,	//Unsigned >=, or carry clear
+		COND_E = 0x4,
+		COND_NE = 0x5,
+		COND_A = 0x7,		//Unsigned >
+		COND_NS = 0x9
+	};
+
+	//ALU operations for alu() and alu_imm(); the value is the reg-reg opcode, and alu_imm_ext gives the /digit for the imm form
+	enum AluOp {
+		ALU_ADD = 0x01,
+		ALU_OR = 0x09,
+		ALU_AND = 0x21,
+		ALU_SUB = 0x29,
+		ALU_XOR = 0x31,
+		ALU_CMP = 0x39
+	};
+
+	struct Mem {
+		Reg base, index;
+		int disp;
+	};
+
+	__CLASSMETHOD__ Mem mem(const Reg base, const int disp) { return Mem{ base, NO_REG, disp }; }
+	__CLASSMETHOD__ Mem mem(const Reg base, const Reg index, const int disp) { return Mem{ base, index, disp }; }
+
+	X64Emitter(byte * const start, byte * const end)
+		: cursor(start), limit(end) {}
+
+	byte * get_cursor() const { return cursor; }
+	const bool has_room(const dword bytes) const { return (cursor + bytes) <= limit; }
+
+	//*****Register forms (32 bit unless noted)*****
+
+	void mov(const Reg dst, const Reg src) { rex_rr(false, src, dst); emit8(0x89); modrm_rr(src, dst); }
+	void mov64(const Reg dst, const Reg src) { rex_rr(true, src, dst); emit8(0x89); modrm_rr(src, dst); }
+	void alu(const AluOp op, const Reg dst, const Reg src) { rex_rr(false, src, dst); emit8(op); modrm_rr(src, dst); }
+
+	void alu_imm(const AluOp op, const Reg dst, const int imm) {
+		rex_rr(false, RAX, dst);
+		emit8(0x81);
+		modrm_rr((Reg)alu_imm_ext(op), dst);
+		emit32(imm);
+	}
+
+	void mov_imm(const Reg dst, const dword imm) { rex_rr(false, RAX, dst); emit8(0xB8 + (dst & 7)); emit32(imm); }
+	void mov_imm64(const Reg dst, const qword imm) { rex_rr(true, RAX, dst); emit8(0xB8 + (dst & 7)); emit32((dword)imm); emit32((dword)(imm >> 32)); }
+
+	void shl(const Reg dst, const byte count) { rex_rr(false, RAX, dst); emit8(0xC1); modrm_rr((Reg)4, dst); emit8(count); }
+	void shr(const Reg dst, const byte count) { rex_rr(false, RAX, dst); emit8(0xC1); modrm_rr((Reg)5, dst); emit8(count); }
+	void not_(const Reg dst) { rex_rr(false, RAX, dst); emit8(0xF7); modrm_rr((Reg)2, dst); }
+
+	void push(const Reg reg) { if (reg & 8) { emit8(0x41); } emit8(0x50 + (reg & 7)); }
+	void pop(const Reg reg) { if (reg & 8) { emit8(0x41); } emit8(0x58 + (reg & 7)); }
+	void ret() { emit8(0xC3); }
+
+	//*****Memory forms*****
+
+	void movzx8(const Reg dst, const Mem &src) { rex_mem(false, false, dst, src); emit8(0x0F); emit8(0xB6); modrm_mem(dst, src); }
+	void store8(const Mem &dst, const Reg src) { rex_mem(false, true, src, dst); emit8(0x88); modrm_mem(src, dst); }
+	void store8_imm(const Mem &dst, const byte imm) { rex_mem(false, false, RAX, dst); emit8(0xC6); modrm_mem(RAX, dst); emit8(imm); }
+	void store16(const Mem &dst, const Reg src) { emit8(0x66); rex_mem(false, false, src, dst); emit8(0x89); modrm_mem(src, dst); }
+	void store16_imm(const Mem &dst, const word imm) { emit8(0x66); rex_mem(false, false, RAX, dst); emit8(0xC7); modrm_mem(RAX, dst); emit16(imm); }
+	void cmp8_imm(const Mem &dst, const byte imm) { rex_mem(false, false, RAX, dst); emit8(0x80); modrm_mem((Reg)7, dst); emit8(imm); }
+	void test8_imm(const Mem &dst, const byte imm) { rex_mem(false, false, RAX, dst); emit8(0xF6); modrm_mem(RAX, dst); emit8(imm); }
+	void test16_imm(const Mem &dst, const word imm) { emit8(0x66); rex_mem(false, false, RAX, dst); emit8(0xF7); modrm_mem(RAX, dst); emit16(imm); }
+	void setcc(const Cond cond, const Mem &dst) { rex_mem(false, false, RAX, dst); emit8(0x0F); emit8(0x90 + cond); modrm_mem(RAX, dst); }
+
+	//*****Control flow*****
+
+	//Both return the location of the rel32 so it can be pointed somewhere with patch()
+	byte * jcc(const Cond cond) { emit8(0x0F); emit8(0x80 + cond); emit32(0); return cursor - 4; }
+	byte * jmp() { emit8(0xE9); emit32(0); return cursor - 4; }
+
+	__CLASSMETHOD__ void patch(byte * const rel32, const byte * const target) {
+		const int offset = (int)(target - (rel32 + 4));
+		rel32[0] = offset & 0xFF;
+		rel32[1] = (offset >> 8) & 0xFF;
+		rel32[2] = (offset >> 16) & 0xFF;
+		rel32[3] = (offset >> 24) & 0xFF;
+	}
+
+private:
+	byte *cursor, *limit;
+
+	FORCEINLINE void emit8(const byte val) { *cursor++ = val; }
+	FORCEINLINE void emit16(const word val) { emit8(val & 0xFF); emit8(val >> 8); }
+	FORCEINLINE void emit32(const dword val) { emit16(val & 0xFFFF); emit16(val >> 16); }
+
+	__CLASSMETHOD__ byte alu_imm_ext(const AluOp op) {
+		switch (op) {
+		case ALU_ADD:
+			return 0;
+		case ALU_OR:
+			return 1;
+		case ALU_AND:
+			return 4;
+		case ALU_SUB:
+			return 5;
+		case ALU_XOR:
+			return 6;
+		default:
+			return 7; //ALU_CMP
+		}
+	}
+
+	void rex_rr(const bool wide, const Reg reg, const Reg rm) {
+		const byte rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+		if (rex != 0x40) {
+			emit8(rex);
+		}
+	}
+
+	//byteReg forces a REX prefix so that registers 4-7 mean spl/bpl/sil/dil rather than ah/ch/dh/bh
+	void rex_mem(const bool wide, const bool byteReg, const Reg reg, const Mem &m) {
+		const byte rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) |
+			(((m.index != NO_REG) && (m.index & 8)) ? 0x02 : 0) | ((m.base & 8) ? 0x01 : 0);
+		if ((rex != 0x40) || (byteReg && ((reg & 7) >= 4))) {
+			emit8(rex);
+		}
+	}
+
+	void modrm_rr(const Reg reg, const Reg rm) {
+		emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	//Always mod 10 (disp32). rsp/r12 as a base, or any index, needs a SIB byte.
+	void modrm_mem(const Reg reg, const Mem &m) {
+		if ((m.index == NO_REG) && ((m.base & 7) != 4)) {
+			emit8(0x80 | ((reg & 7) << 3) | (m.base & 7));
+		} else {
+			emit8(0x80 | ((reg & 7) << 3) | 4);
+			emit8((((m.index == NO_REG) ? 4 : m.index) & 7) << 3 | (m.base & 7));
+		}
+		emit32(m.disp);
+	}
+};
+
+} /* namespace MAGSNES */
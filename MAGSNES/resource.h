@@ -25,9 +25,25 @@
 
 #define IDM_MENU_EMULATION_PAUSE	200
 #define IDM_MENU_EMULATION_RESUME	201
+#define IDM_MENU_EMULATION_RECORD_START	202
+#define IDM_MENU_EMULATION_RECORD_STOP	203
+#define IDM_MENU_EMULATION_DUMP_TIMINGS	204
+#define IDM_MENU_EMULATION_DUMP_TRACE	205
 
 #define IDM_MENU_OPTIONS_VIDEO		300
 #define IDM_MENU_OPTIONS_AUDIO		301
 #define IDM_MENU_OPTIONS_CONTROLS	302
+#define IDM_MENU_OPTIONS_CPU_RECOMPILER	310
+#define IDM_MENU_OPTIONS_CPU_CHECK_RECOMPILER	311
+#define IDM_MENU_OPTIONS_CPU_CYCLE_ACCURATE	312
+#define IDM_MENU_OPTIONS_CPU_TRACE	313
+#define IDM_MENU_OPTIONS_SYNC_TIMER	320
+#define IDM_MENU_OPTIONS_SYNC_AUDIO	321
+#define IDM_MENU_OPTIONS_SYNC_VSYNC	322
+#define IDM_MENU_OPTIONS_SYNC_FREE_RUN	323
+#define IDM_MENU_OPTIONS_FRAMESKIP_0	330
+#define IDM_MENU_OPTIONS_FRAMESKIP_1	331
+#define IDM_MENU_OPTIONS_FRAMESKIP_2	332
+#define IDM_MENU_OPTIONS_FRAMESKIP_3	333
 
 #define IDM_MENU_ABOUT		400
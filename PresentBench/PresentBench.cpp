@@ -0,0 +1,222 @@
+//Measures how long presenting a frame keeps the caller busy, through GLPresenter's legacy and streaming paths, in a headless EGL
+//context. Meant for Mesa's software llvmpipe driver, so the two paths can be compared on a machine without a GPU. Each path gets
+//the same generated frames, every one different; at the end the picture is read back and checked against the frame that should
+//be showing (the one before last for the streaming path, which runs a frame behind).
+//
+//Linux only. Needs Mesa's EGL with EGL_MESA_platform_surfaceless; LIBGL_ALWAYS_SOFTWARE=1 picks llvmpipe even when there is a GPU.
+//
+//	g++ -O2 -std=c++17 -I../MAGSNES PresentBench.cpp ../MAGSNES/GLPresenter.cpp -lEGL -lOpenGL -o PresentBench
+//	LIBGL_ALWAYS_SOFTWARE=1 ./PresentBench [frames]
+//
+//Exits with 1 if a path can't be set up or shows the wrong picture.
+
+#include "../MAGSNES/GLPresenter.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace MAGSNES;
+
+__FILESCOPE__{
+	const int DEFAULT_FRAME_COUNT = 600;
+
+	//Presented before timing starts, so shader compilation and the driver's first-use allocations aren't counted
+	const int WARMUP_FRAMES = 30;
+
+	//The surface is the size of the emulator's window, so the draw costs what it does there
+	const int SURFACE_WIDTH = DEFAULT_WINDOW_WIDTH, SURFACE_HEIGHT = DEFAULT_WINDOW_HEIGHT;
+	const int FRAME_PIXEL_COUNT = NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT;
+
+	struct PathResult {
+		double averageMicroseconds, maxMicroseconds;
+		double framesPerSecond;
+		bool matches;
+	};
+
+	//Opaque gradients that scroll at different speeds, so no two frames are alike
+	void fill_frame(dword * const dst, const int frame) {
+		for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+			for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+				dst[(y * NES_SCREEN_WIDTH) + x] = 0xFF000000 | ((((x ^ y) + frame) & 0xFF) << 16) | (((y + (frame * 3)) & 0xFF) << 8) |
+					((x + frame) & 0xFF);
+			}
+		}
+	}
+
+	//Whether the surface shows frame, each texel scaled up to a SURFACE_WIDTH / NES_SCREEN_WIDTH square with row 0 at the top
+	const bool shows_frame(const int frame) {
+		std::vector<dword> expected(FRAME_PIXEL_COUNT), surface(SURFACE_WIDTH * SURFACE_HEIGHT);
+		fill_frame(expected.data(), frame);
+
+		glFinish();
+		glReadPixels(0, 0, SURFACE_WIDTH, SURFACE_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, surface.data());
+
+		const int scale = SURFACE_WIDTH / NES_SCREEN_WIDTH;
+		for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+			//glReadPixels starts at the bottom row; sample the middle of each square
+			const int surfaceRow = SURFACE_HEIGHT - 1 - ((y * scale) + (scale / 2));
+
+			for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+				if (surface[(surfaceRow * SURFACE_WIDTH) + (x * scale) + (scale / 2)] != expected[(y * NES_SCREEN_WIDTH) + x]) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	const bool has_extension(const char * const name) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+		for (GLint i = 0; i < count; i++) {
+			if (std::strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	const bool run_path(const bool streaming, const GLPresenter::Capabilities &caps, const int frameCount, EGLDisplay display,
+		EGLSurface surface, PathResult &result) {
+
+		GLPresenter presenter;
+		if (!presenter.init(NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT, streaming, caps)) {
+			std::fprintf(stderr, "%s\n", presenter.get_error());
+			presenter.release();
+			return false;
+		}
+
+		//The legacy path uploads from memory the caller owns; the streaming one is handed a mapped PBO
+		std::vector<dword> pixels(FRAME_PIXEL_COUNT);
+		double totalMicroseconds = 0.0, maxMicroseconds = 0.0;
+		std::chrono::steady_clock::time_point timedStart;
+
+		const int lastFrame = WARMUP_FRAMES + frameCount - 1;
+		for (int i = 0; i <= lastFrame; i++) {
+			if (i == WARMUP_FRAMES) {
+				timedStart = std::chrono::steady_clock::now();
+			}
+
+			//The same span GLManager::update_screen times: filling the frame and handing it to GL, up to the buffer swap
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			if (streaming) {
+				dword * const dst = presenter.begin_streaming_frame();
+				if (dst != nullptr) {
+					fill_frame(dst, i);
+				}
+				presenter.end_streaming_frame();
+			} else {
+				fill_frame(pixels.data(), i);
+				presenter.present_legacy(pixels.data());
+			}
+
+			const double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			if (i >= WARMUP_FRAMES) {
+				totalMicroseconds += elapsed;
+				maxMicroseconds = (elapsed > maxMicroseconds) ? elapsed : maxMicroseconds;
+			}
+
+			eglSwapBuffers(display, surface);
+		}
+
+		const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timedStart).count();
+
+		result.averageMicroseconds = totalMicroseconds / frameCount;
+		result.maxMicroseconds = maxMicroseconds;
+		result.framesPerSecond = frameCount / wallSeconds;
+		result.matches = shows_frame(streaming ? (lastFrame - 1) : lastFrame);
+
+		presenter.release();
+		return true;
+	}
+}
+
+int main(int argc, char **argv) {
+	const int frameCount = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+	if ((argc > 2) || (frameCount < 2)) {
+		std::fprintf(stderr, "Usage: PresentBench [frames, at least 2]\n");
+		return 1;
+	}
+
+	//The surfaceless platform needs no window system, so this runs in a container or over ssh
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = (getPlatformDisplay != nullptr) ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) :
+		eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if ((display == EGL_NO_DISPLAY) || !eglInitialize(display, &major, &minor)) {
+		std::fprintf(stderr, "Unable to initialize EGL (error 0x%04X)\n", eglGetError());
+		return 1;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, SURFACE_WIDTH, EGL_HEIGHT, SURFACE_HEIGHT, EGL_NONE };
+
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || (configCount == 0) || !eglBindAPI(EGL_OPENGL_API)) {
+		std::fprintf(stderr, "No RGBA8 desktop OpenGL pbuffer config\n");
+		eglTerminate(display);
+		return 1;
+	}
+
+	//A compatibility context, since the legacy path draws with immediate mode
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if ((surface == EGL_NO_SURFACE) || (context == EGL_NO_CONTEXT) || !eglMakeCurrent(display, surface, surface, context)) {
+		std::fprintf(stderr, "Unable to create a GL context (error 0x%04X)\n", eglGetError());
+		eglTerminate(display);
+		return 1;
+	}
+
+	GLint glMajor = 0, glMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &glMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &glMinor);
+
+	GLPresenter::Capabilities caps;
+	caps.hasGL30 = (glMajor >= 3);
+	caps.hasTextureStorage = caps.hasGL30 && (((glMajor * 10) + glMinor >= 42) || has_extension("GL_ARB_texture_storage"));
+
+	std::printf("%s, OpenGL %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+	std::printf("%d frames of %dx%d drawn to %dx%d, after %d warm-up frames\n", frameCount, NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT,
+		SURFACE_WIDTH, SURFACE_HEIGHT, WARMUP_FRAMES);
+
+	bool passed = true;
+
+	for (int path = 0; path < 2; path++) {
+		const bool streaming = (path == 1);
+		const char * const name = streaming ? "streaming" : "legacy";
+		PathResult result;
+
+		if (!run_path(streaming, caps, frameCount, display, surface, result)) {
+			std::printf("\t%s: unavailable, FAIL\n", name);
+			passed = false;
+			continue;
+		}
+
+		std::printf("\t%s: avg %.1f us, max %.1f us per present, %.1f frames/s, picture matches: %s, %s\n", name, result.averageMicroseconds,
+			result.maxMicroseconds, result.framesPerSecond, result.matches ? "yes" : "no", result.matches ? "PASS" : "FAIL");
+		passed = passed && result.matches;
+	}
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglDestroySurface(display, surface);
+	eglTerminate(display);
+
+	return passed ? 0 : 1;
+}
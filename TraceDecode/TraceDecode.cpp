@@ -0,0 +1,146 @@
+//Turns a CPU trace snapshot (MAGSNES_trace.bin, see CPUTrace) into nestest.log style text, one line per instruction:
+//
+//C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+//
+//The trace doesn't hold memory, so the " = XX" values nestest.log shows after some operands are left out; everything from A: on
+//lines up column for column.
+//
+//Usage: TraceDecode <trace file> [output file]; the text goes to stdout without an output file.
+
+#include "../MAGSNES/CPUTrace.h"
+
+#include <cstring>
+
+using namespace MAGSNES;
+
+__FILESCOPE__{
+	const dword RECORDS_PER_READ = 4096;
+
+	void format_operand(const CPUTrace::Record &rec, const byte format, char * const dst, const size_t size) {
+		const word operandWord = rec.operandLo | (rec.operandHi << 8);
+
+		switch (format) {
+		case CPUTrace::OPERAND_ACCUMULATOR:
+			sprintf_s(dst, size, "A");
+			break;
+		case CPUTrace::OPERAND_IMMEDIATE:
+			sprintf_s(dst, size, "#$%02X", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_ZERO_PAGE:
+			sprintf_s(dst, size, "$%02X", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_ZERO_PAGE_X:
+			sprintf_s(dst, size, "$%02X,X", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_ZERO_PAGE_Y:
+			sprintf_s(dst, size, "$%02X,Y", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_ABSOLUTE:
+			sprintf_s(dst, size, "$%04X", operandWord);
+			break;
+		case CPUTrace::OPERAND_ABSOLUTE_X:
+			sprintf_s(dst, size, "$%04X,X", operandWord);
+			break;
+		case CPUTrace::OPERAND_ABSOLUTE_Y:
+			sprintf_s(dst, size, "$%04X,Y", operandWord);
+			break;
+		case CPUTrace::OPERAND_RELATIVE:
+			//Branches are shown with their target
+			sprintf_s(dst, size, "$%04X", (word)(rec.pc + 2 + (signed char)rec.operandLo));
+			break;
+		case CPUTrace::OPERAND_INDIRECT_X:
+			sprintf_s(dst, size, "($%02X,X)", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_INDIRECT_Y:
+			sprintf_s(dst, size, "($%02X),Y", rec.operandLo);
+			break;
+		case CPUTrace::OPERAND_INDIRECT:
+			sprintf_s(dst, size, "($%04X)", operandWord);
+			break;
+		default: //OPERAND_NONE
+			dst[0] = '\0';
+			break;
+		}
+	}
+
+	void write_line(std::FILE * const out, const CPUTrace::Record &rec, const CPUTrace::OpcodeInfo &info) {
+		const byte operandBytes = CPUTrace::get_operand_bytes(info.format);
+
+		char bytes[16], operand[16], instruction[40];
+		if (operandBytes == 0) {
+			sprintf_s(bytes, "%02X", rec.opcode);
+		} else if (operandBytes == 1) {
+			sprintf_s(bytes, "%02X %02X", rec.opcode, rec.operandLo);
+		} else {
+			sprintf_s(bytes, "%02X %02X %02X", rec.opcode, rec.operandLo, rec.operandHi);
+		}
+
+		format_operand(rec, info.format, operand, sizeof(operand));
+		sprintf_s(instruction, "%s%s%s", info.mnemonic, (operand[0] != '\0') ? " " : "", operand);
+
+		//nestest.log marks unofficial opcodes with a * just before the mnemonic
+		std::fprintf(out, "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3u,%3u CYC:%llu\n",
+			rec.pc, bytes, info.isUnofficial ? '*' : ' ', instruction, rec.a, rec.x, rec.y, rec.p, rec.sp, rec.scanline, rec.dot, rec.cycle);
+	}
+}
+
+int main(int argc, char **argv) {
+	if ((argc < 2) || (argc > 3)) {
+		std::fprintf(stderr, "Usage: TraceDecode <trace file> [output file]\n");
+		return 1;
+	}
+
+	std::FILE *in;
+	if (fopen_s(&in, argv[1], "rb") != 0) {
+		std::fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return 1;
+	}
+
+	CPUTrace::FileHeader header;
+	if ((std::fread(&header, sizeof(CPUTrace::FileHeader), 1, in) != 1) ||
+		(std::memcmp(header.magic, CPUTrace::get_magic(), sizeof(header.magic)) != 0)) {
+
+		std::fprintf(stderr, "%s is not a CPU trace\n", argv[1]);
+		std::fclose(in);
+		return 1;
+	}
+
+	if ((header.version != CPUTrace::FILE_VERSION) || (header.recordSize != sizeof(CPUTrace::Record))) {
+		std::fprintf(stderr, "%s is from a different version of MAGSNES (trace version %u)\n", argv[1], header.version);
+		std::fclose(in);
+		return 1;
+	}
+
+	std::FILE *out = stdout;
+	if ((argc == 3) && (fopen_s(&out, argv[2], "w") != 0)) {
+		std::fprintf(stderr, "Unable to open %s\n", argv[2]);
+		std::fclose(in);
+		return 1;
+	}
+
+	CPUTrace::Record *records = new CPUTrace::Record[RECORDS_PER_READ];
+	dword remaining = header.recordCount;
+
+	while (remaining > 0) {
+		const dword wanted = (remaining < RECORDS_PER_READ) ? remaining : RECORDS_PER_READ;
+		const dword count = (dword)std::fread(records, sizeof(CPUTrace::Record), wanted, in);
+
+		for (dword i = 0; i < count; i++) {
+			write_line(out, records[i], header.opcodes[records[i].opcode]);
+		}
+
+		if (count < wanted) {
+			std::fprintf(stderr, "%s ends %u records early\n", argv[1], remaining - count);
+			break;
+		}
+		remaining -= count;
+	}
+
+	delete[] records;
+	std::fclose(in);
+	if (out != stdout) {
+		std::fclose(out);
+	}
+
+	return 0;
+}